@@ -6,9 +6,13 @@
 
 #include "ccore.h"
 #include <ChessCore/Database.h>
+#include <ChessCore/CfdbDatabase.h>
 #include <ChessCore/PgnDatabase.h>
+#include <ChessCore/PgnWriter.h>
 #include <ChessCore/OpeningTree.h>
+#include <ChessCore/PolyglotBook.h>
 #include <ChessCore/Epd.h>
+#include <ChessCore/Bitstream.h>
 #include <ChessCore/Log.h>
 #include <ChessCore/Rand64.h>
 #include <stdio.h>
@@ -28,6 +32,10 @@ static void posDump(const Position &pos, unsigned depth);
 static bool indexCallback(unsigned gameNum, float percentComplete, void *contextInfo);
 static bool treeCallback(unsigned gameNum, float percentComplete, void *contextInfo);
 static bool searchCallback(unsigned gameNum, float percentComplete, void *contextInfo);
+static bool scanPgn(PgnScannerContext::Lexer lexer, const string &input, bool useStream, unsigned iterations,
+                    uint64_t &numTokens, unsigned &elapsed);
+static bool bitLoopWrite(Blob &blob, unsigned &bitPos, uint32_t value, unsigned numBits);
+static bool bitLoopRead(const Blob &blob, unsigned &bitPos, uint32_t &value, unsigned numBits);
 
 static const char *m_classname = "";
 
@@ -511,6 +519,97 @@ bool funcCopyDb() {
     return retval;
 }
 
+//
+// Export a database to a PGN file, formatting the games on several threads
+//
+bool funcExportPgn() {
+    unsigned firstGame = 0, lastGame = 0, startTime, endTime;
+
+    PgnDatabase::setRelaxedParsing(true);
+
+    if (g_optInputDb.empty()) {
+        cerr << "No input database specified" << endl;
+        return false;
+    }
+
+    if (g_optOutputDb.empty()) {
+        cerr << "No output PGN file specified" << endl;
+        return false;
+    }
+
+    shared_ptr<Database> indb = Database::openDatabase(g_optInputDb, true);
+    if (!indb) {
+        cerr << "Don't know how to open database '" << g_optInputDb << "'" << endl;
+        return false;
+    } else if (!indb->isOpen()) {
+        cerr << "Failed to open database '" << g_optInputDb << "': " << indb->errorMsg() << endl;
+        return false;
+    }
+
+    if (indb->needsIndexing() &&
+        !indb->index(indexCallback, NULL)) {
+        cerr << "Failed to index database '" << g_optInputDb << "': " << indb->errorMsg() << endl;
+        return false;
+    }
+
+    if (indb->numGames() == 0) {
+        cerr << "Database '" << g_optInputDb << "' is empty" << endl;
+        return false;
+    }
+
+    if (g_optNumber1 <= 0)
+        firstGame = indb->firstGameNum();
+    else
+        firstGame = (unsigned)g_optNumber1;
+
+    if (g_optNumber2 <= 0)
+        lastGame = indb->lastGameNum();
+    else
+        lastGame = g_optNumber2;
+
+    if (firstGame > lastGame) {
+        cerr << "Invalid game numbers specified" << endl;
+        return false;
+    }
+
+    PgnWriter writer;
+    if (!writer.open(g_optOutputDb, false)) {
+        cerr << "Failed to create '" << g_optOutputDb << "': " << writer.errorMsg() << endl;
+        return false;
+    }
+
+    unsigned numThreads = g_optDepth > 0 ? (unsigned)g_optDepth : Util::numProcessors();
+
+    cout << "Exporting database '" << g_optInputDb << "' games " << firstGame << "-" << lastGame <<
+        " to '" << g_optOutputDb << "' using " << numThreads << " thread(s)" << endl;
+
+    startTime = Util::getTickCount();
+
+    bool retval = writer.writeDatabase(*indb, firstGame, lastGame, numThreads, indexCallback, NULL) &&
+                  writer.close();
+
+    endTime = Util::getTickCount();
+
+    if (g_quitFlag) {
+        cout << "Exporting aborted" << endl;
+    } else if (retval) {
+        unsigned elapsed = endTime - startTime;
+        unsigned gameCount = lastGame - firstGame + 1;
+        cout << "Successfully exported database. " << gameCount << " games in " << elapsed << "mS";
+
+        if (elapsed)
+            cout << " (" << (gameCount * 1000) / elapsed << " games/s)";
+
+        cout << endl;
+    } else {
+        cerr << "Failed to export database: " << writer.errorMsg() << endl;
+    }
+
+    indb->close();
+
+    return retval;
+}
+
 //
 // Build the opening tree in a database
 //
@@ -632,6 +731,134 @@ bool funcBuildOpeningTree() {
     return retval;
 }
 
+//
+// Upgrade a CFDB database to the current schema version
+//
+bool funcUpgradeDb() {
+    if (g_optInputDb.empty()) {
+        cerr << "No input database specified" << endl;
+        return false;
+    }
+
+    CfdbDatabase indb(g_optInputDb, false);
+
+    if (!indb.isOpen()) {
+        cerr << "Failed to open database '" << g_optInputDb << "': " << indb.errorMsg() << endl;
+        return false;
+    }
+
+    if (indb.schemaVersion() == CfdbDatabase::currentSchemaVersion()) {
+        cout << "Database '" << g_optInputDb << "' is already using schema version " << indb.schemaVersion() <<
+            endl;
+        return true;
+    }
+
+    cout << "Upgrading database '" << g_optInputDb << "' from schema version " << indb.schemaVersion() <<
+        " to " << CfdbDatabase::currentSchemaVersion() << endl;
+
+    unsigned startTime = Util::getTickCount();
+
+    if (!indb.upgradeSchema(treeCallback, NULL)) {
+        cerr << "Failed to upgrade database: " << indb.errorMsg() << endl;
+        return false;
+    }
+
+    cout << "Database successfully upgraded in " << Util::getTickCount() - startTime << "mS" << endl;
+
+    return true;
+}
+
+//
+// Build a Polyglot opening book
+//
+bool funcMakeBook() {
+    unsigned firstGame, lastGame, startTime, elapsed;
+    string errorMsg;
+
+    if (g_optInputDb.empty()) {
+        cerr << "No input database specified" << endl;
+        return false;
+    }
+
+    if (g_optOutputDb.empty()) {
+        cerr << "No output book specified" << endl;
+        return false;
+    }
+
+    if (!g_optRandomsFile.empty() &&
+        !PolyglotBook::loadRandoms(g_optRandomsFile, errorMsg)) {
+        cerr << errorMsg << endl;
+        return false;
+    }
+
+    shared_ptr<Database> indb = Database::openDatabase(g_optInputDb, true);
+    if (!indb) {
+        cerr << "Don't know how to open database '" << g_optInputDb << "'" << endl;
+        return false;
+    } else if (!indb->isOpen()) {
+        cerr << "Failed to open database '" << g_optInputDb << "': " << indb->errorMsg() << endl;
+        return false;
+    }
+
+    if (indb->needsIndexing() &&
+        !indb->index(indexCallback, NULL)) {
+        cerr << "Failed to index database '" << g_optInputDb << "': " << indb->errorMsg() << endl;
+        return false;
+    }
+
+    if (indb->numGames() == 0) {
+        cerr << "Database '" << g_optInputDb << "' is empty" << endl;
+        return false;
+    }
+
+    if (g_optDepth <= 0)
+        g_optDepth = 50;
+
+    if (g_optNumber1 <= 0)
+        firstGame = indb->firstGameNum();
+    else
+        firstGame = (unsigned)g_optNumber1;
+
+    if (g_optNumber2 <= 0)
+        lastGame = indb->lastGameNum();
+    else
+        lastGame = g_optNumber2;
+
+    if (firstGame > lastGame) {
+        cerr << "Invalid game numbers specified" << endl;
+        return false;
+    }
+
+    cout << "Building Polyglot book '" << g_optOutputDb << "' from database '" << g_optInputDb << "' games " <<
+        firstGame << "-" << lastGame << endl;
+
+    startTime = Util::getTickCount();
+
+    PolyglotBookBuilder builder;
+
+    if (!builder.addGames(*indb, firstGame, lastGame, g_optDepth, treeCallback, NULL)) {
+        cerr << "Failed to build Polyglot book: " << builder.errorMsg() << endl;
+        return false;
+    }
+
+    indb->close();
+
+    if (!builder.write(g_optOutputDb)) {
+        cerr << "Failed to write Polyglot book: " << builder.errorMsg() << endl;
+        return false;
+    }
+
+    elapsed = Util::getTickCount() - startTime;
+    cout << "Polyglot book successfully built. " << builder.numGames() << " games in " << elapsed << "mS";
+
+    if (elapsed)
+        cout << " (" << (builder.numGames() * 1000) / elapsed << " games/s)";
+
+    cout << endl;
+
+    return true;
+}
+
 //
 // Classify games by ECO code
 //
@@ -671,6 +898,9 @@ bool funcClassify() {
         return false;
     }
 
+    if (!optree.load())
+        cerr << "Failed to load ECO Classification file '" << g_optEcoFile << "' into memory" << endl;
+
     if (indb->needsIndexing() &&
         !indb->index(indexCallback, NULL)) {
         cerr << "Failed to index database '" << g_optInputDb << "': " << indb->errorMsg() << endl;
@@ -1217,6 +1447,217 @@ bool funcTestPopCnt() {
     return true;
 }
 
+//
+// Compare the throughput of the flex scanner and the hand-written tokenizer, scanning
+// both an in-memory buffer and a stream.  The tokenizer must produce the same tokens as
+// the flex scanner.
+//
+bool funcBenchPgnScanner() {
+    if (g_optInputDb.empty()) {
+        cerr << "No input PGN file specified" << endl;
+        return false;
+    }
+
+    ifstream file(g_optInputDb.c_str(), ios::in | ios::binary);
+    if (!file.is_open()) {
+        cerr << "Failed to open PGN file '" << g_optInputDb << "'" << endl;
+        return false;
+    }
+
+    stringstream contents;
+    contents << file.rdbuf();
+    string input = contents.str();
+    unsigned iterations = g_optNumber1 > 0 ? (unsigned)g_optNumber1 : 1;
+
+    cout << "Scanning " << dec << input.size() << " bytes " << iterations << " time(s)" << endl;
+
+    static const struct {
+        const char *name;
+        PgnScannerContext::Lexer lexer;
+    } lexers[] = {
+        { "flex", PgnScannerContext::LEXER_FLEX },
+        { "tokenizer", PgnScannerContext::LEXER_TOKENIZER }
+    };
+
+    PgnScannerContext::Lexer savedLexer = PgnScannerContext::defaultLexer();
+    bool retval = true;
+
+    for (unsigned mode = 0; mode < 2 && retval && !g_quitFlag; mode++) {
+        bool useStream = mode == 1;
+        uint64_t expectedTokens = 0;
+
+        for (unsigned i = 0; i < sizeof(lexers) / sizeof(lexers[0]) && !g_quitFlag; i++) {
+            uint64_t numTokens;
+            unsigned elapsed;
+
+            if (!scanPgn(lexers[i].lexer, input, useStream, iterations, numTokens, elapsed)) {
+                cerr << "The " << lexers[i].name << " scanner produced different tokens to the flex scanner" << endl;
+                retval = false;
+                break;
+            }
+
+            if (i == 0)
+                expectedTokens = numTokens;
+            else if (numTokens != expectedTokens) {
+                cerr << "The " << lexers[i].name << " scanner produced " << numTokens << " tokens; expected " <<
+                    expectedTokens << endl;
+                retval = false;
+                break;
+            }
+
+            double mbytes = double(input.size()) * iterations / (1024.0 * 1024.0);
+            cout << setw(9) << lexers[i].name << (useStream ? " (stream): " : " (buffer): ") <<
+                numTokens << " tokens in " << Util::formatElapsed(elapsed);
+            if (elapsed > 0)
+                cout << " (" << fixed << setprecision(1) << (mbytes * 1000.0) / elapsed << " MB/s)";
+            cout << endl;
+        }
+    }
+
+    PgnScannerContext::setDefaultLexer(savedLexer);
+
+    return retval;
+}
+
+//
+// Compare the throughput of Bitstream with the bit-at-a-time loops it replaced, using
+// fields of the sizes used by encoded moves.  Both must produce the same bytes.
+//
+bool funcBenchBitstream() {
+    static const unsigned numValues = 1 << 20;
+    unsigned iterations = g_optNumber1 > 0 ? (unsigned)g_optNumber1 : 10;
+    vector<uint32_t> values(numValues);
+    vector<unsigned> bitsizes(numValues);
+    unsigned i, iteration, elapsed, totalBits = 0;
+
+    Rand64::init();
+
+    for (i = 0; i < numValues; i++) {
+        // A move type and then a move or annotated move, with the odd larger field
+        if ((i & 1) == 0)
+            bitsizes[i] = 2;
+        else if ((Rand64::rand() & 15) == 0)
+            bitsizes[i] = (unsigned)(Rand64::rand() % 32) + 1;
+        else
+            bitsizes[i] = (Rand64::rand() & 3) == 0 ? 11 : 8;
+
+        values[i] = (uint32_t)Rand64::rand();
+        totalBits += bitsizes[i];
+    }
+
+    cout << "Writing and reading " << dec << numValues << " values (" << totalBits / 8 << " bytes) " <<
+        iterations << " time(s)" << endl;
+
+    double mbytes = double(totalBits / 8) * iterations / (1024.0 * 1024.0);
+    Blob loopBlob, streamBlob;
+    unsigned bitPos;
+    uint32_t value, checksum = 0, loopChecksum = 0;
+
+    // Bit-at-a-time
+    unsigned startTime = Util::getTickCount();
+
+    for (iteration = 0; iteration < iterations && !g_quitFlag; iteration++) {
+        loopBlob.free();
+        bitPos = 0;
+
+        for (i = 0; i < numValues; i++)
+            if (!bitLoopWrite(loopBlob, bitPos, values[i], bitsizes[i])) {
+                cerr << "Failed to write value " << i << " bit-at-a-time" << endl;
+                return false;
+            }
+    }
+
+    elapsed = Util::getTickCount() - startTime;
+    cout << "    bit loop (write): " << Util::formatElapsed(elapsed);
+    if (elapsed > 0)
+        cout << " (" << fixed << setprecision(1) << (mbytes * 1000.0) / elapsed << " MB/s)";
+    cout << endl;
+
+    startTime = Util::getTickCount();
+
+    for (iteration = 0; iteration < iterations && !g_quitFlag; iteration++) {
+        bitPos = 0;
+
+        for (i = 0; i < numValues; i++) {
+            if (!bitLoopRead(loopBlob, bitPos, value, bitsizes[i])) {
+                cerr << "Failed to read value " << i << " bit-at-a-time" << endl;
+                return false;
+            }
+
+            loopChecksum += value;
+        }
+    }
+
+    elapsed = Util::getTickCount() - startTime;
+    cout << "     bit loop (read): " << Util::formatElapsed(elapsed);
+    if (elapsed > 0)
+        cout << " (" << fixed << setprecision(1) << (mbytes * 1000.0) / elapsed << " MB/s)";
+    cout << endl;
+
+    // Word-at-a-time
+    startTime = Util::getTickCount();
+
+    for (iteration = 0; iteration < iterations && !g_quitFlag; iteration++) {
+        streamBlob.free();
+        Bitstream bitstream(streamBlob);
+
+        for (i = 0; i < numValues; i++)
+            if (!bitstream.write(values[i], bitsizes[i])) {
+                cerr << "Failed to write value " << i << " to the bitstream" << endl;
+                return false;
+            }
+
+        if (!bitstream.flush()) {
+            cerr << "Failed to flush the bitstream" << endl;
+            return false;
+        }
+    }
+
+    elapsed = Util::getTickCount() - startTime;
+    cout << "   bitstream (write): " << Util::formatElapsed(elapsed);
+    if (elapsed > 0)
+        cout << " (" << fixed << setprecision(1) << (mbytes * 1000.0) / elapsed << " MB/s)";
+    cout << endl;
+
+    startTime = Util::getTickCount();
+
+    for (iteration = 0; iteration < iterations && !g_quitFlag; iteration++) {
+        const Blob &constBlob = streamBlob;
+        Bitstream bitstream(constBlob);
+
+        for (i = 0; i < numValues; i++) {
+            if (!bitstream.read(value, bitsizes[i])) {
+                cerr << "Failed to read value " << i << " from the bitstream" << endl;
+                return false;
+            }
+
+            checksum += value;
+        }
+    }
+
+    elapsed = Util::getTickCount() - startTime;
+    cout << "    bitstream (read): " << Util::formatElapsed(elapsed);
+    if (elapsed > 0)
+        cout << " (" << fixed << setprecision(1) << (mbytes * 1000.0) / elapsed << " MB/s)";
+    cout << endl;
+
+    if (g_quitFlag)
+        return true;
+
+    if (streamBlob.length() != loopBlob.length() ||
+        memcmp(streamBlob.data(), loopBlob.data(), loopBlob.length()) != 0) {
+        cerr << "The bitstream wrote different bytes to the bit loop" << endl;
+        return false;
+    }
+
+    if (checksum != loopChecksum) {
+        cerr << "The bitstream read different values to the bit loop" << endl;
+        return false;
+    }
+
+    return true;
+}
+
 static uint64_t perft(const Position &pos, unsigned depth, bool printMoves) {
     if (depth == 0)
         return 1ULL;
@@ -1286,6 +1727,56 @@ static bool treeCallback(unsigned gameNum, float percentComplete, void *contextI
     return !g_quitFlag;
 }
 
+//
+// Scan the input using the specified lexer, returning the number of tokens seen and
+// the time taken.  When scanning with the tokenizer, each token is checked against
+// the flex scanner (outside of the timed loop).
+//
+static bool scanPgn(PgnScannerContext::Lexer lexer, const string &input, bool useStream, unsigned iterations,
+                    uint64_t &numTokens, unsigned &elapsed) {
+    PgnScannerContext::setDefaultLexer(lexer);
+
+    numTokens = 0;
+    unsigned startTime = Util::getTickCount();
+
+    for (unsigned i = 0; i < iterations && !g_quitFlag; i++) {
+        istringstream iss(input);
+        unique_ptr<PgnScannerContext> context;
+        if (useStream)
+            context.reset(new PgnScannerContext(iss));
+        else
+            context.reset(new PgnScannerContext(input));
+
+        while (context->lex() > 0)
+            numTokens++;
+    }
+
+    elapsed = Util::getTickCount() - startTime;
+
+    if (lexer == PgnScannerContext::LEXER_FLEX)
+        return true;
+
+    PgnScannerContext::setDefaultLexer(PgnScannerContext::LEXER_FLEX);
+    PgnScannerContext reference(input);
+    PgnScannerContext::setDefaultLexer(lexer);
+    PgnScannerContext context(input);
+    int token;
+
+    do {
+        int referenceToken = reference.lex();
+        token = context.lex();
+        if (token != referenceToken ||
+            (token > 0 &&
+             (strcmp(context.text(), reference.text()) != 0 || context.lineNumber() != reference.lineNumber()))) {
+            LOGERR << "Mismatch at line " << reference.lineNumber() << ": expected token " << referenceToken <<
+                " '" << reference.text() << "', got token " << token << " '" << context.text() << "'";
+            return false;
+        }
+    } while (token > 0);
+
+    return true;
+}
+
 static bool searchCallback(unsigned gameNum, float percentComplete, void *contextInfo) {
     Database *database = (Database *)contextInfo;
     GameHeader header;
@@ -1301,3 +1792,83 @@ static bool searchCallback(unsigned gameNum, float percentComplete, void *contex
 
     return !g_quitFlag;
 }
+
+//
+// The bit-at-a-time implementation of Bitstream::write(), used as the reference by
+// funcBenchBitstream().
+//
+static bool bitLoopWrite(Blob &blob, unsigned &bitPos, uint32_t value, unsigned numBits) {
+    unsigned newLength = (bitPos + numBits + 7) / 8;
+
+    if (newLength > blob.allocatedLength() && !blob.reserve(newLength))
+        return false;
+
+    if (newLength > blob.length())
+        blob.setLength(newLength);
+
+    unsigned offset = bitPos / 8, bit = 7 - (bitPos & 7);
+    uint8_t byte = blob.data()[offset];
+    bool needsFlush = false;
+
+    bitPos += numBits;
+
+    while (numBits > 0) {
+        byte |= ((value >> (numBits - 1)) & 1) << bit;
+        needsFlush = true;
+
+        if (bit == 0) {
+            blob.data()[offset++] = byte;
+            byte = 0;
+            bit = 7;
+            needsFlush = false;
+        } else {
+            bit--;
+        }
+
+        numBits--;
+    }
+
+    if (needsFlush)
+        blob.data()[offset] = byte;
+
+    return true;
+}
+
+//
+// The bit-at-a-time implementation of Bitstream::read().
+//
+static bool bitLoopRead(const Blob &blob, unsigned &bitPos, uint32_t &value, unsigned numBits) {
+    unsigned offset = bitPos / 8, bit = 7 - (bitPos & 7);
+
+    value = 0;
+
+    if (offset >= blob.length())
+        return false;
+
+    uint8_t byte = blob.data()[offset];
+
+    bitPos += numBits;
+
+    while (numBits > 0) {
+        value <<= 1;
+        value |= (byte >> bit) & 1;
+
+        if (bit == 0) {
+            bit = 7;
+            offset++;
+
+            if (numBits > 1) {
+                if (offset >= blob.length())
+                    return false;
+
+                byte = blob.data()[offset];
+            }
+        } else {
+            bit--;
+        }
+
+        numBits--;
+    }
+
+    return true;
+}
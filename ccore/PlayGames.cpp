@@ -94,6 +94,9 @@ bool playGames(const string &engineId1, const string &engineId2) {
             cerr << "Failed to open ECO classification file '" << g_optEcoFile << "'" << endl;
             return false;
         }
+
+        if (!openingTree->load())
+            cerr << "Failed to load ECO classification file '" << g_optEcoFile << "' into memory" << endl;
     }
 
     const shared_ptr<Config> config1 = Config::config(engineId1);
@@ -50,6 +50,7 @@ int g_optNumber2 = 0;
 bool g_optNumber2Ind = false;
 string g_optOutputDb;
 bool g_optQuiet = false;
+string g_optRandomsFile;
 bool g_optRelaxed = false;
 TimeControl g_optTimeControl;
 string g_optTimeStr;
@@ -73,6 +74,7 @@ static ProgOption g_options[] = {
     ProgOption('o', "outdb",        false,  &g_optOutputDb),
     ProgOption('r', "relaxed",      false,  &g_optRelaxed),
     ProgOption('q', "quiet",        false,  &g_optQuiet),
+    ProgOption(0,   "randoms",      false,  &g_optRandomsFile),
     ProgOption('t', "timecontrol",  false,  &g_optTimeStr),
     ProgOption('v', "version",      false,  &g_optVersion),
     ProgOption()
@@ -236,8 +238,14 @@ static bool run(const vector<string> &args) {
             return funcValidateDb();
         else if (args[0] == "copydb")
             return funcCopyDb();
+        else if (args[0] == "exportpgn")
+            return funcExportPgn();
         else if (args[0] == "buildoptree")
             return funcBuildOpeningTree();
+        else if (args[0] == "upgradedb")
+            return funcUpgradeDb();
+        else if (args[0] == "makebook")
+            return funcMakeBook();
         else if (args[0] == "classify")
             return funcClassify();
         else if (args[0] == "pgnindex")
@@ -252,6 +260,10 @@ static bool run(const vector<string> &args) {
             return funcFindBuggyPos();
         else if (args[0] == "testpopcnt")
             return funcTestPopCnt();
+        else if (args[0] == "benchpgnscan")
+            return funcBenchPgnScanner();
+        else if (args[0] == "benchbitstream")
+            return funcBenchBitstream();
     } else if (args.size() == 2) {
         if (args[0] == "analyze")
             return analyzeGames(args[1]);
@@ -289,6 +301,7 @@ static void usage(ostream &stream) {
     stream << "-N, --number2=NUM          Integer variable #2.\n";
     stream << "-o, --outdb=FILE           Output database\n";
     stream << "-q, --quiet=BOOL           If on, don't print program info during start-up.\n";
+    stream << "    --randoms=FILE         Polyglot random numbers, instead of the built-in ones.\n";
     stream << "-r, --relaxed=BOOL         If on, allow errors.\n";
     stream << "-t, --timecontrol=TIME     Time control, for example \"40/120;G/20\" or \"300+10:1800\".\n";
     stream << "-v, --version              Write program version in machine-readable format.\n";
@@ -302,7 +315,10 @@ static void usage(ostream &stream) {
     stream << "          makeepd: Generate EPD from a database. -e, -i.\n";
     stream << "          validatedb: Validate a database. -i, [-n=first game, -N=last game].\n";
     stream << "          copydb: Copy a database. -i, -o, [-n=first game, -N=last game].\n";
+    stream << "          exportpgn: Export a database to PGN. -i, -o, [-n=first game, -N=last game, -d=threads].\n";
     stream << "          buildoptree: Build Opening Tree. -i, [-n=first game, -N=last game, -d].\n";
+    stream << "          upgradedb: Upgrade a CFDB database to the current schema version. -i.\n";
+    stream << "          makebook: Build Polyglot book. -i, -o, [--randoms, -n=first game, -N=last game, -d].\n";
     stream << "          classify: Classify openings. -i, -E, [-n=first game, -N=last game].\n";
     stream << "          pgnindex: Get PGN index info. -i, [-n=first game, -N=last game].\n";
     stream << "          searchdb: Search database. -i.\n";
@@ -310,6 +326,8 @@ static void usage(ostream &stream) {
     stream << "          recursiveposdump: Recursive dump the positions FENs. -f, -d\n";
     stream << "          findbuggypos: Interactive mode used with tools/find_buggy_pos.py\n";
     stream << "          testpopcnt: Test popcnt performance. -n=iterations.\n";
+    stream << "          benchpgnscan: Compare PGN scanner performance. -i=PGN file, [-n=iterations].\n";
+    stream << "          benchbitstream: Compare bitstream performance. [-n=iterations].\n";
 }
 
 static void writeProgramInfo(ostream &stream) {
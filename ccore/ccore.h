@@ -33,6 +33,7 @@ extern int g_optNumber2;
 extern bool g_optNumber2Ind;
 extern std::string g_optOutputDb;
 extern bool g_optQuiet;
+extern std::string g_optRandomsFile;
 extern bool g_optRelaxed;
 extern ChessCore::TimeControl g_optTimeControl;
 extern std::string g_optTimeStr;
@@ -66,7 +67,10 @@ extern bool funcRandomPositions();
 extern bool funcMakeEpd();
 extern bool funcValidateDb();
 extern bool funcCopyDb();
+extern bool funcExportPgn();
 extern bool funcBuildOpeningTree();
+extern bool funcUpgradeDb();
+extern bool funcMakeBook();
 extern bool funcClassify();
 extern bool funcPgnIndex();
 extern bool funcSearchDb();
@@ -74,3 +78,5 @@ extern bool funcPerftdiv();
 extern bool funcRecursivePosDump();
 extern bool funcFindBuggyPos();
 extern bool funcTestPopCnt();
+extern bool funcBenchPgnScanner();
+extern bool funcBenchBitstream();
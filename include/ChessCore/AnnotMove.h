@@ -15,6 +15,7 @@ namespace ChessCore {
 const size_t STORED_NAGS = 4;
 
 class AnnotMove;
+class AnnotMovePool;
 class Position;
 
 typedef uint8_t Nag;
@@ -104,6 +105,12 @@ public:
     AnnotMove(const AnnotMove *other);
     virtual ~AnnotMove();
 
+    // Moves are allocated from an AnnotMovePool, or from the heap if no pool is given
+    static void *operator new(size_t size);
+    static void *operator new(size_t size, AnnotMovePool *pool);
+    static void operator delete(void *p);
+    static void operator delete(void *p, AnnotMovePool *pool);
+
     /**
      * Delete the specified move and any following or variation moves.
      *
@@ -115,10 +122,11 @@ public:
      * Make a 'deep' copy of a tree of AnnotMove objects.
      *
      * @param amove The first move in the move tree to copy.
+     * @param pool The pool to allocate the copied moves from, or 0 for the heap.
      *
      * @return A copy of the move tree.
      */
-    static AnnotMove *deepCopy(const AnnotMove *amove);
+    static AnnotMove *deepCopy(const AnnotMove *amove, AnnotMovePool *pool = 0);
 
     /**
      * Remove and delete any variations from the move list
@@ -476,11 +484,13 @@ public:
      * occurred before.
      *
      * @param amove The move with the position to count.
+     * @param maxPlies The number of plies to look back, which is the halfmove clock
+     * of the position as earlier positions cannot recur.
      *
      * @return The number of times the position appears in the move tree
      * (always at least once as the 'amove' position is always counted).
      */
-    static unsigned countRepeatedPositions(const AnnotMove *amove);
+    static unsigned countRepeatedPositions(const AnnotMove *amove, unsigned maxPlies);
 
     /**
      * Dump the line recursively to a file in 'dot' file.
@@ -0,0 +1,85 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// AnnotMovePool.h: AnnotMovePool class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <vector>
+
+namespace ChessCore {
+
+/**
+ * An AnnotMovePool allocates AnnotMove nodes from blocks of memory that are kept for
+ * the life of the pool, so the nodes of a game that is cleared and read again reuse
+ * the same memory.  Each Game owns a pool for the moves it makes.
+ *
+ * Every AnnotMove, whether allocated from a pool or from the heap, is preceded by a
+ * pointer to its pool so that deleting it returns it to the right place.  Moves can
+ * outlive the Game that made them (for example moves unlinked for undo); the pool is
+ * only destroyed once its owner has released it and all of its moves are deleted.
+ */
+class CHESSCORE_EXPORT AnnotMovePool {
+private:
+    static const char *m_classname;
+
+public:
+    enum {
+        NODES_PER_BLOCK = 128
+    };
+
+protected:
+    std::vector<void *> m_blocks;   // Blocks of NODES_PER_BLOCK nodes
+    void *m_freeList;               // Free nodes, linked through their first word
+    unsigned m_numAllocated;        // Nodes in use
+    bool m_released;                // The owner no longer uses the pool
+
+    ~AnnotMovePool();
+
+public:
+    AnnotMovePool();
+
+    /**
+     * Allocate memory for an AnnotMove.
+     *
+     * @param pool The pool to allocate from.  If this is 0, or the size is larger
+     * than a pool node, then the memory is allocated from the heap.
+     * @param size The size of the object.
+     *
+     * @return The memory.  std::bad_alloc is thrown if it cannot be allocated.
+     */
+    static void *allocate(AnnotMovePool *pool, size_t size);
+
+    /**
+     * Free memory returned by allocate().
+     *
+     * @param p The memory to free.  Can be 0.
+     */
+    static void deallocate(void *p);
+
+    /**
+     * Give up ownership of the pool.  The pool deletes itself once the moves
+     * allocated from it have been deleted.
+     */
+    void release();
+
+    unsigned numAllocated() const {
+        return m_numAllocated;
+    }
+
+    unsigned capacity() const {
+        return (unsigned)m_blocks.size() * NODES_PER_BLOCK;
+    }
+
+protected:
+    void *allocateNode();
+    void freeNode(void *node);
+
+private:
+    // Owned by Game and never copied
+    AnnotMovePool(const AnnotMovePool &other);
+    AnnotMovePool &operator=(const AnnotMovePool &other);
+};
+} // namespace ChessCore
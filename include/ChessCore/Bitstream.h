@@ -17,10 +17,12 @@ private:
 protected:
     Blob &m_blob;
     bool m_readOnly;                // If initialised with const Blob &
-    unsigned m_readOffset;          // Read offset (byte count)
-    unsigned m_readBit;             // Read bit within offset
-    unsigned m_writeOffset;         // Write offset (byte count)
-    unsigned m_writeBit;            // Write bit within offset
+    unsigned m_readPos;             // Read position (bit count)
+    uint64_t m_readBuffer;          // Bits following the read position, left-aligned
+    unsigned m_readBufferBits;      // Number of bits in m_readBuffer
+    unsigned m_writePos;            // Write position (bit count)
+    uint64_t m_writeBuffer;         // Bits not yet stored in the blob, right-aligned
+    unsigned m_writeBufferBits;     // Number of bits in m_writeBuffer
 
 public:
     Bitstream(Blob &blob);
@@ -28,7 +30,8 @@ public:
     virtual ~Bitstream();
 
     unsigned length() const {
-        return m_blob.length();
+        unsigned writeLength = (m_writePos + 7) >> 3;
+        return writeLength > m_blob.length() ? writeLength : m_blob.length();
     }
 
     unsigned allocatedLength() const {
@@ -44,31 +47,31 @@ public:
     }
 
     unsigned readOffset() const {
-        return m_readOffset;
+        return m_readPos >> 3;
     }
 
     unsigned readBit() const {
-        return m_readBit;
+        return 7 - (m_readPos & 7);
     }
 
     unsigned writeOffset() const {
-        return m_writeOffset;
+        return m_writePos >> 3;
     }
 
     unsigned writeBit() const {
-        return m_writeBit;
+        return 7 - (m_writePos & 7);
     }
 
-    void reset() {
-        m_readOffset = 0;
-        m_readBit = 7;
-        m_writeOffset = 0;
-        m_writeBit = 7;
-    }
+    /**
+     * Flush any buffered bits and move the read and write offsets back to the start
+     * of the blob.
+     */
+    void reset();
 
     /**
      * Read the specified number of bits from the current read bit offset in the blob
-     * and into to the unsigned integer.
+     * and into to the unsigned integer.  The blob is read 64-bits at a time into a
+     * buffer, from which the bits are taken.
      *
      * @param value The value to read.
      * @param numBits The number of bits to read.
@@ -79,7 +82,9 @@ public:
 
     /**
      * Write the specified number of bits from an unsigned integer, into the blob
-     * at the current write offset, allocating additional space as required.
+     * at the current write offset, allocating additional space as required.  The bits
+     * are buffered and stored in the blob 32-bits at a time, so flush() must be called
+     * before the blob is used directly.
      *
      * @param value The value to write.
      * @param numBits The number of bits to write.
@@ -87,5 +92,21 @@ public:
      * @return Boolean success code.
      */
     bool write(uint32_t value, unsigned numBits);
+
+    /**
+     * Store the buffered bits in the blob and set its length.  This is also done by
+     * the destructor, however errors can only be reported by calling this method.
+     *
+     * @return true if the bits were stored successfully, else false.
+     */
+    bool flush();
+
+protected:
+    bool refill(unsigned numBits);
+    bool store(unsigned offset, uint32_t word, unsigned numBytes);
+
+private:
+    Bitstream(const Bitstream &other);
+    Bitstream &operator=(const Bitstream &other);
 };
 } // namespace ChessCore
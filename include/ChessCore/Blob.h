@@ -10,15 +10,27 @@
 
 namespace ChessCore {
 
+/**
+ * A Blob holds binary data, either in memory it owns or in external memory it tracks.
+ * Blobs of up to INLINE_LENGTH bytes are held within the object itself, avoiding a
+ * heap allocation for most positions, time controls and short games, and the memory
+ * of larger blobs grows geometrically as data is added.
+ */
 class CHESSCORE_EXPORT Blob {
 private:
     static const char *m_classname;
 
+public:
+    enum {
+        INLINE_LENGTH = 128
+    };
+
 protected:
     uint8_t *m_data;
     unsigned m_length;
     unsigned m_allocatedLength;
     bool m_ownsMemory;
+    uint8_t m_inline[INLINE_LENGTH];    // Used instead of heap memory for small blobs
 
 public:
     Blob();
@@ -26,6 +38,10 @@ public:
     // Same as calling set(data, length, false); the blob won't own the memory
     Blob(uint8_t *data, unsigned length);
 
+    // The other blob is left empty
+    Blob(Blob &&other);
+    Blob &operator=(Blob &&other);
+
     ~Blob();
 
     uint8_t *data() {
@@ -57,6 +73,10 @@ public:
         return m_ownsMemory;
     }
 
+    bool isInline() const {
+        return m_data == m_inline;
+    }
+
     bool isEmpty() const {
         return m_data == 0 || m_length == 0;
     }
@@ -64,7 +84,9 @@ public:
     /**
      * Reserve the specified number of bytes to avoid unncessary realloc's when
      * adding data to the blob.  If the blob doesn't currently own the memory,
-     * then the request will be rejected.
+     * then the request will be rejected.  Nothing is done if enough memory is already
+     * allocated, and otherwise the memory at least doubles in size.  Newly allocated
+     * bytes are zeroed.
      *
      * Note that this method does not set the length of the blob, so if you are doing:
      *
@@ -109,6 +131,12 @@ public:
      */
     void free();
 
+    /**
+     * Empty the blob, keeping the memory it owns so it can be reused without being
+     * allocated again; for example when encoding one game after another.
+     */
+    void clear();
+
     /**
      * Format the binary data as a string.
      */
@@ -120,6 +148,13 @@ public:
     std::string dump() const;
 
     friend CHESSCORE_EXPORT std::ostream &operator<<(std::ostream &os, const Blob &blob);
+
+protected:
+    bool grow(unsigned length);
+
+private:
+    Blob(const Blob &other);
+    Blob &operator=(const Blob &other);
 };
 
 } // namespace ChessCore
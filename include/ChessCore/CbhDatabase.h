@@ -110,6 +110,7 @@ public:
     bool close();
     bool readHeader(unsigned gameNum, GameHeader &gameHeader);
     bool read(unsigned gameNum, Game &game);
+    using Database::read;
     bool write(unsigned gameNum, const Game &game);
 
     unsigned numGames();
@@ -122,6 +123,7 @@ public:
     }
 
 protected:
+    std::shared_ptr<Database> openReader();
     bool cbhReadHeader(CbhHeader &cbhHeader);
     bool cbhReadRecord(unsigned gameNum, CbhRecord &cbhRecord);
     bool cbpReadHeader(CbTreeHeader &cbpHeader);
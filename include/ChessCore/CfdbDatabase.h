@@ -11,6 +11,9 @@
 #include <ChessCore/Player.h>
 #include <ChessCore/Blob.h>
 #include <ChessCore/Bitstream.h>
+#include <ChessCore/OpeningTreeFile.h>
+#include <ChessCore/OpeningTreeCache.h>
+#include <ChessCore/SearchIndex.h>
 
 #include <sstream>
 #include <sqlite3.h>
@@ -22,13 +25,26 @@ private:
 
 protected:
     enum {
-        CURRENT_SCHEMA_VERSION = 1
+        CURRENT_SCHEMA_VERSION = 3,
+        OPTREE_DELTA_SCHEMA_VERSION = 3,    // First version with optree.prev_pos and optree_delta
+        BUSY_TIMEOUT = 10000                // How long to wait for another connection to unlock (mS)
     };
 
     static unsigned m_sqliteVersion;
+    static unsigned m_openingTreePrewarmPlies;
 
     std::string m_filename;
     sqlite3 *m_db;
+    unsigned m_schemaVersion;               // Schema version of the open database
+    OpeningTreeFile m_openingTreeFile;      // Copy of the optree table when last built
+    unsigned m_openingTreeDepth;            // Depth maintained by write(), or 0
+    std::shared_ptr<OpeningTreeCache> m_openingTreeCache;   // 0 if not caching
+    SearchIndex m_searchIndex;              // Header cache used by search(), if up-to-date
+    bool m_useSearchIndex;
+    bool m_nameIndexes;                     // Full-text indexes of the names exist and are usable
+    Blob m_moves;                           // Reused by write() from game to game
+    Blob m_annotations;
+    bool m_isReader;                        // Opened by openReader() to read games only
 
 public:
     static unsigned currentSchemaVersion() {
@@ -39,6 +55,14 @@ public:
         return m_sqliteVersion;
     }
 
+    /**
+     * Set the number of half-moves of the opening tree that open() loads into the
+     * opening tree cache, if one has been set.  The default is 0, which loads nothing.
+     */
+    static void setOpeningTreePrewarmPlies(unsigned plies) {
+        m_openingTreePrewarmPlies = plies;
+    }
+
     CfdbDatabase();
     CfdbDatabase(const std::string &filename, bool readOnly);
     virtual ~CfdbDatabase();
@@ -67,12 +91,145 @@ public:
     bool close();
     bool readHeader(unsigned gameNum, GameHeader &gameHeader);
     bool read(unsigned gameNum, Game &game);
+    bool read(unsigned gameNum, Game &game, const DatabaseReadOptions &options);
+    bool read(unsigned gameNum, CompactGame &game, const DatabaseReadOptions &options);
     bool write(unsigned gameNum, const Game &game);
 
     bool buildOpeningTree(unsigned gameNum, unsigned depth, DATABASE_CALLBACK_FUNC callback, void *contextInfo);
     bool searchOpeningTree(uint64_t hashKey, bool lastMoveOnly, std::vector<OpeningTreeEntry> &entries);
     bool countInOpeningTree(uint64_t hashKey, unsigned &count);
+    bool searchOpeningTreeStats(uint64_t hashKey, unsigned maxSampleGames, std::vector<OpeningTreeStats> &stats);
+    bool searchOpeningTreeChildren(uint64_t hashKey, std::vector<OpeningTreeEdge> &edges);
+    bool searchOpeningTreeParents(uint64_t hashKey, std::vector<OpeningTreeEdge> &edges);
     bool countLongestLine(unsigned &count);
+    bool readOpeningTree(std::vector<OpeningTreeEntry> &entries);
+
+    /**
+     * Get the number of half-moves of each game that write() keeps in the opening tree.
+     *
+     * @return The depth, or 0 if write() does not update the opening tree.
+     */
+    unsigned openingTreeDepth() const {
+        return m_openingTreeDepth;
+    }
+
+    /**
+     * Make write() keep the opening tree of each game it writes up-to-date, changing only
+     * the entries that differ from the game's existing entries.  The setting is stored in
+     * the database, and building the whole opening tree updates the depth.
+     *
+     * @param depth The number of half-moves to include in the opening tree, or 0 to stop
+     * updating the opening tree.
+     *
+     * @return true if the setting was changed successfully, else false.
+     */
+    bool setOpeningTreeDepth(unsigned depth);
+
+    /**
+     * Get the cache used by searchOpeningTree() and countInOpeningTree().
+     *
+     * @return The cache, or 0 if the results are not cached.
+     */
+    std::shared_ptr<OpeningTreeCache> openingTreeCache() const {
+        return m_openingTreeCache;
+    }
+
+    /**
+     * Set the cache used by searchOpeningTree() and countInOpeningTree().  Connections
+     * to the same database can share a cache.  There is no cache by default, as a cache
+     * is only cleared by the changes made through the connections using it; games
+     * written by any other connection leave it out-of-date.
+     *
+     * @param cache The cache, or 0 to stop caching.
+     */
+    void setOpeningTreeCache(std::shared_ptr<OpeningTreeCache> cache) {
+        m_openingTreeCache = cache;
+    }
+
+    /**
+     * Load the positions of the first half-moves of the opening tree into the opening
+     * tree cache, stopping early if the cache fills.
+     *
+     * @param plies The number of half-moves to load.
+     *
+     * @return true if the positions were loaded successfully, else false.
+     */
+    bool prewarmOpeningTreeCache(unsigned plies);
+
+    /**
+     * @return true if search() uses the search index.
+     */
+    bool useSearchIndex() const {
+        return m_useSearchIndex;
+    }
+
+    /**
+     * Set whether search() uses the search index, a column store of the game header
+     * fields held in a side file next to the database.  The search index is rebuilt by
+     * search() when the database has been written since it was built.  The default is
+     * true; when false, or if the search index cannot be built, search() queries the
+     * database tables.
+     */
+    void setUseSearchIndex(bool useSearchIndex) {
+        m_useSearchIndex = useSearchIndex;
+    }
+
+    /**
+     * Build the search index.  search() will build the search index itself if it is
+     * missing or out-of-date, however this method allows it to be done up-front.
+     *
+     * @return true if the search index was built successfully, else false.
+     */
+    bool buildSearchIndex();
+
+    /**
+     * @return true if the database has name indexes that search() can use.
+     */
+    bool hasNameIndexes() const {
+        return m_nameIndexes;
+    }
+
+    /**
+     * Build full-text indexes of the player, event, site and annotator names.  search()
+     * uses the indexes, rather than the search index, to find the names that start with
+     * or contain a value, ignoring case, without comparing every name.  The indexes are
+     * optional and are kept up-to-date by write() once built, however they require a
+     * version of sqlite with the FTS5 trigram tokenizer.  Indexes left out-of-date by
+     * games written without one are built again when the database is next opened for
+     * writing, and ignored until then.
+     *
+     * @return true if the name indexes were built successfully, else false.
+     */
+    bool buildNameIndexes();
+
+    /**
+     * Remove the name indexes from the database.
+     *
+     * @return true if the name indexes were removed successfully, else false.
+     */
+    bool dropNameIndexes();
+
+    /**
+     * @return The schema version of the open database, or 0 if the database is not open.
+     */
+    unsigned schemaVersion() const {
+        return m_schemaVersion;
+    }
+
+    /**
+     * Upgrade the database to the current schema version.  Databases using an older
+     * schema version can be read and written, however games are stored in the format of
+     * that version; version 1 encodes each move as its index in the generated moves of
+     * the position, which is slower to read and write.  Before version 3 the opening
+     * tree file is deleted, rather than kept up-to-date, when games are written.
+     *
+     * @param callback An optional callback function, used to provide feedback.
+     * @param contextInfo Context Info to pass to the callback function.
+     *
+     * @return true if the database was upgraded successfully or is already using the
+     * current schema version, else false.
+     */
+    bool upgradeSchema(DATABASE_CALLBACK_FUNC callback, void *contextInfo);
 
     bool search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
                 DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset = 0, int limit = 0);
@@ -89,7 +246,36 @@ public:
 protected:
     bool createSchema();
     bool checkSchema();
-    bool decodeMoves(Game &game, const Blob &moves, const Blob &annotations);
+    std::string openingTreeFilename() const;
+    bool openOpeningTreeFile();
+    unsigned openingTreeGeneration();
+    bool openingTreeGraphAvailable();
+    bool selectOpeningTree(uint64_t hashKey, bool lastMoveOnly, std::vector<OpeningTreeEntry> &entries);
+    bool selectOpeningTreeCount(uint64_t hashKey, unsigned &count);
+    bool selectOpeningTreeDelta(const char *column, uint64_t hashKey, std::vector<OpeningTreeEntry> &added,
+                                std::vector<OpeningTreeEntry> &removed);
+    void invalidateOpeningTreeCache();
+    bool buildWholeOpeningTree(unsigned depth, DATABASE_CALLBACK_FUNC callback, void *contextInfo);
+    bool updateGameOpeningTree(unsigned gameNum, const Game *game, unsigned depth);
+    bool createOpeningTreeDelta();
+    bool recordOpeningTreeDelta(const OpeningTreeEntry &entry, bool added);
+    std::string searchIndexFilename() const;
+    bool openSearchIndex();
+    unsigned headerGeneration();
+    bool incrementHeaderGeneration();
+    bool searchTables(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                      DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset, int limit);
+    bool checkNameIndexes();
+    bool updateNameIndex(const std::string &table, unsigned id, const std::string &name);
+    bool updateNameIndexGeneration();
+    bool nameIndexSearch(const DatabaseSearchCriteria &searchCriteria) const;
+    bool selectMetadata(const std::string &name, std::string &value);
+    bool updateMetadata(const std::string &name, const std::string &value);
+    std::shared_ptr<Database> openReader();
+    bool selectMoves(unsigned gameNum, Blob &partial, Blob &moves, Blob *annotations);
+    bool decodeMoves(Game &game, const Blob &moves, const Blob &annotations, const DatabaseReadOptions &options);
+    bool decodeMoves(CompactGame &game, const Blob &moves, const DatabaseReadOptions &options);
+    bool skipVariation(Bitstream &moveBitstream, const uint8_t *&pannot, const Position &prior, const Position &pos);
     bool encodeMoves(const Game &game, Blob &moves, Blob &annotations);
     bool encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream, Blob &annotations, bool isVariation);
     unsigned selectPlayer(const Player &player);
@@ -110,7 +296,11 @@ protected:
     bool updateAnnotator(unsigned id, const std::string &name);
     const char *getAnnot(const char *pannot, const char *annotations, unsigned annotationsLen);
     void setDbErrorMsg(const char *fmt, ...);
-    static std::string comparisonString(DatabaseComparison comparison);
+    static std::string comparisonCondition(const std::string &column, DatabaseComparison comparison);
     static std::string orderString(DatabaseOrder order);
+    static bool nameIndexesSupported();
+    static bool nameIndexComparison(DatabaseComparison comparison, const std::string &value);
+    static std::string nameIndexCondition(const std::string &column, const std::string &table,
+                                          DatabaseComparison comparison);
 };
 } // namespace ChessCore
@@ -0,0 +1,171 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// CompactGame.h: CompactGame class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/GameHeader.h>
+#include <ChessCore/Position.h>
+#include <vector>
+
+namespace ChessCore {
+class Game;
+class AnnotMove;
+
+/**
+ * A CompactGame holds the moves of a game in flat arrays rather than a tree of
+ * AnnotMove objects, for processing large numbers of games where only the moves and
+ * positions matter.  Annotations are not held and the game-over flags (FL_MATE and
+ * FL_DRAW) are not set in the moves.
+ *
+ * moves() holds the mainline moves, in order, followed by the moves of the
+ * variations in the order they appear in the game, and posHashes() holds the hash
+ * key of the position after each move.  Each variation move has an entry in
+ * variationParents(): the index of the move it follows, or NO_PARENT if it is made
+ * from the starting position.  The first move of a line after a move is the
+ * continuation of that move's line and any later ones are variations of it.
+ */
+class CHESSCORE_EXPORT CompactGame : public GameHeader {
+private:
+    static const char *m_classname;
+
+public:
+    static const uint32_t NO_PARENT = 0xffffffff;
+
+    // Set in the index returned by addVariationMove() until endMoves() is called
+    static const uint32_t VARIATION_INDEX = 0x80000000;
+
+protected:
+    Position m_startPosition;               // Game starting position
+    unsigned m_mainlineLength;              // Number of mainline moves at the start of m_moves
+    std::vector<Move> m_moves;              // Mainline moves followed by variation moves
+    std::vector<uint64_t> m_posHashes;      // Hash key of the position after each move
+    std::vector<uint32_t> m_variationParents; // Index of the move before each variation move
+    std::vector<Move> m_variationMoves;     // Variation moves while the game is being built
+    std::vector<uint64_t> m_variationHashes;
+
+public:
+    CompactGame();
+    CompactGame(const Game &game);
+    virtual ~CompactGame();
+
+    /**
+     * Clear the game.  The memory used by the moves is kept for the next game.
+     */
+    void init();
+
+    const Position &startPosition() const {
+        return m_startPosition;
+    }
+
+    void setStartPosition(const Position &startPosition) {
+        m_startPosition.set(startPosition);
+    }
+
+    unsigned mainlineLength() const {
+        return m_mainlineLength;
+    }
+
+    unsigned numMoves() const {
+        return (unsigned)m_moves.size();
+    }
+
+    const std::vector<Move> &moves() const {
+        return m_moves;
+    }
+
+    const std::vector<uint64_t> &posHashes() const {
+        return m_posHashes;
+    }
+
+    /**
+     * Get the index of the move that the specified move follows.
+     *
+     * @param index The index of the move.
+     *
+     * @return The index of the previous move, or NO_PARENT if the move is made from
+     * the starting position.
+     */
+    uint32_t parent(unsigned index) const {
+        if (index < m_mainlineLength)
+            return index > 0 ? index - 1 : NO_PARENT;
+
+        return m_variationParents[index - m_mainlineLength];
+    }
+
+    const std::vector<uint32_t> &variationParents() const {
+        return m_variationParents;
+    }
+
+    /**
+     * Add a mainline move.
+     *
+     * @param move The move, as set by Position::lastMove() after it was made.
+     * @param posHash The hash key of the position after the move.
+     *
+     * @return The index of the move.
+     */
+    uint32_t addMainlineMove(Move move, uint64_t posHash);
+
+    /**
+     * Add a variation move.  endMoves() must be called once all moves have been added.
+     *
+     * @param move The move, as set by Position::lastMove() after it was made.
+     * @param posHash The hash key of the position after the move.
+     * @param parent The index returned when the previous move was added, or NO_PARENT
+     * if the move is made from the starting position.
+     *
+     * @return The index of the move, which has VARIATION_INDEX set.
+     */
+    uint32_t addVariationMove(Move move, uint64_t posHash, uint32_t parent);
+
+    /**
+     * Move the variation moves after the mainline moves and set the indexes of their
+     * parents.
+     */
+    void endMoves();
+
+    /**
+     * Set from a Game.
+     *
+     * @param game The game to copy.
+     */
+    void set(const Game &game);
+
+    /**
+     * Make the moves in a Game.
+     *
+     * @param game The game to set.
+     *
+     * @return true if the moves were made successfully, else false.
+     */
+    bool toGame(Game &game) const;
+
+protected:
+    void addLine(const AnnotMove *amove, uint32_t parent, bool isMainline);
+    bool makeLine(Game &game, uint32_t index, const std::vector<uint32_t> &firstChild,
+                  const std::vector<uint32_t> &nextSibling) const;
+};
+
+//
+// The state of a line of a CompactGame while its moves are being read
+//
+
+struct CompactGameLine {
+    Position pos;           // Position the next move is made from
+    UnmakeMoveInfo umi;     // Unmakes the last move, giving the position a variation starts from
+    uint32_t parent;        // Index of the last move, which the next move follows
+    uint32_t prevParent;    // Index of the move the last move follows
+    bool hasMove;           // A move has been made in this line
+
+    CompactGameLine() :
+        parent(CompactGame::NO_PARENT),
+        prevParent(CompactGame::NO_PARENT),
+        hasMove(false)
+    {
+    }
+};
+} // namespace ChessCore
@@ -8,6 +8,7 @@
 
 #include <ChessCore/ChessCore.h>
 #include <ChessCore/Game.h>
+#include <ChessCore/CompactGame.h>
 #include <ChessCore/Mutex.h>
 #include <memory>
 #include <vector>
@@ -18,6 +19,8 @@ namespace ChessCore {
 
 class Database;
 class OpeningTreeEntry;
+class OpeningTreeStats;
+class OpeningTreeEdge;
 class DatabaseErrorString;
 
 extern "C"
@@ -103,6 +106,23 @@ struct DatabaseSearchDescriptor {
 
 typedef std::vector<DatabaseSearchDescriptor> DatabaseSearchCriteria;
 
+//
+// Which parts of a game to read
+//
+
+struct DatabaseReadOptions {
+    bool mainlineOnly;          // Don't read variations
+    bool skipAnnotations;       // Don't read comments and NAGs
+    unsigned maxPlies;          // Don't read moves more than this many plies into the game (0 = no limit)
+
+    DatabaseReadOptions() :
+        mainlineOnly(false),
+        skipAnnotations(false),
+        maxPlies(0)
+    {
+    }
+};
+
 extern "C"{
 /**
  * Database subclass factory method.  This should be registered with
@@ -136,6 +156,10 @@ protected:
     Access m_access;
     Mutex m_mutex;
     std::string m_errorMsg;
+    Mutex m_readersMutex;           // Protects the readers used by readShared() and the state
+                                    // openReader() uses; never held while taking m_mutex
+    std::vector<std::shared_ptr<Database> > m_readers;  // Readers not in use
+    unsigned m_readersGeneration;   // Incremented when the readers are discarded
 
 public:
     /**
@@ -228,6 +252,20 @@ public:
      */
     virtual bool readHeader(unsigned gameNum, GameHeader &gameHeader) = 0;
 
+    /**
+     * Read a range of game headers from the database.  The default implementation
+     * calls readHeader() for each game in turn; subclasses that can read
+     * consecutive headers more efficiently should override it.
+     *
+     * @param firstGameNum The first game header number to read, starting at 1.
+     * @param lastGameNum The last game header number to read (inclusive).
+     * @param gameHeaders Where to store the game headers.  Upon success this
+     * will contain (lastGameNum - firstGameNum + 1) entries.
+     *
+     * @return true if all game headers were read successfully, else false.
+     */
+    virtual bool readHeaders(unsigned firstGameNum, unsigned lastGameNum, std::vector<GameHeader> &gameHeaders);
+
     /**
      * Read the specified game from the database.
      *
@@ -238,6 +276,49 @@ public:
      */
     virtual bool read(unsigned gameNum, Game &game) = 0;
 
+    /**
+     * Read part of the specified game from the database.  This default implementation
+     * reads the whole game and then removes the parts that are not wanted; subclasses
+     * that can skip those parts while decoding the game should override it.
+     *
+     * @param gameNum The game number to read, starting at 1.
+     * @param game The Game instance in which to read the game.
+     * @param options Which parts of the game to read.
+     *
+     * @return true if the game was read successfully, else false.
+     */
+    virtual bool read(unsigned gameNum, Game &game, const DatabaseReadOptions &options);
+
+    /**
+     * Read the moves of the specified game into a CompactGame.  This default
+     * implementation reads the game into a Game and converts it; subclasses that can
+     * decode the moves directly should override it.  Annotations are never read.
+     *
+     * @param gameNum The game number to read, starting at 1.
+     * @param game The CompactGame instance in which to read the game.
+     * @param options Which parts of the game to read.
+     *
+     * @return true if the game was read successfully, else false.
+     */
+    virtual bool read(unsigned gameNum, CompactGame &game, const DatabaseReadOptions &options);
+
+    /**
+     * Read part of the specified game from the database.  Unlike read(), this can be
+     * called by several threads at once: each call borrows a reader (see openReader()),
+     * which has its own file handles or connection, and readers are kept for reuse.
+     * Readers are opened one at a time.  Databases that cannot open readers are read
+     * by one thread at a time, holding m_mutex.
+     *
+     * @param gameNum The game number to read, starting at 1.
+     * @param game The Game instance in which to read the game.
+     * @param options Which parts of the game to read.
+     * @param errorMsg Where to store the reason the game could not be read, as
+     * errorMsg() cannot be shared between threads.
+     *
+     * @return true if the game was read successfully, else false.
+     */
+    bool readShared(unsigned gameNum, Game &game, const DatabaseReadOptions &options, std::string &errorMsg);
+
     /**
      * Write the specified game to the database.
      *
@@ -293,6 +374,46 @@ public:
      */
     virtual bool countInOpeningTree(uint64_t hashKey, unsigned &count);
 
+    /**
+     * Get the number of games and their results for each move into a position, without
+     * fetching an entry for every game.
+     *
+     * Only available if supportsOpeningTree() returns true.
+     *
+     * @param hashKey The hash key of the position.
+     * @param maxSampleGames The maximum number of game numbers to return with each move.
+     * @param stats Where to store the OpeningTreeStats objects, most played move first.
+     *
+     * @return true if the statistics were successfully populated, else false.
+     */
+    virtual bool searchOpeningTreeStats(uint64_t hashKey, unsigned maxSampleGames,
+                                        std::vector<OpeningTreeStats> &stats);
+
+    /**
+     * Get the moves from a position to the positions that follow it, however the
+     * position was reached.
+     *
+     * Only available if supportsOpeningTree() returns true.
+     *
+     * @param hashKey The hash key of the position.
+     * @param edges Where to store the OpeningTreeEdge objects, in move order.
+     *
+     * @return true if the moves were successfully populated, else false.
+     */
+    virtual bool searchOpeningTreeChildren(uint64_t hashKey, std::vector<OpeningTreeEdge> &edges);
+
+    /**
+     * Get the moves into a position from the positions that precede it.
+     *
+     * Only available if supportsOpeningTree() returns true.
+     *
+     * @param hashKey The hash key of the position.
+     * @param edges Where to store the OpeningTreeEdge objects, in move order.
+     *
+     * @return true if the moves were successfully populated, else false.
+     */
+    virtual bool searchOpeningTreeParents(uint64_t hashKey, std::vector<OpeningTreeEdge> &edges);
+
     /**
      * Count the longest line in the opening tree.
      *
@@ -304,6 +425,18 @@ public:
      */
     virtual bool countLongestLine(unsigned &count);
 
+    /**
+     * Read the entire opening tree.
+     *
+     * Only available if supportsOpeningTree() returns true.
+     *
+     * @param entries Where to store the OpeningTreeEntry objects, in the order in
+     *        which they were added to the opening tree.
+     *
+     * @return true if the opening tree was read successfully, else false.
+     */
+    virtual bool readOpeningTree(std::vector<OpeningTreeEntry> &entries);
+
     /**
      * Test if the database already has a valid index file.  This has the
      * side effect of opening the index file if it's successful.
@@ -425,6 +558,22 @@ public:
     }
 
 protected:
+    /**
+     * Open another instance of the database, with its own file handles or connection,
+     * for readShared() to read games with.  It is called holding m_readersMutex, which
+     * subclasses must also hold while changing the state it uses.  The default
+     * implementation returns 0 as the database does not support concurrent readers.
+     *
+     * @return The reader, or 0 if a reader could not be opened.
+     */
+    virtual std::shared_ptr<Database> openReader();
+
+    /**
+     * Discard the readers opened by openReader().  Subclasses must call this when the
+     * database is closed, or changed in a way that the readers would not see.
+     */
+    void closeReaders();
+
     /**
      * Set the last error message.
      *
@@ -11,6 +11,7 @@
 #include <ChessCore/GameHeader.h>
 #include <ChessCore/Position.h>
 #include <ChessCore/AnnotMove.h>
+#include <ChessCore/AnnotMovePool.h>
 
 namespace ChessCore {
 class CHESSCORE_EXPORT Game : public GameHeader {
@@ -36,13 +37,20 @@ protected:
     AnnotMove *m_mainline;          // First mainline move in doubly-linked list
     AnnotMove *m_currentMove;       // The current move (normally the last one made)
     bool m_variationStart;          // The next move made will be a variation of the current move
+    AnnotMovePool *m_pool;          // Where the moves made are allocated
 
 public:
     Game();
     Game(const Game &other);
 
+    // The moves are taken from the other game, which is left empty
+    Game(Game &&other);
+
     virtual ~Game();
 
+    Game &operator=(const Game &other);
+    Game &operator=(Game &&other);
+
     void init();
 
     /**
@@ -126,6 +134,26 @@ public:
     AnnotMove *makeMove(unsigned moveIndex, const std::string *annot = 0, std::string *formattedMove = 0,
                         bool includeMoveNum = false, GameOver *gameOver = 0, AnnotMove **oldNext = 0);
 
+    /**
+     * Make a move on the board whose piece and flags have already been set, for example
+     * by Position::buildMove().  Unlike the other makeMove() methods no moves are
+     * generated, so the move must be legal in the current position.
+     *
+     * @param move The move to make.
+     * @param annot If this is non-0 then it contains an annotation to add to move.
+     * @param formattedMove If this is non-0 then the formatted move is stored in
+     *        the string.
+     * @param includeMoveNum If true then include the move number with the formatted
+     *        move string.
+     * @param gameOver If this is non-0 then the gameover indicator is stored here.
+     * @param oldNext If this is non-0 then the move that was next is not
+     *        deleted, instead a pointer to is copied here.
+     *
+     * @return The newly allocated AnnotMove object, else 0 if an error occurred.
+     */
+    AnnotMove *makeBuiltMove(Move &move, const std::string *annot = 0, std::string *formattedMove = 0,
+                             bool includeMoveNum = false, GameOver *gameOver = 0, AnnotMove **oldNext = 0);
+
 protected:
     /**
      * Common internal method used by public makeMove() methods.
@@ -133,6 +161,17 @@ protected:
     AnnotMove *makeMoveImpl(Move &move, const Position &prevPosition, const std::string *annot,
                             std::string *formattedMove, bool includeMoveNum, GameOver *gameOver, AnnotMove **oldNext);
 
+    /**
+     * Check if the game is over in the current position and set the game-over flag
+     * (FL_MATE or FL_DRAW) of the specified move.
+     *
+     * @param amove The move that led to the current position.
+     * @param autoAnnot Where to store the annotation describing a draw.
+     *
+     * @return GAMEOVER_xxx value.
+     */
+    GameOver setGameOverFlags(AnnotMove *amove, std::string &autoAnnot);
+
 public:
     /**
      * Get the AnnotMove equivalent of the move.
@@ -262,6 +301,18 @@ public:
      */
     GameOver isGameOver();
 
+    /**
+     * Check if the game is over and set the game-over flag (FL_MATE or FL_DRAW) of the
+     * current move.  The makeMove() methods only do this when asked for the game-over
+     * condition, which costs a move generation on every move.  Code that makes many
+     * moves without needing the condition of each (for example when reading a game) can
+     * instead call this at the end of each line, as mate and stalemate can only occur
+     * there.
+     *
+     * @return GAMEOVER_xxx value.
+     */
+    GameOver checkGameOver();
+
     inline const Position &startPosition() const {
         return m_startPosition;
     }
@@ -40,8 +40,18 @@ public:
         setHeader(other);
     }
 
+    // The other header is left empty
+    GameHeader(GameHeader &&other);
+
     virtual ~GameHeader();
 
+    GameHeader &operator=(const GameHeader &other) {
+        setHeader(other);
+        return *this;
+    }
+
+    GameHeader &operator=(GameHeader &&other);
+
     void initHeader();
 
     /**
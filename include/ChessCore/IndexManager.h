@@ -83,6 +83,21 @@ public:
      */
     bool deleteIndexFile(const std::string &filename);
 
+    /**
+     * Get the name of a side file for the specified filename.  Side files are
+     * stored next to the index file and hold other data derived from the indexed
+     * file (for example cached game headers):
+     *
+     * deviceinode.extension
+     *
+     * @param filename The name of the file being indexed.
+     * @param extension The extension of the side file (without the leading '.').
+     *
+     * @return The fullpath of the side file, or an empty string if it could not
+     * be determined.
+     */
+    std::string getSideFilename(const std::string &filename, const std::string &extension) const;
+
 protected:
     std::string getIndexFilenameForFile(const std::string &filename) const;
 };
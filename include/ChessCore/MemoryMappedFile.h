@@ -0,0 +1,83 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// MemoryMappedFile.h: MemoryMappedFile class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <string>
+
+namespace ChessCore {
+/**
+ * The MemoryMappedFile class maps the contents of a file, read-only, into memory.
+ * It is used for the side files of databases (search indexes and the like) which
+ * are read far more often than they are written.
+ */
+class CHESSCORE_EXPORT MemoryMappedFile {
+private:
+    static const char *m_classname;
+
+protected:
+    std::string m_filename;
+    const uint8_t *m_data;
+    uint64_t m_size;
+#ifdef WINDOWS
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else // !WINDOWS
+    int m_fd;
+#endif // WINDOWS
+
+public:
+    MemoryMappedFile();
+    virtual ~MemoryMappedFile();
+
+    /**
+     * Map the specified file into memory.  Any currently mapped file is unmapped first.
+     *
+     * @param filename The name of the file to map.  The file must not be empty.
+     *
+     * @return true if the file was mapped successfully, else false.
+     */
+    bool open(const std::string &filename);
+
+    /**
+     * Unmap the file.
+     */
+    void close();
+
+    /**
+     * @return true if a file is currently mapped.
+     */
+    bool isOpen() const {
+        return m_data != 0;
+    }
+
+    /**
+     * @return The name of the mapped file.
+     */
+    const std::string &filename() const {
+        return m_filename;
+    }
+
+    /**
+     * @return The start of the mapped file.
+     */
+    const uint8_t *data() const {
+        return m_data;
+    }
+
+    /**
+     * @return The size of the mapped file, in bytes.
+     */
+    uint64_t size() const {
+        return m_size;
+    }
+
+private:
+    MemoryMappedFile(const MemoryMappedFile &other);
+    MemoryMappedFile &operator=(const MemoryMappedFile &other);
+};
+}   // namespace ChessCore
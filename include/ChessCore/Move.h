@@ -17,6 +17,11 @@ private:
     static const char *m_classname;
 
 public:
+    // Size of the buffer needed by san(), including the NUL terminator
+    enum {
+        MAX_SAN_LENGTH      = 8         // "exd8=Q+" or "Qa1xb2+"
+    };
+
     // Move flags
     enum {
         FL_NONE             = 0x0000,   // No flag
@@ -294,6 +299,21 @@ public:
      */
     std::string san(const Position &pos, const char *pieceMap = 0) const;
 
+    /**
+     * Generate the Short Algebraic Notation (SAN) for the move into a buffer,
+     * without allocating memory.
+     *
+     * @param pos the position in which this move is being made.
+     * @param buffer where to store the NUL-terminated move string.  This must
+     * be at least MAX_SAN_LENGTH characters long.
+     * @param pieceMap the list of chess pieces to use in the output.  If this
+     * is 0, then the default built-in set is used.
+     *
+     * @return The length of the move string, or 0 if the move is not legal in
+     * the position.
+     */
+    unsigned san(const Position &pos, char *buffer, const char *pieceMap = 0) const;
+
     /**
      * Generate the co-ordinate notation for a move.
      *
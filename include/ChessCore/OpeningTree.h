@@ -11,24 +11,25 @@
 #include <ChessCore/Database.h>
 #include <string>
 #include <sstream>
+#include <vector>
 
 namespace ChessCore {
 class CHESSCORE_EXPORT OpeningTreeEntry {
 protected:
     uint64_t m_hashKey;
+    uint64_t m_prevHashKey;     // Position before the move (if known)
     Move m_move;
     int m_score;                // +1: white win, 0: draw or not finished, -1: black wins
     bool m_lastMove;            // true if last move in game
     unsigned m_gameNum;         // Database game number (if known)
 
 public:
-    OpeningTreeEntry():m_hashKey(0ULL), m_move(), m_score(0), m_lastMove(false), m_gameNum(0) {
+    OpeningTreeEntry():m_hashKey(0ULL), m_prevHashKey(0ULL), m_move(), m_score(0), m_lastMove(false), m_gameNum(0) {
     }
 
     OpeningTreeEntry(uint64_t hashKey, uint64_t prevHashKey, Move move, int score, bool lastMove,
-                     unsigned gameNum):m_hashKey(hashKey), m_move(move), m_score(score), m_lastMove(lastMove),
-        m_gameNum(
-            gameNum) {
+                     unsigned gameNum):m_hashKey(hashKey), m_prevHashKey(prevHashKey), m_move(move), m_score(score),
+        m_lastMove(lastMove), m_gameNum(gameNum) {
     }
 
     virtual ~OpeningTreeEntry() {
@@ -36,6 +37,7 @@ public:
 
     void init() {
         m_hashKey = 0ULL;
+        m_prevHashKey = 0ULL;
         m_move.init();
         m_score = 0;
         m_lastMove = false;
@@ -50,6 +52,18 @@ public:
         m_hashKey = hashKey;
     }
 
+    /**
+     * The position the move was made from.  This is only known for entries generated
+     * from the games themselves; it is not stored in the database.
+     */
+    uint64_t prevHashKey() const {
+        return m_prevHashKey;
+    }
+
+    void setPrevHashKey(uint64_t prevHashKey) {
+        m_prevHashKey = prevHashKey;
+    }
+
     Move move() const {
         return m_move;
     }
@@ -83,8 +97,173 @@ public:
     }
 
     std::string dump() const {
-        return Util::format("m_hashKey=0x%016llx, m_move=0x%04x, m_score=%d, m_lastMove=%s, m_gameNum=%u",
-                            m_hashKey, (unsigned)m_move.intValue(), m_score, m_lastMove ? "true" : "false", m_gameNum);
+        return Util::format("m_hashKey=0x%016llx, m_prevHashKey=0x%016llx, m_move=0x%04x, m_score=%d, "
+                            "m_lastMove=%s, m_gameNum=%u", m_hashKey, m_prevHashKey, (unsigned)m_move.intValue(),
+                            m_score, m_lastMove ? "true" : "false", m_gameNum);
+    }
+};
+
+//
+// Aggregated opening tree entries for one move into a position
+//
+class CHESSCORE_EXPORT OpeningTreeStats {
+protected:
+    uint64_t m_hashKey;
+    Move m_move;
+    unsigned m_numGames;
+    unsigned m_whiteWins;
+    unsigned m_draws;               // Includes games that are not finished
+    unsigned m_blackWins;
+    std::vector<unsigned> m_sampleGames;
+
+public:
+    OpeningTreeStats():m_hashKey(0ULL), m_move(), m_numGames(0), m_whiteWins(0), m_draws(0), m_blackWins(0),
+        m_sampleGames() {
+    }
+
+    virtual ~OpeningTreeStats() {
+    }
+
+    void init() {
+        m_hashKey = 0ULL;
+        m_move.init();
+        m_numGames = 0;
+        m_whiteWins = 0;
+        m_draws = 0;
+        m_blackWins = 0;
+        m_sampleGames.clear();
+    }
+
+    uint64_t hashKey() const {
+        return m_hashKey;
+    }
+
+    void setHashKey(uint64_t hashKey) {
+        m_hashKey = hashKey;
+    }
+
+    Move move() const {
+        return m_move;
+    }
+
+    void setMove(Move move) {
+        m_move = move;
+    }
+
+    unsigned numGames() const {
+        return m_numGames;
+    }
+
+    void setNumGames(unsigned numGames) {
+        m_numGames = numGames;
+    }
+
+    unsigned whiteWins() const {
+        return m_whiteWins;
+    }
+
+    void setWhiteWins(unsigned whiteWins) {
+        m_whiteWins = whiteWins;
+    }
+
+    unsigned draws() const {
+        return m_draws;
+    }
+
+    void setDraws(unsigned draws) {
+        m_draws = draws;
+    }
+
+    unsigned blackWins() const {
+        return m_blackWins;
+    }
+
+    void setBlackWins(unsigned blackWins) {
+        m_blackWins = blackWins;
+    }
+
+    /**
+     * The lowest numbered games that played the move, up to the number requested.
+     */
+    const std::vector<unsigned> &sampleGames() const {
+        return m_sampleGames;
+    }
+
+    std::vector<unsigned> &sampleGames() {
+        return m_sampleGames;
+    }
+
+    std::string dump() const {
+        return Util::format("m_hashKey=0x%016llx, m_move=0x%04x, m_numGames=%u, m_whiteWins=%u, m_draws=%u, "
+                            "m_blackWins=%u, m_sampleGames=%u", m_hashKey, (unsigned)m_move.intValue(), m_numGames,
+                            m_whiteWins, m_draws, m_blackWins, (unsigned)m_sampleGames.size());
+    }
+};
+
+//
+// A move between two positions of the opening tree, and the number of games that
+// played it
+//
+class CHESSCORE_EXPORT OpeningTreeEdge {
+protected:
+    uint64_t m_fromHashKey;
+    uint64_t m_toHashKey;
+    Move m_move;
+    unsigned m_numGames;
+
+public:
+    OpeningTreeEdge():m_fromHashKey(0ULL), m_toHashKey(0ULL), m_move(), m_numGames(0) {
+    }
+
+    OpeningTreeEdge(uint64_t fromHashKey, uint64_t toHashKey, Move move, unsigned numGames):m_fromHashKey(fromHashKey),
+        m_toHashKey(toHashKey), m_move(move), m_numGames(numGames) {
+    }
+
+    virtual ~OpeningTreeEdge() {
+    }
+
+    void init() {
+        m_fromHashKey = 0ULL;
+        m_toHashKey = 0ULL;
+        m_move.init();
+        m_numGames = 0;
+    }
+
+    uint64_t fromHashKey() const {
+        return m_fromHashKey;
+    }
+
+    void setFromHashKey(uint64_t fromHashKey) {
+        m_fromHashKey = fromHashKey;
+    }
+
+    uint64_t toHashKey() const {
+        return m_toHashKey;
+    }
+
+    void setToHashKey(uint64_t toHashKey) {
+        m_toHashKey = toHashKey;
+    }
+
+    Move move() const {
+        return m_move;
+    }
+
+    void setMove(Move move) {
+        m_move = move;
+    }
+
+    unsigned numGames() const {
+        return m_numGames;
+    }
+
+    void setNumGames(unsigned numGames) {
+        m_numGames = numGames;
+    }
+
+    std::string dump() const {
+        return Util::format("m_fromHashKey=0x%016llx, m_toHashKey=0x%016llx, m_move=0x%04x, m_numGames=%u",
+                            m_fromHashKey, m_toHashKey, (unsigned)m_move.intValue(), m_numGames);
     }
 };
 
@@ -93,8 +272,29 @@ private:
     static const char *m_classname;
 
 protected:
+    // An opening classification, read from the header of an ECO database game
+    struct Classification {
+        std::string eco;
+        std::string opening;
+        std::string variation;
+    };
+
+    // Open-addressing hash table slot, mapping a position to its classification
+    struct ClassificationSlot {
+        uint64_t hashKey;           // 0 if the slot is unused
+        uint32_t classification;    // Index into m_classifications, or NO_CLASSIFICATION
+    };
+
+    enum {
+        NO_CLASSIFICATION = 0xffffffff
+    };
+
     std::shared_ptr<Database> m_db;
     unsigned m_longestLine;
+    std::vector<Classification> m_classifications;
+    std::vector<ClassificationSlot> m_slots;
+    size_t m_slotMask;
+    bool m_loaded;
 
 public:
     OpeningTree(const std::string &filename);
@@ -104,6 +304,19 @@ public:
         return m_db && m_db->isOpen();
     }
 
+    /**
+     * Load the opening tree and the classifications into memory.  Once loaded,
+     * classify() no longer queries the database and can be called from several
+     * threads at once.
+     *
+     * @return true if the opening tree was loaded successfully, else false.
+     */
+    bool load();
+
+    bool isLoaded() const {
+        return m_loaded;
+    }
+
     /**
      * Get the longest line in the classification database.
      */
@@ -134,5 +347,10 @@ public:
      * @return true if the game was successfully classified, else false.
      */
     bool classify(Game &game, bool setComment = true);
+
+protected:
+    bool classifyInMemory(const Game &game, std::string &eco, std::string &opening,
+                          std::string &variation) const;
+    const ClassificationSlot *findSlot(uint64_t hashKey) const;
 };
 } // namespace ChessCore
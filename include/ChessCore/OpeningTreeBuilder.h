@@ -0,0 +1,170 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// OpeningTreeBuilder.h: OpeningTreeBuilder class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/Database.h>
+#include <ChessCore/OpeningTree.h>
+#include <ChessCore/Mutex.h>
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace ChessCore {
+class OpeningTreeBuilderThread;
+
+/**
+ * The OpeningTreeBuilder class generates the opening tree entries of a range of games
+ * in sorted order, without holding them all in memory:
+ *
+ * 1. Worker threads, each with its own connection to the database, replay the games
+ *    and collect the entries.
+ * 2. Whenever a thread has collected its share of the memory limit, it sorts the
+ *    entries and writes them to a temporary run file.
+ * 3. next() merges the runs, returning the entries in hash key and then game order.
+ *
+ * The database must therefore allow several read-only connections at once.
+ */
+class CHESSCORE_EXPORT OpeningTreeBuilder {
+    friend class OpeningTreeBuilderThread;
+
+private:
+    static const char *m_classname;
+
+public:
+    // The packed form of an OpeningTreeEntry used in the runs
+    struct Tuple {
+        uint64_t hashKey;
+        uint64_t prevHashKey;
+        uint32_t gameRef;           // See OpeningTreeFile::gameRef()
+        uint32_t move;
+
+        bool operator<(const Tuple &other) const {
+            if (hashKey != other.hashKey)
+                return hashKey < other.hashKey;
+            if (gameRef != other.gameRef)
+                return gameRef < other.gameRef;
+            if (move != other.move)
+                return move < other.move;
+            return prevHashKey < other.prevHashKey;
+        }
+    };
+
+    enum {
+        DEFAULT_MAX_MEMORY = 256 * 1024 * 1024
+    };
+
+protected:
+    // Reads a run back during the merge
+    struct Run {
+        std::ifstream file;
+        std::vector<Tuple> buffer;
+        size_t pos;
+        uint64_t remaining;         // Tuples not yet read into the buffer
+    };
+
+    // Orders the merge heap, lowest tuple first
+    struct RunOrder {
+        const std::vector<Run *> &m_runs;
+
+        RunOrder(const std::vector<Run *> &runs) :
+            m_runs(runs) {
+        }
+
+        bool operator()(unsigned a, unsigned b) const {
+            return m_runs[b]->buffer[m_runs[b]->pos] < m_runs[a]->buffer[m_runs[a]->pos];
+        }
+    };
+
+    size_t m_maxMemory;
+    std::string m_runPrefix;
+    std::vector<std::string> m_runFilenames;
+    std::vector<uint64_t> m_runSizes;
+    std::vector<Run *> m_runs;
+    std::vector<unsigned> m_heap;
+    uint64_t m_numEntries;
+    unsigned m_gamesDone;
+    Mutex m_mutex;                  // Protects the run lists and m_gamesDone
+    std::string m_errorMsg;
+
+public:
+    OpeningTreeBuilder();
+    virtual ~OpeningTreeBuilder();
+
+    const std::string &errorMsg() const {
+        return m_errorMsg;
+    }
+
+    /**
+     * Set the approximate amount of memory the worker threads may use between them.
+     */
+    void setMaxMemory(size_t maxMemory) {
+        m_maxMemory = maxMemory;
+    }
+
+    /**
+     * Get the number of entries generated by build().
+     */
+    uint64_t numEntries() const {
+        return m_numEntries;
+    }
+
+    /**
+     * Get the opening tree entries of a game, in the order the moves were played.  Games
+     * that start from a set position or that have no moves have no entries.
+     *
+     * @param game The game.
+     * @param gameNum The database game number of the game.
+     * @param depth The number of half-moves of the game to include.
+     * @param entries Where to store the entries.
+     * @param errorMsg Where to store an error message if the game cannot be replayed.
+     *
+     * @return true if the game was replayed successfully, else false.
+     */
+    static bool replayGame(const Game &game, unsigned gameNum, unsigned depth,
+                           std::vector<OpeningTreeEntry> &entries, std::string &errorMsg);
+
+    /**
+     * Replay games and sort their opening tree entries into runs.  Games that do not
+     * exist, that start from a set position or that have no moves are ignored.
+     *
+     * @param dburl The URL of the database, which each thread opens read-only.
+     * @param firstGameNum The first game to replay.
+     * @param lastGameNum The last game to replay.
+     * @param depth The number of half-moves of each game to include.
+     * @param numThreads The number of worker threads.  0 to use one for each processor.
+     * @param callback An optional callback function, used to provide feedback.
+     * @param contextInfo Context Info to pass to the callback function.
+     *
+     * @return true if the runs were built successfully, else false.
+     */
+    bool build(const std::string &dburl, unsigned firstGameNum, unsigned lastGameNum, unsigned depth,
+               unsigned numThreads, DATABASE_CALLBACK_FUNC callback, void *contextInfo);
+
+    /**
+     * Get the next entry, in hash key and then game order.
+     *
+     * @param entry Where to store the entry.
+     * @param done Set to true once there are no more entries.
+     *
+     * @return true if an entry was read or there are no more, else false if an error
+     * occurred.
+     */
+    bool next(OpeningTreeEntry &entry, bool &done);
+
+    /**
+     * Delete the runs.
+     */
+    void clear();
+
+protected:
+    bool writeRun(std::vector<Tuple> &tuples);
+    bool startMerge();
+    bool fillBuffer(Run &run);
+    void setErrorMsg(const std::string &errorMsg);
+};
+} // namespace ChessCore
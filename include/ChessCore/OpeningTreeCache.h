@@ -0,0 +1,126 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// OpeningTreeCache.h: OpeningTreeCache class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/OpeningTree.h>
+#include <ChessCore/Mutex.h>
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+namespace ChessCore {
+/**
+ * The OpeningTreeCache class holds the results of recent opening tree lookups, so the
+ * positions most often asked for do not go to the database each time.  The least
+ * recently used positions are discarded once the cache holds more than the maximum
+ * number of entries.
+ *
+ * The cache is thread-safe, so one cache can be shared by several connections to the
+ * same database; any of them that changes the opening tree must clear() it.
+ */
+class CHESSCORE_EXPORT OpeningTreeCache {
+private:
+    static const char *m_classname;
+
+public:
+    enum {
+        DEFAULT_MAX_ENTRIES = 1000000
+    };
+
+protected:
+    // The cached results for one position
+    struct Item {
+        uint64_t hashKey;
+        unsigned count;
+        bool haveEntries;           // entries holds every entry of the position
+        std::vector<OpeningTreeEntry> entries;
+    };
+
+    typedef std::list<Item> ItemList;
+
+    ItemList m_items;               // Most recently used first
+    std::unordered_map<uint64_t, ItemList::iterator> m_index;
+    size_t m_maxEntries;
+    size_t m_numEntries;            // Each item counts as one, plus its entries
+    uint64_t m_hits;
+    uint64_t m_misses;
+    mutable Mutex m_mutex;
+
+public:
+    OpeningTreeCache(size_t maxEntries = DEFAULT_MAX_ENTRIES);
+    virtual ~OpeningTreeCache();
+
+    /**
+     * Set the maximum number of entries held by the cache.  0 disables the cache.
+     */
+    void setMaxEntries(size_t maxEntries);
+
+    size_t maxEntries() const;
+
+    /**
+     * Get the entries of a position, as Database::searchOpeningTree() does.
+     *
+     * @return true if the entries were in the cache, else false.
+     */
+    bool findEntries(uint64_t hashKey, bool lastMoveOnly, std::vector<OpeningTreeEntry> &entries);
+
+    /**
+     * Get the number of entries of a position, as Database::countInOpeningTree() does.
+     *
+     * @return true if the count was in the cache, else false.
+     */
+    bool findCount(uint64_t hashKey, unsigned &count);
+
+    /**
+     * Add every entry of a position.  Positions with too many entries to cache are
+     * only added as a count.
+     */
+    void addEntries(uint64_t hashKey, const std::vector<OpeningTreeEntry> &entries);
+
+    /**
+     * Add the number of entries of a position.
+     */
+    void addCount(uint64_t hashKey, unsigned count);
+
+    /**
+     * Discard every position, after the opening tree has changed.
+     */
+    void clear();
+
+    /**
+     * Test if the cache has reached its maximum size.
+     */
+    bool isFull() const;
+
+    size_t numPositions() const;
+    size_t numEntries() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+    /**
+     * Get the proportion of lookups found in the cache.
+     *
+     * @return The hit rate, from 0.0 to 1.0.
+     */
+    double hitRate() const;
+
+    /**
+     * Reset the hit and miss counts.
+     */
+    void resetStats();
+
+protected:
+    Item *findItem(uint64_t hashKey);
+    Item &addItem(uint64_t hashKey);
+    void evict();
+
+private:
+    OpeningTreeCache(const OpeningTreeCache &other);
+    OpeningTreeCache &operator=(const OpeningTreeCache &other);
+};
+} // namespace ChessCore
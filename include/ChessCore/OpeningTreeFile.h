@@ -0,0 +1,298 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// OpeningTreeFile.h: OpeningTreeFile class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/MemoryMappedFile.h>
+#include <ChessCore/OpeningTree.h>
+#include <ChessCore/Util.h>
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace ChessCore {
+/**
+ * The OpeningTreeFile class holds the opening tree of a database in a single file,
+ * which is memory-mapped while in use:
+ *
+ * Header:    magic, version, number of games in the database when written, generation
+ *            (uint32_t each), number of records, number of game references, number of
+ *            nodes, number of edges (uint64_t each).
+ * Records:   One Record for each (position, move) pair, sorted by position hash key
+ *            and then move.
+ * Game list: One uint32_t game reference for each game that played the move in the
+ *            position, in game order.  Each record refers to a contiguous run of
+ *            references.  The list is padded to a multiple of 8 bytes.
+ * Nodes:     One Node for each position, sorted by hash key, including the starting
+ *            position.
+ * Children:  One Edge for each move from a position, grouped by node in move order.
+ * Parents:   One Edge for each move into a position, grouped by node in move order.
+ *
+ * The nodes and edges form the position graph of the tree: a position reached by
+ * several move orders is a single node, so its continuations and the positions it was
+ * reached from can be found without scanning the records.
+ *
+ * The generation identifies the opening tree the file was written from, so a file
+ * left over from an earlier tree is not used.
+ *
+ * A game reference is (gameNum << 3) | (lastMove << 2) | (score + 1).  All values are
+ * little-endian.  Positions are found using an interpolation search, which works well
+ * as the hash keys are evenly distributed.
+ */
+class CHESSCORE_EXPORT OpeningTreeFile {
+private:
+    static const char *m_classname;
+
+public:
+    struct Record {
+        uint64_t hashKey;           // Position after the move
+        uint64_t firstGame;         // Index of the first game reference
+        uint32_t move;              // Move::intValue()
+        uint32_t numGames;          // Number of game references
+        uint32_t whiteWins;
+        uint32_t draws;             // Draws and unfinished games
+        uint32_t blackWins;
+        uint32_t reserved;
+    };
+
+    struct Node {
+        uint64_t hashKey;
+        uint64_t firstChild;        // Index of the first child edge
+        uint64_t firstParent;       // Index of the first parent edge
+        uint32_t numChildren;
+        uint32_t numParents;
+    };
+
+    struct Edge {
+        uint64_t hashKey;           // Position at the other end of the move
+        uint32_t move;              // Move::intValue()
+        uint32_t numGames;
+    };
+
+    enum {
+        CURRENT_VERSION = 3
+    };
+
+protected:
+    MemoryMappedFile m_file;
+    unsigned m_numGames;
+    unsigned m_generation;
+    uint64_t m_numRecords;
+    uint64_t m_numGameRefs;
+    uint64_t m_numNodes;
+    uint64_t m_numEdges;
+    const Record *m_records;
+    const uint32_t *m_gameRefs;
+    const Node *m_nodes;
+    const Edge *m_children;
+    const Edge *m_parents;
+
+public:
+    OpeningTreeFile();
+    virtual ~OpeningTreeFile();
+
+    /**
+     * Map an opening tree file into memory.
+     *
+     * @param filename The name of the opening tree file.
+     * @param generation The generation of the database's opening tree.
+     *
+     * @return true if the file was mapped and is valid, else false.
+     */
+    bool open(const std::string &filename, unsigned generation);
+
+    /**
+     * Unmap the opening tree file.
+     */
+    void close();
+
+    bool isOpen() const {
+        return m_file.isOpen();
+    }
+
+    unsigned numGames() const {
+        return m_numGames;
+    }
+
+    unsigned generation() const {
+        return m_generation;
+    }
+
+    uint64_t numRecords() const {
+        return m_numRecords;
+    }
+
+    uint64_t numNodes() const {
+        return m_numNodes;
+    }
+
+    /**
+     * Find the records for a position.
+     *
+     * @param hashKey The hash key of the position.
+     * @param numRecords Where to store the number of records found.
+     *
+     * @return The first record for the position, or 0 if the position is not in the
+     * opening tree.
+     */
+    const Record *find(uint64_t hashKey, unsigned &numRecords) const;
+
+    /**
+     * Find the node of a position in the position graph.
+     *
+     * @return The node, or 0 if the position is not in the opening tree.
+     */
+    const Node *findNode(uint64_t hashKey) const;
+
+    /**
+     * Get the game references of a record.
+     */
+    const uint32_t *gameRefs(const Record &record) const {
+        return m_gameRefs + le64(record.firstGame);
+    }
+
+    /**
+     * Get the games that passed through a position, as Database::searchOpeningTree()
+     * does.  Entries are returned in game order.
+     */
+    void search(uint64_t hashKey, bool lastMoveOnly, std::vector<OpeningTreeEntry> &entries) const;
+
+    /**
+     * Count the games that passed through a position, as
+     * Database::countInOpeningTree() does.
+     */
+    unsigned count(uint64_t hashKey) const;
+
+    /**
+     * Get the statistics of each move into a position, as
+     * Database::searchOpeningTreeStats() does.  The statistics are returned in move
+     * order.
+     */
+    void stats(uint64_t hashKey, unsigned maxSampleGames, std::vector<OpeningTreeStats> &stats) const;
+
+    /**
+     * Get the moves from a position, in move order.
+     */
+    void children(uint64_t hashKey, std::vector<OpeningTreeEdge> &edges) const;
+
+    /**
+     * Get the moves into a position, in move order.
+     */
+    void parents(uint64_t hashKey, std::vector<OpeningTreeEdge> &edges) const;
+
+    static uint32_t gameRef(unsigned gameNum, bool lastMove, int score) {
+        return (gameNum << 3) | (lastMove ? 4 : 0) | (uint32_t)(score + 1);
+    }
+
+    static unsigned gameRefGameNum(uint32_t gameRef) {
+        return gameRef >> 3;
+    }
+
+    static bool gameRefLastMove(uint32_t gameRef) {
+        return (gameRef & 4) != 0;
+    }
+
+    static int gameRefScore(uint32_t gameRef) {
+        return (int)(gameRef & 3) - 1;
+    }
+
+private:
+    OpeningTreeFile(const OpeningTreeFile &other);
+    OpeningTreeFile &operator=(const OpeningTreeFile &other);
+};
+
+/**
+ * The OpeningTreeFileWriter class creates an opening tree file from opening tree
+ * entries, which must be added in hash key order and, for each move into a position,
+ * in game order.  The entries of one position are held in memory until the next
+ * position is added, and the edges of the position graph until finish().  Entries
+ * without a previous hash key add no edges.  The file is written under a temporary
+ * name and renamed by finish(), so any process that has the old file mapped is
+ * unaffected.
+ */
+class CHESSCORE_EXPORT OpeningTreeFileWriter {
+private:
+    static const char *m_classname;
+
+public:
+    // A move into the current position, and the games that played it
+    struct PositionMove {
+        OpeningTreeFile::Record record;
+        std::vector<uint32_t> gameRefs;
+    };
+
+    // A move between two positions
+    struct GraphEdge {
+        uint64_t from;
+        uint64_t to;
+        uint32_t move;
+        uint32_t numGames;
+    };
+
+protected:
+    std::string m_filename;
+    std::string m_tempFilename;
+    std::string m_gamesFilename;
+    std::ofstream m_file;           // Header and records
+    std::ofstream m_gamesFile;      // Game list, appended to m_file by finish()
+    std::vector<PositionMove> m_moves;
+    std::vector<GraphEdge> m_positionEdges; // Moves into the current position
+    std::vector<GraphEdge> m_edges;         // In 'to' and then move order
+    uint64_t m_hashKey;             // The current position
+    bool m_havePosition;
+    unsigned m_numGames;
+    unsigned m_generation;
+    uint64_t m_numRecords;
+    uint64_t m_numGameRefs;
+    uint64_t m_numNodes;
+    uint64_t m_numEdges;
+    std::string m_errorMsg;
+
+public:
+    OpeningTreeFileWriter();
+    virtual ~OpeningTreeFileWriter();
+
+    const std::string &errorMsg() const {
+        return m_errorMsg;
+    }
+
+    /**
+     * Start writing an opening tree file.
+     *
+     * @param filename The name of the opening tree file.
+     * @param numGames The number of games in the database.
+     * @param generation The generation of the opening tree being written.
+     *
+     * @return true if the file was created, else false.
+     */
+    bool create(const std::string &filename, unsigned numGames, unsigned generation);
+
+    /**
+     * Add an opening tree entry.
+     *
+     * @return true if the entry was added, else false.
+     */
+    bool add(const OpeningTreeEntry &entry);
+
+    /**
+     * Complete the file and give it its real name.
+     *
+     * @return true if the file was written successfully, else false.
+     */
+    bool finish();
+
+    /**
+     * Abandon the file.
+     */
+    void abort();
+
+protected:
+    bool writePosition();
+    bool writeGraph();
+    bool writeHeader();
+};
+} // namespace ChessCore
@@ -10,6 +10,7 @@
 #include <ChessCore/PgnScanner.h>
 #include <ChessCore/Database.h>
 #include <ChessCore/IndexManager.h>
+#include <ChessCore/SearchIndex.h>
 #include <fstream>
 
 namespace ChessCore {
@@ -21,6 +22,10 @@ protected:
     // m_relaxedParsing allows 'spurious characters' to be ignored when parsing
     static bool m_relaxedParsing;
 
+    // m_headerCaching causes readHeaders() to keep a copy of the tag section of
+    // each game in a side file next to the index file
+    static bool m_headerCaching;
+
     // Manages the PGN index files in a temporary directory.  This is intialised
     // the first time this class is used.
     static IndexManager m_indexManager;
@@ -35,6 +40,11 @@ protected:
     std::fstream m_pgnFile;
     std::string m_indexFilename;
     std::fstream m_indexFile;
+    std::string m_headerCacheFilename;
+    std::fstream m_headerCacheFile;
+    SearchIndex m_searchIndex;
+    std::vector<char> m_gameText;   // Text of the game being read, when using the index
+    std::string m_writeBuffer;      // Text of the game being written
     PgnScannerContext m_context;
     unsigned m_numGames;
 
@@ -47,6 +57,14 @@ public:
         m_relaxedParsing = relaxedParsing;
     }
 
+    static bool isHeaderCaching() {
+        return m_headerCaching;
+    }
+
+    static void setHeaderCaching(bool headerCaching) {
+        m_headerCaching = headerCaching;
+    }
+
     static Nag fromPgnNag(unsigned nag);
     static unsigned toPgnNag(Nag nag);
 
@@ -73,18 +91,51 @@ public:
     }
 
     bool supportsSearching() const {
-        return false;
+        return true;
     }
 
     bool open(const std::string &filename, bool readOnly);
     bool close();
     bool readHeader(unsigned gameNum, GameHeader &gameHeader);
+    bool readHeaders(unsigned firstGameNum, unsigned lastGameNum, std::vector<GameHeader> &gameHeaders);
     bool read(unsigned gameNum, Game &game);
+    bool read(unsigned gameNum, Game &game, const DatabaseReadOptions &options);
+    bool read(unsigned gameNum, CompactGame &game, const DatabaseReadOptions &options);
     bool write(unsigned gameNum, const Game &game);
 
     bool hasValidIndex();
     bool index(DATABASE_CALLBACK_FUNC callback, void *contextInfo);
 
+    /**
+     * Build the header cache, which holds the tag section of every game and is used
+     * by readHeaders() when header caching is enabled.  The database must have been
+     * indexed.
+     *
+     * @param callback An optional callback function, used to provide feedback
+     * of the build process.
+     * @param contextInfo Context Info to pass to the callback function.
+     *
+     * @return true if the header cache was built successfully, else false.
+     */
+    bool buildHeaderCache(DATABASE_CALLBACK_FUNC callback, void *contextInfo);
+
+    /**
+     * Build the search index, a column store of the game header fields held in a
+     * side file next to the index file, which is used by search().  search() will
+     * build the search index itself if it is missing or out-of-date, however this
+     * method allows it to be done up-front.  The database must have been indexed.
+     *
+     * @param callback An optional callback function, used to provide feedback
+     * of the build process.
+     * @param contextInfo Context Info to pass to the callback function.
+     *
+     * @return true if the search index was built successfully, else false.
+     */
+    bool buildSearchIndex(DATABASE_CALLBACK_FUNC callback, void *contextInfo);
+
+    bool search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset = 0, int limit = 0);
+
     // Special methods to allow games to be read from/written to strings
     // (as PGN is the standard game interchange format).
     static bool readFromString(const std::string &input, Game &game);
@@ -113,18 +164,35 @@ public:
     }
 
 protected:
-    static bool read(PgnScannerContext &context, Game &game, std::string &errorMsg);
+    static bool read(PgnScannerContext &context, Game &game, std::string &errorMsg,
+                     const DatabaseReadOptions &options = DatabaseReadOptions());
+    static bool read(PgnScannerContext &context, CompactGame &game, std::string &errorMsg,
+                     const DatabaseReadOptions &options);
     static bool readRoster(PgnScannerContext &context, int token, GameHeader &gameHeader, std::string &errorMsg);
+    static bool readRoster(const char *text, unsigned lineNumber, int token, GameHeader &gameHeader,
+                           std::string &errorMsg);
+    static bool readTagSection(const std::string &tagSection, unsigned lineNumber, GameHeader &gameHeader,
+                               std::string &errorMsg);
+    static int tagToken(const char *text);
     static bool write(std::ostream &output, const Game &game, std::string &errorMsg);
-    static bool writeMoves(std::ostream &output, const AnnotMove *amove, unsigned &width, std::string &errorMsg);
-    static void writeText(std::ostream &output, const std::string &text, unsigned &width, bool insertSpace = true);
     static std::string getTagString(PgnScannerContext &context, std::string &errorMsg);
-    static std::string formatTagString(const std::string &str);
+    static std::string getTagString(const char *text, unsigned lineNumber, std::string &errorMsg);
     static void setOpening(Player &player, const std::string &data);
+    std::shared_ptr<Database> openReader();
+    template <class GameType>
+    bool readGame(unsigned gameNum, GameType &game, const DatabaseReadOptions &options);
     bool seekGameNum(unsigned gameNum, uint32_t &linenum);
+    bool readGameText(unsigned gameNum, uint32_t &linenum);
+    bool readTagSections(unsigned firstGameNum, const std::vector<uint64_t> &offsets,
+                         std::vector<std::string> &tagSections);
+    bool openHeaderCache();
+    bool openSearchIndex();
+    bool readHeaderCache(unsigned firstGameNum, unsigned lastGameNum, std::vector<std::string> &tagSections);
 
 public:
     bool readIndex(unsigned gameNum, uint64_t &offset, uint32_t &linenum);
+    bool readIndex(unsigned firstGameNum, unsigned lastGameNum, std::vector<uint64_t> &offsets,
+                   std::vector<uint32_t> &linenums);
     bool writeIndex(unsigned gameNum, uint64_t offset, uint32_t linenum);
 };
 } // namespace ChessCore
@@ -8,8 +8,12 @@
 
 #include <ChessCore/ChessCore.h>
 #include <istream>
+#include <string>
+#include <vector>
 
 namespace ChessCore {
+class PgnTokenizer;
+
 //
 // PgnScannerContext keeps context between PgnDatabase and PgnScanner
 //
@@ -17,14 +21,58 @@ class CHESSCORE_EXPORT PgnScannerContext {
 private:
     static const char *m_classname;
 
+public:
+    enum Lexer {
+        LEXER_FLEX,             // The flex scanner in PgnScanner.l (the reference)
+        LEXER_TOKENIZER         // The hand-written PgnTokenizer
+    };
+
 protected:
+    static Lexer m_defaultLexer;
+
+    Lexer m_lexer;
     void *m_scanner;
-    std::istream &m_stream;
+    PgnTokenizer *m_tokenizer;
+    std::istream *m_stream;         // Input stream, or 0 if scanning a buffer
+    char *m_buffer;                 // Buffer being scanned, or 0 if scanning a stream
+    std::vector<char> m_bufferCopy; // Owned copy of the input, if any
     unsigned m_lineNumber;
 
 public:
+    static Lexer defaultLexer() {
+        return m_defaultLexer;
+    }
+
+    /**
+     * Set the lexer used by contexts created from now on.
+     */
+    static void setDefaultLexer(Lexer lexer) {
+        m_defaultLexer = lexer;
+    }
+
     PgnScannerContext(std::istream &stream);
+
+    /**
+     * Scan an in-memory buffer in-place, without copying it.
+     *
+     * As with yy_scan_buffer(), the last two bytes of the buffer must be NUL and
+     * are included in 'size'.  The scanner modifies the buffer as it goes, and the
+     * buffer must remain valid for the lifetime of the context.
+     */
+    PgnScannerContext(char *buffer, size_t size);
+
+    /**
+     * Scan a string.  The string is copied once, into a NUL-terminated buffer that
+     * is then scanned in-place.
+     */
+    PgnScannerContext(const std::string &input);
+
     virtual ~PgnScannerContext();
+
+    Lexer lexer() const {
+        return m_lexer;
+    }
+
     void *scanner();
     int read(void *buffer, unsigned len);
     int lex();
@@ -34,8 +82,15 @@ public:
     unsigned lineNumber() const;
     void setLineNumber(unsigned lineNumber);
     void incLineNumber(unsigned amount = 1);
+
+    /**
+     * @return The number of bytes of the buffer consumed by the scanner so far, or
+     * 0 if scanning a stream.
+     */
+    size_t bufferOffset() const;
 protected:
     void initScanner();
+    void initBuffer(char *buffer, size_t size);
     void destroyScanner();
 };
 
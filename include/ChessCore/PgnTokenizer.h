@@ -0,0 +1,87 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// PgnTokenizer.h: Hand-written PGN tokenizer.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <istream>
+#include <vector>
+
+namespace ChessCore {
+class PgnScannerContext;
+
+//
+// PgnTokenizer is a hand-written alternative to the flex-generated scanner in
+// PgnScanner.l.  It returns the same tokens, with the same text and line numbering,
+// but dispatches on the first character of each token rather than running the DFA.
+// The flex scanner remains the reference implementation; any change to the rules in
+// PgnScanner.l must be reflected here.
+//
+// PgnTokenizer is normally used through PgnScannerContext (see
+// PgnScannerContext::setDefaultLexer()).
+//
+class CHESSCORE_EXPORT PgnTokenizer {
+private:
+    static const char *m_classname;
+
+protected:
+    PgnScannerContext &m_context;
+    std::istream *m_stream;         // Input stream, or 0 if scanning a buffer
+    std::vector<char> m_data;       // Buffered stream data
+    char *m_buffer;                 // Data being scanned; always followed by two NULs
+    size_t m_length;                // Length of data in m_buffer, excluding the NULs
+    size_t m_pos;                   // Offset of the next token
+    char *m_text;                   // Text of the current token
+    char *m_holdPos;                // Where the current token was NUL-terminated
+    char m_holdChar;                // Character overwritten at m_holdPos
+    bool m_atBol;                   // Next token is at the beginning of a line
+    bool m_eof;                     // No more data can be read into m_buffer
+
+public:
+    /**
+     * Tokenize a stream.  Data is read from the stream in blocks.
+     */
+    PgnTokenizer(PgnScannerContext &context, std::istream &stream);
+
+    /**
+     * Tokenize a buffer in-place.  As with PgnScannerContext, the last two bytes of the
+     * buffer must be NUL and are included in 'size'.
+     */
+    PgnTokenizer(PgnScannerContext &context, char *buffer, size_t size);
+
+    /**
+     * @return The next token, or 0 at the end of the input.
+     */
+    int lex();
+
+    /**
+     * @return The NUL-terminated text of the last token returned by lex().
+     */
+    char *text() const;
+
+    /**
+     * Discard any buffered stream data, so the next token is read from the current
+     * position of the stream.  Does nothing when tokenizing a buffer.
+     */
+    void flush();
+
+    /**
+     * @return The number of bytes of the buffer consumed so far, or 0 if tokenizing
+     * a stream.
+     */
+    size_t bufferOffset() const;
+
+    /**
+     * @return The A_PGN_* token for the PGN tag 'text' of 'length' characters, which
+     * must start with '[' and end with ']'.
+     */
+    static int tagToken(const char *text, size_t length);
+
+protected:
+    bool fill();
+    void restoreHoldChar();
+};
+} // namespace ChessCore
@@ -0,0 +1,138 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// PgnWriter.h: Buffered PGN writer.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/Database.h>
+#include <ChessCore/Game.h>
+#include <string>
+
+namespace ChessCore {
+//
+// PgnWriter formats games as PGN directly into a large output buffer, which is written
+// to the file with write(2) when it fills.  Games without annotations or variations
+// are formatted using a fast path.
+//
+// The static format() method is also used by PgnDatabase, so the output is the same
+// whichever is used.
+//
+class CHESSCORE_EXPORT PgnWriter {
+private:
+    static const char *m_classname;
+
+protected:
+    std::string m_filename;
+    int m_fd;
+    std::string m_buffer;           // Formatted games not yet written to the file
+    uint64_t m_fileSize;            // Bytes written to the file, excluding m_buffer
+    std::string m_errorMsg;
+
+public:
+    enum {
+        BUFFER_SIZE = 1024 * 1024,  // Size at which the output buffer is written
+        MAX_LINE_WIDTH = 79
+    };
+
+    PgnWriter();
+    virtual ~PgnWriter();
+
+    /**
+     * Open the output file.
+     *
+     * @param filename The file to write.
+     * @param append If true then games are added to the end of an existing file,
+     * else any existing file is truncated.
+     *
+     * @return true if the file was opened, else false.
+     */
+    bool open(const std::string &filename, bool append);
+
+    /**
+     * Write any buffered output and close the file.
+     *
+     * @return true if the buffered output was written successfully, else false.
+     */
+    bool close();
+
+    inline bool isOpen() const {
+        return m_fd >= 0;
+    }
+
+    inline const std::string &filename() const {
+        return m_filename;
+    }
+
+    inline const std::string &errorMsg() const {
+        return m_errorMsg;
+    }
+
+    /**
+     * @return The offset in the file at which the next game will be written,
+     * including any buffered output.
+     */
+    inline uint64_t offset() const {
+        return m_fileSize + m_buffer.length();
+    }
+
+    /**
+     * Format a game and add it to the output buffer, separated from any previous
+     * game by a blank line.
+     *
+     * @return true if the game was formatted and any output written successfully,
+     * else false.
+     */
+    bool write(const Game &game);
+
+    /**
+     * Write the contents of the output buffer to the file.
+     */
+    bool flush();
+
+    /**
+     * Write a range of games from a database.  Games are read on the calling thread
+     * while 'numThreads' threads format the previous batch, and are written in order.
+     *
+     * @param database The database to read.
+     * @param firstGameNum The first game to write.
+     * @param lastGameNum The last game to write.
+     * @param numThreads The number of formatting threads.  If this is 0 then the
+     * number of processors is used.
+     * @param callback Progress callback.  Can be 0.
+     * @param contextInfo Context information passed to the callback.
+     *
+     * @return true if the games were written successfully, else false.
+     */
+    bool writeDatabase(Database &database, unsigned firstGameNum, unsigned lastGameNum, unsigned numThreads,
+                       DATABASE_CALLBACK_FUNC callback, void *contextInfo);
+
+    /**
+     * Format a game as PGN, appending it to 'output'.  Once 'output' has grown large
+     * enough, formatting does not allocate memory.
+     *
+     * @return true if the game was formatted successfully, else false.
+     */
+    static bool format(const Game &game, std::string &output, std::string &errorMsg);
+
+protected:
+    bool writeBuffer(const char *data, size_t length);
+    void appendSeparator();
+
+    static void formatHeader(const Game &game, const char *result, std::string &output);
+    static void formatTag(const char *name, const std::string &value, std::string &output);
+    static void formatTagString(const std::string &str, std::string &output);
+    static bool hasAnnotations(const AnnotMove *amove);
+    static bool formatMainline(const AnnotMove *amove, std::string &output, unsigned &width,
+                               std::string &errorMsg);
+    static bool formatMoves(const AnnotMove *amove, std::string &output, unsigned &width,
+                            std::string &errorMsg);
+    static void formatAnnotation(const std::string &annotation, std::string &output, unsigned &width,
+                                 bool insertSpace);
+    static void formatText(const char *text, size_t length, std::string &output, unsigned &width,
+                           bool insertSpace = true);
+    static size_t formatMoveNumber(const Position &pos, char *buffer);
+};
+} // namespace ChessCore
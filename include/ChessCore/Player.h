@@ -26,8 +26,14 @@ public:
 
     Player(const Player &other);
 
+    // The other player is left empty
+    Player(Player &&other);
+
     virtual ~Player();
 
+    Player &operator=(const Player &other);
+    Player &operator=(Player &&other);
+
     // Set the player from another instance
     void set(const Player &other);
     void set(const Player *other);
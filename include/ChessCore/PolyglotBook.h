@@ -0,0 +1,306 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// PolyglotBook.h: PolyglotBook class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/Database.h>
+#include <ChessCore/MemoryMappedFile.h>
+#include <ChessCore/Position.h>
+#include <ChessCore/Util.h>
+#include <string>
+#include <vector>
+
+namespace ChessCore {
+//
+// A move found in a Polyglot opening book
+//
+class CHESSCORE_EXPORT PolyglotBookEntry {
+protected:
+    Move m_move;
+    unsigned m_weight;
+    unsigned m_learn;
+
+public:
+    PolyglotBookEntry():m_move(), m_weight(0), m_learn(0) {
+    }
+
+    PolyglotBookEntry(Move move, unsigned weight, unsigned learn):m_move(move), m_weight(weight), m_learn(learn) {
+    }
+
+    virtual ~PolyglotBookEntry() {
+    }
+
+    Move move() const {
+        return m_move;
+    }
+
+    void setMove(Move move) {
+        m_move = move;
+    }
+
+    unsigned weight() const {
+        return m_weight;
+    }
+
+    void setWeight(unsigned weight) {
+        m_weight = weight;
+    }
+
+    unsigned learn() const {
+        return m_learn;
+    }
+
+    void setLearn(unsigned learn) {
+        m_learn = learn;
+    }
+
+    std::string dump() const {
+        return Util::format("m_move=0x%08x, m_weight=%u, m_learn=%u", (unsigned)m_move.intValue(), m_weight,
+                            m_learn);
+    }
+};
+
+/**
+ * The PolyglotBook class reads opening books in the Polyglot format used by most UCI
+ * engines.  A book is a sorted array of 16-byte entries:
+ *
+ * key (uint64_t), move (uint16_t), weight (uint16_t), learn (uint32_t)
+ *
+ * All values are big-endian.  The key is the Polyglot hash of the position, which
+ * uses its own Zobrist random numbers rather than those of Position::hashKey(), and
+ * the entries of a position are in descending weight order.  The book is
+ * memory-mapped and positions are found using a binary search.
+ *
+ * The 781 Polyglot random numbers are built in.  Others can be loaded with
+ * loadRandoms(), and are checked against the published Polyglot keys of several
+ * positions, so a book is never written or probed with the wrong keys.
+ */
+class CHESSCORE_EXPORT PolyglotBook {
+private:
+    static const char *m_classname;
+
+public:
+    struct Entry {
+        uint64_t key;
+        uint16_t move;
+        uint16_t weight;
+        uint32_t learn;
+    };
+
+    enum {
+        NUM_RANDOMS = 781,
+        MAX_WEIGHT = 0xffff
+    };
+
+protected:
+    static std::vector<uint64_t> m_randoms;
+
+    MemoryMappedFile m_file;
+    uint64_t m_numEntries;
+    const Entry *m_entries;
+
+public:
+    PolyglotBook();
+    virtual ~PolyglotBook();
+
+    /**
+     * Replace the built-in Polyglot random numbers with those in a text file.  The file
+     * must contain the 781 numbers in Polyglot order, written in hexadecimal with a '0x'
+     * prefix; any other text is ignored, so the Random64 array of the Polyglot source
+     * can be used as it is.  This must be done before other threads use Polyglot keys.
+     *
+     * @param filename The name of the file.
+     * @param errorMsg Where to store an error message if the numbers cannot be loaded.
+     *
+     * @return true if the numbers were loaded and are correct, else false.
+     */
+    static bool loadRandoms(const std::string &filename, std::string &errorMsg);
+
+    /**
+     * Set the Polyglot random numbers.
+     *
+     * @param randoms The 781 random numbers.
+     * @param errorMsg Where to store an error message if the numbers are incorrect.
+     * @param validate If false the numbers are not checked against the published
+     * Polyglot keys.  Only books written and read by ChessCore will then work.
+     *
+     * @return true if the numbers were set, else false.
+     */
+    static bool setRandoms(const std::vector<uint64_t> &randoms, std::string &errorMsg, bool validate = true);
+
+    /**
+     * @return true if the Polyglot random numbers have been set.
+     */
+    static bool haveRandoms() {
+        return m_randoms.size() == NUM_RANDOMS;
+    }
+
+    /**
+     * Calculate the Polyglot key of a position.  The random numbers must have been set.
+     */
+    static uint64_t hashKey(const Position &pos);
+
+    /**
+     * Convert a move into Polyglot format.  Castling moves are encoded as the king
+     * capturing its own rook.
+     */
+    static uint16_t encodeMove(Move move);
+
+    /**
+     * Find the move of a position that matches a Polyglot move.
+     *
+     * @return true if the position has the move, else false.
+     */
+    static bool decodeMove(const Position &pos, uint16_t polyglotMove, Move &move);
+
+    /**
+     * Map a Polyglot book into memory.
+     *
+     * @param filename The name of the book.
+     *
+     * @return true if the book was mapped and looks valid, else false.
+     */
+    bool open(const std::string &filename);
+
+    /**
+     * Unmap the book.
+     */
+    void close();
+
+    bool isOpen() const {
+        return m_file.isOpen();
+    }
+
+    uint64_t numEntries() const {
+        return m_numEntries;
+    }
+
+    /**
+     * Find the entries for a Polyglot key.
+     *
+     * @param key The Polyglot key of the position.
+     * @param numEntries Where to store the number of entries found.
+     *
+     * @return The first entry for the position, or 0 if the position is not in the book.
+     */
+    const Entry *find(uint64_t key, unsigned &numEntries) const;
+
+    /**
+     * Get the book moves of a position, in the order they appear in the book.  Entries
+     * whose move is not possible in the position are ignored.
+     *
+     * @param pos The position.
+     * @param entries Where to store the moves.
+     *
+     * @return true if the position was probed, else false if the book is not open or
+     * the random numbers have not been set.
+     */
+    bool probe(const Position &pos, std::vector<PolyglotBookEntry> &entries) const;
+
+protected:
+    static bool validateRandoms(const std::vector<uint64_t> &randoms, std::string &errorMsg);
+    static uint64_t hashKey(const Position &pos, const std::vector<uint64_t> &randoms);
+
+private:
+    PolyglotBook(const PolyglotBook &other);
+    PolyglotBook &operator=(const PolyglotBook &other);
+};
+
+/**
+ * The PolyglotBookBuilder class creates a Polyglot book from the games of a database,
+ * reading each game once.  The number of games and the points scored by each move are
+ * tallied, with two points for a win and one for a draw or unfinished game, and the
+ * tallies are periodically sorted and merged so memory use depends on the number of
+ * distinct moves rather than the number of games.  The weight of a move is its points,
+ * scaled down if necessary to fit the book format; moves that scored nothing are left
+ * out.
+ */
+class CHESSCORE_EXPORT PolyglotBookBuilder {
+private:
+    static const char *m_classname;
+
+public:
+    struct Tally {
+        uint64_t key;
+        uint32_t numGames;
+        uint32_t points;
+        uint16_t move;
+    };
+
+    enum {
+        DEFAULT_COMPACT_SIZE = 1 << 20
+    };
+
+protected:
+    std::vector<Tally> m_tallies;
+    size_t m_numSorted;             // The leading tallies that are sorted and merged
+    size_t m_compactSize;           // Number of tallies that triggers compaction
+    unsigned m_numGames;
+    std::string m_errorMsg;
+
+public:
+    PolyglotBookBuilder();
+    virtual ~PolyglotBookBuilder();
+
+    const std::string &errorMsg() const {
+        return m_errorMsg;
+    }
+
+    /**
+     * Discard every tally.
+     */
+    void clear();
+
+    /**
+     * Get the number of games added.
+     */
+    unsigned numGames() const {
+        return m_numGames;
+    }
+
+    /**
+     * Tally the moves of a game.  Games that start from a set position are ignored.
+     * The Polyglot random numbers must have been set.
+     *
+     * @param game The game.
+     * @param depth The number of half-moves of the game to include.
+     *
+     * @return true if the game was added, else false.
+     */
+    bool addGame(const Game &game, unsigned depth);
+
+    /**
+     * Tally the moves of a range of database games.  Games that do not exist are
+     * ignored.
+     *
+     * @param db The database.
+     * @param firstGameNum The first game to add.
+     * @param lastGameNum The last game to add.
+     * @param depth The number of half-moves of each game to include.
+     * @param callback An optional callback function, used to provide feedback.
+     * @param contextInfo Context Info to pass to the callback function.
+     *
+     * @return true if the games were added, else false.
+     */
+    bool addGames(Database &db, unsigned firstGameNum, unsigned lastGameNum, unsigned depth,
+                  DATABASE_CALLBACK_FUNC callback, void *contextInfo);
+
+    /**
+     * Write the book.  The book is written under a temporary name and then renamed.
+     *
+     * @param filename The name of the book.
+     * @param minGames The number of games a move must have been played in to be
+     * included.
+     *
+     * @return true if the book was written, else false.
+     */
+    bool write(const std::string &filename, unsigned minGames = 1);
+
+protected:
+    void compact();
+};
+} // namespace ChessCore
@@ -320,6 +320,34 @@ public:
      */
     bool attacks(unsigned sq, bool stm, uint64_t removePiece = 0ULL) const;
 
+    /**
+     * Get the squares a piece of the side to move can move to, using attack lookups
+     * rather than move generation.  Pins and checks are ignored and castling only
+     * requires the castling right, so the squares are a superset of those of the
+     * legal moves of the piece.
+     *
+     * @param from The offset of the square of the piece.
+     *
+     * @return A bitboard of the target squares, or 0 if the square does not hold a piece
+     * of the side to move.
+     */
+    uint64_t moveTargets(Square from) const;
+
+    /**
+     * Build a move from its squares, setting the piece and flags from the position.
+     * The move must be one of moveTargets(), however it is not checked for legality and
+     * the check flags are only set when the move is made.
+     *
+     * @param from The offset of the from square.
+     * @param to The offset of the to square.
+     * @param prom The promotion piece, which is ignored unless a pawn reaches the last
+     * rank.
+     * @param move Where to store the move.
+     *
+     * @return true if the move was built, else false.
+     */
+    bool buildMove(Square from, Square to, Piece prom, Move &move) const;
+
     /**
      * Complete a move by setting the correct flags (including check and mate)
      * and generate the SAN.
@@ -436,6 +464,16 @@ public:
         colour = pieceColour(m_board[sq]);
     }
 
+    /**
+     * Get the bitboard of the pieces of a colour.
+     *
+     * @param col the colour of the pieces.
+     * @param pce the piece (if ALLPIECES then all pieces of the colour).
+     */
+    inline uint64_t pieces(Colour col, Piece pce) const {
+        return m_pieces[col][pce];
+    }
+
     /**
      * Count the number of pieces for a specified colour.
      *
@@ -0,0 +1,252 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// SearchIndex.h: SearchIndex class definition.
+//
+
+#pragma once
+
+#include <ChessCore/ChessCore.h>
+#include <ChessCore/Database.h>
+#include <ChessCore/MemoryMappedFile.h>
+#include <ChessCore/Util.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace ChessCore {
+/**
+ * The SearchIndex class is a column store of game header fields, used to search and
+ * sort databases without going through their own query engine.  It is held in a
+ * single file which is memory-mapped while in use:
+ *
+ * Header:       magic, number of games, number of strings, generation, number of
+ *               trigrams, reserved (uint32_t each).
+ * Columns:      NUM_COLUMNS arrays of number-of-games uint32_t values.
+ * String table: number-of-strings + 1 uint32_t offsets into the string data.
+ * Trigrams:     number-of-trigrams uint32_t trigrams, in ascending order.
+ * Posting list: number-of-trigrams + 1 uint32_t offsets into the postings.
+ * Postings:     For each trigram, the IDs of the strings that contain it (uint32_t
+ *               each, in ascending order).
+ * String data:  The strings, without terminators.
+ * Folded data:  The strings in upper case, at the same offsets.
+ *
+ * Strings (player last names, event, site and ECO) are dictionary-encoded and the
+ * dictionary is sorted, so comparing string IDs is equivalent to comparing the
+ * strings themselves and case-sensitive equals and starts-with searches are a range of
+ * the dictionary.  The trigrams (three consecutive characters) of the upper case
+ * strings narrow down the strings that need comparing in the other searches.  The
+ * generation is set by the database and allows it to detect an out-of-date index.
+ * All values are little-endian.
+ */
+class CHESSCORE_EXPORT SearchIndex {
+private:
+    static const char *m_classname;
+
+public:
+    enum Column {
+        COLUMN_WHITE,       // String ID of the white player's last name
+        COLUMN_BLACK,       // String ID of the black player's last name
+        COLUMN_EVENT,       // String ID
+        COLUMN_SITE,        // String ID
+        COLUMN_ECO,         // String ID
+        COLUMN_DATE,        // YYYYMMDD (unknown parts are 0)
+        COLUMN_ROUND,       // (major << 16) | minor
+        COLUMN_RESULT,      // Game::Result, or NO_GAME if the game number is not used
+        NUM_COLUMNS
+    };
+
+    enum {
+        NO_GAME = 0xffffffff
+    };
+
+protected:
+    MemoryMappedFile m_file;
+    unsigned m_numGames;
+    unsigned m_numStrings;
+    unsigned m_generation;
+    unsigned m_numTrigrams;
+    const uint32_t *m_columns[NUM_COLUMNS];
+    const uint32_t *m_stringOffsets;
+    const uint32_t *m_trigrams;
+    const uint32_t *m_postingOffsets;
+    const uint32_t *m_postings;
+    const char *m_stringData;
+    const char *m_foldedData;
+
+public:
+    SearchIndex();
+    virtual ~SearchIndex();
+
+    /**
+     * Build a search index file from the game headers of a database.  The file is
+     * written under a temporary name and then renamed, so any process that has the
+     * old file mapped is unaffected.
+     *
+     * @param filename The name of the search index file.
+     * @param database The database to index.  It must be open and, if it needs
+     * indexing, indexed.
+     * @param callback An optional callback function, used to provide feedback
+     * of the build process.
+     * @param contextInfo Context Info to pass to the callback function.
+     * @param errorMsg Where to store any error message.
+     *
+     * @return true if the search index was built successfully, else false.
+     */
+    static bool build(const std::string &filename, Database &database, DATABASE_CALLBACK_FUNC callback,
+                      void *contextInfo, std::string &errorMsg);
+
+    /**
+     * Map a search index file into memory.
+     *
+     * @param filename The name of the search index file.
+     * @param numGames The number of games the search index is expected to contain.
+     * @param generation The generation the search index is expected to have.
+     *
+     * @return true if the file was mapped and is valid, else false.
+     */
+    bool open(const std::string &filename, unsigned numGames, unsigned generation = 0);
+
+    /**
+     * Unmap the search index file.
+     */
+    void close();
+
+    bool isOpen() const {
+        return m_file.isOpen();
+    }
+
+    unsigned numGames() const {
+        return m_numGames;
+    }
+
+    unsigned numStrings() const {
+        return m_numStrings;
+    }
+
+    unsigned generation() const {
+        return m_generation;
+    }
+
+    /**
+     * Get a column value.
+     *
+     * @param column The column.
+     * @param gameNum The game number, starting at 1.
+     *
+     * @return The column value.
+     */
+    uint32_t value(Column column, unsigned gameNum) const {
+        return le32(m_columns[column][gameNum - 1]);
+    }
+
+    /**
+     * Get a string from the dictionary.
+     *
+     * @param stringId The string ID, as held in one of the string columns.
+     *
+     * @return The string.
+     */
+    std::string stringValue(uint32_t stringId) const;
+
+    /**
+     * Search the index, returning the matching game numbers in the specified order.
+     * See Database::search() for a description of the search and sort criteria.
+     *
+     * @param searchCriteria The fields to search.
+     * @param sortCriteria The order in which results should be returned.
+     * @param gameList Where to store the matching game numbers.
+     * @param errorMsg Where to store any error message.
+     *
+     * @return true if the search was successful, else false.
+     */
+    bool search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                DatabaseGameList &gameList, std::string &errorMsg) const;
+
+protected:
+    void matchStrings(DatabaseComparison comparison, const std::string &value, std::vector<uint8_t> &matches) const;
+    bool stringMatches(const char *data, uint32_t stringId, DatabaseComparison compare,
+                       const std::string &target) const;
+    uint32_t lowerBound(const std::string &target) const;
+    bool trigramCandidates(const std::string &folded, const uint32_t *&first, const uint32_t *&last) const;
+
+private:
+    SearchIndex(const SearchIndex &other);
+    SearchIndex &operator=(const SearchIndex &other);
+};
+
+/**
+ * The SearchIndexBuilder class collects the game header fields of a database and
+ * writes them as a search index file.  Games must be added in ascending game number
+ * order; game numbers that are skipped are marked as unused.
+ */
+class CHESSCORE_EXPORT SearchIndexBuilder {
+private:
+    static const char *m_classname;
+
+protected:
+    std::unordered_map<std::string, uint32_t> m_ids;
+    std::vector<const std::string *> m_strings;     // Owned by m_ids
+    std::vector<uint32_t> m_columns[SearchIndex::NUM_COLUMNS];
+
+public:
+    SearchIndexBuilder();
+    virtual ~SearchIndexBuilder();
+
+    /**
+     * Reserve space for the specified number of games.
+     */
+    void reserve(unsigned numGames);
+
+    /**
+     * Get the number of games added, including unused game numbers.
+     */
+    unsigned numGames() const {
+        return (unsigned)m_columns[0].size();
+    }
+
+    /**
+     * Add the header fields of a game.
+     */
+    void add(unsigned gameNum, const GameHeader &gameHeader);
+
+    /**
+     * Add the header fields of a game.
+     *
+     * @param gameNum The game number, starting at 1.
+     * @param white The white player's last name.
+     * @param black The black player's last name.
+     * @param event The event.
+     * @param site The site.
+     * @param eco The ECO code.
+     * @param date The date, as YYYYMMDD.
+     * @param roundMajor The major round number.
+     * @param roundMinor The minor round number.
+     * @param result The Game::Result.
+     */
+    void add(unsigned gameNum, const std::string &white, const std::string &black, const std::string &event,
+             const std::string &site, const std::string &eco, uint32_t date, unsigned roundMajor,
+             unsigned roundMinor, uint32_t result);
+
+    /**
+     * Write the search index file.  The file is written under a temporary name and
+     * then renamed, so any process that has the old file mapped is unaffected.
+     *
+     * @param filename The name of the search index file.
+     * @param generation The generation to store in the file.
+     * @param errorMsg Where to store any error message.
+     *
+     * @return true if the file was written successfully, else false.
+     */
+    bool write(const std::string &filename, unsigned generation, std::string &errorMsg);
+
+protected:
+    uint32_t addString(const std::string &str);
+    void addRow(uint32_t white, uint32_t black, uint32_t event, uint32_t site, uint32_t eco, uint32_t date,
+                uint32_t round, uint32_t result);
+
+private:
+    SearchIndexBuilder(const SearchIndexBuilder &other);
+    SearchIndexBuilder &operator=(const SearchIndexBuilder &other);
+};
+}   // namespace ChessCore
@@ -123,12 +123,14 @@ protected:
 public:
     TimeControl();
     TimeControl(const TimeControl &other);
+    TimeControl(TimeControl &&other);
     TimeControl(const std::vector<TimeControlPeriod> &periods);
     TimeControl(const std::string &notation,
                 TimeControlPeriod::Format format = TimeControlPeriod::FORMAT_UNKNOWN);
     TimeControl(const Blob &blob);
 
     TimeControl &operator=(const TimeControl &other);
+    TimeControl &operator=(TimeControl &&other);
     bool operator==(const TimeControl &other) const;
 
 	std::vector<TimeControlPeriod> &periods();
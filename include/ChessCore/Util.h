@@ -194,6 +194,13 @@ public:
      */
     static unsigned getTickCount();
 
+    /**
+     * Get the number of processors available.
+     *
+     * @return The number of online processors (at least 1).
+     */
+    static unsigned numProcessors();
+
     /**
      * Get the current time.
      *
@@ -472,7 +479,7 @@ public:
     static bool deleteFile(const std::string &filename);
 
     /**
-     * Rename a file.
+     * Rename a file, replacing any file that already has the new name.
      *
      * @param oldFilename The name of the file to move.
      * @param newFilename The new name of the file.
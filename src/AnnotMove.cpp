@@ -5,6 +5,7 @@
 //
 
 #include <ChessCore/AnnotMove.h>
+#include <ChessCore/AnnotMovePool.h>
 #include <ChessCore/Position.h>
 #include <ChessCore/Log.h>
 #include <string.h>
@@ -98,6 +99,22 @@ AnnotMove::~AnnotMove() {
     clearPriorPosition();
 }
 
+void *AnnotMove::operator new(size_t size) {
+    return AnnotMovePool::allocate(0, size);
+}
+
+void *AnnotMove::operator new(size_t size, AnnotMovePool *pool) {
+    return AnnotMovePool::allocate(pool, size);
+}
+
+void AnnotMove::operator delete(void *p) {
+    AnnotMovePool::deallocate(p);
+}
+
+void AnnotMove::operator delete(void *p, AnnotMovePool * /*pool*/) {
+    AnnotMovePool::deallocate(p);
+}
+
 void AnnotMove::deepDelete(AnnotMove *amove) {
     if (amove == 0)
         return;
@@ -107,11 +124,11 @@ void AnnotMove::deepDelete(AnnotMove *amove) {
     delete amove;
 }
 
-AnnotMove *AnnotMove::deepCopy(const AnnotMove *amove) {
+AnnotMove *AnnotMove::deepCopy(const AnnotMove *amove, AnnotMovePool *pool /*=0*/) {
     AnnotMove *first = 0;
 
     while (amove) {
-        AnnotMove *newMove = new AnnotMove(amove);
+        AnnotMove *newMove = new (pool) AnnotMove(amove);
 
         if (first == 0)
             first = newMove;
@@ -119,7 +136,7 @@ AnnotMove *AnnotMove::deepCopy(const AnnotMove *amove) {
             first->addMove(newMove);
 
         if (amove->m_variation) {
-            AnnotMove *newVar = AnnotMove::deepCopy(amove->m_variation);
+            AnnotMove *newVar = AnnotMove::deepCopy(amove->m_variation, pool);
             newMove->m_variation = newVar;
             newVar->m_mainline = newMove;
         }
@@ -629,14 +646,15 @@ void AnnotMove::count(const AnnotMove *amove, unsigned &moveCount, unsigned &var
     }
 }
 
-unsigned AnnotMove::countRepeatedPositions(const AnnotMove *amove) {
+unsigned AnnotMove::countRepeatedPositions(const AnnotMove *amove, unsigned maxPlies) {
     unsigned count = 0;
     uint64_t hash = amove->posHash();
 
     ASSERT(hash);
 
-    while (amove) {
-        if (amove->posHash() == hash)
+    // A position can only recur with the same side to move, so every other ply
+    for (unsigned plies = 0; amove && plies <= maxPlies; plies++) {
+        if ((plies & 1) == 0 && amove->posHash() == hash)
             count++;
 
         while (amove->mainline())
@@ -0,0 +1,100 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// AnnotMovePool.cpp: AnnotMovePool class implementation.
+//
+
+#include <ChessCore/AnnotMovePool.h>
+#include <ChessCore/AnnotMove.h>
+#include <ChessCore/Log.h>
+#include <new>
+
+using namespace std;
+
+namespace ChessCore {
+// Precedes every AnnotMove; the union keeps the move 8-byte aligned on 32-bit systems
+union NodeHeader {
+    AnnotMovePool *pool;        // 0 if allocated from the heap
+    uint64_t align;
+};
+
+static const size_t NODE_SIZE = (sizeof(NodeHeader) + sizeof(AnnotMove) + 7) & ~(size_t)7;
+
+const char *AnnotMovePool::m_classname = "AnnotMovePool";
+
+AnnotMovePool::AnnotMovePool() :
+    m_blocks(),
+    m_freeList(0),
+    m_numAllocated(0),
+    m_released(false)
+{
+}
+
+AnnotMovePool::~AnnotMovePool() {
+    for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it)
+        ::operator delete(*it);
+}
+
+void *AnnotMovePool::allocate(AnnotMovePool *pool, size_t size) {
+    NodeHeader *header;
+
+    if (pool && sizeof(NodeHeader) + size <= NODE_SIZE) {
+        header = (NodeHeader *)pool->allocateNode();
+        header->pool = pool;
+    } else {
+        header = (NodeHeader *)::operator new(sizeof(NodeHeader) + size);
+        header->pool = 0;
+    }
+
+    return header + 1;
+}
+
+void AnnotMovePool::deallocate(void *p) {
+    if (p == 0)
+        return;
+
+    NodeHeader *header = (NodeHeader *)p - 1;
+
+    if (header->pool)
+        header->pool->freeNode(header);
+    else
+        ::operator delete(header);
+}
+
+void AnnotMovePool::release() {
+    ASSERT(!m_released);
+    m_released = true;
+
+    if (m_numAllocated == 0)
+        delete this;
+}
+
+void *AnnotMovePool::allocateNode() {
+    if (m_freeList == 0) {
+        uint8_t *block = (uint8_t *)::operator new(NODES_PER_BLOCK * NODE_SIZE);
+        m_blocks.push_back(block);
+
+        // Link the nodes in order, so they are handed out in memory order
+        for (unsigned i = NODES_PER_BLOCK; i > 0; i--) {
+            void *node = block + ((i - 1) * NODE_SIZE);
+            *(void **)node = m_freeList;
+            m_freeList = node;
+        }
+    }
+
+    void *node = m_freeList;
+    m_freeList = *(void **)node;
+    m_numAllocated++;
+    return node;
+}
+
+void AnnotMovePool::freeNode(void *node) {
+    ASSERT(m_numAllocated > 0);
+
+    *(void **)node = m_freeList;
+    m_freeList = node;
+
+    if (--m_numAllocated == 0 && m_released)
+        delete this;
+}
+} // namespace ChessCore
@@ -13,129 +13,181 @@ using namespace std;
 namespace ChessCore {
 const char *Bitstream::m_classname = "Bitstream";
 
+// Load 8 bytes as a big-endian word
+static inline uint64_t loadWord(const uint8_t *data) {
+    return ((uint64_t)data[0] << 56) | ((uint64_t)data[1] << 48) | ((uint64_t)data[2] << 40) |
+           ((uint64_t)data[3] << 32) | ((uint64_t)data[4] << 24) | ((uint64_t)data[5] << 16) |
+           ((uint64_t)data[6] << 8) | (uint64_t)data[7];
+}
+
 Bitstream::Bitstream(Blob &blob) :
     m_blob(blob),
     m_readOnly(false),
-    m_readOffset(0),
-    m_readBit(7),
-    m_writeOffset(0),
-    m_writeBit(7)
+    m_readPos(0),
+    m_readBuffer(0),
+    m_readBufferBits(0),
+    m_writePos(0),
+    m_writeBuffer(0),
+    m_writeBufferBits(0)
 {
 }
 
 Bitstream::Bitstream(const Blob &blob) :
     m_blob(const_cast<Blob &> (blob)),
     m_readOnly(true),
-    m_readOffset(0),
-    m_readBit(7),
-    m_writeOffset(0),
-    m_writeBit(7)
+    m_readPos(0),
+    m_readBuffer(0),
+    m_readBufferBits(0),
+    m_writePos(0),
+    m_writeBuffer(0),
+    m_writeBufferBits(0)
 {
 }
 
 Bitstream::~Bitstream() {
+    if (m_writeBufferBits > 0)
+        flush();
 }
 
-bool Bitstream::read(uint32_t &value, unsigned numBits) {
-#define READ_BYTE() \
-    if (m_readOffset >= m_blob.length()) { \
-        logerr("No more data at offset %u (blob length=%u)", m_readOffset, m_blob.length()); \
-        return false; \
-    } \
-    byte = *(m_blob.data() + m_readOffset)
+void Bitstream::reset() {
+    if (m_writeBufferBits > 0)
+        flush();
 
-    value = 0;
-    uint8_t byte;
+    m_readPos = 0;
+    m_readBuffer = 0;
+    m_readBufferBits = 0;
+    m_writePos = 0;
+    m_writeBuffer = 0;
+    m_writeBufferBits = 0;
+}
 
-    READ_BYTE();
+bool Bitstream::read(uint32_t &value, unsigned numBits) {
+    ASSERT(numBits <= 32);
 
-    while (numBits > 0) {
-        value <<= 1;
-        value |= (byte >> m_readBit) & 1;
+    value = 0;
 
-        if (m_readBit == 0) {
-            m_readBit = 7;
-            m_readOffset++;
+    if (numBits == 0)
+        return true;
 
-            if (numBits > 1) {
-                READ_BYTE();
-            }
-        } else {
-            m_readBit--;
-        }
+    if (m_readBufferBits < numBits && !refill(numBits))
+        return false;
 
-        numBits--;
-    }
+    value = (uint32_t)(m_readBuffer >> (64 - numBits));
+    m_readBuffer <<= numBits;
+    m_readBufferBits -= numBits;
+    m_readPos += numBits;
 
     return true;
-
-#undef READ_BYTE
 }
 
 bool Bitstream::write(uint32_t value, unsigned numBits) {
-#define READ_BYTE() \
-    if (m_writeOffset >= m_blob.allocatedLength()) { \
-        logerr("No more data at offset %u (blob length=%u)", m_writeOffset, m_blob.allocatedLength()); \
-        return false; \
-    } \
-    byte = *(m_blob.data() + m_writeOffset)
-
-#define WRITE_BYTE() \
-    if (m_writeOffset >= m_blob.allocatedLength()) { \
-        logerr("No more space at offset %u (blob length=%u)", m_writeOffset, m_blob.allocatedLength()); \
-        return false; \
-    } \
-    *(m_blob.data() + m_writeOffset) = byte
-
     if (m_readOnly) {
         LOGERR << "Cannot write to a read-only bitstream";
         return false;
     }
 
-    unsigned newBitLength = (m_writeOffset * 8) + (7 - m_writeBit) + numBits;
-    unsigned newLength = (newBitLength / 8) + ((newBitLength & 7) == 0 ? 0 : 1);
+    ASSERT(numBits <= 32);
 
-    if (newLength > m_blob.allocatedLength()) {
-        if (!m_blob.reserve(newLength)) {
-            LOGERR << "Failed to reserve " << newLength << " bytes in blob";
-            return false;
-        }
+    if (numBits == 0)
+        return true;
+
+    if (numBits < 32)
+        value &= (1U << numBits) - 1;
+
+    // The buffer holds fewer than 32 bits, so there is always room for the value
+    m_writeBuffer = (m_writeBuffer << numBits) | value;
+    m_writeBufferBits += numBits;
+    m_writePos += numBits;
+
+    // Anything read-ahead may now be out-of-date
+    m_readBufferBits = 0;
+
+    if (m_writeBufferBits >= 32) {
+        m_writeBufferBits -= 32;
+        return store((m_writePos - m_writeBufferBits - 32) >> 3, (uint32_t)(m_writeBuffer >> m_writeBufferBits), 4);
     }
 
-    // As we aren't using Blob::add() to add the bytes, explicitly set the length
-    // of the blob ourselves
-    if (newLength > m_blob.length())
-        m_blob.setLength(newLength);
+    return true;
+}
+
+bool Bitstream::flush() {
+    if (m_writeBufferBits == 0)
+        return true;
 
-    uint8_t byte;
-    bool needsFlush = false;
+    // The buffer starts on a byte boundary and holds fewer than 32 bits
+    unsigned offset = (m_writePos - m_writeBufferBits) >> 3;
+    unsigned numBytes = (m_writeBufferBits + 7) >> 3;
 
-    READ_BYTE();
+    if (!store(offset, (uint32_t)(m_writeBuffer << (32 - m_writeBufferBits)), numBytes))
+        return false;
 
-    while (numBits > 0) {
-        byte |= ((value >> (numBits - 1)) & 1) << m_writeBit;
-        needsFlush = true;
+    // Keep the bits of a partly-written byte, which later writes add to
+    m_writeBufferBits &= 7;
+    m_readBufferBits = 0;
 
-        if (m_writeBit == 0) {
-            WRITE_BYTE();
-            byte = 0;
-            m_writeOffset++;
-            m_writeBit = 7;
-            needsFlush = false;
-        } else {
-            m_writeBit--;
+    return true;
+}
+
+bool Bitstream::refill(unsigned numBits) {
+    // Buffered writes must be in the blob before they can be read
+    if (m_writeBufferBits > 0 && !flush())
+        return false;
+
+    const uint8_t *data = m_blob.data();
+    unsigned length = m_blob.length();
+    unsigned offset = (m_readPos + m_readBufferBits) >> 3;
+
+    if (m_readBufferBits == 0) {
+        unsigned skip = m_readPos & 7;
+
+        m_readBuffer = 0;
+
+        // Take the rest of a partly-read byte, so the buffer ends on a byte boundary
+        if (skip > 0 && offset < length) {
+            m_readBuffer = (uint64_t)(uint8_t)(data[offset] << skip) << 56;
+            m_readBufferBits = 8 - skip;
+            offset++;
         }
+    }
 
-        numBits--;
+    if (offset + 8 <= length) {
+        // Take as many whole bytes of the word as will fit
+        m_readBuffer |= loadWord(data + offset) >> m_readBufferBits;
+        m_readBufferBits += (64 - m_readBufferBits) & ~7U;
+        m_readBuffer &= ~0ULL << (64 - m_readBufferBits);
+    } else {
+        while (m_readBufferBits <= 56 && offset < length) {
+            m_readBuffer |= (uint64_t)data[offset++] << (56 - m_readBufferBits);
+            m_readBufferBits += 8;
+        }
     }
 
-    if (needsFlush) {
-        WRITE_BYTE();
+    if (m_readBufferBits < numBits) {
+        logerr("No more data at offset %u (blob length=%u)", offset, length);
+        return false;
     }
 
     return true;
+}
 
-#undef READ_BYTE
-#undef WRITE_BYTE
+bool Bitstream::store(unsigned offset, uint32_t word, unsigned numBytes) {
+    unsigned newLength = offset + numBytes;
+
+    if (newLength > m_blob.allocatedLength() && !m_blob.reserve(newLength)) {
+        LOGERR << "Failed to reserve " << newLength << " bytes in blob";
+        return false;
+    }
+
+    uint8_t *data = m_blob.data() + offset;
+
+    for (unsigned i = 0; i < numBytes; i++)
+        data[i] = (uint8_t)(word >> (24 - (i * 8)));
+
+    // As we aren't using Blob::add() to add the bytes, explicitly set the length
+    // of the blob ourselves
+    if (newLength > m_blob.length())
+        m_blob.setLength(newLength);
+
+    return true;
 }
 }   // namespace ChessCore
@@ -11,6 +11,7 @@
 #include <iomanip>
 #include <sstream>
 #include <new>
+#include <utility>
 #include <ChessCore/Blob.h>
 #include <ChessCore/Util.h>
 #include <ChessCore/Log.h>
@@ -36,6 +37,40 @@ Blob::Blob(uint8_t *data, unsigned length) :
 {
 }
 
+Blob::Blob(Blob &&other) :
+    m_data(0),
+    m_length(0),
+    m_allocatedLength(0),
+    m_ownsMemory(false)
+{
+    *this = std::move(other);
+}
+
+Blob &Blob::operator=(Blob &&other) {
+    if (this == &other)
+        return *this;
+
+    free();
+
+    if (other.isInline()) {
+        ::memcpy(m_inline, other.m_inline, other.m_length);
+        m_data = m_inline;
+    } else {
+        m_data = other.m_data;
+    }
+
+    m_length = other.m_length;
+    m_allocatedLength = other.m_allocatedLength;
+    m_ownsMemory = other.m_ownsMemory;
+
+    other.m_data = 0;
+    other.m_length = 0;
+    other.m_allocatedLength = 0;
+    other.m_ownsMemory = false;
+
+    return *this;
+}
+
 Blob::~Blob() {
     free();
 }
@@ -46,65 +81,37 @@ bool Blob::reserve(unsigned length) {
         return true;    // Ignore
     }
 
-    if (!m_data) {
-        ASSERT(!m_length);
-        ASSERT(!m_allocatedLength);
-        m_data = (uint8_t *)::malloc(length);
-
-        if (m_data == 0) {
-            LOGERR << "Failed to allocate " << length << " bytes of memory";
-            return false;
-        }
-
-        memset(m_data, 0, length);
-        m_allocatedLength = length;
-        m_ownsMemory = true;
-        LOGVERBOSE << "Reserved " << m_allocatedLength << " bytes";
-    } else {
-        if (!ownsMemory()) {
-            LOGERR << "Cannot reserve more as the blob does not own the memory";
-            return false;
-        }
-
-        if (length < m_allocatedLength) {
-            LOGERR << "Reserve length (" << length <<
-                ") is smaller than length already allocated (" << m_allocatedLength;
-            return false;
-        }
-
-        m_data = (uint8_t *)::realloc(m_data, length);
-        if (!m_data) {
-            LOGERR << "Failed to reallocate " << length << " bytes of memory";
-            return false;
-        }
-
-        memset(m_data + m_allocatedLength, 0, length - m_allocatedLength);
-        m_allocatedLength = length;
-        LOGVERBOSE << "Reserved " << length << " bytes";
+    if (m_data && !ownsMemory()) {
+        LOGERR << "Cannot reserve more as the blob does not own the memory";
+        return false;
     }
 
-    return true;
+    if (length <= m_allocatedLength)
+        return true;
+
+    return grow(length);
 }
 
 bool Blob::set(const uint8_t *data, unsigned length, bool copy /*=true*/) {
-    free();
-
-    if (!data || !length)
+    if (!data || !length) {
+        free();
         return true; // That's OK
+    }
 
     if (copy) {
-        m_data = (uint8_t *)::malloc(length);
-        if (!m_data) {
-            LOGERR << "Failed to allocate " << length << " bytes of memory";
-            return false;
+        // Reuse the memory already owned, if it's big enough
+        if (!m_ownsMemory || length > m_allocatedLength) {
+            free();
+
+            if (!grow(length))
+                return false;
         }
 
         ::memcpy(m_data, data, length);
         m_length = length;
-        m_allocatedLength = length;
-        m_ownsMemory = true;
-        LOGVERBOSE << "Copied " << m_allocatedLength << " bytes";
+        LOGVERBOSE << "Copied " << m_length << " bytes";
     } else {
+        free();
         m_data = const_cast<uint8_t *> (data);
         m_length = length;
         m_allocatedLength = length;
@@ -115,47 +122,22 @@ bool Blob::set(const uint8_t *data, unsigned length, bool copy /*=true*/) {
 }
 
 bool Blob::add(const uint8_t *data, unsigned length) {
-    if (!m_data) {
-        ASSERT(!m_length);
-        ASSERT(!m_allocatedLength);
-        m_data = (uint8_t *)::malloc(length);
-        if (!m_data) {
-            LOGERR << "Failed to allocate " << length << " bytes of memory";
-            return false;
-        }
-
-        ::memcpy(m_data, data, length);
-        m_length = length;
-        m_allocatedLength = length;
-        m_ownsMemory = true;
-    } else {
-        if (!m_ownsMemory) {
-            LOGERR << "Cannot add data as the blob does not own the memory";
-            return false;
-        }
+    if (m_data && !m_ownsMemory) {
+        LOGERR << "Cannot add data as the blob does not own the memory";
+        return false;
+    }
 
-        ASSERT(m_ownsMemory);
+    if (m_length + length > m_allocatedLength && !grow(m_length + length))
+        return false;
 
-        if (m_length + length > m_allocatedLength) {
-            m_data = (uint8_t *)::realloc(m_data, m_length + length);
-            if (!m_data) {
-                LOGERR << "Failed to reallocate " << (m_length + length) << " bytes of memory";
-                return false;
-            }
-
-            LOGVERBOSE << "Allocated an extra " << (m_length + length) - m_allocatedLength << " bytes";
-            m_allocatedLength = m_length + length;
-        }
-
-        ::memcpy(m_data + m_length, data, length);
-        m_length += length;
-    }
+    ::memcpy(m_data + m_length, data, length);
+    m_length += length;
 
     return true;
 }
 
 void Blob::free() {
-    if (m_ownsMemory && m_data && m_allocatedLength)
+    if (m_ownsMemory && m_data && !isInline())
         ::free(m_data);
 
     m_data = 0;
@@ -164,6 +146,57 @@ void Blob::free() {
     m_ownsMemory = false;
 }
 
+void Blob::clear() {
+    if (m_ownsMemory)
+        m_length = 0;
+    else
+        free();
+}
+
+bool Blob::grow(unsigned length) {
+    ASSERT(!m_data || m_ownsMemory);
+    ASSERT(length > m_allocatedLength);
+
+    if (!m_data && length <= INLINE_LENGTH) {
+        m_data = m_inline;
+        m_allocatedLength = INLINE_LENGTH;
+        m_ownsMemory = true;
+        memset(m_data, 0, INLINE_LENGTH);
+        return true;
+    }
+
+    // Grow geometrically, so adding data a little at a time is linear overall
+    unsigned newLength = m_allocatedLength * 2;
+
+    if (newLength < length)
+        newLength = length;
+
+    uint8_t *data;
+
+    if (!m_data || isInline()) {
+        data = (uint8_t *)::malloc(newLength);
+
+        if (data && m_data)
+            ::memcpy(data, m_data, m_allocatedLength);
+    } else {
+        data = (uint8_t *)::realloc(m_data, newLength);
+    }
+
+    if (!data) {
+        LOGERR << "Failed to allocate " << newLength << " bytes of memory";
+        return false;
+    }
+
+    memset(data + m_allocatedLength, 0, newLength - m_allocatedLength);
+    LOGVERBOSE << "Allocated " << newLength << " bytes";
+
+    m_data = data;
+    m_allocatedLength = newLength;
+    m_ownsMemory = true;
+
+    return true;
+}
+
 void Blob::toString(string &dest) const {
     stringstream oss;
 
@@ -122,6 +122,8 @@ CbhDatabase::~CbhDatabase() {
 }
 
 bool CbhDatabase::open(const string &filename, bool readOnly) {
+    MutexLock lock(m_readersMutex);
+
     clearErrorMsg();
 
     if (!Util::fileExists(filename)) {
@@ -238,6 +240,9 @@ bool CbhDatabase::open(const string &filename, bool readOnly) {
 }
 
 bool CbhDatabase::close() {
+    MutexLock lock(m_readersMutex);
+
+    closeReaders();
     m_cbhFile.close();
     m_cbgFile.close();
     m_cbaFile.close();
@@ -297,6 +302,20 @@ bool CbhDatabase::write(unsigned gameNum, const Game &game) {
     return false;
 }
 
+shared_ptr<Database> CbhDatabase::openReader() {
+    if (!m_isOpen)
+        return shared_ptr<Database>();
+
+    shared_ptr<CbhDatabase> reader(new CbhDatabase());
+
+    if (!reader->open(m_filename, true)) {
+        LOGWRN << "Failed to open reader for '" << m_filename << "': " << reader->errorMsg();
+        return shared_ptr<Database>();
+    }
+
+    return reader;
+}
+
 unsigned CbhDatabase::numGames() {
     return m_numGames;
 }
@@ -10,16 +10,17 @@
 #include <ChessCore/CfdbDatabase.h>
 #include <ChessCore/SqliteStatement.h>
 #include <ChessCore/OpeningTree.h>
+#include <ChessCore/OpeningTreeBuilder.h>
 #include <ChessCore/Log.h>
 #include <stdio.h>
 #include <string.h>
 #include <iomanip>
+#include <algorithm>
 #include <set>
 
 using namespace std;
 
 namespace ChessCore {
-// Constants used by encoded moves
 
 // Database Factory
 static shared_ptr<Database> databaseFactory(const string &dburl, bool readOnly) {
@@ -32,6 +33,175 @@ static shared_ptr<Database> databaseFactory(const string &dburl, bool readOnly)
 
 static bool registered = Database::registerFactory(databaseFactory);
 
+// Used to return opening tree statistics with the most played move first
+static bool moreGamesPlayed(const OpeningTreeStats &a, const OpeningTreeStats &b) {
+    if (a.numGames() != b.numGames())
+        return a.numGames() > b.numGames();
+    return a.move().intValue() < b.move().intValue();
+}
+
+// Used to return opening tree entries in game order
+static bool gameNumLess(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    return a.gameNum() < b.gameNum();
+}
+
+// Used to return the moves from a position in the order the opening tree file does
+static bool childLess(const OpeningTreeEdge &a, const OpeningTreeEdge &b) {
+    if (a.move().intValue() != b.move().intValue())
+        return a.move().intValue() < b.move().intValue();
+    return a.toHashKey() < b.toHashKey();
+}
+
+// Used to return the moves into a position in the order the opening tree file does
+static bool parentLess(const OpeningTreeEdge &a, const OpeningTreeEdge &b) {
+    if (a.move().intValue() != b.move().intValue())
+        return a.move().intValue() < b.move().intValue();
+    return a.fromHashKey() < b.fromHashKey();
+}
+
+//
+// Apply the changes made to the optree table since the opening tree file was written
+// to what the file returned from index first onwards.
+//
+static void mergeEntryDelta(vector<OpeningTreeEntry> &entries, size_t first, bool lastMoveOnly,
+                            const vector<OpeningTreeEntry> &added, const vector<OpeningTreeEntry> &removed) {
+    for (auto it = removed.begin(); it != removed.end(); ++it) {
+        for (auto entry = entries.begin() + first; entry != entries.end(); ++entry) {
+            if (entry->gameNum() == it->gameNum() &&
+                entry->move().intValue() == it->move().intValue() &&
+                entry->score() == it->score() &&
+                entry->lastMove() == it->lastMove()) {
+                entries.erase(entry);
+                break;
+            }
+        }
+    }
+
+    for (auto it = added.begin(); it != added.end(); ++it) {
+        if (!lastMoveOnly || it->lastMove()) {
+            entries.push_back(*it);
+            entries.back().setPrevHashKey(0ULL);
+        }
+    }
+
+    stable_sort(entries.begin() + first, entries.end(), gameNumLess);
+}
+
+static void adjustStats(OpeningTreeStats &stats, int score, int change) {
+    stats.setNumGames(stats.numGames() + change);
+
+    if (score > 0)
+        stats.setWhiteWins(stats.whiteWins() + change);
+    else if (score < 0)
+        stats.setBlackWins(stats.blackWins() + change);
+    else
+        stats.setDraws(stats.draws() + change);
+}
+
+static void mergeStatsDelta(vector<OpeningTreeStats> &stats, size_t first, uint64_t hashKey, unsigned maxSampleGames,
+                            const vector<OpeningTreeEntry> &added, const vector<OpeningTreeEntry> &removed) {
+    vector<OpeningTreeStats>::iterator moveStats;
+
+    for (auto it = removed.begin(); it != removed.end(); ++it) {
+        for (moveStats = stats.begin() + first; moveStats != stats.end(); ++moveStats)
+            if (moveStats->move().intValue() == it->move().intValue())
+                break;
+
+        if (moveStats == stats.end() || moveStats->numGames() == 0)
+            continue;
+
+        adjustStats(*moveStats, it->score(), -1);
+
+        vector<unsigned> &samples = moveStats->sampleGames();
+        auto sample = find(samples.begin(), samples.end(), it->gameNum());
+
+        if (sample != samples.end())
+            samples.erase(sample);
+    }
+
+    for (auto it = added.begin(); it != added.end(); ++it) {
+        for (moveStats = stats.begin() + first; moveStats != stats.end(); ++moveStats)
+            if (moveStats->move().intValue() == it->move().intValue())
+                break;
+
+        if (moveStats == stats.end()) {
+            stats.push_back(OpeningTreeStats());
+            moveStats = stats.end() - 1;
+            moveStats->setHashKey(hashKey);
+            moveStats->setMove(it->move());
+        }
+
+        adjustStats(*moveStats, it->score(), +1);
+        moveStats->sampleGames().push_back(it->gameNum());
+    }
+
+    for (moveStats = stats.begin() + first; moveStats != stats.end();) {
+        if (moveStats->numGames() == 0) {
+            moveStats = stats.erase(moveStats);
+            continue;
+        }
+
+        vector<unsigned> &samples = moveStats->sampleGames();
+        sort(samples.begin(), samples.end());
+
+        if (samples.size() > maxSampleGames)
+            samples.resize(maxSampleGames);
+
+        ++moveStats;
+    }
+}
+
+static void adjustEdges(vector<OpeningTreeEdge> &edges, size_t first, const OpeningTreeEntry &entry, int change) {
+    // The file has no edge for an entry without a previous position
+    if (entry.prevHashKey() == 0ULL)
+        return;
+
+    for (auto edge = edges.begin() + first; edge != edges.end(); ++edge) {
+        if (edge->fromHashKey() == entry.prevHashKey() &&
+            edge->toHashKey() == entry.hashKey() &&
+            edge->move().intValue() == entry.move().intValue()) {
+            if (change > 0 || edge->numGames() > 0)
+                edge->setNumGames(edge->numGames() + change);
+
+            return;
+        }
+    }
+
+    if (change > 0)
+        edges.push_back(OpeningTreeEdge(entry.prevHashKey(), entry.hashKey(), entry.move(), (unsigned)change));
+}
+
+static void mergeEdgeDelta(vector<OpeningTreeEdge> &edges, size_t first, const vector<OpeningTreeEntry> &added,
+                           const vector<OpeningTreeEntry> &removed,
+                           bool (*edgeLess)(const OpeningTreeEdge &, const OpeningTreeEdge &)) {
+    for (auto it = removed.begin(); it != removed.end(); ++it)
+        adjustEdges(edges, first, *it, -1);
+
+    for (auto it = added.begin(); it != added.end(); ++it)
+        adjustEdges(edges, first, *it, +1);
+
+    for (auto edge = edges.begin() + first; edge != edges.end();) {
+        if (edge->numGames() == 0)
+            edge = edges.erase(edge);
+        else
+            ++edge;
+    }
+
+    sort(edges.begin() + first, edges.end(), edgeLess);
+}
+
+// The tables that have a full-text index of their names, named <table>_fts
+static const struct {
+    const char *table;
+    const char *idColumn;
+    const char *nameColumn;
+} nameIndexTables[] = {
+    { "player", "player_id", "last_name" },
+    { "event", "event_id", "name" },
+    { "site", "site_id", "name" },
+    { "annotator", "annotator_id", "name" }
+};
+
 // The first bit shows the type of the encoded move:
 const unsigned ENCMOVE_TYPE_BITSIZE =       2;
 const uint32_t ENCMOVE_TYPE_MOVE =          0x0;
@@ -39,23 +209,100 @@ const uint32_t ENCMOVE_TYPE_ANNOTMOVE =     0x1;
 const uint32_t ENCMOVE_TYPE_VARSTART =      0x2;
 const uint32_t ENCMOVE_TYPE_VAREND =        0x3;
 
-// ENCMOVE_MOVE
-const unsigned ENCMOVE_MOVE_BITSIZE =       8;
-const uint32_t ENCMOVE_MOVE_INDEX_MASK =    0x00ff;
+// The layout of ENCMOVE_MOVE and ENCMOVE_ANNOTMOVE (ENCMOVE_MOVE plus bits), which
+// depends on the schema version.  Version 1 stores the index of the move in
+// Position::genMoves().  Later versions store the ordinal of the moving piece among
+// the pieces of the side to move and the ordinal of its to square among
+// Position::moveTargets(), so moves are encoded and decoded without generating moves;
+// a pawn promotion is followed by ENCMOVE_PROM_BITSIZE bits of promotion piece.
+struct MoveEncoding {
+    unsigned moveBitsize;
+    unsigned annotMoveBitsize;
+    uint32_t moveMask;
+    uint32_t preAnnotBit;
+    uint32_t postAnnotBit;
+    uint32_t nagsBit;
+};
+
+static const MoveEncoding moveEncodings[] = {
+    { 8, 11, 0x00ff, 0x0100, 0x0200, 0x0400 },     // Schema version 1
+    { 9, 12, 0x01ff, 0x0200, 0x0400, 0x0800 },     // Schema version 2
+    { 9, 12, 0x01ff, 0x0200, 0x0400, 0x0800 }      // Schema version 3
+};
+
+const unsigned ENCMOVE_TARGET_BITSIZE =     5;
+const uint32_t ENCMOVE_TARGET_MASK =        0x001f;
+const unsigned ENCMOVE_PROM_BITSIZE =       2;
+
+static const Piece promPieces[4] = { QUEEN, ROOK, KNIGHT, BISHOP };
+
+// Get the offset of the nth set bit of a bitboard, or -1 if there are not enough bits
+static int nthBit(uint64_t bb, unsigned n) {
+    for (; bb && n > 0; n--)
+        bb &= bb - 1;
+
+    return bb ? (int)lsb(bb) : -1;
+}
+
+// Decode a schema version 2 move from the ordinals of its piece and to square, reading
+// the promotion piece from the bitstream if the move is a promotion
+static bool decodeOrdinals(const Position &pos, uint32_t ordinals, Bitstream &moveBitstream, Move &move) {
+    int from = nthBit(pos.pieces(pos.wtm() ? WHITE : BLACK, ALLPIECES), ordinals >> ENCMOVE_TARGET_BITSIZE);
+    int to = from < 0 ? -1 : nthBit(pos.moveTargets(from), ordinals & ENCMOVE_TARGET_MASK);
+    Piece prom = EMPTY;
 
-// ENCMOVE_ANNOTMOVE (ENCMOVE_MOVE plus bits)
-const unsigned ENCMOVE_ANNOTMOVE_BITSIZE =  11;
-const uint32_t ENCMOVE_PRE_ANNOT_BIT =      0x0100;
-const uint32_t ENCMOVE_POST_ANNOT_BIT =     0x0200;
-const uint32_t ENCMOVE_NAGS_BIT =           0x0400;
+    if (to < 0)
+        return false;
+
+    if (pos.piece(from) == toPieceColour(PAWN, pos.wtm() ? WHITE : BLACK) && (offsetBit(to) & rankMask1and8)) {
+        uint32_t promIndex;
+
+        if (!moveBitstream.read(promIndex, ENCMOVE_PROM_BITSIZE))
+            return false;
+
+        prom = promPieces[promIndex];
+    }
+
+    return pos.buildMove(from, to, prom, move);
+}
+
+// Step over the annotations of an encoded move that is not being read
+static void skipAnnotations(const uint8_t *&pannot, uint32_t encodedMove, const MoveEncoding &encoding) {
+    if (pannot == 0)
+        return;     // Annotations were not selected
+
+    if (encodedMove & encoding.preAnnotBit)
+        pannot += strlen((const char *)pannot) + 1;
+
+    if (encodedMove & encoding.postAnnotBit)
+        pannot += strlen((const char *)pannot) + 1;
+
+    if (encodedMove & encoding.nagsBit) {
+        while (*pannot != NAG_NONE)
+            pannot++;
+
+        pannot++;   // Skip terminating NAG_NONE
+    }
+}
 
 const char *CfdbDatabase::m_classname = "CfdbDatabase";
 unsigned CfdbDatabase::m_sqliteVersion = 0;
+unsigned CfdbDatabase::m_openingTreePrewarmPlies = 0;
 
 CfdbDatabase::CfdbDatabase() :
     Database(),
     m_filename(),
-    m_db(0) {
+    m_db(0),
+    m_schemaVersion(0),
+    m_openingTreeFile(),
+    m_openingTreeDepth(0),
+    m_openingTreeCache(),
+    m_searchIndex(),
+    m_useSearchIndex(true),
+    m_nameIndexes(false),
+    m_moves(),
+    m_annotations(),
+    m_isReader(false) {
     if (m_sqliteVersion == 0) {
         m_sqliteVersion = (unsigned)sqlite3_libversion_number();
         LOGINF << "sqlite version: " << m_sqliteVersion;
@@ -69,7 +316,17 @@ CfdbDatabase::CfdbDatabase() :
 CfdbDatabase::CfdbDatabase(const string &filename, bool readOnly) :
     Database(),
     m_filename(),
-    m_db(0)
+    m_db(0),
+    m_schemaVersion(0),
+    m_openingTreeFile(),
+    m_openingTreeDepth(0),
+    m_openingTreeCache(),
+    m_searchIndex(),
+    m_useSearchIndex(true),
+    m_nameIndexes(false),
+    m_moves(),
+    m_annotations(),
+    m_isReader(false)
 {
     if (m_sqliteVersion == 0) {
         m_sqliteVersion = (unsigned)sqlite3_libversion_number();
@@ -83,6 +340,8 @@ CfdbDatabase::~CfdbDatabase() {
 }
 
 bool CfdbDatabase::open(const string &filename, bool readOnly) {
+    MutexLock lock(m_readersMutex);
+
     clearErrorMsg();
 
     if (m_isOpen)
@@ -122,6 +381,14 @@ bool CfdbDatabase::open(const string &filename, bool readOnly) {
             LOGWRN << "Failed to set journal_mode to MEMORY: " << sqlite3_errmsg(m_db);
         }
 
+        // The pragma returns a row, which would keep its statement active and the tables
+        // locked against being dropped
+        stmt.finalize();
+
+        // Wait for the readers and writers on other connections rather than fail, so
+        // the games can be written while readShared() is reading them
+        sqlite3_busy_timeout(m_db, BUSY_TIMEOUT);
+
         if (!exists) {
             // Create the schema
             if (!createSchema())
@@ -134,18 +401,43 @@ bool CfdbDatabase::open(const string &filename, bool readOnly) {
             m_filename = filename;
             m_access = readOnly ? ACCESS_READONLY : ACCESS_READWRITE;
         }
+
+        // Readers only read games, so need none of the opening tree or search state
+        if (m_isOpen && !m_isReader) {
+            openOpeningTreeFile();
+
+            string depth;
+
+            if (selectMetadata("optree_depth", depth))
+                m_openingTreeDepth = (unsigned)atoi(depth.c_str());
+
+            invalidateOpeningTreeCache();
+            checkNameIndexes();
+
+            if (m_openingTreePrewarmPlies > 0 && !prewarmOpeningTreeCache(m_openingTreePrewarmPlies))
+                LOGWRN << "Failed to prewarm the opening tree cache: " << errorMsg();
+        }
     }
 
     return m_isOpen;
 }
 
 bool CfdbDatabase::close() {
+    MutexLock lock(m_readersMutex);
+
+    closeReaders();
+    m_openingTreeFile.close();
+    m_searchIndex.close();
+
     if (m_db) {
         sqlite3_close(m_db);
         m_db = 0;
     }
 
     m_filename.clear();
+    m_schemaVersion = 0;
+    m_openingTreeDepth = 0;
+    m_nameIndexes = false;
     m_isOpen = false;
     m_access = ACCESS_NONE;
 
@@ -261,6 +553,10 @@ bool CfdbDatabase::readHeader(unsigned gameNum, GameHeader &gameHeader) {
 }
 
 bool CfdbDatabase::read(unsigned gameNum, Game &game) {
+    return read(gameNum, game, DatabaseReadOptions());
+}
+
+bool CfdbDatabase::read(unsigned gameNum, Game &game, const DatabaseReadOptions &options) {
     //LOGDBG << "gameNum=" << gameNum;
 
     clearErrorMsg();
@@ -282,52 +578,126 @@ bool CfdbDatabase::read(unsigned gameNum, Game &game) {
 
     game.setReadFail(true);
 
-    int rv;
-    SqliteStatement stmt(m_db);
+    Blob partial, moves, annotations;
 
-    if (stmt.prepare("SELECT partial, moves, annotations FROM game WHERE game_id = ?") &&
-        stmt.bind(1, (int)gameNum)) {
-        rv = stmt.step();
+    if (!selectMoves(gameNum, partial, moves, options.skipAnnotations ? 0 : &annotations))
+        return false;
 
-        if (rv == SQLITE_ROW) {
-            Blob partial, moves, annotations;
-            stmt.columnBlob(0, partial);
-            stmt.columnBlob(1, moves);
-            stmt.columnBlob(2, annotations);
+    if (partial.length() > 0) {
+        Position pos;
+        if (pos.setFromBlob(partial) == Position::LEGAL) game.setStartPosition(pos);
+        else {
+            LOGERR << "Invalid starting position in binary object";
+            return false;
+        }
+    }
 
-#if DEBUG_BLOBS
-            LOGDBG << "partial " << partial;
-            LOGDBG << "moves " << moves;
-            LOGDBG << "annotations " << annotations;
-#endif // DEBUG_BLOBS
+    game.setPositionToStart();
 
-            if (partial.length() > 0) {
-                Position pos;
-                if (pos.setFromBlob(partial) == Position::LEGAL) game.setStartPosition(pos);
-                else {
-                    LOGERR << "Invalid starting position in binary object";
-                    return false;
-                }
-            }
+    if (moves.length() > 0) {
+        if (!decodeMoves(game, moves, annotations, options)) return false;
+    } else LOGINF << "game " << gameNum << " has no moves!";
 
-            game.setPositionToStart();
+    game.setReadFail(false);
+    return true;
+}
 
-            if (moves.length() > 0) {
-                if (!decodeMoves(game, moves, annotations)) return false;
-            } else LOGINF << "game " << gameNum << " has no moves!";
-        } else if (rv == SQLITE_DONE) {
-            DBERROR << "Game " << gameNum << " does not exist";
-            return false;
-        } else {
-            DBERROR << "Failed to select game " << gameNum;
+bool CfdbDatabase::read(unsigned gameNum, CompactGame &game, const DatabaseReadOptions &options) {
+    //LOGDBG << "gameNum=" << gameNum;
+
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    game.init();
+
+    if (!readHeader(gameNum, game))
+        return false;
+
+    game.setReadFail(true);
+
+    Blob partial, moves;
+
+    if (!selectMoves(gameNum, partial, moves, 0))
+        return false;
+
+    if (partial.length() > 0) {
+        Position pos;
+        if (pos.setFromBlob(partial) == Position::LEGAL) game.setStartPosition(pos);
+        else {
+            LOGERR << "Invalid starting position in binary object";
             return false;
         }
-    } else {
+    }
+
+    if (moves.length() > 0) {
+        if (!decodeMoves(game, moves, options)) return false;
+    } else LOGINF << "game " << gameNum << " has no moves!";
+
+    game.setReadFail(false);
+    return true;
+}
+
+shared_ptr<Database> CfdbDatabase::openReader() {
+    if (!m_isOpen)
+        return shared_ptr<Database>();
+
+    shared_ptr<CfdbDatabase> reader(new CfdbDatabase());
+    reader->m_isReader = true;
+
+    if (!reader->open(m_filename, true)) {
+        LOGWRN << "Failed to open reader for '" << m_filename << "': " << reader->errorMsg();
+        return shared_ptr<Database>();
+    }
+
+    return reader;
+}
+
+bool CfdbDatabase::selectMoves(unsigned gameNum, Blob &partial, Blob &moves, Blob *annotations) {
+    SqliteStatement stmt(m_db);
+
+    const char *sql = annotations ?
+        "SELECT partial, moves, annotations FROM game WHERE game_id = ?" :
+        "SELECT partial, moves FROM game WHERE game_id = ?";
+
+    if (!stmt.prepare(sql) ||
+        !stmt.bind(1, (int)gameNum)) {
         DBERROR << "Failed to prepare game select statement";
         return false;
     }
 
-    game.setReadFail(false);
+    int rv = stmt.step();
+
+    if (rv == SQLITE_DONE) {
+        DBERROR << "Game " << gameNum << " does not exist";
+        return false;
+    } else if (rv != SQLITE_ROW) {
+        DBERROR << "Failed to select game " << gameNum;
+        return false;
+    }
+
+    stmt.columnBlob(0, partial);
+    stmt.columnBlob(1, moves);
+
+    if (annotations)
+        stmt.columnBlob(2, *annotations);
+
+#if DEBUG_BLOBS
+    LOGDBG << "partial " << partial;
+    LOGDBG << "moves " << moves;
+
+    if (annotations)
+        LOGDBG << "annotations " << *annotations;
+#endif // DEBUG_BLOBS
+
     return true;
 }
 
@@ -347,7 +717,8 @@ bool CfdbDatabase::write(unsigned gameNum, const Game &game) {
     }
 
     bool inserting = gameNum == 0 || !gameExists(gameNum);
-    Blob timeControl, partial, moves, annotations;
+    Blob timeControl, partial;
+    Blob &moves = m_moves, &annotations = m_annotations;
 
     if (game.timeControl().isValid())
         if (!game.timeControl().blob(timeControl))
@@ -520,9 +891,26 @@ bool CfdbDatabase::write(unsigned gameNum, const Game &game) {
         }
     }
 
+    if (retval && m_openingTreeDepth > 0)
+        retval = updateGameOpeningTree(gameNum, &game, m_openingTreeDepth);
+
+    // Marks the search index out-of-date, and the name indexes unless they were updated
+    if (retval)
+        retval = incrementHeaderGeneration();
+
+    if (retval && m_nameIndexes)
+        retval = updateNameIndexGeneration();
+
+    if (retval && !stmt.commit()) {
+        setDbErrorMsg("Failed to commit game %u", gameNum);
+        retval = false;
+    }
+
     if (retval) {
-        stmt.commit();
         LOGVERBOSE << "Committed transaction";
+
+        if (m_openingTreeDepth > 0)
+            invalidateOpeningTreeCache();
     } else {
         stmt.rollback();
         LOGVERBOSE << "Rolled-back transaction";
@@ -547,202 +935,440 @@ bool CfdbDatabase::buildOpeningTree(unsigned gameNum, unsigned depth, DATABASE_C
         return false;
     }
 
-    // Delete the existing entries
-    int rv;
-    SqliteStatement stmt(m_db);
-
-    if (gameNum > 0) {
-        if (stmt.prepare("DELETE FROM optree WHERE game_id = ?") &&
-            stmt.bind(1, (int)gameNum)) {
-            rv = stmt.step();
+    if (gameNum == 0) {
+        // The file is replaced once the new tree has been committed
+        m_openingTreeFile.close();
+        invalidateOpeningTreeCache();
+        bool retval = buildWholeOpeningTree(depth, callback, contextInfo);
 
-            if (rv != SQLITE_DONE) {
-                setDbErrorMsg("Failed to delete optree entries for game %u", gameNum);
-                return false;
-            }
-        } else {
-            setDbErrorMsg("Failed to prepare optree delete statement for game %u", gameNum);
-            return false;
-        }
-    } else {
-        if (stmt.prepare("DELETE FROM optree")) {
-            rv = stmt.step();
+        // A failed build leaves the existing tree, and its file, in place
+        if (!retval)
+            openOpeningTreeFile();
 
-            if (rv != SQLITE_DONE) {
-                setDbErrorMsg("Failed to delete optree entries");
-                return false;
-            }
-        } else {
-            setDbErrorMsg("Failed to prepare optree delete statement");
-            return false;
-        }
+        invalidateOpeningTreeCache();
+        return retval;
     }
 
-    unsigned first, last, count;
-    int score;
     Game game;
-    Position pos, prevPos;
-    UnmakeMoveInfo umi;
-    OpeningTreeEntry entry;
-    const AnnotMove *move;
-
-    if (gameNum > 0) {
-        first = gameNum;
-        last = gameNum;
-    } else {
-        first = firstGameNum();
-        last = lastGameNum();
-    }
-
-    LOGINF << "Building Opening Tree in database '" << filename() << "' for games " << first << " to "
-           << last;
+    bool exists = gameExists(gameNum);
 
-    for (unsigned i = first; i <= last; i++) {
-        if (!gameExists(i)) {
-            LOGDBG << "Ignoring game " << i << " as it does not exist";
-            continue;
-        }
+    if (exists) {
+        // See OpeningTreeBuilder for why the move after the depth is read
+        DatabaseReadOptions options;
+        options.mainlineOnly = true;
+        options.skipAnnotations = true;
+        options.maxPlies = depth + 1;
 
-        if (!read(i, game)) {
-            LOGERR << "Failed to read game " << i;
+        if (!read(gameNum, game, options)) {
+            LOGERR << "Failed to read game " << gameNum;
             return false;
         }
+    } else {
+        LOGDBG << "Removing game " << gameNum << " from the opening tree as it does not exist";
+    }
 
-        if (!game.startPosition().isStarting()) {
-            LOGDBG << "Ignoring game " << i << " as it starts from a set position";
-            continue;
-        }
-
-        if (game.mainline() == 0) {
-            LOGDBG << "Ignoring game " << i << " as it has no moves";
-            continue;
-        }
-
-        game.setPositionToStart();
-        pos = game.position();
-
-        switch (game.result()) {
-        case GameHeader::WHITE_WIN:
-            score = +1;
-            break;
+    SqliteStatement stmt(m_db);
 
-        case GameHeader::BLACK_WIN:
-            score = -1;
-            break;
+    if (!stmt.beginTransaction()) {
+        setDbErrorMsg("Failed to begin transaction");
+        return false;
+    }
 
-        default:
-            score = 0;
-            break;
-        }
+    if (!updateGameOpeningTree(gameNum, exists ? &game : 0, depth)) {
+        stmt.rollback();
+        return false;
+    }
 
-        for (move = game.mainline(), count = 0;
-             move && count < depth;
-             move = move->next(), count++) {
-            entry.init();
-            prevPos = pos;
+    if (!stmt.commit()) {
+        setDbErrorMsg("Failed to commit opening tree entries for game %u", gameNum);
+        stmt.rollback();
+        return false;
+    }
 
-            if (!pos.makeMove(move, umi)) {
-                DBERROR << "Error making move '" << move->dump(false) << "'";
-                return false;
-            }
+    invalidateOpeningTreeCache();
 
-            entry.setHashKey(pos.hashKey());
-            entry.setMove(move->move());
-            entry.setScore(score);
-            entry.setLastMove(move->next() == 0);
-            entry.setGameNum(i);
-
-            // Write the opening tree entry to the database
-
-            if (stmt.prepare(
-                    "INSERT INTO optree (pos, move, score, last_move, game_id) "
-                    "VALUES (?, ?, ?, ?, ?)") &&
-                stmt.bind(1, entry.hashKey()) &&
-                stmt.bind(2, (int)entry.move().intValue()) &&
-                stmt.bind(3, entry.score()) &&
-                stmt.bind(4, entry.lastMove()) &&
-                stmt.bind(5, (int)entry.gameNum())) {
-                rv = stmt.step();
-
-                if (rv == SQLITE_DONE) {
-                    LOGDBG << "Inserted optree entry for game " << i << ", depth " << count;
-
-                    if (callback) {
-                        float complete = static_cast<float> ((i * 100) / last);
-
-                        if (!callback(i, complete, contextInfo)) {
-                            DBERROR << "User cancelled operation";
-                            return false;
-                        }
-                    }
-                } else {
-                    setDbErrorMsg("Failed to insert optree entry for game %u, depth %u", i, count);
-                    return false;
-                }
-            } else {
-                setDbErrorMsg("Failed to prepare optree insert statement for game %u, depth %u", i, count);
-                return false;
-            }
-        }
+    if (callback && !callback(gameNum, 100.0f, contextInfo)) {
+        DBERROR << "User cancelled operation";
+        return false;
     }
 
     return true;
 }
 
-bool CfdbDatabase::searchOpeningTree(uint64_t hashKey, bool lastMoveOnly, vector<OpeningTreeEntry> &entries) {
-    clearErrorMsg();
-
-    if (!m_isOpen) {
-        DBERROR << "Database is not open";
-        return false;
-    }
+bool CfdbDatabase::updateGameOpeningTree(unsigned gameNum, const Game *game, unsigned depth) {
+    vector<OpeningTreeEntry> entries;
+    string errorMsg;
 
-    if (m_access == ACCESS_NONE) {
-        DBERROR << "Cannot read from this database";
+    if (game && !OpeningTreeBuilder::replayGame(*game, gameNum, depth, entries, errorMsg)) {
+        DBERROR << errorMsg;
         return false;
     }
 
-    //logdbg("hashKey=0x%016llx, current=%s", hashKey, current ? "true" : "false");
+    // The game's existing entries
+    struct Row {
+        int64_t rowid;
+        OpeningTreeEntry entry;
+        bool matched;
+    };
 
+    vector<Row> rows;
+    Row row;
     int rv;
-    string sql = "SELECT move, score, last_move, game_id FROM optree WHERE pos = ?";
+    SqliteStatement stmt(m_db);
 
-    if (lastMoveOnly)
-        sql += " AND last_move <> 0";
+    // Older schema versions do not store the positions the moves were made from, so
+    // prev_pos (parameter 1 of the statements below) is left out
+    bool hasPrevPos = m_schemaVersion >= OPTREE_DELTA_SCHEMA_VERSION;
 
-    SqliteStatement stmt(m_db);
+    if (!stmt.prepare(hasPrevPos ?
+                      "SELECT rowid, pos, prev_pos, move, score, last_move FROM optree WHERE game_id = ?" :
+                      "SELECT rowid, pos, 0, move, score, last_move FROM optree WHERE game_id = ?") ||
+        !stmt.bind(1, (int)gameNum)) {
+        setDbErrorMsg("Failed to prepare optree select statement for game %u", gameNum);
+        return false;
+    }
 
-    if (!stmt.prepare(sql) ||
-        !stmt.bind(1, hashKey)) {
-        setDbErrorMsg("Failed to prepare optree select statement");
+    while ((rv = stmt.step()) == SQLITE_ROW) {
+        row.rowid = stmt.columnInt64(0);
+        row.entry.setHashKey(stmt.columnUInt64(1));
+        row.entry.setPrevHashKey(stmt.columnUInt64(2));
+        row.entry.setMove((uint32_t)stmt.columnInt(3));
+        row.entry.setScore(stmt.columnInt(4));
+        row.entry.setLastMove(stmt.columnBool(5));
+        row.entry.setGameNum(gameNum);
+        row.matched = false;
+        rows.push_back(row);
+    }
+
+    if (rv != SQLITE_DONE) {
+        setDbErrorMsg("Failed to select optree entries for game %u", gameNum);
+        return false;
+    }
+
+    // The opening tree file is kept up-to-date by recording the changes made since it
+    // was written, which are merged with its contents when it is searched
+    bool recordDelta = hasPrevPos && openingTreeGeneration() > 0;
+
+    // Pair each new entry with an existing entry for the same position and move, which
+    // only needs updating if the result or the end of the game has changed
+    unsigned numInserted = 0, numUpdated = 0, numDeleted = 0;
+    size_t i, j;
+
+    for (i = 0; i < entries.size(); i++) {
+        const OpeningTreeEntry &entry = entries[i];
+
+        for (j = 0; j < rows.size(); j++) {
+            if (!rows[j].matched &&
+                rows[j].entry.hashKey() == entry.hashKey() &&
+                rows[j].entry.move().intValue() == entry.move().intValue())
+                break;
+        }
+
+        if (j < rows.size()) {
+            const OpeningTreeEntry &old = rows[j].entry;
+            rows[j].matched = true;
+
+            if (old.score() == entry.score() &&
+                old.lastMove() == entry.lastMove() &&
+                (!hasPrevPos || old.prevHashKey() == entry.prevHashKey()))
+                continue;
+
+            if (!stmt.prepare(hasPrevPos ?
+                              "UPDATE optree SET prev_pos = ?1, score = ?2, last_move = ?3 WHERE rowid = ?4" :
+                              "UPDATE optree SET score = ?2, last_move = ?3 WHERE rowid = ?4") ||
+                !stmt.bind(1, entry.prevHashKey()) ||
+                !stmt.bind(2, entry.score()) ||
+                !stmt.bind(3, entry.lastMove()) ||
+                !stmt.bind(4, rows[j].rowid) ||
+                stmt.step() != SQLITE_DONE) {
+                setDbErrorMsg("Failed to update optree entry for game %u", gameNum);
+                return false;
+            }
+
+            if (recordDelta &&
+                (!recordOpeningTreeDelta(old, false) || !recordOpeningTreeDelta(entry, true)))
+                return false;
+
+            numUpdated++;
+        } else {
+            if (!stmt.prepare(hasPrevPos ?
+                              "INSERT INTO optree (pos, prev_pos, move, score, last_move, game_id) "
+                              "VALUES (?2, ?1, ?3, ?4, ?5, ?6)" :
+                              "INSERT INTO optree (pos, move, score, last_move, game_id) "
+                              "VALUES (?2, ?3, ?4, ?5, ?6)") ||
+                !stmt.bind(1, entry.prevHashKey()) ||
+                !stmt.bind(2, entry.hashKey()) ||
+                !stmt.bind(3, (int)entry.move().intValue()) ||
+                !stmt.bind(4, entry.score()) ||
+                !stmt.bind(5, entry.lastMove()) ||
+                !stmt.bind(6, (int)gameNum) ||
+                stmt.step() != SQLITE_DONE) {
+                setDbErrorMsg("Failed to insert optree entry for game %u", gameNum);
+                return false;
+            }
+
+            if (recordDelta && !recordOpeningTreeDelta(entry, true))
+                return false;
+
+            numInserted++;
+        }
+    }
+
+    for (j = 0; j < rows.size(); j++) {
+        if (rows[j].matched)
+            continue;
+
+        if (!stmt.prepare("DELETE FROM optree WHERE rowid = ?") ||
+            !stmt.bind(1, rows[j].rowid) ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to delete optree entry for game %u", gameNum);
+            return false;
+        }
+
+        if (recordDelta && !recordOpeningTreeDelta(rows[j].entry, false))
+            return false;
+
+        numDeleted++;
+    }
+
+    if (numInserted + numUpdated + numDeleted > 0) {
+        LOGDBG << "Opening tree of game " << gameNum << ": " << numInserted << " inserted, " << numUpdated <<
+            " updated, " << numDeleted << " deleted";
+
+        // Without the changes the opening tree file no longer matches the table
+        if (!hasPrevPos && (m_openingTreeFile.isOpen() || Util::fileExists(openingTreeFilename()))) {
+            m_openingTreeFile.close();
+            Util::deleteFile(openingTreeFilename());
+        }
+
+        invalidateOpeningTreeCache();
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::createOpeningTreeDelta() {
+    SqliteStatement stmt(m_db);
+
+    LOGDBG << "Creating table 'optree_delta'";
+
+    if (!stmt.prepare(
+            "CREATE TABLE optree_delta ("
+            "pos UNSIGNED BIG INT, "
+            "prev_pos UNSIGNED BIG INT, "
+            "move INTEGER, "
+            "score TINYINT, "
+            "last_move TINYINT, "
+            "game_id INTEGER, "
+            "added TINYINT)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create table 'optree_delta'");
+        return false;
+    }
+
+    LOGDBG << "Creating indexes of 'optree_delta'";
+
+    if (!stmt.prepare("CREATE INDEX optree_delta_pos_index ON optree_delta (pos)") ||
+        stmt.step() != SQLITE_DONE ||
+        !stmt.prepare("CREATE INDEX optree_delta_prev_pos_index ON optree_delta (prev_pos)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create indexes of 'optree_delta'");
+        return false;
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::recordOpeningTreeDelta(const OpeningTreeEntry &entry, bool added) {
+    // An entry that reverses an earlier change cancels it out
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.prepare("DELETE FROM optree_delta WHERE rowid = (SELECT rowid FROM optree_delta WHERE "
+                      "pos = ? AND prev_pos = ? AND move = ? AND score = ? AND last_move = ? AND "
+                      "game_id = ? AND added = ? LIMIT 1)") ||
+        !stmt.bind(1, entry.hashKey()) ||
+        !stmt.bind(2, entry.prevHashKey()) ||
+        !stmt.bind(3, (int)entry.move().intValue()) ||
+        !stmt.bind(4, entry.score()) ||
+        !stmt.bind(5, entry.lastMove()) ||
+        !stmt.bind(6, (int)entry.gameNum()) ||
+        !stmt.bind(7, !added) ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to delete optree_delta entry for game %u", entry.gameNum());
+        return false;
+    }
+
+    if (sqlite3_changes(m_db) > 0)
+        return true;
+
+    if (!stmt.prepare("INSERT INTO optree_delta (pos, prev_pos, move, score, last_move, game_id, added) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?)") ||
+        !stmt.bind(1, entry.hashKey()) ||
+        !stmt.bind(2, entry.prevHashKey()) ||
+        !stmt.bind(3, (int)entry.move().intValue()) ||
+        !stmt.bind(4, entry.score()) ||
+        !stmt.bind(5, entry.lastMove()) ||
+        !stmt.bind(6, (int)entry.gameNum()) ||
+        !stmt.bind(7, added) ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to insert optree_delta entry for game %u", entry.gameNum());
+        return false;
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::buildWholeOpeningTree(unsigned depth, DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    unsigned first = firstGameNum(), last = lastGameNum();
+
+    LOGINF << "Building Opening Tree in database '" << filename() << "' for games " << first << " to "
+           << last;
+
+    unsigned startTime = Util::getTickCount();
+    OpeningTreeBuilder builder;
+
+    if (!builder.build(m_filename, first, last, depth, 0, callback, contextInfo)) {
+        DBERROR << builder.errorMsg();
         return false;
     }
 
+    // Load the sorted entries in a single transaction and only then index them, while
+    // also writing the opening tree file
+    string treeFilename = openingTreeFilename();
+    unsigned generation = openingTreeGeneration() + 1;
+    OpeningTreeFileWriter writer;
+    SqliteStatement stmt(m_db), insertStmt(m_db);
     OpeningTreeEntry entry;
+    bool done = false;
+    bool hasPrevPos = m_schemaVersion >= OPTREE_DELTA_SCHEMA_VERSION;
+    int rv;
 
-    while ((rv = stmt.step()) == SQLITE_ROW) {
-        entry.setHashKey(hashKey);
-        entry.setMove((uint32_t)stmt.columnInt(0));
-        entry.setScore(stmt.columnInt(1));
-        entry.setLastMove(stmt.columnBool(2));
-        entry.setGameNum((unsigned)stmt.columnInt(3));
+    if (!writer.create(treeFilename, numGames(), generation)) {
+        DBERROR << writer.errorMsg();
+        return false;
+    }
 
-        LOGVERBOSE << "Matched " << entry.dump();
+    if (!stmt.beginTransaction()) {
+        setDbErrorMsg("Failed to start transaction");
+        return false;
+    }
 
-        entries.push_back(entry);
+    if (!stmt.prepare("DROP INDEX IF EXISTS optree_pos_index") ||
+        stmt.step() != SQLITE_DONE ||
+        !stmt.prepare("DROP INDEX IF EXISTS optree_game_index") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to drop optree indexes");
+        stmt.rollback();
+        return false;
     }
 
-    if (rv != SQLITE_DONE) {
-        setDbErrorMsg("Failed to select optree row");
+    // The existing entries are replaced in the same transaction, so a failed or
+    // cancelled build leaves them untouched
+    if (!stmt.prepare("DELETE FROM optree") ||
+        stmt.step() != SQLITE_DONE ||
+        (hasPrevPos && (!stmt.prepare("DELETE FROM optree_delta") || stmt.step() != SQLITE_DONE))) {
+        setDbErrorMsg("Failed to delete optree entries");
+        stmt.rollback();
         return false;
     }
 
-    LOGDBG << entries.size() << " matches";
+    // Older schema versions do not store prev_pos (parameter 1)
+    if (!insertStmt.prepare(hasPrevPos ?
+                            "INSERT INTO optree (pos, prev_pos, move, score, last_move, game_id) "
+                            "VALUES (?2, ?1, ?3, ?4, ?5, ?6)" :
+                            "INSERT INTO optree (pos, move, score, last_move, game_id) "
+                            "VALUES (?2, ?3, ?4, ?5, ?6)")) {
+        setDbErrorMsg("Failed to prepare optree insert statement");
+        stmt.rollback();
+        return false;
+    }
+
+    while (true) {
+        if (!builder.next(entry, done)) {
+            DBERROR << builder.errorMsg();
+            stmt.rollback();
+            return false;
+        }
+
+        if (done)
+            break;
+
+        insertStmt.reset();
+
+        if (!insertStmt.bind(1, entry.prevHashKey()) ||
+            !insertStmt.bind(2, entry.hashKey()) ||
+            !insertStmt.bind(3, (int)entry.move().intValue()) ||
+            !insertStmt.bind(4, entry.score()) ||
+            !insertStmt.bind(5, entry.lastMove()) ||
+            !insertStmt.bind(6, (int)entry.gameNum()) ||
+            (rv = insertStmt.step()) != SQLITE_DONE) {
+            setDbErrorMsg("Failed to insert optree entry for game %u", entry.gameNum());
+            stmt.rollback();
+            return false;
+        }
+
+        if (!writer.add(entry)) {
+            DBERROR << writer.errorMsg();
+            stmt.rollback();
+            return false;
+        }
+    }
+
+    insertStmt.finalize();
+
+    if (!stmt.prepare("CREATE INDEX optree_pos_index ON optree (pos)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'optree_pos_index'");
+        stmt.rollback();
+        return false;
+    }
+
+    // Only the file written with this tree will be used
+    if (!updateMetadata("optree_generation", Util::format("%u", generation))) {
+        stmt.rollback();
+        return false;
+    }
+
+    // Keep maintaining the tree in write(), to the new depth
+    if (m_openingTreeDepth > 0) {
+        if (!stmt.prepare("CREATE INDEX optree_game_index ON optree (game_id)") ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to create index 'optree_game_index'");
+            stmt.rollback();
+            return false;
+        }
+
+        if (!updateMetadata("optree_depth", Util::format("%u", depth))) {
+            stmt.rollback();
+            return false;
+        }
+
+        m_openingTreeDepth = depth;
+    }
+
+    if (!stmt.commit()) {
+        setDbErrorMsg("Failed to commit opening tree");
+        stmt.rollback();
+        return false;
+    }
+
+    if (!writer.finish()) {
+        DBERROR << writer.errorMsg();
+        return false;
+    }
+
+    LOGINF << "Built opening tree of " << builder.numEntries() << " entries in " <<
+        (Util::getTickCount() - startTime) << "ms";
+
+    if (!openOpeningTreeFile()) {
+        DBERROR << "Failed to open opening tree file '" << treeFilename << "'";
+        return false;
+    }
 
     return true;
 }
 
-bool CfdbDatabase::countInOpeningTree(uint64_t hashKey, unsigned &count) {
+bool CfdbDatabase::searchOpeningTree(uint64_t hashKey, bool lastMoveOnly, vector<OpeningTreeEntry> &entries) {
     clearErrorMsg();
 
     if (!m_isOpen) {
@@ -755,29 +1381,30 @@ bool CfdbDatabase::countInOpeningTree(uint64_t hashKey, unsigned &count) {
         return false;
     }
 
-    count = 0;
+    //logdbg("hashKey=0x%016llx, current=%s", hashKey, current ? "true" : "false");
 
-    int rv;
-    bool retval = false;
-    SqliteStatement stmt(m_db);
+    if (!m_openingTreeCache)
+        return selectOpeningTree(hashKey, lastMoveOnly, entries);
 
-    if (stmt.prepare("SELECT COUNT(*) FROM optree WHERE pos = ?") &&
-        stmt.bind(1, hashKey)) {
-        rv = stmt.step();
+    if (m_openingTreeCache->findEntries(hashKey, lastMoveOnly, entries))
+        return true;
 
-        if (rv == SQLITE_ROW) {
-            count = (unsigned)stmt.columnInt(0);
-            retval = true;
-        } else setDbErrorMsg("Failed to select count from optree");
-    } else setDbErrorMsg("Failed to prepare optree select count statement");
+    // Cache every entry of the position, whichever were asked for
+    vector<OpeningTreeEntry> allEntries;
 
-    LOGVERBOSE << "hashKey=0x" << hex << setw(16) << setfill('0') << hashKey <<
-        ", count=" << dec << setw(0) << count;
+    if (!selectOpeningTree(hashKey, false, allEntries))
+        return false;
 
-    return retval;
+    m_openingTreeCache->addEntries(hashKey, allEntries);
+
+    for (auto it = allEntries.begin(); it != allEntries.end(); ++it)
+        if (!lastMoveOnly || it->lastMove())
+            entries.push_back(*it);
+
+    return true;
 }
 
-bool CfdbDatabase::countLongestLine(unsigned &count) {
+bool CfdbDatabase::countInOpeningTree(uint64_t hashKey, unsigned &count) {
     clearErrorMsg();
 
     if (!m_isOpen) {
@@ -792,24 +1419,19 @@ bool CfdbDatabase::countLongestLine(unsigned &count) {
 
     count = 0;
 
-    bool retval = false;
-    int rv;
-    SqliteStatement stmt(m_db);
+    if (m_openingTreeCache && m_openingTreeCache->findCount(hashKey, count))
+        return true;
 
-    if (stmt.prepare("SELECT MAX(halfmoves) FROM game")) {
-        rv = stmt.step();
+    if (!selectOpeningTreeCount(hashKey, count))
+        return false;
 
-        if (rv == SQLITE_ROW) {
-            count = (unsigned)stmt.columnInt(0);
-            retval = true;
-        } else setDbErrorMsg("Failed to select from game");
-    } else setDbErrorMsg("Failed to prepare SELECT MAX statement");
+    if (m_openingTreeCache)
+        m_openingTreeCache->addCount(hashKey, count);
 
-    return retval;
+    return true;
 }
 
-bool CfdbDatabase::search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
-                          DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset /*=0*/, int limit /*=0*/) {
+bool CfdbDatabase::prewarmOpeningTreeCache(unsigned plies) {
     clearErrorMsg();
 
     if (!m_isOpen) {
@@ -822,320 +1444,322 @@ bool CfdbDatabase::search(const DatabaseSearchCriteria &searchCriteria, const Da
         return false;
     }
 
-    if (callback == 0) {
-        DBERROR << "No callback function provided";
-        return false;
-    }
+    if (!m_openingTreeCache)
+        return true;
 
-    vector<string> binds;
-    set<string> joins;
-    ostringstream query, where, orderBy;
+    unsigned startTime = Util::getTickCount(), numPositions = 0;
+    vector<Position> positions(1), nextPositions;
+    vector<OpeningTreeEntry> entries;
+    set<uint64_t> seen;
+    Move moves[256];
+    UnmakeMoveInfo umi;
+    unsigned count;
 
-    for (auto it = searchCriteria.begin(); it != searchCriteria.end(); ++it) {
-        const DatabaseSearchDescriptor &descriptor = *it;
+    positions[0].setStarting();
 
-        bool caseInsensitive = databaseComparisonCaseInsensitive(descriptor.comparison);
+    // Visit the positions of the tree a half-move at a time
+    for (unsigned ply = 0; ply < plies && !positions.empty(); ply++) {
+        nextPositions.clear();
 
-        if (!binds.empty()) where << " AND";
+        for (auto it = positions.begin(); it != positions.end(); ++it) {
+            unsigned numMoves = it->genMoves(moves);
 
-        switch (descriptor.field) {
-        case DATABASE_FIELD_WHITEPLAYER:
-            where << (caseInsensitive ? " UPPER(whiteplayer.last_name)" : " whiteplayer.last_name") <<
-                comparisonString(descriptor.comparison);
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            joins.insert("white_player_id");
-            break;
+            for (unsigned i = 0; i < numMoves; i++) {
+                Position pos(*it);
 
-        case DATABASE_FIELD_BLACKPLAYER:
-            where << (caseInsensitive ? " UPPER(blackplayer.last_name)" : " blackplayer.last_name") <<
-                comparisonString(descriptor.comparison);
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            joins.insert("black_player_id");
-            break;
+                if (!pos.makeMove(moves[i], umi) || !seen.insert(pos.hashKey()).second)
+                    continue;
 
-        case DATABASE_FIELD_PLAYER:
-            where << " (" <<
-                (caseInsensitive ? "UPPER(whiteplayer.last_name)" : "whiteplayer.last_name") <<
-                comparisonString(descriptor.comparison) << " OR " <<
-                (caseInsensitive ? "UPPER(blackplayer.last_name)" : "blackplayer.last_name") <<
-                comparisonString(descriptor.comparison) << ")";
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            joins.insert("white_player_id");
-            joins.insert("black_player_id");
-            break;
+                if (!selectOpeningTreeCount(pos.hashKey(), count))
+                    return false;
 
-        case DATABASE_FIELD_EVENT:
-            where << (caseInsensitive ? " UPPER(event.name)" : " event.name") <<
-                comparisonString(descriptor.comparison);
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            joins.insert("event_id");
-            break;
+                if (count == 0)
+                    continue;
 
-        case DATABASE_FIELD_SITE:
-            where << (caseInsensitive ? " UPPER(site.name)" : " site.name") <<
-                comparisonString(descriptor.comparison);
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            joins.insert("site_id");
-            break;
+                entries.clear();
 
-        case DATABASE_FIELD_DATE:
+                if (!selectOpeningTree(pos.hashKey(), false, entries))
+                    return false;
 
-            if (databaseComparisonNoFlags(descriptor.comparison) == DATABASE_COMPARE_EQUALS) {
-                // This could probably use bind variables as well, but it's (wrongly )assumed that all
-                // bind variables are strings, so that would need changing first...
-                int year = 0, month = 0, day = 0;
+                m_openingTreeCache->addEntries(pos.hashKey(), entries);
+                nextPositions.push_back(pos);
+                numPositions++;
 
-                if (sscanf(descriptor.value.c_str(), "%04d%02d%02d", &year, &month, &day) == 3)
-                    // Compare with exact year/month/day
-                    where << " game.date = " << Util::format("%04d%02d%02d", year, month, day);
-                else if (sscanf(descriptor.value.c_str(), "%04d%02d", &year, &month) == 2)
-                    // Compare with this month and end of month
-                    where << " (game.date >= " << Util::format("%04d%02d00", year, month) <<
-                        " AND game.date <= " << Util::format("%04d%02d31", year, month) << ")";
-                else if (sscanf(descriptor.value.c_str(), "%04d", &year) == 1)
-                    // Compare with this year and end of year
-                    where << " (game.date >= " << Util::format("%04d0000", year) <<
-                        " AND game.date <= " << Util::format("%04d1231", year) << ")";
-                else {
-                    DBERROR << "Cannot search for date using invalid value '" << descriptor.value << "'";
-                    return false;
+                if (m_openingTreeCache->isFull()) {
+                    LOGDBG << "Opening tree cache filled after " << numPositions << " positions";
+                    return true;
                 }
-            } else LOGWRN << "Ignoring to request to search for date as comparison is not \"equals\"";
+            }
+        }
 
-            break;
+        positions.swap(nextPositions);
+    }
 
-        case DATABASE_FIELD_ECO:
-            where << (caseInsensitive ? " UPPER(game.eco)" : " game.eco") <<
-                comparisonString(descriptor.comparison);
-            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
-            break;
+    LOGDBG << "Loaded " << numPositions << " positions into the opening tree cache in " <<
+        (Util::getTickCount() - startTime) << "ms";
 
-        default:
-            DBERROR << "Field " << descriptor.field << " cannot be used for searching";
+    return true;
+}
+
+bool CfdbDatabase::selectOpeningTree(uint64_t hashKey, bool lastMoveOnly, vector<OpeningTreeEntry> &entries) {
+    if (m_openingTreeFile.isOpen()) {
+        vector<OpeningTreeEntry> added, removed;
+
+        if (!selectOpeningTreeDelta("pos", hashKey, added, removed))
             return false;
-        }
+
+        size_t first = entries.size();
+        m_openingTreeFile.search(hashKey, lastMoveOnly, entries);
+
+        if (!added.empty() || !removed.empty())
+            mergeEntryDelta(entries, first, lastMoveOnly, added, removed);
+
+        return true;
     }
 
-    if (sortCriteria.empty()) {
-        orderBy << "game.game_id ASC";
-    } else {
-        for (auto it = sortCriteria.begin(); it != sortCriteria.end(); ++it) {
-            const DatabaseSortDescriptor &descriptor = *it;
+    int rv;
+    string sql = "SELECT move, score, last_move, game_id FROM optree WHERE pos = ?";
 
-            if (orderBy.tellp() > 0) orderBy << ", ";
+    if (lastMoveOnly)
+        sql += " AND last_move <> 0";
 
-            switch (descriptor.field) {
-            case DATABASE_FIELD_GAME_NUM:
-                orderBy << "game.game_id" << orderString(descriptor.order);
-                break;
+    SqliteStatement stmt(m_db);
 
-            case DATABASE_FIELD_WHITEPLAYER:
-                orderBy << "whiteplayer.last_name" << orderString(descriptor.order);
-                joins.insert("white_player_id");
-                break;
+    if (!stmt.prepare(sql) ||
+        !stmt.bind(1, hashKey)) {
+        setDbErrorMsg("Failed to prepare optree select statement");
+        return false;
+    }
 
-            case DATABASE_FIELD_BLACKPLAYER:
-                orderBy << "blackplayer.last_name" << orderString(descriptor.order);
-                joins.insert("black_player_id");
-                break;
+    OpeningTreeEntry entry;
 
-            case DATABASE_FIELD_EVENT:
-                orderBy << "event.name" << orderString(descriptor.order);
-                joins.insert("event_id");
-                break;
+    while ((rv = stmt.step()) == SQLITE_ROW) {
+        entry.setHashKey(hashKey);
+        entry.setMove((uint32_t)stmt.columnInt(0));
+        entry.setScore(stmt.columnInt(1));
+        entry.setLastMove(stmt.columnBool(2));
+        entry.setGameNum((unsigned)stmt.columnInt(3));
 
-            case DATABASE_FIELD_SITE:
-                orderBy << "site.name" << orderString(descriptor.order);
-                joins.insert("site_id");
-                break;
+        LOGVERBOSE << "Matched " << entry.dump();
 
-            case DATABASE_FIELD_ROUND:
-                orderBy << "game.round_major" << orderString(descriptor.order) <<
-                    ", game.round_minor" << orderString(descriptor.order);
-                break;
+        entries.push_back(entry);
+    }
 
-            case DATABASE_FIELD_DATE:
-                orderBy << "game.date" << orderString(descriptor.order);
-                break;
+    if (rv != SQLITE_DONE) {
+        setDbErrorMsg("Failed to select optree row");
+        return false;
+    }
 
-            case DATABASE_FIELD_ECO:
-                orderBy << "game.eco" << orderString(descriptor.order);
-                break;
+    LOGDBG << entries.size() << " matches";
 
-            case DATABASE_FIELD_RESULT:
-                orderBy << "game.result" << orderString(descriptor.order);
-                break;
+    return true;
+}
 
-            default:
-                DBERROR << "Field " << descriptor.field << " cannot be used for sorting";
-                return false;
-            }
-        }
+bool CfdbDatabase::selectOpeningTreeCount(uint64_t hashKey, unsigned &count) {
+    count = 0;
+
+    if (m_openingTreeFile.isOpen()) {
+        vector<OpeningTreeEntry> added, removed;
+
+        if (!selectOpeningTreeDelta("pos", hashKey, added, removed))
+            return false;
+
+        count = m_openingTreeFile.count(hashKey) + (unsigned)added.size() - (unsigned)removed.size();
+        return true;
     }
 
-    query << "SELECT game.game_id FROM game";
+    int rv;
+    bool retval = false;
+    SqliteStatement stmt(m_db);
+
+    if (stmt.prepare("SELECT COUNT(*) FROM optree WHERE pos = ?") &&
+        stmt.bind(1, hashKey)) {
+        rv = stmt.step();
+
+        if (rv == SQLITE_ROW) {
+            count = (unsigned)stmt.columnInt(0);
+            retval = true;
+        } else setDbErrorMsg("Failed to select count from optree");
+    } else setDbErrorMsg("Failed to prepare optree select count statement");
 
-    bool whereEmpty = where.str().empty();
+    LOGVERBOSE << "hashKey=0x" << hex << setw(16) << setfill('0') << hashKey <<
+        ", count=" << dec << setw(0) << count;
 
-    if (!whereEmpty && joins.size() > 0)
-        where << " AND (";
+    return retval;
+}
 
-    for (auto it = joins.begin(); it != joins.end(); ++it) {
-        const string &column = *it;
+void CfdbDatabase::invalidateOpeningTreeCache() {
+    if (m_openingTreeCache)
+        m_openingTreeCache->clear();
+}
 
-        if (it != joins.begin()) where << " AND";
+bool CfdbDatabase::searchOpeningTreeStats(uint64_t hashKey, unsigned maxSampleGames, vector<OpeningTreeStats> &stats) {
+    clearErrorMsg();
 
-        if (column == "white_player_id") {
-            query << ", player whiteplayer";
-            where << " game.white_player_id = whiteplayer.player_id";
-        } else if (column == "black_player_id") {
-            query << ", player blackplayer";
-            where << " game.black_player_id = blackplayer.player_id";
-        } else if (column == "event_id") {
-            query << ", event";
-            where << " game.event_id = event.event_id";
-        } else if (column == "site_id") {
-            query << ", site";
-            where << " game.site_id = site.site_id";
-        } else ASSERT(false);
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
     }
 
-    if (!whereEmpty && joins.size() > 0)
-        where << ")";
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
 
-    if (where.tellp() > 0)
-        query << " WHERE" << where.str();
+    size_t firstStats = stats.size();
 
-    query << " GROUP BY game.game_id";
-    query << " ORDER BY " << orderBy.str();
+    if (m_openingTreeFile.isOpen()) {
+        vector<OpeningTreeEntry> added, removed;
 
-    if (limit > 0)
-        query << " LIMIT " << limit;
+        if (!selectOpeningTreeDelta("pos", hashKey, added, removed))
+            return false;
 
-    if (offset > 0)
-        query << " OFFSET " << offset - 1;
+        if (added.empty() && removed.empty()) {
+            m_openingTreeFile.stats(hashKey, maxSampleGames, stats);
+        } else {
+            // Enough sample games to replace any that have been removed
+            unsigned numSamples = maxSampleGames > 0 ? maxSampleGames + (unsigned)removed.size() : 0;
+            m_openingTreeFile.stats(hashKey, numSamples, stats);
+            mergeStatsDelta(stats, firstStats, hashKey, maxSampleGames, added, removed);
+        }
 
-    LOGDBG << "Query: " << query.str();
+        sort(stats.begin() + firstStats, stats.end(), moreGamesPlayed);
+        return true;
+    }
 
+    int rv;
     SqliteStatement stmt(m_db);
 
-    if (stmt.prepare(query.str())) {
-        int bindColumn = 1, rv;
+    if (!stmt.prepare("SELECT move, COUNT(*), SUM(score > 0), SUM(score = 0), SUM(score < 0) "
+                      "FROM optree WHERE pos = ? GROUP BY move") ||
+        !stmt.bind(1, hashKey)) {
+        setDbErrorMsg("Failed to prepare optree select statement");
+        return false;
+    }
 
-        for (auto it = binds.begin(); it != binds.end(); ++it) {
-            const string &value = *it;
+    OpeningTreeStats moveStats;
 
-            if (!stmt.bind(bindColumn, value)) {
-                LOGERR << "Failed to bind column " << bindColumn << " with value '" << value << "'";
-                return false;
-            }
+    while ((rv = stmt.step()) == SQLITE_ROW) {
+        moveStats.init();
+        moveStats.setHashKey(hashKey);
+        moveStats.setMove((uint32_t)stmt.columnInt(0));
+        moveStats.setNumGames((unsigned)stmt.columnInt(1));
+        moveStats.setWhiteWins((unsigned)stmt.columnInt(2));
+        moveStats.setDraws((unsigned)stmt.columnInt(3));
+        moveStats.setBlackWins((unsigned)stmt.columnInt(4));
 
-            bindColumn++;
-        }
+        LOGVERBOSE << "Matched " << moveStats.dump();
 
-        while ((rv = stmt.step()) == SQLITE_ROW) {
-            unsigned gameNum = (unsigned)stmt.columnInt(0);
+        stats.push_back(moveStats);
+    }
 
-            if (!callback(gameNum, 0.0f, contextInfo)) {
-                LOGINF << "User terminated search";
-                return true;
-            }
+    if (rv != SQLITE_DONE) {
+        setDbErrorMsg("Failed to select optree row");
+        return false;
+    }
+
+    sort(stats.begin() + firstStats, stats.end(), moreGamesPlayed);
+
+    if (maxSampleGames == 0)
+        return true;
+
+    for (auto it = stats.begin() + firstStats; it != stats.end(); ++it) {
+        if (!stmt.prepare("SELECT game_id FROM optree WHERE pos = ? AND move = ? ORDER BY game_id LIMIT ?") ||
+            !stmt.bind(1, hashKey) ||
+            !stmt.bind(2, (int)it->move().intValue()) ||
+            !stmt.bind(3, (int)maxSampleGames)) {
+            setDbErrorMsg("Failed to prepare optree select statement");
+            return false;
         }
 
+        while ((rv = stmt.step()) == SQLITE_ROW)
+            it->sampleGames().push_back((unsigned)stmt.columnInt(0));
+
         if (rv != SQLITE_DONE) {
-            setDbErrorMsg("Failed to search games");
+            setDbErrorMsg("Failed to select optree row");
             return false;
         }
-    } else {
-        setDbErrorMsg("Failed to prepare search statement");
-        return false;
     }
 
     return true;
 }
 
-unsigned CfdbDatabase::numGames() {
-    clearErrorMsg();
+bool CfdbDatabase::searchOpeningTreeChildren(uint64_t hashKey, vector<OpeningTreeEdge> &edges) {
+    if (!openingTreeGraphAvailable())
+        return false;
 
-    if (!m_isOpen) {
-        DBERROR << "Database is not open";
-        return 0;
-    }
+    vector<OpeningTreeEntry> added, removed;
 
-    unsigned count = 0;
-    int rv;
-    SqliteStatement stmt(m_db);
+    if (!selectOpeningTreeDelta("prev_pos", hashKey, added, removed))
+        return false;
 
-    if (stmt.prepare("SELECT COUNT(*) FROM game")) {
-        rv = stmt.step();
-        if (rv == SQLITE_ROW) {
-            count = (unsigned)stmt.columnInt(0);
-            LOGDBG << "Database '" << m_filename << "' contains " << count << " games";
-        } else if (rv == SQLITE_DONE) {
-            DBERROR << "Failed to count games";
-        }
-        else {
-            setDbErrorMsg("Failed to count games");
-        }
-    } else {
-        setDbErrorMsg("Failed to prepare SELECT COUNT statement");
-    }
+    size_t first = edges.size();
+    m_openingTreeFile.children(hashKey, edges);
 
-    return count;
+    if (!added.empty() || !removed.empty())
+        mergeEdgeDelta(edges, first, added, removed, childLess);
+
+    return true;
 }
 
-unsigned CfdbDatabase::firstGameNum() {
-    clearErrorMsg();
+bool CfdbDatabase::searchOpeningTreeParents(uint64_t hashKey, vector<OpeningTreeEdge> &edges) {
+    if (!openingTreeGraphAvailable())
+        return false;
 
-    if (!m_isOpen) {
-        DBERROR << "Database is not open";
-        return 0;
-    }
+    vector<OpeningTreeEntry> added, removed;
 
-    unsigned gameNum = 0;
-    int rv;
-    SqliteStatement stmt(m_db);
+    if (!selectOpeningTreeDelta("pos", hashKey, added, removed))
+        return false;
 
-    if (stmt.prepare("SELECT MIN(game_id) FROM game")) {
-        rv = stmt.step();
-        if (rv == SQLITE_ROW)
-            gameNum = (unsigned)stmt.columnInt(0);
-        else
-            setDbErrorMsg("Failed to get first game number");
-    } else {
-        setDbErrorMsg("Failed to prepare SELECT MIN statement");
-    }
+    size_t first = edges.size();
+    m_openingTreeFile.parents(hashKey, edges);
 
-    return gameNum;
-}
+    if (!added.empty() || !removed.empty())
+        mergeEdgeDelta(edges, first, added, removed, parentLess);
 
-unsigned CfdbDatabase::lastGameNum() {
-    clearErrorMsg();
+    return true;
+}
 
-    if (!m_isOpen) {
-        DBERROR << "Database is not open";
-        return 0;
-    }
+bool CfdbDatabase::selectOpeningTreeDelta(const char *column, uint64_t hashKey, vector<OpeningTreeEntry> &added,
+                                          vector<OpeningTreeEntry> &removed) {
+    if (m_schemaVersion < OPTREE_DELTA_SCHEMA_VERSION)
+        return true;
 
-    unsigned gameNum = 0;
     int rv;
     SqliteStatement stmt(m_db);
 
-    if (stmt.prepare("SELECT MAX(game_id) FROM game")) {
-        rv = stmt.step();
-        if (rv == SQLITE_ROW)
-            gameNum = (unsigned)stmt.columnInt(0);
+    if (!stmt.prepare(string("SELECT pos, prev_pos, move, score, last_move, game_id, added FROM optree_delta WHERE ") +
+                      column + " = ?") ||
+        !stmt.bind(1, hashKey)) {
+        setDbErrorMsg("Failed to prepare optree_delta select statement");
+        return false;
+    }
+
+    OpeningTreeEntry entry;
+
+    while ((rv = stmt.step()) == SQLITE_ROW) {
+        entry.setHashKey(stmt.columnUInt64(0));
+        entry.setPrevHashKey(stmt.columnUInt64(1));
+        entry.setMove((uint32_t)stmt.columnInt(2));
+        entry.setScore(stmt.columnInt(3));
+        entry.setLastMove(stmt.columnBool(4));
+        entry.setGameNum((unsigned)stmt.columnInt(5));
+
+        if (stmt.columnBool(6))
+            added.push_back(entry);
         else
-            setDbErrorMsg("Failed to get last game number");
-    } else {
-        setDbErrorMsg("Failed to prepare SELECT MAX statement");
+            removed.push_back(entry);
     }
 
-    return gameNum;
+    if (rv != SQLITE_DONE) {
+        setDbErrorMsg("Failed to select optree_delta row");
+        return false;
+    }
+
+    return true;
 }
 
-bool CfdbDatabase::gameExists(unsigned gameNum) {
+bool CfdbDatabase::countLongestLine(unsigned &count) {
     clearErrorMsg();
 
     if (!m_isOpen) {
@@ -1143,12 +1767,877 @@ bool CfdbDatabase::gameExists(unsigned gameNum) {
         return false;
     }
 
-    unsigned count = 0;
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    count = 0;
+
+    bool retval = false;
     int rv;
     SqliteStatement stmt(m_db);
 
-    if (stmt.prepare("SELECT COUNT(*) FROM game WHERE game_id = ?") &&
-        stmt.bind(1, (int)gameNum)) {
+    if (stmt.prepare("SELECT MAX(halfmoves) FROM game")) {
+        rv = stmt.step();
+
+        if (rv == SQLITE_ROW) {
+            count = (unsigned)stmt.columnInt(0);
+            retval = true;
+        } else setDbErrorMsg("Failed to select from game");
+    } else setDbErrorMsg("Failed to prepare SELECT MAX statement");
+
+    return retval;
+}
+
+bool CfdbDatabase::readOpeningTree(vector<OpeningTreeEntry> &entries) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    entries.clear();
+
+    // Rows are returned in the same order as searchOpeningTree() returns them for a
+    // single position
+    int rv;
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.prepare("SELECT pos, move, score, last_move, game_id FROM optree ORDER BY rowid")) {
+        setDbErrorMsg("Failed to prepare optree select statement");
+        return false;
+    }
+
+    OpeningTreeEntry entry;
+
+    while ((rv = stmt.step()) == SQLITE_ROW) {
+        entry.setHashKey(stmt.columnUInt64(0));
+        entry.setMove((uint32_t)stmt.columnInt(1));
+        entry.setScore(stmt.columnInt(2));
+        entry.setLastMove(stmt.columnBool(3));
+        entry.setGameNum((unsigned)stmt.columnInt(4));
+        entries.push_back(entry);
+    }
+
+    if (rv != SQLITE_DONE) {
+        setDbErrorMsg("Failed to select optree row");
+        return false;
+    }
+
+    LOGDBG << entries.size() << " opening tree entries";
+
+    return true;
+}
+
+bool CfdbDatabase::setOpeningTreeDepth(unsigned depth) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access != ACCESS_READWRITE) {
+        DBERROR << "Cannot write to this database";
+        return false;
+    }
+
+    // write() finds the existing entries of a game using the index
+    SqliteStatement stmt(m_db);
+
+    if (depth > 0) {
+        if (!stmt.prepare("CREATE INDEX IF NOT EXISTS optree_game_index ON optree (game_id)") ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to create index 'optree_game_index'");
+            return false;
+        }
+    } else {
+        if (!stmt.prepare("DROP INDEX IF EXISTS optree_game_index") ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to drop index 'optree_game_index'");
+            return false;
+        }
+    }
+
+    if (!updateMetadata("optree_depth", Util::format("%u", depth)))
+        return false;
+
+    m_openingTreeDepth = depth;
+    return true;
+}
+
+bool CfdbDatabase::openingTreeGraphAvailable() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    // The optree table does not record the position each move was made from
+    if (!m_openingTreeFile.isOpen()) {
+        DBERROR << "The opening tree file is not available; the opening tree must be rebuilt";
+        return false;
+    }
+
+    return true;
+}
+
+string CfdbDatabase::openingTreeFilename() const {
+    return m_filename + ".optree";
+}
+
+bool CfdbDatabase::openOpeningTreeFile() {
+    m_openingTreeFile.close();
+
+    string filename = openingTreeFilename();
+
+    // The file must have been written from the current opening tree, with any later
+    // changes in the optree_delta table; the modification times cannot show this as the
+    // database and the file are written in the same second
+    if (!Util::fileExists(filename))
+        return false;
+
+    return m_openingTreeFile.open(filename, openingTreeGeneration());
+}
+
+unsigned CfdbDatabase::openingTreeGeneration() {
+    string generation;
+
+    if (!selectMetadata("optree_generation", generation))
+        return 0;
+
+    return (unsigned)atoi(generation.c_str());
+}
+
+string CfdbDatabase::searchIndexFilename() const {
+    return m_filename + ".search";
+}
+
+bool CfdbDatabase::openSearchIndex() {
+    string filename = searchIndexFilename();
+
+    // Ignore the file if the database has been modified since it was written
+    if (!Util::fileExists(filename) ||
+        Util::modifyTime(filename) < Util::modifyTime(m_filename)) {
+        m_searchIndex.close();
+        return false;
+    }
+
+    // The generation changes with every write, including those made within the
+    // modification time resolution and by other connections
+    unsigned numGames = lastGameNum();
+    unsigned generation = headerGeneration();
+
+    if (m_searchIndex.isOpen() &&
+        m_searchIndex.numGames() == numGames &&
+        m_searchIndex.generation() == generation)
+        return true;
+
+    return m_searchIndex.open(filename, numGames, generation);
+}
+
+unsigned CfdbDatabase::headerGeneration() {
+    string generation;
+
+    if (!selectMetadata("header_generation", generation))
+        return 0;
+
+    return (unsigned)atoi(generation.c_str());
+}
+
+bool CfdbDatabase::incrementHeaderGeneration() {
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.prepare(
+            "INSERT OR REPLACE INTO metadata (name, val) VALUES ('header_generation', "
+            "COALESCE((SELECT val FROM metadata WHERE name = 'header_generation'), 0) + 1)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to set metadata 'header_generation'");
+        return false;
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::buildSearchIndex() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    unsigned startTime = Util::getTickCount();
+    unsigned generation = headerGeneration();
+    SearchIndexBuilder builder;
+    SqliteStatement stmt(m_db);
+    string white, black, event, site, eco, errorMsg;
+    int rv;
+
+    m_searchIndex.close();
+
+    if (!stmt.prepare(
+            "SELECT game.game_id, whiteplayer.last_name, blackplayer.last_name, event.name, site.name, "
+            "game.eco, game.date, game.round_major, game.round_minor, game.result FROM game "
+            "LEFT JOIN player whiteplayer ON game.white_player_id = whiteplayer.player_id "
+            "LEFT JOIN player blackplayer ON game.black_player_id = blackplayer.player_id "
+            "LEFT JOIN event ON game.event_id = event.event_id "
+            "LEFT JOIN site ON game.site_id = site.site_id "
+            "ORDER BY game.game_id")) {
+        setDbErrorMsg("Failed to prepare search index statement");
+        return false;
+    }
+
+    builder.reserve(lastGameNum());
+
+    while ((rv = stmt.step()) == SQLITE_ROW) {
+        stmt.columnString(1, white);
+        stmt.columnString(2, black);
+        stmt.columnString(3, event);
+        stmt.columnString(4, site);
+        stmt.columnString(5, eco);
+        builder.add((unsigned)stmt.columnInt(0), white, black, event, site, eco, (uint32_t)stmt.columnInt(6),
+                    (unsigned)stmt.columnInt(7), (unsigned)stmt.columnInt(8), (uint32_t)stmt.columnInt(9));
+    }
+
+    if (rv != SQLITE_DONE) {
+        setDbErrorMsg("Failed to read game headers");
+        return false;
+    }
+
+    if (!builder.write(searchIndexFilename(), generation, errorMsg)) {
+        DBERROR << errorMsg;
+        return false;
+    }
+
+    LOGINF << "Built search index of " << builder.numGames() << " games in " << (Util::getTickCount() - startTime) <<
+        "ms";
+
+    return true;
+}
+
+bool CfdbDatabase::buildNameIndexes() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access != ACCESS_READWRITE) {
+        DBERROR << "Cannot write to this database";
+        return false;
+    }
+
+    if (!nameIndexesSupported()) {
+        DBERROR << "This version of sqlite (" << sqlite3_libversion() <<
+            ") does not support FTS5 trigram indexes";
+        return false;
+    }
+
+    unsigned startTime = Util::getTickCount();
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.beginTransaction()) {
+        setDbErrorMsg("Failed to begin transaction");
+        return false;
+    }
+
+    for (unsigned i = 0; i < sizeof(nameIndexTables) / sizeof(nameIndexTables[0]); i++) {
+        const char *table = nameIndexTables[i].table;
+
+        if (!stmt.prepare(Util::format("DROP TABLE IF EXISTS %s_fts", table)) ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to drop table '%s_fts'", table);
+            stmt.rollback();
+            return false;
+        }
+
+        if (!stmt.prepare(Util::format("CREATE VIRTUAL TABLE %s_fts USING fts5(name, tokenize = 'trigram')", table)) ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to create table '%s_fts'", table);
+            stmt.rollback();
+            return false;
+        }
+
+        if (!stmt.prepare(Util::format("INSERT INTO %s_fts (rowid, name) SELECT %s, %s FROM %s", table,
+                                       nameIndexTables[i].idColumn, nameIndexTables[i].nameColumn, table)) ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to populate table '%s_fts'", table);
+            stmt.rollback();
+            return false;
+        }
+    }
+
+    if (!updateNameIndexGeneration()) {
+        stmt.rollback();
+        return false;
+    }
+
+    if (!stmt.commit()) {
+        setDbErrorMsg("Failed to commit name indexes");
+        stmt.rollback();
+        return false;
+    }
+
+    m_nameIndexes = true;
+
+    LOGINF << "Built name indexes in " << (Util::getTickCount() - startTime) << "ms";
+
+    return true;
+}
+
+bool CfdbDatabase::dropNameIndexes() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access != ACCESS_READWRITE) {
+        DBERROR << "Cannot write to this database";
+        return false;
+    }
+
+    // Dropping a virtual table needs its module, so the tables are left alone if
+    // this version of sqlite cannot use them
+    if (!nameIndexesSupported()) {
+        DBERROR << "This version of sqlite (" << sqlite3_libversion() <<
+            ") does not support FTS5 trigram indexes";
+        return false;
+    }
+
+    SqliteStatement stmt(m_db);
+
+    m_nameIndexes = false;
+
+    for (unsigned i = 0; i < sizeof(nameIndexTables) / sizeof(nameIndexTables[0]); i++) {
+        const char *table = nameIndexTables[i].table;
+
+        if (!stmt.prepare(Util::format("DROP TABLE IF EXISTS %s_fts", table)) ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to drop table '%s_fts'", table);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::nameIndexesSupported() {
+    // The trigram tokenizer is in sqlite 3.34.0 onwards, provided FTS5 is enabled
+    return sqlite3_libversion_number() >= 3034000 && sqlite3_compileoption_used("ENABLE_FTS5") != 0;
+}
+
+bool CfdbDatabase::checkNameIndexes() {
+    m_nameIndexes = false;
+
+    SqliteStatement stmt(m_db);
+    unsigned numTables = sizeof(nameIndexTables) / sizeof(nameIndexTables[0]);
+
+    if (!stmt.prepare("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name IN "
+                      "('player_fts', 'event_fts', 'site_fts', 'annotator_fts')") ||
+        stmt.step() != SQLITE_ROW ||
+        (unsigned)stmt.columnInt(0) != numTables)
+        return false;
+
+    // The tables cannot be rebuilt while the statement is active
+    stmt.finalize();
+
+    if (!nameIndexesSupported()) {
+        LOGWRN << "Ignoring the name indexes as this version of sqlite (" << sqlite3_libversion() <<
+            ") does not support them";
+        return false;
+    }
+
+    // Games written without updating the indexes leave them behind the headers
+    string generation;
+
+    if (!selectMetadata("name_index_generation", generation) ||
+        (unsigned)atoi(generation.c_str()) != headerGeneration()) {
+        if (m_access != ACCESS_READWRITE) {
+            LOGWRN << "Ignoring the name indexes as they are out-of-date";
+            return false;
+        }
+
+        LOGINF << "Rebuilding the name indexes as they are out-of-date";
+
+        if (!buildNameIndexes()) {
+            LOGWRN << "Failed to rebuild the name indexes: " << errorMsg();
+            return false;
+        }
+
+        return true;
+    }
+
+    m_nameIndexes = true;
+    return true;
+}
+
+bool CfdbDatabase::updateNameIndexGeneration() {
+    return updateMetadata("name_index_generation", Util::format("%u", headerGeneration()));
+}
+
+bool CfdbDatabase::nameIndexSearch(const DatabaseSearchCriteria &searchCriteria) const {
+    if (!m_nameIndexes)
+        return false;
+
+    for (auto it = searchCriteria.begin(); it != searchCriteria.end(); ++it) {
+        switch (it->field) {
+        case DATABASE_FIELD_WHITEPLAYER:
+        case DATABASE_FIELD_BLACKPLAYER:
+        case DATABASE_FIELD_PLAYER:
+        case DATABASE_FIELD_EVENT:
+        case DATABASE_FIELD_SITE:
+            if (nameIndexComparison(it->comparison, it->value))
+                return true;
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
+
+bool CfdbDatabase::updateNameIndex(const string &table, unsigned id, const string &name) {
+    if (!m_nameIndexes)
+        return true;
+
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.prepare("INSERT OR REPLACE INTO " + table + "_fts (rowid, name) VALUES (?, ?)") ||
+        !stmt.bind(1, (int)id) ||
+        !stmt.bind(2, name) ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to update name index of %s %u", table.c_str(), id);
+        return false;
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                          DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset /*=0*/, int limit /*=0*/) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    if (callback == 0) {
+        DBERROR << "No callback function provided";
+        return false;
+    }
+
+    // The name indexes find the games without the search index, which would otherwise
+    // need building after every write
+    if (!m_useSearchIndex || nameIndexSearch(searchCriteria))
+        return searchTables(searchCriteria, sortCriteria, callback, contextInfo, offset, limit);
+
+    if (!openSearchIndex() && (!buildSearchIndex() || !openSearchIndex())) {
+        LOGWRN << "Searching without the search index: " << errorMsg();
+        clearErrorMsg();
+        return searchTables(searchCriteria, sortCriteria, callback, contextInfo, offset, limit);
+    }
+
+    DatabaseGameList gameList;
+    string errorMsg;
+
+    if (!m_searchIndex.search(searchCriteria, sortCriteria, gameList, errorMsg)) {
+        DBERROR << errorMsg;
+        return false;
+    }
+
+    LOGDBG << gameList.size() << " games matched";
+
+    size_t first = offset > 0 ? (size_t)(offset - 1) : 0;
+    size_t last = gameList.size();
+
+    if (limit > 0 && first + limit < last)
+        last = first + limit;
+
+    for (size_t i = first; i < last; i++) {
+        if (!callback(gameList[i], 0.0f, contextInfo)) {
+            LOGINF << "User terminated search";
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::searchTables(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                                DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset, int limit) {
+    vector<string> binds;
+    set<string> joins;
+    ostringstream query, where, orderBy;
+
+    for (auto it = searchCriteria.begin(); it != searchCriteria.end(); ++it) {
+        const DatabaseSearchDescriptor &descriptor = *it;
+
+        bool caseInsensitive = databaseComparisonCaseInsensitive(descriptor.comparison);
+
+        if (!binds.empty()) where << " AND";
+
+        // The name indexes find the matching names, which are then looked-up in the games
+        if (m_nameIndexes && nameIndexComparison(descriptor.comparison, descriptor.value)) {
+            switch (descriptor.field) {
+            case DATABASE_FIELD_WHITEPLAYER:
+                where << nameIndexCondition("white_player_id", "player", descriptor.comparison);
+                binds.push_back(descriptor.value);
+                continue;
+
+            case DATABASE_FIELD_BLACKPLAYER:
+                where << nameIndexCondition("black_player_id", "player", descriptor.comparison);
+                binds.push_back(descriptor.value);
+                continue;
+
+            case DATABASE_FIELD_PLAYER:
+                where << " (" << nameIndexCondition("white_player_id", "player", descriptor.comparison) <<
+                    " OR" << nameIndexCondition("black_player_id", "player", descriptor.comparison) << ")";
+                binds.push_back(descriptor.value);
+                binds.push_back(descriptor.value);
+                continue;
+
+            case DATABASE_FIELD_EVENT:
+                where << nameIndexCondition("event_id", "event", descriptor.comparison);
+                binds.push_back(descriptor.value);
+                continue;
+
+            case DATABASE_FIELD_SITE:
+                where << nameIndexCondition("site_id", "site", descriptor.comparison);
+                binds.push_back(descriptor.value);
+                continue;
+
+            default:
+                break;
+            }
+        }
+
+        switch (descriptor.field) {
+        case DATABASE_FIELD_WHITEPLAYER:
+            where << comparisonCondition(caseInsensitive ? "UPPER(whiteplayer.last_name)" : "whiteplayer.last_name",
+                                         descriptor.comparison);
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            joins.insert("white_player_id");
+            break;
+
+        case DATABASE_FIELD_BLACKPLAYER:
+            where << comparisonCondition(caseInsensitive ? "UPPER(blackplayer.last_name)" : "blackplayer.last_name",
+                                         descriptor.comparison);
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            joins.insert("black_player_id");
+            break;
+
+        case DATABASE_FIELD_PLAYER:
+            where << " (" <<
+                comparisonCondition(caseInsensitive ? "UPPER(whiteplayer.last_name)" : "whiteplayer.last_name",
+                                    descriptor.comparison) << " OR" <<
+                comparisonCondition(caseInsensitive ? "UPPER(blackplayer.last_name)" : "blackplayer.last_name",
+                                    descriptor.comparison) << ")";
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            joins.insert("white_player_id");
+            joins.insert("black_player_id");
+            break;
+
+        case DATABASE_FIELD_EVENT:
+            where << comparisonCondition(caseInsensitive ? "UPPER(event.name)" : "event.name", descriptor.comparison);
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            joins.insert("event_id");
+            break;
+
+        case DATABASE_FIELD_SITE:
+            where << comparisonCondition(caseInsensitive ? "UPPER(site.name)" : "site.name", descriptor.comparison);
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            joins.insert("site_id");
+            break;
+
+        case DATABASE_FIELD_DATE:
+
+            if (databaseComparisonNoFlags(descriptor.comparison) == DATABASE_COMPARE_EQUALS) {
+                // This could probably use bind variables as well, but it's (wrongly )assumed that all
+                // bind variables are strings, so that would need changing first...
+                int year = 0, month = 0, day = 0;
+
+                if (sscanf(descriptor.value.c_str(), "%04d%02d%02d", &year, &month, &day) == 3)
+                    // Compare with exact year/month/day
+                    where << " game.date = " << Util::format("%04d%02d%02d", year, month, day);
+                else if (sscanf(descriptor.value.c_str(), "%04d%02d", &year, &month) == 2)
+                    // Compare with this month and end of month
+                    where << " (game.date >= " << Util::format("%04d%02d00", year, month) <<
+                        " AND game.date <= " << Util::format("%04d%02d31", year, month) << ")";
+                else if (sscanf(descriptor.value.c_str(), "%04d", &year) == 1)
+                    // Compare with this year and end of year
+                    where << " (game.date >= " << Util::format("%04d0000", year) <<
+                        " AND game.date <= " << Util::format("%04d1231", year) << ")";
+                else {
+                    DBERROR << "Cannot search for date using invalid value '" << descriptor.value << "'";
+                    return false;
+                }
+            } else LOGWRN << "Ignoring to request to search for date as comparison is not \"equals\"";
+
+            break;
+
+        case DATABASE_FIELD_ECO:
+            where << comparisonCondition(caseInsensitive ? "UPPER(game.eco)" : "game.eco", descriptor.comparison);
+            binds.push_back(caseInsensitive ? Util::toupper(descriptor.value) : descriptor.value);
+            break;
+
+        default:
+            DBERROR << "Field " << descriptor.field << " cannot be used for searching";
+            return false;
+        }
+    }
+
+    if (sortCriteria.empty()) {
+        orderBy << "game.game_id ASC";
+    } else {
+        for (auto it = sortCriteria.begin(); it != sortCriteria.end(); ++it) {
+            const DatabaseSortDescriptor &descriptor = *it;
+
+            if (orderBy.tellp() > 0) orderBy << ", ";
+
+            switch (descriptor.field) {
+            case DATABASE_FIELD_GAME_NUM:
+                orderBy << "game.game_id" << orderString(descriptor.order);
+                break;
+
+            case DATABASE_FIELD_WHITEPLAYER:
+                orderBy << "whiteplayer.last_name" << orderString(descriptor.order);
+                joins.insert("white_player_id");
+                break;
+
+            case DATABASE_FIELD_BLACKPLAYER:
+                orderBy << "blackplayer.last_name" << orderString(descriptor.order);
+                joins.insert("black_player_id");
+                break;
+
+            case DATABASE_FIELD_EVENT:
+                orderBy << "event.name" << orderString(descriptor.order);
+                joins.insert("event_id");
+                break;
+
+            case DATABASE_FIELD_SITE:
+                orderBy << "site.name" << orderString(descriptor.order);
+                joins.insert("site_id");
+                break;
+
+            case DATABASE_FIELD_ROUND:
+                orderBy << "game.round_major" << orderString(descriptor.order) <<
+                    ", game.round_minor" << orderString(descriptor.order);
+                break;
+
+            case DATABASE_FIELD_DATE:
+                orderBy << "game.date" << orderString(descriptor.order);
+                break;
+
+            case DATABASE_FIELD_ECO:
+                orderBy << "game.eco" << orderString(descriptor.order);
+                break;
+
+            case DATABASE_FIELD_RESULT:
+                orderBy << "game.result" << orderString(descriptor.order);
+                break;
+
+            default:
+                DBERROR << "Field " << descriptor.field << " cannot be used for sorting";
+                return false;
+            }
+        }
+    }
+
+    query << "SELECT game.game_id FROM game";
+
+    // Games without a player, event or site are still found, as they are by the search
+    // index, if the other criteria match
+    for (auto it = joins.begin(); it != joins.end(); ++it) {
+        const string &column = *it;
+
+        if (column == "white_player_id")
+            query << " LEFT JOIN player whiteplayer ON game.white_player_id = whiteplayer.player_id";
+        else if (column == "black_player_id")
+            query << " LEFT JOIN player blackplayer ON game.black_player_id = blackplayer.player_id";
+        else if (column == "event_id")
+            query << " LEFT JOIN event ON game.event_id = event.event_id";
+        else if (column == "site_id")
+            query << " LEFT JOIN site ON game.site_id = site.site_id";
+        else ASSERT(false);
+    }
+
+    if (where.tellp() > 0)
+        query << " WHERE" << where.str();
+
+    query << " GROUP BY game.game_id";
+    query << " ORDER BY " << orderBy.str();
+
+    if (limit > 0)
+        query << " LIMIT " << limit;
+
+    if (offset > 0)
+        query << " OFFSET " << offset - 1;
+
+    LOGDBG << "Query: " << query.str();
+
+    SqliteStatement stmt(m_db);
+
+    if (stmt.prepare(query.str())) {
+        int bindColumn = 1, rv;
+
+        for (auto it = binds.begin(); it != binds.end(); ++it) {
+            const string &value = *it;
+
+            if (!stmt.bind(bindColumn, value)) {
+                LOGERR << "Failed to bind column " << bindColumn << " with value '" << value << "'";
+                return false;
+            }
+
+            bindColumn++;
+        }
+
+        while ((rv = stmt.step()) == SQLITE_ROW) {
+            unsigned gameNum = (unsigned)stmt.columnInt(0);
+
+            if (!callback(gameNum, 0.0f, contextInfo)) {
+                LOGINF << "User terminated search";
+                return true;
+            }
+        }
+
+        if (rv != SQLITE_DONE) {
+            setDbErrorMsg("Failed to search games");
+            return false;
+        }
+    } else {
+        setDbErrorMsg("Failed to prepare search statement");
+        return false;
+    }
+
+    return true;
+}
+
+unsigned CfdbDatabase::numGames() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return 0;
+    }
+
+    unsigned count = 0;
+    int rv;
+    SqliteStatement stmt(m_db);
+
+    if (stmt.prepare("SELECT COUNT(*) FROM game")) {
+        rv = stmt.step();
+        if (rv == SQLITE_ROW) {
+            count = (unsigned)stmt.columnInt(0);
+            LOGDBG << "Database '" << m_filename << "' contains " << count << " games";
+        } else if (rv == SQLITE_DONE) {
+            DBERROR << "Failed to count games";
+        }
+        else {
+            setDbErrorMsg("Failed to count games");
+        }
+    } else {
+        setDbErrorMsg("Failed to prepare SELECT COUNT statement");
+    }
+
+    return count;
+}
+
+unsigned CfdbDatabase::firstGameNum() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return 0;
+    }
+
+    unsigned gameNum = 0;
+    int rv;
+    SqliteStatement stmt(m_db);
+
+    if (stmt.prepare("SELECT MIN(game_id) FROM game")) {
+        rv = stmt.step();
+        if (rv == SQLITE_ROW)
+            gameNum = (unsigned)stmt.columnInt(0);
+        else
+            setDbErrorMsg("Failed to get first game number");
+    } else {
+        setDbErrorMsg("Failed to prepare SELECT MIN statement");
+    }
+
+    return gameNum;
+}
+
+unsigned CfdbDatabase::lastGameNum() {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return 0;
+    }
+
+    unsigned gameNum = 0;
+    int rv;
+    SqliteStatement stmt(m_db);
+
+    if (stmt.prepare("SELECT MAX(game_id) FROM game")) {
+        rv = stmt.step();
+        if (rv == SQLITE_ROW)
+            gameNum = (unsigned)stmt.columnInt(0);
+        else
+            setDbErrorMsg("Failed to get last game number");
+    } else {
+        setDbErrorMsg("Failed to prepare SELECT MAX statement");
+    }
+
+    return gameNum;
+}
+
+bool CfdbDatabase::gameExists(unsigned gameNum) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    unsigned count = 0;
+    int rv;
+    SqliteStatement stmt(m_db);
+
+    if (stmt.prepare("SELECT COUNT(*) FROM game WHERE game_id = ?") &&
+        stmt.bind(1, (int)gameNum)) {
         rv = stmt.step();
         if (rv == SQLITE_ROW)
             count = (unsigned)stmt.columnInt(0);
@@ -1158,244 +2647,661 @@ bool CfdbDatabase::gameExists(unsigned gameNum) {
         setDbErrorMsg("Failed to prepare game exists statement");
     }
 
-    return count == 1;
-}
+    return count == 1;
+}
+
+bool CfdbDatabase::createSchema() {
+    clearErrorMsg();
+
+    SqliteStatement stmt(m_db);
+
+    LOGDBG << "Creating table 'metadata'";
+
+    if (!stmt.prepare(
+            "CREATE TABLE metadata ("
+            "name TEXT PRIMARY KEY, "
+            "val TEXT)") || stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create table 'metadata'");
+        return false;
+    }
+
+    LOGDBG << "Creating table 'game'";
+
+    if (!stmt.prepare(
+            "CREATE TABLE game ("
+            "game_id INTEGER PRIMARY KEY, "
+            "white_player_id INTEGER, "
+            "black_player_id INTEGER, "
+            "event_id INTEGER, "
+            "site_id INTEGER, "
+            "date INTEGER, "
+            "round_major INTEGER, "
+            "round_minor INTEGER, "
+            "result INTEGER, "
+            "annotator_id INTEGER, "
+            "eco TEXT, "
+            "white_elo INTEGER, "
+            "black_elo INTEGER, "
+            "time_control BLOB, "
+            "halfmoves INTEGER, "
+            "partial BLOB, "
+            "moves BLOB, "
+            "annotations BLOB)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create table 'game'");
+        return false;
+    }
+
+    LOGDBG << "Creating index 'game_index'";
+
+    if (!stmt.prepare(
+            "CREATE UNIQUE INDEX game_index ON game (game_id)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'game_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating table 'player'";
+
+    if (!stmt.prepare(
+            "CREATE TABLE player ("
+            "player_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "last_name TEXT, "
+            "first_names TEXT, "
+            "country_code TEXT)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create table 'player'");
+        return false;
+    }
+
+    LOGDBG << "Creating index 'player_index'";
+
+    if (!stmt.prepare("CREATE UNIQUE INDEX player_index ON player (player_id)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'player_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating index 'player_last_name_index'";
+
+    if (!stmt.prepare(
+            "CREATE INDEX player_last_name_index ON player (last_name)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'player_last_name_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating table 'event'";
+
+    if (!stmt.prepare(
+            "CREATE TABLE event ("
+            "event_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create table 'event'");
+        return false;
+    }
+
+    LOGDBG << "Creating index 'event_index'";
+
+    if (!stmt.prepare("CREATE UNIQUE INDEX event_index ON event (event_id)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'event_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating index 'event_name_index'";
+
+    if (!stmt.prepare("CREATE INDEX event_name_index ON event (name)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'event_name_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating table 'site'";
 
-bool CfdbDatabase::createSchema() {
-    clearErrorMsg();
+    if (!stmt.prepare(
+            "CREATE TABLE site ("
+            "site_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create table 'site'");
+        return false;
+    }
 
-    SqliteStatement stmt(m_db);
+    LOGDBG << "Creating index 'site_index'";
 
-    LOGDBG << "Creating table 'metadata'";
+    if (!stmt.prepare("CREATE UNIQUE INDEX site_index ON site (site_id)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'site_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating index 'site_name_index'";
+
+    if (!stmt.prepare("CREATE INDEX site_name_index ON site (name)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'site_name_index'");
+        return false;
+    }
+
+    LOGDBG << "Creating table 'annotator'";
 
     if (!stmt.prepare(
-            "CREATE TABLE metadata ("
-            "name TEXT PRIMARY KEY, "
-            "val TEXT)") || stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create table 'metadata'");
+            "CREATE TABLE annotator ("
+            "annotator_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT)") ||
+        stmt.step() != SQLITE_DONE) setDbErrorMsg("Failed to create table 'annotator'");
+
+    LOGDBG << "Creating index 'annotator_index'";
+
+    if (!stmt.prepare(
+            "CREATE UNIQUE INDEX annotator_index ON annotator (annotator_id)") ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to create index 'annotator_index'");
         return false;
     }
 
-    LOGDBG << "Creating table 'game'";
+    LOGDBG << "Creating index 'annotator_name_index'";
 
     if (!stmt.prepare(
-            "CREATE TABLE game ("
-            "game_id INTEGER PRIMARY KEY, "
-            "white_player_id INTEGER, "
-            "black_player_id INTEGER, "
-            "event_id INTEGER, "
-            "site_id INTEGER, "
-            "date INTEGER, "
-            "round_major INTEGER, "
-            "round_minor INTEGER, "
-            "result INTEGER, "
-            "annotator_id INTEGER, "
-            "eco TEXT, "
-            "white_elo INTEGER, "
-            "black_elo INTEGER, "
-            "time_control BLOB, "
-            "halfmoves INTEGER, "
-            "partial BLOB, "
-            "moves BLOB, "
-            "annotations BLOB)") ||
+            "CREATE INDEX annotator_name_index ON annotator (name)") ||
         stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create table 'game'");
+        setDbErrorMsg("Failed to create index 'annotator_name_index'");
         return false;
     }
 
-    LOGDBG << "Creating index 'game_index'";
+    LOGDBG << "Creating table 'optree'";
 
     if (!stmt.prepare(
-            "CREATE UNIQUE INDEX game_index ON game (game_id)") ||
+            "CREATE TABLE optree ("
+            "pos UNSIGNED BIG INT, "
+            "prev_pos UNSIGNED BIG INT, "
+            "move INTEGER, "
+            "score TINYINT, "
+            "last_move TINYINT, "
+            "game_id INTEGER)") ||
         stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'game_index'");
+        setDbErrorMsg("Failed to create table 'optree'");
         return false;
     }
 
-    LOGDBG << "Creating table 'player'";
+    LOGDBG << "Creating index 'optree_pos_index'";
 
     if (!stmt.prepare(
-            "CREATE TABLE player ("
-            "player_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-            "last_name TEXT, "
-            "first_names TEXT, "
-            "country_code TEXT)") ||
+            "CREATE INDEX optree_pos_index ON optree (pos)") ||
         stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create table 'player'");
+        setDbErrorMsg("Failed to create index 'optree_pos_index'");
         return false;
     }
 
-    LOGDBG << "Creating index 'player_index'";
+    if (!createOpeningTreeDelta())
+        return false;
 
-    if (!stmt.prepare("CREATE UNIQUE INDEX player_index ON player (player_id)") ||
+    LOGDBG << "Populating 'metadata' table";
+
+    if (!stmt.prepare("INSERT INTO metadata (name, val) VALUES (?, ?)") ||
+        !stmt.bind(1, "schema_version") ||
+        !stmt.bind(2, CURRENT_SCHEMA_VERSION) ||
         stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'player_index'");
+        setDbErrorMsg("Failed to set schema version");
+        return false;
+    }
+
+    m_schemaVersion = CURRENT_SCHEMA_VERSION;
+    return true;
+}
+
+bool CfdbDatabase::selectMetadata(const string &name, string &value) {
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.prepare("SELECT val FROM metadata WHERE name = ?") ||
+        !stmt.bind(1, name) ||
+        stmt.step() != SQLITE_ROW)
+        return false;
+
+    return stmt.columnString(0, value);
+}
+
+bool CfdbDatabase::updateMetadata(const string &name, const string &value) {
+    SqliteStatement stmt(m_db);
+
+    if (!stmt.prepare("INSERT OR REPLACE INTO metadata (name, val) VALUES (?, ?)") ||
+        !stmt.bind(1, name) ||
+        !stmt.bind(2, value) ||
+        stmt.step() != SQLITE_DONE) {
+        setDbErrorMsg("Failed to set metadata '%s'", name.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool CfdbDatabase::checkSchema() {
+    clearErrorMsg();
+
+    SqliteStatement stmt(m_db);
+
+    int stepval = SQLITE_OK;
+
+    if (!stmt.prepare("SELECT val FROM metadata WHERE name = ?") ||
+        !stmt.bind(1, "schema_version") ||
+        (stepval = stmt.step()) != SQLITE_ROW) {
+        if (stepval == SQLITE_DONE)
+            setDbErrorMsg("Schema version is not set in the database");
+        else
+            setDbErrorMsg("Failed to select schema_version");
+
+        return false;
+    }
+
+    int schemaVersion = stmt.columnInt(0);
+    LOGDBG << "Schema version is " << schemaVersion;
+
+    if (schemaVersion < 1 || schemaVersion > CURRENT_SCHEMA_VERSION) {
+        DBERROR << "Database is using an unsupported schema version (" << schemaVersion << ")";
+        return false;
+    }
+
+    if (schemaVersion != CURRENT_SCHEMA_VERSION)
+        LOGINF << "Database is using schema version " << schemaVersion << " rather than " << CURRENT_SCHEMA_VERSION;
+
+    m_schemaVersion = (unsigned)schemaVersion;
+    return true;
+}
+
+bool CfdbDatabase::upgradeSchema(DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access != ACCESS_READWRITE) {
+        DBERROR << "Cannot write to this database";
+        return false;
+    }
+
+    if (m_schemaVersion == CURRENT_SCHEMA_VERSION)
+        return true;
+
+    // The readers would decode the games using the old schema version
+    closeReaders();
+
+    LOGINF << "Upgrading database '" << m_filename << "' from schema version " << m_schemaVersion <<
+        " to " << CURRENT_SCHEMA_VERSION;
+
+    unsigned startTime = Util::getTickCount();
+    unsigned oldSchemaVersion = m_schemaVersion;
+    unsigned generation = openingTreeGeneration();
+    vector<unsigned> gameNums;
+    SqliteStatement stmt(m_db), updateStmt(m_db);
+    int rv;
+
+    // Only version 1 encodes the moves differently from the current version
+    if (oldSchemaVersion == 1) {
+        if (!stmt.prepare("SELECT game_id FROM game ORDER BY game_id")) {
+            setDbErrorMsg("Failed to prepare game select statement");
+            return false;
+        }
+
+        while ((rv = stmt.step()) == SQLITE_ROW)
+            gameNums.push_back((unsigned)stmt.columnInt(0));
+
+        if (rv != SQLITE_DONE) {
+            setDbErrorMsg("Failed to select games");
+            return false;
+        }
+    }
+
+    if (!stmt.beginTransaction()) {
+        setDbErrorMsg("Failed to begin transaction");
+        return false;
+    }
+
+    if (!gameNums.empty() && !updateStmt.prepare("UPDATE game SET moves = ?, annotations = ? WHERE game_id = ?")) {
+        setDbErrorMsg("Failed to prepare game update statement");
+        stmt.rollback();
+        return false;
+    }
+
+    // Each game is read using the old encoding and written using the new one
+    Game game;
+
+    for (size_t i = 0; i < gameNums.size(); i++) {
+        unsigned gameNum = gameNums[i];
+        m_schemaVersion = oldSchemaVersion;
+
+        if (!read(gameNum, game)) {
+            LOGERR << "Failed to read game " << gameNum;
+            stmt.rollback();
+            return false;
+        }
+
+        m_schemaVersion = CURRENT_SCHEMA_VERSION;
+
+        if (!encodeMoves(game, m_moves, m_annotations)) {
+            m_schemaVersion = oldSchemaVersion;
+            stmt.rollback();
+            return false;
+        }
+
+        updateStmt.reset();
+
+        if (!updateStmt.bind(1, m_moves) ||
+            !updateStmt.bind(2, m_annotations) ||
+            !updateStmt.bind(3, (int)gameNum) ||
+            updateStmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to update game %u", gameNum);
+            m_schemaVersion = oldSchemaVersion;
+            stmt.rollback();
+            return false;
+        }
+
+        if (callback && !callback(gameNum, ((float)(i + 1) * 100.0f) / (float)gameNums.size(), contextInfo)) {
+            DBERROR << "User cancelled operation";
+            m_schemaVersion = oldSchemaVersion;
+            stmt.rollback();
+            return false;
+        }
+    }
+
+    updateStmt.finalize();
+    m_schemaVersion = oldSchemaVersion;
+
+    // The opening tree changes are recorded with the positions the moves were made from,
+    // which the existing entries do not have, so any opening tree file must be rebuilt
+    if (oldSchemaVersion < OPTREE_DELTA_SCHEMA_VERSION) {
+        if (!stmt.prepare("ALTER TABLE optree ADD COLUMN prev_pos UNSIGNED BIG INT") ||
+            stmt.step() != SQLITE_DONE) {
+            setDbErrorMsg("Failed to add column 'prev_pos' to table 'optree'");
+            stmt.rollback();
+            return false;
+        }
+
+        if (!createOpeningTreeDelta() ||
+            (generation > 0 && !updateMetadata("optree_generation", Util::format("%u", generation + 1)))) {
+            stmt.rollback();
+            return false;
+        }
+    }
+
+    if (!updateMetadata("schema_version", Util::format("%u", (unsigned)CURRENT_SCHEMA_VERSION))) {
+        stmt.rollback();
+        return false;
+    }
+
+    if (!stmt.commit()) {
+        setDbErrorMsg("Failed to commit upgraded database");
+        stmt.rollback();
         return false;
     }
 
-    LOGDBG << "Creating index 'player_last_name_index'";
+    m_schemaVersion = CURRENT_SCHEMA_VERSION;
+    openOpeningTreeFile();
+    invalidateOpeningTreeCache();
+
+    LOGINF << "Upgraded " << gameNums.size() << " games in " << (Util::getTickCount() - startTime) << "ms";
+
+    return true;
+}
+
+bool CfdbDatabase::decodeMoves(Game &game, const Blob &moves, const Blob &annotations,
+                               const DatabaseReadOptions &options) {
+    clearErrorMsg();
+
+    ASSERT(moves.data());
+    ASSERT(moves.length());
+    ASSERT(m_schemaVersion >= 1 && m_schemaVersion <= CURRENT_SCHEMA_VERSION);
+
+    const MoveEncoding &encoding = moveEncodings[m_schemaVersion - 1];
+    Bitstream moveBitstream(moves);
+    const uint8_t *pannot = annotations.data();
+    AnnotMove *lastMove = 0;
+    bool variationStarted = false;
+    Position variationPos;
+    unsigned startPly = game.position().ply(), depth = 0;
+
+    while (moveBitstream.readOffset() < moves.length()) {
+        uint32_t encodedMove;
+
+        if (!moveBitstream.read(encodedMove, ENCMOVE_TYPE_BITSIZE)) {
+            DBERROR << "Failed to read from move bitstream at offset " << moveBitstream.readOffset();
+            return false;
+        }
+
+        if (encodedMove == ENCMOVE_TYPE_VARSTART) {
+            if (options.mainlineOnly) {
+                // The variation is made from the position before the current move
+                if (m_schemaVersion > 1 && !game.getPriorPosition(game.currentMove(), variationPos)) {
+                    DBERROR << "Failed to get the position at the start of the variation";
+                    return false;
+                }
+
+                if (!skipVariation(moveBitstream, pannot, variationPos, variationPos))
+                    return false;
+
+                continue;
+            }
+
+            if (!game.startVariation()) {
+                DBERROR << "Failed to start variation after move '" <<
+                    (lastMove ? lastMove->dump() : "none") << "'";
+                return false;
+            }
+            lastMove = 0;
+            variationStarted = true;
+            depth++;
+        } else if (encodedMove == ENCMOVE_TYPE_VAREND) {
+            game.checkGameOver();
+
+            if (!game.endVariation()) {
+                DBERROR << "Failed to end variation after move '" <<
+                    (lastMove ? lastMove->dump() : "none") << "'";
+                return false;
+            }
+            lastMove = 0;
+            variationStarted = false;
+            depth--;
+        } else { // Move
+            unsigned bitcount;
 
-    if (!stmt.prepare(
-            "CREATE INDEX player_last_name_index ON player (last_name)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'player_last_name_index'");
-        return false;
-    }
+            if (encodedMove == ENCMOVE_TYPE_MOVE)
+                bitcount = encoding.moveBitsize;
+            else // encodedMove == ENCMOVE_TYPE_ANNOTMOVE
+                bitcount = encoding.annotMoveBitsize;
 
-    LOGDBG << "Creating table 'event'";
+            if (!moveBitstream.read(encodedMove, bitcount)) {
+                DBERROR << "Failed to read from move bitstream at offset " << moveBitstream.readOffset();
+                return false;
+            }
 
-    if (!stmt.prepare(
-            "CREATE TABLE event ("
-            "event_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-            "name TEXT)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create table 'event'");
-        return false;
-    }
+            // Is this the end-of-game marker?
+            if (bitcount == encoding.annotMoveBitsize && encodedMove == 0) {
+                game.checkGameOver();
+                return true;
+            }
 
-    LOGDBG << "Creating index 'event_index'";
+            // The first move of a variation is made from the position before the
+            // move it replaces
+            const Position *pos = &game.position();
+            Move move;
 
-    if (!stmt.prepare("CREATE UNIQUE INDEX event_index ON event (event_id)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'event_index'");
-        return false;
-    }
+            if (m_schemaVersion > 1) {
+                if (variationStarted) {
+                    if (!game.getPriorPosition(game.currentMove(), variationPos)) {
+                        DBERROR << "Failed to get the position at the start of the variation";
+                        return false;
+                    }
 
-    LOGDBG << "Creating index 'event_name_index'";
+                    pos = &variationPos;
+                }
 
-    if (!stmt.prepare("CREATE INDEX event_name_index ON event (name)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'event_name_index'");
-        return false;
-    }
+                uint32_t ordinals = encodedMove & encoding.moveMask;
 
-    LOGDBG << "Creating table 'site'";
+                if (!decodeOrdinals(*pos, ordinals, moveBitstream, move)) {
+                    DBERROR << "Invalid encoded move 0x" << hex << ordinals << dec << " in position " << pos->fen();
+                    return false;
+                }
+            }
 
-    if (!stmt.prepare(
-            "CREATE TABLE site ("
-            "site_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-            "name TEXT)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create table 'site'");
-        return false;
-    }
+            // A move beyond the ply limit ends its line.  The first move of a variation
+            // replaces a move that has been read, so it is always within the limit.
+            if (options.maxPlies > 0 && !variationStarted && game.position().ply() - startPly >= options.maxPlies) {
+                if (depth == 0)
+                    return true;
 
-    LOGDBG << "Creating index 'site_index'";
+                skipAnnotations(pannot, encodedMove, encoding);
+                Position next(*pos);
 
-    if (!stmt.prepare("CREATE UNIQUE INDEX site_index ON site (site_id)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'site_index'");
-        return false;
-    }
+                if (m_schemaVersion > 1) {
+                    UnmakeMoveInfo umi;
 
-    LOGDBG << "Creating index 'site_name_index'";
+                    if (!next.makeMove(move, umi)) {
+                        DBERROR << "Failed to make move " << move.dump();
+                        return false;
+                    }
+                }
 
-    if (!stmt.prepare("CREATE INDEX site_name_index ON site (name)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'site_name_index'");
-        return false;
-    }
+                if (!skipVariation(moveBitstream, pannot, *pos, next))
+                    return false;
 
-    LOGDBG << "Creating table 'annotator'";
+                if (!game.endVariation()) {
+                    DBERROR << "Failed to end variation after move '" <<
+                        (lastMove ? lastMove->dump() : "none") << "'";
+                    return false;
+                }
+                lastMove = 0;
+                depth--;
+                continue;
+            }
 
-    if (!stmt.prepare(
-            "CREATE TABLE annotator ("
-            "annotator_id INTEGER PRIMARY KEY AUTOINCREMENT, "
-            "name TEXT)") ||
-        stmt.step() != SQLITE_DONE) setDbErrorMsg("Failed to create table 'annotator'");
+            // The game-over flags (e.g. mate) are set at the end of each line
+            if (m_schemaVersion == 1)
+                lastMove = game.makeMove(encodedMove & encoding.moveMask);
+            else
+                lastMove = game.makeBuiltMove(move);
 
-    LOGDBG << "Creating index 'annotator_index'";
+            variationStarted = false;
 
-    if (!stmt.prepare(
-            "CREATE UNIQUE INDEX annotator_index ON annotator (annotator_id)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'annotator_index'");
-        return false;
-    }
+            if (lastMove) {
+                if (!options.skipAnnotations) {
+                    if (encodedMove & encoding.preAnnotBit) {
+                        ASSERT(pannot < annotations.end());
+                        lastMove->setPreAnnot((const char *)pannot);
+                        pannot += strlen((const char *)pannot) + 1;
+                    }
 
-    LOGDBG << "Creating index 'annotator_name_index'";
+                    if (encodedMove & encoding.postAnnotBit) {
+                        ASSERT(pannot < annotations.end());
+                        lastMove->setPostAnnot((const char *)pannot);
+                        pannot += strlen((const char *)pannot) + 1;
+                    }
 
-    if (!stmt.prepare(
-            "CREATE INDEX annotator_name_index ON annotator (name)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'annotator_name_index'");
-        return false;
-    }
+                    if (encodedMove & encoding.nagsBit) {
+                        ASSERT(pannot < annotations.end());
 
-    LOGDBG << "Creating table 'optree'";
+                        while (*pannot != NAG_NONE)
+                            lastMove->addNag((Nag) * pannot++);
 
-    if (!stmt.prepare(
-            "CREATE TABLE optree ("
-            "pos UNSIGNED BIG INT, "
-            "move INTEGER, "
-            "score TINYINT, "
-            "last_move TINYINT, "
-            "game_id INTEGER)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create table 'optree'");
-        return false;
+                        pannot++; // Skip terminating NAG_NONE
+                    }
+                }
+            } else {
+                DBERROR << "Failed to make move " << (unsigned)(encodedMove & encoding.moveMask);
+                return false;
+            }
+        }
     }
 
-    LOGDBG << "Creating index 'optree_pos_index'";
+    DBERROR << "End of blob encountered before end-of-marker found";
+    return false;
+}
 
-    if (!stmt.prepare(
-            "CREATE INDEX optree_pos_index ON optree (pos)") ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to create index 'optree_pos_index'");
-        return false;
-    }
+bool CfdbDatabase::skipVariation(Bitstream &moveBitstream, const uint8_t *&pannot, const Position &prior,
+                                 const Position &pos) {
+    // Schema version 1 moves can be skipped without knowing the position, however
+    // whether a version 2 move is followed by a promotion piece depends on it.
+    // 'pos' is the position the next move of the line is made from and 'prior' is
+    // the position the previous move was made from, which is where a variation
+    // of the previous move starts.
+    const MoveEncoding &encoding = moveEncodings[m_schemaVersion - 1];
+    Position linePrior(prior), linePos(pos);
+
+    while (moveBitstream.readOffset() < moveBitstream.length()) {
+        uint32_t encodedMove;
 
-    LOGDBG << "Populating 'metadata' table";
+        if (!moveBitstream.read(encodedMove, ENCMOVE_TYPE_BITSIZE)) {
+            DBERROR << "Failed to read from move bitstream at offset " << moveBitstream.readOffset();
+            return false;
+        }
 
-    if (!stmt.prepare("INSERT INTO metadata (name, val) VALUES (?, ?)") ||
-        !stmt.bind(1, "schema_version") ||
-        !stmt.bind(2, CURRENT_SCHEMA_VERSION) ||
-        stmt.step() != SQLITE_DONE) {
-        setDbErrorMsg("Failed to set schema version");
-        return false;
-    }
+        if (encodedMove == ENCMOVE_TYPE_VARSTART) {
+            if (!skipVariation(moveBitstream, pannot, linePrior, linePrior))
+                return false;
+        } else if (encodedMove == ENCMOVE_TYPE_VAREND) {
+            return true;
+        } else { // Move
+            unsigned bitcount;
 
-    return true;
-}
+            if (encodedMove == ENCMOVE_TYPE_MOVE)
+                bitcount = encoding.moveBitsize;
+            else // encodedMove == ENCMOVE_TYPE_ANNOTMOVE
+                bitcount = encoding.annotMoveBitsize;
 
-bool CfdbDatabase::checkSchema() {
-    clearErrorMsg();
+            if (!moveBitstream.read(encodedMove, bitcount)) {
+                DBERROR << "Failed to read from move bitstream at offset " << moveBitstream.readOffset();
+                return false;
+            }
 
-    SqliteStatement stmt(m_db);
+            if (bitcount == encoding.annotMoveBitsize && encodedMove == 0) {
+                DBERROR << "End-of-game marker found within a variation";
+                return false;
+            }
 
-    int stepval = SQLITE_OK;
+            if (m_schemaVersion > 1) {
+                uint32_t ordinals = encodedMove & encoding.moveMask;
+                Move move;
+                UnmakeMoveInfo umi;
 
-    if (!stmt.prepare("SELECT val FROM metadata WHERE name = ?") ||
-        !stmt.bind(1, "schema_version") ||
-        (stepval = stmt.step()) != SQLITE_ROW) {
-        if (stepval == SQLITE_DONE)
-            setDbErrorMsg("Schema version is not set in the database");
-        else
-            setDbErrorMsg("Failed to select schema_version");
+                if (!decodeOrdinals(linePos, ordinals, moveBitstream, move)) {
+                    DBERROR << "Invalid encoded move 0x" << hex << ordinals << dec << " in position " << linePos.fen();
+                    return false;
+                }
 
-        return false;
-    }
+                linePrior = linePos;
 
-    int schemaVersion = stmt.columnInt(0);
-    LOGDBG << "Schema version is " << schemaVersion;
+                if (!linePos.makeMove(move, umi)) {
+                    DBERROR << "Failed to make move " << move.dump();
+                    return false;
+                }
+            }
 
-    if (schemaVersion != CURRENT_SCHEMA_VERSION) {
-        DBERROR << "Database is using an unsupported schema version (" << schemaVersion << ")";
-        return false;
+            skipAnnotations(pannot, encodedMove, encoding);
+        }
     }
 
-    return true;
+    DBERROR << "End of blob encountered before end of variation found";
+    return false;
 }
 
-bool CfdbDatabase::decodeMoves(Game &game, const Blob &moves, const Blob &annotations) {
+bool CfdbDatabase::decodeMoves(CompactGame &game, const Blob &moves, const DatabaseReadOptions &options) {
     clearErrorMsg();
 
     ASSERT(moves.data());
     ASSERT(moves.length());
+    ASSERT(m_schemaVersion >= 1 && m_schemaVersion <= CURRENT_SCHEMA_VERSION);
 
+    const MoveEncoding &encoding = moveEncodings[m_schemaVersion - 1];
     Bitstream moveBitstream(moves);
-    const uint8_t *pannot = annotations.data();
-    AnnotMove *lastMove = 0;
+    const uint8_t *pannot = 0;      // Annotations are not read
+    unsigned startPly = game.startPosition().ply();
+    Move genMoves[256];
+
+    // lines[0] is the mainline and the others are the variations being decoded
+    vector<CompactGameLine> lines(1);
+    lines[0].pos = game.startPosition();
 
     while (moveBitstream.readOffset() < moves.length()) {
         uint32_t encodedMove;
@@ -1406,26 +3312,38 @@ bool CfdbDatabase::decodeMoves(Game &game, const Blob &moves, const Blob &annota
         }
 
         if (encodedMove == ENCMOVE_TYPE_VARSTART) {
-            if (!game.startVariation()) {
-                DBERROR << "Failed to start variation after move '" <<
-                    (lastMove ? lastMove->dump() : "none") << "'";
+            CompactGameLine variation = lines.back();
+
+            // The variation is made from the position before the last move
+            if (!variation.hasMove || !variation.pos.unmakeMove(variation.umi)) {
+                DBERROR << "Failed to start variation at offset " << moveBitstream.readOffset();
                 return false;
             }
-            lastMove = 0;
+
+            if (options.mainlineOnly) {
+                if (!skipVariation(moveBitstream, pannot, variation.pos, variation.pos))
+                    return false;
+
+                continue;
+            }
+
+            variation.parent = variation.prevParent;
+            variation.hasMove = false;
+            lines.push_back(variation);
         } else if (encodedMove == ENCMOVE_TYPE_VAREND) {
-            if (!game.endVariation()) {
-                DBERROR << "Failed to end variation after move '" <<
-                    (lastMove ? lastMove->dump() : "none") << "'";
+            if (lines.size() == 1) {
+                DBERROR << "Failed to end variation at offset " << moveBitstream.readOffset();
                 return false;
             }
-            lastMove = 0;
+
+            lines.pop_back();
         } else { // Move
             unsigned bitcount;
 
             if (encodedMove == ENCMOVE_TYPE_MOVE)
-                bitcount = ENCMOVE_MOVE_BITSIZE;
+                bitcount = encoding.moveBitsize;
             else // encodedMove == ENCMOVE_TYPE_ANNOTMOVE
-                bitcount = ENCMOVE_ANNOTMOVE_BITSIZE;
+                bitcount = encoding.annotMoveBitsize;
 
             if (!moveBitstream.read(encodedMove, bitcount)) {
                 DBERROR << "Failed to read from move bitstream at offset " << moveBitstream.readOffset();
@@ -1433,39 +3351,66 @@ bool CfdbDatabase::decodeMoves(Game &game, const Blob &moves, const Blob &annota
             }
 
             // Is this the end-of-game marker?
-            if (bitcount == ENCMOVE_ANNOTMOVE_BITSIZE && encodedMove == 0)
+            if (bitcount == encoding.annotMoveBitsize && encodedMove == 0) {
+                game.endMoves();
                 return true;
+            }
 
-            // It is necessary to ask the for the 'game over' condition when making the
-            // move in order to get the returned move to have the right flags (e.g. mate).
-            Game::GameOver gameOver = Game::GAMEOVER_NOT;
-            lastMove = game.makeMove(encodedMove & ENCMOVE_MOVE_INDEX_MASK, 0, 0, false, &gameOver, 0);
+            CompactGameLine &line = lines.back();
+            uint32_t ordinals = encodedMove & encoding.moveMask;
+            Move move;
 
-            if (lastMove) {
-                if (encodedMove & ENCMOVE_PRE_ANNOT_BIT) {
-                    ASSERT(pannot < annotations.end());
-                    lastMove->setPreAnnot((const char *)pannot);
-                    pannot += strlen((const char *)pannot) + 1;
+            if (m_schemaVersion == 1) {
+                if (ordinals >= line.pos.genMoves(genMoves)) {
+                    DBERROR << "Invalid move index " << ordinals << " in position " << line.pos.fen();
+                    return false;
                 }
 
-                if (encodedMove & ENCMOVE_POST_ANNOT_BIT) {
-                    ASSERT(pannot < annotations.end());
-                    lastMove->setPostAnnot((const char *)pannot);
-                    pannot += strlen((const char *)pannot) + 1;
-                }
+                move = genMoves[ordinals];
+            } else if (!decodeOrdinals(line.pos, ordinals, moveBitstream, move)) {
+                DBERROR << "Invalid encoded move 0x" << hex << ordinals << dec << " in position " << line.pos.fen();
+                return false;
+            }
 
-                if (encodedMove & ENCMOVE_NAGS_BIT) {
-                    ASSERT(pannot < annotations.end());
+            // A move beyond the ply limit ends its line.  The first move of a variation
+            // replaces a move that has been read, so it is always within the limit.
+            if (options.maxPlies > 0 && line.pos.ply() - startPly >= options.maxPlies) {
+                if (lines.size() == 1) {
+                    game.endMoves();
+                    return true;
+                }
 
-                    while (*pannot != NAG_NONE)
-                        lastMove->addNag((Nag) * pannot++);
+                Position next(line.pos);
+                UnmakeMoveInfo umi;
 
-                    pannot++; // Skip terminating NAG_NONE
+                if (!next.makeMove(move, umi)) {
+                    DBERROR << "Failed to make move " << move.dump();
+                    return false;
                 }
-            } else {
-                DBERROR << "Failed to make move " << (unsigned)(encodedMove & ENCMOVE_MOVE_INDEX_MASK);
+
+                if (!skipVariation(moveBitstream, pannot, line.pos, next))
+                    return false;
+
+                lines.pop_back();
+                continue;
+            }
+
+            if (!line.pos.makeMove(move, line.umi)) {
+                DBERROR << "Failed to make move " << move.dump();
                 return false;
             }
+
+            uint32_t index;
+
+            // Use the position's last move as that has the flags updated (FL_CHECK etc.)
+            if (lines.size() == 1)
+                index = game.addMainlineMove(line.pos.lastMove(), line.pos.hashKey());
+            else
+                index = game.addVariationMove(line.pos.lastMove(), line.pos.hashKey(), line.parent);
+
+            line.prevParent = line.parent;
+            line.parent = index;
+            line.hasMove = true;
         }
     }
 
@@ -1476,12 +3421,14 @@ bool CfdbDatabase::decodeMoves(Game &game, const Blob &moves, const Blob &annota
 bool CfdbDatabase::encodeMoves(const Game &game, Blob &moves, Blob &annotations) {
     clearErrorMsg();
 
-    moves.free();
-    annotations.free();
+    moves.clear();
+    annotations.clear();
 
     if (game.mainline() == 0)
         return true; // Nothing to do
 
+    ASSERT(m_schemaVersion >= 1 && m_schemaVersion <= CURRENT_SCHEMA_VERSION);
+
     // Reserve enough space in the blobs to hold the moves and annotations
     // (assumes that each move will take 2 bytes, but it won't)
     unsigned moveCount = 0, variationCount = 0, symbolCount = 0, annotationsLength = 0;
@@ -1504,7 +3451,8 @@ bool CfdbDatabase::encodeMoves(const Game &game, Blob &moves, Blob &annotations)
 
     // Add the end-of-game marker (an annotmove with all bits clear)
     if (!moveBitstream.write(ENCMOVE_TYPE_ANNOTMOVE, ENCMOVE_TYPE_BITSIZE) ||
-        !moveBitstream.write(0, ENCMOVE_ANNOTMOVE_BITSIZE)) {
+        !moveBitstream.write(0, moveEncodings[m_schemaVersion - 1].annotMoveBitsize) ||
+        !moveBitstream.flush()) {
         DBERROR << "Failed to write to move bitstream at offset " << moveBitstream.writeOffset();
         return false;
     }
@@ -1513,6 +3461,7 @@ bool CfdbDatabase::encodeMoves(const Game &game, Blob &moves, Blob &annotations)
 }
 
 bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream, Blob &annotations, bool isVariation) {
+    const MoveEncoding &encoding = moveEncodings[m_schemaVersion - 1];
     Move moves[256];
 
     ASSERT(amove);
@@ -1534,19 +3483,36 @@ bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream,
     }
 
     while (amove) {
-        // Get the index of the move
-        unsigned moveIndex;
-        unsigned numMoves = pos.genMoves(moves);
+        uint32_t encodedMove;
 
-        for (moveIndex = 0; moveIndex < numMoves; moveIndex++)
-            if (amove->equals(moves[moveIndex])) break;
+        if (m_schemaVersion == 1) {
+            // Get the index of the move
+            unsigned moveIndex;
+            unsigned numMoves = pos.genMoves(moves);
 
-        if (moveIndex == numMoves) {
-            DBERROR << "Failed to get index of move '" << amove->dump(false) << "'";
-            return false;
+            for (moveIndex = 0; moveIndex < numMoves; moveIndex++)
+                if (amove->equals(moves[moveIndex])) break;
+
+            if (moveIndex == numMoves) {
+                DBERROR << "Failed to get index of move '" << amove->dump(false) << "'";
+                return false;
+            }
+
+            encodedMove = (uint32_t)moveIndex;
+        } else {
+            // Get the ordinals of the piece and its to square
+            uint64_t fromBit = offsetBit(amove->from()), toBit = offsetBit(amove->to());
+            uint64_t pieces = pos.pieces(pos.wtm() ? WHITE : BLACK, ALLPIECES);
+            uint64_t targets = pos.moveTargets(amove->from());
+
+            if ((pieces & fromBit) == 0ULL || (targets & toBit) == 0ULL) {
+                DBERROR << "Failed to encode move '" << amove->dump(false) << "'";
+                return false;
+            }
+
+            encodedMove = (popcnt(pieces & (fromBit - 1)) << ENCMOVE_TARGET_BITSIZE) | popcnt(targets & (toBit - 1));
         }
 
-        uint32_t encodedMove = (uint32_t)moveIndex;
         bool isAnnotMove = false;
 
         const string &preAnnot = amove->preAnnot();
@@ -1557,7 +3523,7 @@ bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream,
                 return false;
             }
 
-            encodedMove |= ENCMOVE_PRE_ANNOT_BIT;
+            encodedMove |= encoding.preAnnotBit;
             isAnnotMove = true;
         }
 
@@ -1569,7 +3535,7 @@ bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream,
                 return false;
             }
 
-            encodedMove |= ENCMOVE_POST_ANNOT_BIT;
+            encodedMove |= encoding.postAnnotBit;
             isAnnotMove = true;
         }
 
@@ -1585,7 +3551,7 @@ bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream,
                 return false;
             }
 
-            encodedMove |= ENCMOVE_NAGS_BIT;
+            encodedMove |= encoding.nagsBit;
             isAnnotMove = true;
         }
 
@@ -1594,10 +3560,10 @@ bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream,
 
         if (isAnnotMove) {
             moveType = ENCMOVE_TYPE_ANNOTMOVE;
-            bitsize = ENCMOVE_ANNOTMOVE_BITSIZE;
+            bitsize = encoding.annotMoveBitsize;
         } else {
             moveType = ENCMOVE_TYPE_MOVE;
-            bitsize = ENCMOVE_MOVE_BITSIZE;
+            bitsize = encoding.moveBitsize;
         }
 
         // Write move type
@@ -1607,6 +3573,19 @@ bool CfdbDatabase::encodeMoves(const AnnotMove *amove, Bitstream &moveBitstream,
             return false;
         }
 
+        // Write the promotion piece
+        if (m_schemaVersion > 1 && amove->isPromotion()) {
+            uint32_t promIndex;
+
+            for (promIndex = 0; promIndex < 4 && promPieces[promIndex] != amove->prom(); promIndex++)
+                ;
+
+            if (promIndex == 4 || !moveBitstream.write(promIndex, ENCMOVE_PROM_BITSIZE)) {
+                DBERROR << "Failed to write promotion of move '" << amove->dump(false) << "'";
+                return false;
+            }
+        }
+
         // Make the move in the position
         UnmakeMoveInfo umi;
 
@@ -1756,6 +3735,9 @@ unsigned CfdbDatabase::insertPlayer(const Player &player) {
         if (rv == SQLITE_DONE) {
             playerId = stmt.lastInsertId();
             LOGVERBOSE << "Player '" << player << "' has player_id " << playerId;
+
+            if (!updateNameIndex("player", playerId, player.lastName()))
+                playerId = 0;
         } else {
             setDbErrorMsg("Failed to insert player '%s'", player.formattedName().c_str());
         }
@@ -1782,7 +3764,7 @@ bool CfdbDatabase::updatePlayer(unsigned id, const Player &player) {
         rv = stmt.step();
 
         if (rv == SQLITE_DONE)
-            retval = true;
+            retval = updateNameIndex("player", id, player.lastName());
         else
             setDbErrorMsg("Failed to update player '%s' (%u)", player.formattedName().c_str(), id);
     } else {
@@ -1869,6 +3851,9 @@ unsigned CfdbDatabase::insertEvent(const string &name) {
         if (rv == SQLITE_DONE) {
             eventId = stmt.lastInsertId();
             LOGVERBOSE << "Event '" << name << "' has event_id " << eventId;
+
+            if (!updateNameIndex("event", eventId, name))
+                eventId = 0;
         } else {
             setDbErrorMsg("Failed to insert event '%s'", name.c_str());
         }
@@ -1892,7 +3877,7 @@ bool CfdbDatabase::updateEvent(unsigned id, const string &name) {
         rv = stmt.step();
 
         if (rv == SQLITE_DONE)
-            retval = true;
+            retval = updateNameIndex("event", id, name);
         else
             setDbErrorMsg("Failed to update event %u", id);
     } else {
@@ -1979,6 +3964,9 @@ unsigned CfdbDatabase::insertSite(const string &name) {
         if (rv == SQLITE_DONE) {
             siteId = stmt.lastInsertId();
             LOGVERBOSE << "Site '" << name << "' has site_id " << siteId;
+
+            if (!updateNameIndex("site", siteId, name))
+                siteId = 0;
         } else {
             setDbErrorMsg("Failed to insert site '%s'", name.c_str());
         }
@@ -2002,7 +3990,7 @@ bool CfdbDatabase::updateSite(unsigned id, const string &name) {
         rv = stmt.step();
 
         if (rv == SQLITE_DONE)
-            retval = true;
+            retval = updateNameIndex("site", id, name);
         else
             setDbErrorMsg("Failed to update site %u", id);
     } else {
@@ -2089,6 +4077,9 @@ unsigned CfdbDatabase::insertAnnotator(const string &name) {
         if (rv == SQLITE_DONE) {
             annotatorId = stmt.lastInsertId();
             LOGVERBOSE << "Annotator '" << name << "' has annotator_id " << annotatorId;
+
+            if (!updateNameIndex("annotator", annotatorId, name))
+                annotatorId = 0;
         } else {
             setDbErrorMsg("Failed to insert annotator '%s'", name.c_str());
         }
@@ -2112,7 +4103,7 @@ bool CfdbDatabase::updateAnnotator(unsigned id, const string &name) {
         rv = stmt.step();
 
         if (rv == SQLITE_DONE)
-            retval = true;
+            retval = updateNameIndex("annotator", id, name);
         else
             setDbErrorMsg("Failed to update annotator %u", id);
     } else {
@@ -2139,16 +4130,18 @@ void CfdbDatabase::setDbErrorMsg(const char *message, ...) {
     }
 }
 
-string CfdbDatabase::comparisonString(DatabaseComparison comparison) {
+string CfdbDatabase::comparisonCondition(const string &column, DatabaseComparison comparison) {
+    // instr() is used rather than LIKE, which ignores case and treats '%' and '_' in the
+    // value as wildcards, so the results are the same as those of the search index
     switch (databaseComparisonNoFlags(comparison)) {
     case DATABASE_COMPARE_EQUALS:
-        return " = ?";
+        return " " + column + " = ?";
 
     case DATABASE_COMPARE_STARTSWITH:
-        return " LIKE ?||'%'";
+        return " instr(" + column + ", ?) = 1";
 
     case DATABASE_COMPARE_CONTAINS:
-        return " LIKE '%'||?||'%'";
+        return " instr(" + column + ", ?) > 0";
 
     default:
         break;
@@ -2158,6 +4151,29 @@ string CfdbDatabase::comparisonString(DatabaseComparison comparison) {
     return "";
 }
 
+bool CfdbDatabase::nameIndexComparison(DatabaseComparison comparison, const string &value) {
+    // The name indexes are compared using LIKE, which ignores case and treats '%' and '_'
+    // as wildcards
+    if (!databaseComparisonCaseInsensitive(comparison) || value.find_first_of("%_") != string::npos)
+        return false;
+
+    switch (databaseComparisonNoFlags(comparison)) {
+    case DATABASE_COMPARE_STARTSWITH:
+    case DATABASE_COMPARE_CONTAINS:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+string CfdbDatabase::nameIndexCondition(const string &column, const string &table, DatabaseComparison comparison) {
+    bool startsWith = databaseComparisonNoFlags(comparison) == DATABASE_COMPARE_STARTSWITH;
+
+    return " game." + column + " IN (SELECT rowid FROM " + table + "_fts WHERE name LIKE " +
+           (startsWith ? "?||'%'" : "'%'||?||'%'") + ")";
+}
+
 string CfdbDatabase::orderString(DatabaseOrder order) {
     switch (order) {
     case DATABASE_ORDER_ASCENDING:
@@ -0,0 +1,183 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// CompactGame.cpp: CompactGame class implementation.
+//
+
+#include <ChessCore/CompactGame.h>
+#include <ChessCore/Game.h>
+#include <ChessCore/Log.h>
+
+using namespace std;
+
+namespace ChessCore {
+const char *CompactGame::m_classname = "CompactGame";
+const uint32_t CompactGame::NO_PARENT;
+const uint32_t CompactGame::VARIATION_INDEX;
+
+CompactGame::CompactGame() :
+    GameHeader(),
+    m_startPosition(),
+    m_mainlineLength(0),
+    m_moves(),
+    m_posHashes(),
+    m_variationParents(),
+    m_variationMoves(),
+    m_variationHashes()
+{
+    init();
+}
+
+CompactGame::CompactGame(const Game &game) :
+    GameHeader(),
+    m_startPosition(),
+    m_mainlineLength(0),
+    m_moves(),
+    m_posHashes(),
+    m_variationParents(),
+    m_variationMoves(),
+    m_variationHashes()
+{
+    set(game);
+}
+
+CompactGame::~CompactGame() {
+}
+
+void CompactGame::init() {
+    initHeader();
+    m_startPosition.setStarting();
+    m_mainlineLength = 0;
+    m_moves.clear();
+    m_posHashes.clear();
+    m_variationParents.clear();
+    m_variationMoves.clear();
+    m_variationHashes.clear();
+}
+
+uint32_t CompactGame::addMainlineMove(Move move, uint64_t posHash) {
+    ASSERT(m_moves.size() == m_mainlineLength);
+
+    m_moves.push_back(move);
+    m_posHashes.push_back(posHash);
+    return m_mainlineLength++;
+}
+
+uint32_t CompactGame::addVariationMove(Move move, uint64_t posHash, uint32_t parent) {
+    m_variationMoves.push_back(move);
+    m_variationHashes.push_back(posHash);
+    m_variationParents.push_back(parent);
+    return (uint32_t)(m_variationMoves.size() - 1) | VARIATION_INDEX;
+}
+
+void CompactGame::endMoves() {
+    if (m_variationMoves.empty())
+        return;
+
+    m_moves.insert(m_moves.end(), m_variationMoves.begin(), m_variationMoves.end());
+    m_posHashes.insert(m_posHashes.end(), m_variationHashes.begin(), m_variationHashes.end());
+
+    for (auto it = m_variationParents.begin(); it != m_variationParents.end(); ++it)
+        if (*it != NO_PARENT && (*it & VARIATION_INDEX) != 0)
+            *it = (*it & ~VARIATION_INDEX) + m_mainlineLength;
+
+    m_variationMoves.clear();
+    m_variationHashes.clear();
+}
+
+void CompactGame::set(const Game &game) {
+    init();
+    setHeader(game);
+    m_startPosition.set(game.startPosition());
+
+    if (game.mainline())
+        addLine(game.mainline(), NO_PARENT, true);
+
+    endMoves();
+}
+
+// Add the moves of a line, each followed by its variations.  The variations of the
+// first move of a variation line are added by the caller, as they are linked from it.
+void CompactGame::addLine(const AnnotMove *amove, uint32_t parent, bool isMainline) {
+    for (bool first = true; amove; amove = amove->next(), first = false) {
+        Move move = amove->move();
+        move.clearFlags(Move::FL_MATE | Move::FL_DRAW);
+
+        uint32_t index;
+
+        if (isMainline)
+            index = addMainlineMove(move, amove->posHash());
+        else
+            index = addVariationMove(move, amove->posHash(), parent);
+
+        if (!first || isMainline)
+            for (const AnnotMove *var = amove->variation(); var; var = var->variation())
+                addLine(var, parent, false);
+
+        parent = index;
+    }
+}
+
+bool CompactGame::toGame(Game &game) const {
+    game.init();
+    game.setHeader(*this);
+    game.setStartPosition(m_startPosition);
+    game.setPositionToStart();
+
+    if (m_moves.empty())
+        return true;
+
+    // Link the moves that follow each move in index order, so the first is the
+    // continuation of the line and the rest are its variations.  Entry 0 of
+    // firstChild is for the starting position.
+    vector<uint32_t> firstChild(m_moves.size() + 1, NO_PARENT);
+    vector<uint32_t> lastChild(m_moves.size() + 1, NO_PARENT);
+    vector<uint32_t> nextSibling(m_moves.size(), NO_PARENT);
+
+    for (uint32_t index = 0; index < (uint32_t)m_moves.size(); index++) {
+        uint32_t entry = parent(index) + 1;     // NO_PARENT becomes 0
+
+        if (lastChild[entry] == NO_PARENT)
+            firstChild[entry] = index;
+        else
+            nextSibling[lastChild[entry]] = index;
+
+        lastChild[entry] = index;
+    }
+
+    // Like a game that has been read, the game is left at the end of the mainline
+    return makeLine(game, firstChild[0], firstChild, nextSibling);
+}
+
+bool CompactGame::makeLine(Game &game, uint32_t index, const vector<uint32_t> &firstChild,
+                           const vector<uint32_t> &nextSibling) const {
+    // The variations of the first move of a variation are made by the caller
+    bool isVariation = index >= m_mainlineLength;
+    bool first = true;
+
+    while (index != NO_PARENT) {
+        Move move = m_moves[index];
+
+        if (game.makeBuiltMove(move) == 0) {
+            LOGERR << "Failed to make move " << move.dump() << " at index " << index;
+            return false;
+        }
+
+        if (!first || !isVariation) {
+            for (uint32_t var = nextSibling[index]; var != NO_PARENT; var = nextSibling[var]) {
+                if (!game.startVariation() ||
+                    !makeLine(game, var, firstChild, nextSibling) ||
+                    !game.endVariation())
+                    return false;
+            }
+        }
+
+        first = false;
+        index = firstChild[index + 1];
+    }
+
+    // The game-over flags are set at the end of each line, as mate can only occur there
+    game.checkGameOver();
+    return true;
+}
+} // namespace ChessCore
@@ -31,18 +31,151 @@ bool Database::registerFactory(DATABASE_FACTORY_FUNC factory) {
 Database::Database() :
     m_isOpen(false),
     m_access(ACCESS_NONE),
-    m_errorMsg() {
+    m_errorMsg(),
+    m_readers(),
+    m_readersGeneration(0) {
 }
 
 Database::Database(const string &filename, bool readOnly) :
     m_isOpen(false),
     m_access(ACCESS_NONE),
-    m_errorMsg() {
+    m_errorMsg(),
+    m_readers(),
+    m_readersGeneration(0) {
 }
 
 Database::~Database() {
 }
 
+bool Database::readHeaders(unsigned firstGameNum, unsigned lastGameNum, vector<GameHeader> &gameHeaders) {
+    gameHeaders.clear();
+
+    if (firstGameNum > lastGameNum) {
+        DBERROR << "Invalid game range " << firstGameNum << " to " << lastGameNum;
+        return false;
+    }
+
+    gameHeaders.resize(lastGameNum - firstGameNum + 1);
+
+    for (unsigned gameNum = firstGameNum; gameNum <= lastGameNum; gameNum++)
+        if (!readHeader(gameNum, gameHeaders[gameNum - firstGameNum]))
+            return false;
+
+    return true;
+}
+
+// Remove the moves and annotations of a line that were not asked for.  Returns true
+// if any moves were removed.
+static bool trimLine(Game &game, AnnotMove *amove, unsigned ply, const DatabaseReadOptions &options) {
+    bool removed = false;
+
+    while (amove) {
+        if (options.maxPlies > 0 && ply > options.maxPlies) {
+            game.removeMove(amove);
+            return true;
+        }
+
+        if (options.skipAnnotations)
+            amove->removeAnnotations();
+
+        // Variations replace this move so start at the same ply
+        if (amove->variation())
+            removed = trimLine(game, amove->variation(), ply, options) || removed;
+
+        amove = amove->next();
+        ply++;
+    }
+
+    return removed;
+}
+
+bool Database::read(unsigned gameNum, Game &game, const DatabaseReadOptions &options) {
+    if (!read(gameNum, game))
+        return false;
+
+    if (options.mainlineOnly)
+        AnnotMove::removeVariations(game.mainline());
+
+    if (trimLine(game, game.mainline(), 1, options))
+        game.setPositionToStart();
+
+    return true;
+}
+
+bool Database::read(unsigned gameNum, CompactGame &game, const DatabaseReadOptions &options) {
+    DatabaseReadOptions gameOptions(options);
+    gameOptions.skipAnnotations = true;
+    Game fullGame;
+
+    if (!read(gameNum, fullGame, gameOptions)) {
+        game.init();
+        game.setReadFail(true);
+        return false;
+    }
+
+    game.set(fullGame);
+    return true;
+}
+
+bool Database::readShared(unsigned gameNum, Game &game, const DatabaseReadOptions &options, string &errorMsg) {
+    shared_ptr<Database> reader;
+    unsigned generation;
+
+    {
+        // Subclasses hold the lock while changing the state that openReader() uses
+        MutexLock lock(m_readersMutex);
+
+        if (!m_isOpen) {
+            errorMsg = "Database is not open";
+            return false;
+        }
+
+        generation = m_readersGeneration;
+
+        if (!m_readers.empty()) {
+            reader = m_readers.back();
+            m_readers.pop_back();
+        } else {
+            reader = openReader();
+        }
+    }
+
+    if (!reader) {
+        // Read one thread at a time using this instance.  m_readersMutex must not be
+        // held here as a writer holding m_mutex takes it
+        MutexLock instanceLock(m_mutex);
+        bool retval = read(gameNum, game, options);
+
+        if (!retval)
+            errorMsg = m_errorMsg;
+
+        return retval;
+    }
+
+    bool retval = reader->read(gameNum, game, options);
+
+    if (!retval)
+        errorMsg = reader->errorMsg();
+
+    // Keep the reader unless the readers were discarded while it was in use
+    MutexLock lock(m_readersMutex);
+
+    if (generation == m_readersGeneration)
+        m_readers.push_back(reader);
+
+    return retval;
+}
+
+shared_ptr<Database> Database::openReader() {
+    return shared_ptr<Database>();
+}
+
+void Database::closeReaders() {
+    MutexLock lock(m_readersMutex);
+    m_readers.clear();
+    m_readersGeneration++;
+}
+
 bool Database::buildOpeningTree(unsigned gameNum, unsigned depth, DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
     DBERROR << "Opening tree is not supported";
     return false;
@@ -58,11 +191,31 @@ bool Database::countInOpeningTree(uint64_t hashKey, unsigned &count) {
     return false;
 }
 
+bool Database::searchOpeningTreeStats(uint64_t hashKey, unsigned maxSampleGames, vector<OpeningTreeStats> &stats) {
+    DBERROR << "Opening tree is not supported";
+    return false;
+}
+
+bool Database::searchOpeningTreeChildren(uint64_t hashKey, vector<OpeningTreeEdge> &edges) {
+    DBERROR << "Opening tree is not supported";
+    return false;
+}
+
+bool Database::searchOpeningTreeParents(uint64_t hashKey, vector<OpeningTreeEdge> &edges) {
+    DBERROR << "Opening tree is not supported";
+    return false;
+}
+
 bool Database::countLongestLine(unsigned &count) {
     DBERROR << "Opening tree is not supported";
     return false;
 }
 
+bool Database::readOpeningTree(vector<OpeningTreeEntry> &entries) {
+    DBERROR << "Opening tree is not supported";
+    return false;
+}
+
 bool Database::hasValidIndex() {
     DBERROR << "Indexing not supported";
     return false;
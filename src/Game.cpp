@@ -13,6 +13,7 @@
 #endif // !WINDOWS
 
 #include <algorithm>
+#include <utility>
 #include <sstream>
 
 using namespace std;
@@ -27,7 +28,8 @@ Game::Game() :
     m_position(),
     m_mainline(0),
     m_currentMove(0),
-    m_variationStart(false)
+    m_variationStart(false),
+    m_pool(new AnnotMovePool)
 {
     init();
 }
@@ -37,13 +39,57 @@ Game::Game(const Game &other) :
     m_startPosition(other.m_startPosition),
     m_position(other.m_startPosition),
     m_currentMove(0),
-    m_variationStart(false)
+    m_variationStart(false),
+    m_pool(new AnnotMovePool)
 {
-    m_mainline = AnnotMove::deepCopy(other.m_mainline);
+    m_mainline = AnnotMove::deepCopy(other.m_mainline, m_pool);
+}
+
+Game::Game(Game &&other) :
+    GameHeader(std::move(other)),
+    m_startPosition(other.m_startPosition),
+    m_position(other.m_position),
+    m_mainline(other.m_mainline),
+    m_currentMove(other.m_currentMove),
+    m_variationStart(other.m_variationStart),
+    m_pool(other.m_pool)
+{
+    // The moves were allocated from the pool, so it goes with them
+    other.m_mainline = 0;
+    other.m_currentMove = 0;
+    other.m_pool = new AnnotMovePool;
+    other.init();
 }
 
 Game::~Game() {
     init();
+    m_pool->release();
+}
+
+Game &Game::operator=(const Game &other) {
+    if (this != &other)
+        setGame(other);
+
+    return *this;
+}
+
+Game &Game::operator=(Game &&other) {
+    if (this == &other)
+        return *this;
+
+    GameHeader::operator=(std::move(other));
+    m_startPosition.set(other.m_startPosition);
+    m_position.set(other.m_position);
+    m_variationStart = other.m_variationStart;
+
+    // Exchange the moves, along with the pools they were allocated from, and then
+    // clear the other game which deletes this game's old moves
+    std::swap(m_mainline, other.m_mainline);
+    std::swap(m_currentMove, other.m_currentMove);
+    std::swap(m_pool, other.m_pool);
+    other.init();
+
+    return *this;
 }
 
 void Game::init() {
@@ -63,7 +109,7 @@ void Game::setGame(const Game &other) {
     if (m_mainline)
         AnnotMove::deepDelete(m_mainline);
 
-    m_mainline = AnnotMove::deepCopy(other.m_mainline);
+    m_mainline = AnnotMove::deepCopy(other.m_mainline, m_pool);
     setPositionToStart();
 }
 
@@ -185,6 +231,30 @@ AnnotMove *Game::makeMove(unsigned moveIndex, const std::string *annot /*=0*/, s
     return makeMoveImpl(move, prevPos, annot, formattedMove, includeMoveNum, gameOver, oldNext);
 }
 
+AnnotMove *Game::makeBuiltMove(Move &move, const std::string *annot /*=0*/, std::string *formattedMove /*=0*/,
+                               bool includeMoveNum /*=false*/, GameOver *gameOver /*=0*/, AnnotMove **oldNext /*=0*/) {
+    if (m_variationStart) {
+        if (!restorePriorPosition(m_currentMove))
+            return 0;
+    } else {
+        if (m_currentMove == 0)
+            if (m_mainline) {
+                if (oldNext)
+                    *oldNext = m_mainline;
+                else
+                    AnnotMove::deepDelete(m_mainline);
+
+                m_mainline = 0;
+            }
+
+    }
+
+    // prevPos *must* be initialised after restorePriorPosition() has been called
+    Position prevPos(m_position);
+
+    return makeMoveImpl(move, prevPos, annot, formattedMove, includeMoveNum, gameOver, oldNext);
+}
+
 AnnotMove *Game::makeMoveImpl(Move &move, const Position &prevPosition, const std::string *annot,
                               std::string *formattedMove, bool includeMoveNum, GameOver *gameOver,
                               AnnotMove **oldNext) {
@@ -202,7 +272,7 @@ AnnotMove *Game::makeMoveImpl(Move &move, const Position &prevPosition, const st
     string autoAnnot;
 
     // Use m_position.lastMove() as that will have updated flags (FL_CHECK etc.)
-    AnnotMove *amove = new AnnotMove(m_position.lastMove(), hash);
+    AnnotMove *amove = new (m_pool) AnnotMove(m_position.lastMove(), hash);
 
     if (m_variationStart) {
         ASSERT(m_mainline);
@@ -235,41 +305,8 @@ AnnotMove *Game::makeMoveImpl(Move &move, const Position &prevPosition, const st
 
     m_currentMove = amove;
 
-    if (gameOver) {
-        *gameOver = isGameOver();
-
-        if (*gameOver != GAMEOVER_NOT) {
-            switch (*gameOver) {
-            case GAMEOVER_MATE:
-                amove->setFlags(Move::FL_MATE);
-                break;
-
-            case GAMEOVER_STALEMATE:
-                amove->setFlags(Move::FL_DRAW);
-                autoAnnot = "Stalemate";
-                break;
-
-            case GAMEOVER_50MOVERULE:
-                amove->setFlags(Move::FL_DRAW);
-                autoAnnot = "Draw by 50-move rule";
-                break;
-
-            case GAMEOVER_3FOLDREP:
-                amove->setFlags(Move::FL_DRAW);
-                autoAnnot = "Draw by 3-fold repetition";
-                break;
-
-            case GAMEOVER_NOMATERIAL:
-                amove->setFlags(Move::FL_DRAW);
-                autoAnnot = "Draw by insufficient material";
-                break;
-
-            default:
-                ASSERT(false);
-                break;
-            }
-        }
-    }
+    if (gameOver)
+        *gameOver = setGameOverFlags(amove, autoAnnot);
 
     if (annot) {
         if (!annot->empty() && !autoAnnot.empty())
@@ -290,6 +327,45 @@ AnnotMove *Game::makeMoveImpl(Move &move, const Position &prevPosition, const st
     return amove;
 }
 
+Game::GameOver Game::setGameOverFlags(AnnotMove *amove, string &autoAnnot) {
+    GameOver gameOver = isGameOver();
+
+    switch (gameOver) {
+    case GAMEOVER_NOT:
+        break;
+
+    case GAMEOVER_MATE:
+        amove->setFlags(Move::FL_MATE);
+        break;
+
+    case GAMEOVER_STALEMATE:
+        amove->setFlags(Move::FL_DRAW);
+        autoAnnot = "Stalemate";
+        break;
+
+    case GAMEOVER_50MOVERULE:
+        amove->setFlags(Move::FL_DRAW);
+        autoAnnot = "Draw by 50-move rule";
+        break;
+
+    case GAMEOVER_3FOLDREP:
+        amove->setFlags(Move::FL_DRAW);
+        autoAnnot = "Draw by 3-fold repetition";
+        break;
+
+    case GAMEOVER_NOMATERIAL:
+        amove->setFlags(Move::FL_DRAW);
+        autoAnnot = "Draw by insufficient material";
+        break;
+
+    default:
+        ASSERT(false);
+        break;
+    }
+
+    return gameOver;
+}
+
 AnnotMove *Game::annotMove(Move move) {
     UnmakeMoveInfo umi;
 
@@ -577,12 +653,13 @@ Game::GameOver Game::isGameOver() {
 
     // If there are two other instances of this key in the position history then the game
     // is drawn by 3-fold repetition.  This cannot be the case if the last move was a capture,
-    // castling or promotion move.
+    // castling or promotion move, and only the positions since the last capture or pawn
+    // move (the halfmove clock) need to be searched.
     if (m_currentMove) {
         int count = 0;
 
         if (!m_currentMove->isCapture() && !m_currentMove->isCastle() && !m_currentMove->isPromotion())
-            count = AnnotMove::countRepeatedPositions(m_currentMove);
+            count = AnnotMove::countRepeatedPositions(m_currentMove, m_position.hmclock());
 
         if (count >= 3)
             return GAMEOVER_3FOLDREP;
@@ -591,6 +668,14 @@ Game::GameOver Game::isGameOver() {
     return GAMEOVER_NOT; // Game not over
 }
 
+Game::GameOver Game::checkGameOver() {
+    if (m_currentMove == 0 || m_variationStart)
+        return isGameOver();
+
+    string autoAnnot;
+    return setGameOverFlags(m_currentMove, autoAnnot);
+}
+
 bool Game::setMainline(const AnnotMove *amoves) {
     if (m_mainline) {
         logerr("Cannot set mainline moves as game already contains a mainline");
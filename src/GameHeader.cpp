@@ -14,6 +14,7 @@
 
 #include <sstream>
 #include <iomanip>
+#include <utility>
 
 using namespace std;
 
@@ -24,14 +25,41 @@ GameHeader::GameHeader() {
     initHeader();
 }
 
+GameHeader::GameHeader(GameHeader &&other) {
+    *this = std::move(other);
+}
+
 GameHeader::~GameHeader() {
 }
 
+GameHeader &GameHeader::operator=(GameHeader &&other) {
+    if (this == &other)
+        return *this;
+
+    m_white = std::move(other.m_white);
+    m_black = std::move(other.m_black);
+    m_event = std::move(other.m_event);
+    m_site = std::move(other.m_site);
+    m_annotator = std::move(other.m_annotator);
+    m_day = other.m_day;
+    m_month = other.m_month;
+    m_year = other.m_year;
+    m_roundMajor = other.m_roundMajor;
+    m_roundMinor = other.m_roundMinor;
+    m_result = other.m_result;
+    m_timeControl = std::move(other.m_timeControl);
+    m_eco = std::move(other.m_eco);
+    m_readFail = other.m_readFail;
+    other.initHeader();
+    return *this;
+}
+
 void GameHeader::initHeader() {
     m_white.clear();
     m_black.clear();
     m_event.clear();
     m_site.clear();
+    m_annotator.clear();
     m_day = m_month = m_year = 0;
     m_roundMajor = m_roundMinor = 0;
     m_result = UNFINISHED;
@@ -72,12 +72,16 @@ bool IndexManager::deleteIndexFile(const string &filename) {
     return true;
 }
 
-string IndexManager::getIndexFilenameForFile(const string &filename) const {
+string IndexManager::getSideFilename(const string &filename, const string &extension) const {
     string uniqueName = Util::getUniqueName(filename);
     if (uniqueName.empty()) {
         LOGERR << "Failed to generate unique name for file '" << filename << "'";
         return "";
     }
-    return Util::format("%s%c%s.index", m_rootDir.c_str(), PATHSEP, uniqueName.c_str());
+    return Util::format("%s%c%s.%s", m_rootDir.c_str(), PATHSEP, uniqueName.c_str(), extension.c_str());
+}
+
+string IndexManager::getIndexFilenameForFile(const string &filename) const {
+    return getSideFilename(filename, "index");
 }
 }   // namespace ChessCore
@@ -0,0 +1,147 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// MemoryMappedFile.cpp: MemoryMappedFile class implementation.
+//
+
+#include <ChessCore/MemoryMappedFile.h>
+#include <ChessCore/Util.h>
+#include <ChessCore/Log.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // !WINDOWS
+
+using namespace std;
+
+namespace ChessCore {
+const char *MemoryMappedFile::m_classname = "MemoryMappedFile";
+
+MemoryMappedFile::MemoryMappedFile() :
+    m_filename(),
+    m_data(0),
+    m_size(0)
+#ifdef WINDOWS
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(NULL)
+#else // !WINDOWS
+    , m_fd(-1)
+#endif // WINDOWS
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+    close();
+}
+
+bool MemoryMappedFile::open(const string &filename) {
+    close();
+
+#ifdef WINDOWS
+
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (m_file == INVALID_HANDLE_VALUE) {
+        LOGERR << "Failed to open file '" << filename << "': " << Util::win32ErrorText(GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        LOGERR << "Cannot map empty file '" << filename << "'";
+        close();
+        return false;
+    }
+
+    m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (m_mapping == NULL) {
+        LOGERR << "Failed to create file mapping for '" << filename << "': " <<
+            Util::win32ErrorText(GetLastError());
+        close();
+        return false;
+    }
+
+    m_data = (const uint8_t *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (m_data == 0) {
+        LOGERR << "Failed to map view of file '" << filename << "': " << Util::win32ErrorText(GetLastError());
+        close();
+        return false;
+    }
+
+    m_size = (uint64_t)size.QuadPart;
+
+#else // !WINDOWS
+
+    m_fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (m_fd < 0) {
+        LOGERR << "Failed to open file '" << filename << "': " << strerror(errno) << " (" << errno << ")";
+        return false;
+    }
+
+    struct stat statbuf;
+
+    if (::fstat(m_fd, &statbuf) < 0 || statbuf.st_size == 0) {
+        LOGERR << "Cannot map empty file '" << filename << "'";
+        close();
+        return false;
+    }
+
+    void *data = ::mmap(0, (size_t)statbuf.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+    if (data == MAP_FAILED) {
+        LOGERR << "Failed to map file '" << filename << "': " << strerror(errno) << " (" << errno << ")";
+        close();
+        return false;
+    }
+
+    m_data = (const uint8_t *)data;
+    m_size = (uint64_t)statbuf.st_size;
+
+#endif // WINDOWS
+
+    m_filename = filename;
+    return true;
+}
+
+void MemoryMappedFile::close() {
+#ifdef WINDOWS
+
+    if (m_data)
+        UnmapViewOfFile(m_data);
+
+    if (m_mapping != NULL)
+        CloseHandle(m_mapping);
+
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+
+#else // !WINDOWS
+
+    if (m_data)
+        ::munmap((void *)m_data, (size_t)m_size);
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_fd = -1;
+
+#endif // WINDOWS
+
+    m_filename.clear();
+    m_data = 0;
+    m_size = 0;
+}
+}   // namespace ChessCore
@@ -43,23 +43,32 @@ void Move::reverseFromTo() {
 }
 
 string Move::san(const Position &pos, const char *pieceMap /*=0*/) const {
+    char buffer[MAX_SAN_LENGTH];
+
+    if (san(pos, buffer, pieceMap) == 0)
+        return "";
+
+    return buffer;
+}
+
+unsigned Move::san(const Position &pos, char *buffer, const char *pieceMap /*=0*/) const {
     unsigned i, numMoves, actualMove = 999;
     Move moves[256];
     char ambigFile, ambigRank;
-    ostringstream oss;
+    char *s = buffer;
 
     if (pieceMap == 0)
         pieceMap = pieceChars;
 
     if (isNull()) {
-        oss << "--";
-        return oss.str();
+        strcpy(buffer, "--");
+        return 2;
     } else if (isCastleKS()) {
-        oss << "O-O";
-        return oss.str();
+        strcpy(buffer, "O-O");
+        return 3;
     } else if (isCastleQS()) {
-        oss << "O-O-O";
-        return oss.str();
+        strcpy(buffer, "O-O-O");
+        return 5;
     }
 
     // If a piece (not a pawn) is moving, check for ambiguity in the
@@ -97,7 +106,8 @@ string Move::san(const Position &pos, const char *pieceMap /*=0*/) const {
 
     if (actualMove == 999) {
         LOGERR << "Didn't find legal move " << dump() << " in position:\n" << pos.dump();
-        return "";
+        *buffer = '\0';
+        return 0;
     }
 
 #ifdef DEBUG
@@ -116,34 +126,35 @@ string Move::san(const Position &pos, const char *pieceMap /*=0*/) const {
 
     if (piece() == PAWN) {
         if (isCapture())
-            oss << char(offsetFile(from()) + 'a');
+            *s++ = char(offsetFile(from()) + 'a');
     } else {
-        oss << pieceMap[piece()];
+        *s++ = pieceMap[piece()];
 
         if (ambigFile != '\0')
-            oss << ambigFile;
+            *s++ = ambigFile;
     }
 
     if (ambigRank != '\0')
-        oss << ambigRank;
+        *s++ = ambigRank;
 
     if (isCapture())
-        oss << 'x';
+        *s++ = 'x';
 
-    oss << char(offsetFile(to()) + 'a');
-    oss << char(offsetRank(to()) + '1');
+    *s++ = char(offsetFile(to()) + 'a');
+    *s++ = char(offsetRank(to()) + '1');
 
     if (isPromotion()) {
-        oss << '=';
-        oss << pieceMap[prom()];
+        *s++ = '=';
+        *s++ = pieceMap[prom()];
     }
 
     if (isMate())
-        oss << '#';
+        *s++ = '#';
     else if (isCheck())
-        oss << '+';
+        *s++ = '+';
 
-    return oss.str();
+    *s = '\0';
+    return (unsigned)(s - buffer);
 }
 
 string Move::coord(bool uciCompliant /*=false*/) const {
@@ -7,16 +7,24 @@
 #include <ChessCore/OpeningTree.h>
 #include <ChessCore/Log.h>
 #include <iomanip>
+#include <algorithm>
+#include <map>
 
 using namespace std;
 
 namespace ChessCore {
 const char *OpeningTree::m_classname = "OpeningTree";
 
-OpeningTree::OpeningTree(const std::string &filename):m_longestLine(0) {
-    m_db = Database::openDatabase(filename, false);
+OpeningTree::OpeningTree(const std::string &filename) :
+    m_db(),
+    m_longestLine(0),
+    m_classifications(),
+    m_slots(),
+    m_slotMask(0),
+    m_loaded(false) {
+    m_db = Database::openDatabase(filename, true);
     if (!m_db) {
-        LOGERR << "Failed to open database '" << filename << "': " << m_db->errorMsg();
+        LOGERR << "Failed to open database '" << filename << "'";
         return;
     }
 
@@ -38,7 +46,107 @@ OpeningTree::~OpeningTree() {
     }
 }
 
+bool OpeningTree::load() {
+    if (!isOpen()) {
+        LOGERR << "Database is not open";
+        return false;
+    }
+
+    m_loaded = false;
+
+    vector<OpeningTreeEntry> entries;
+
+    if (!m_db->readOpeningTree(entries)) {
+        LOGERR << "Failed to read opening tree: " << m_db->errorMsg();
+        return false;
+    }
+
+    // Size the table so it is no more than half full
+    vector<uint64_t> hashKeys;
+    hashKeys.reserve(entries.size());
+
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+        hashKeys.push_back(it->hashKey());
+
+    sort(hashKeys.begin(), hashKeys.end());
+    size_t numPositions = unique(hashKeys.begin(), hashKeys.end()) - hashKeys.begin();
+    size_t numSlots = 16;
+
+    while (numSlots < numPositions * 2)
+        numSlots <<= 1;
+
+    ClassificationSlot unused = { 0ULL, NO_CLASSIFICATION };
+    m_slots.assign(numSlots, unused);
+    m_slotMask = numSlots - 1;
+    m_classifications.clear();
+
+    // The game used for each position is the one classify() used to select from the
+    // database: the first entry where this was the last move, else the first entry.
+    const unsigned noGame = 0xffffffff;
+    vector<unsigned> firstGame(numSlots, noGame), firstLastMoveGame(numSlots, noGame);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        size_t index = (size_t)(it->hashKey() ^ (it->hashKey() >> 32)) & m_slotMask;
+
+        while (m_slots[index].hashKey && m_slots[index].hashKey != it->hashKey())
+            index = (index + 1) & m_slotMask;
+
+        m_slots[index].hashKey = it->hashKey();
+
+        if (firstGame[index] == noGame)
+            firstGame[index] = it->gameNum();
+
+        if (it->lastMove() && firstLastMoveGame[index] == noGame)
+            firstLastMoveGame[index] = it->gameNum();
+    }
+
+    // Read the header of each game used, once
+    map<unsigned, uint32_t> gameClassifications;
+
+    for (size_t index = 0; index < numSlots; index++) {
+        if (m_slots[index].hashKey == 0)
+            continue;
+
+        unsigned gameNum = firstLastMoveGame[index];
+
+        if (gameNum == noGame || gameNum == 0)
+            gameNum = firstGame[index];
+
+        if (gameNum == 0)
+            continue;
+
+        auto found = gameClassifications.find(gameNum);
+
+        if (found == gameClassifications.end()) {
+            GameHeader gameHeader;
+
+            if (!m_db->readHeader(gameNum, gameHeader)) {
+                LOGERR << "Failed to read game " << gameNum;
+                return false;
+            }
+
+            Classification classification;
+            classification.eco = gameHeader.eco();
+            classification.opening = gameHeader.white().lastName();
+            classification.variation = gameHeader.black().lastName();
+            m_classifications.push_back(classification);
+
+            found = gameClassifications.insert(make_pair(gameNum, (uint32_t)(m_classifications.size() - 1))).first;
+        }
+
+        m_slots[index].classification = found->second;
+    }
+
+    LOGDBG << "Loaded " << numPositions << " positions and " << m_classifications.size() << " classifications";
+
+    m_loaded = true;
+    return true;
+}
+
 bool OpeningTree::classify(const Game &game, string &eco, string &opening, string &variation) {
+    if (m_loaded)
+        return classifyInMemory(game, eco, opening, variation);
+
     if (!isOpen()) {
         LOGERR << "Database is not open";
         return false;
@@ -119,6 +227,64 @@ bool OpeningTree::classify(const Game &game, string &eco, string &opening, strin
     return retval;
 }
 
+bool OpeningTree::classifyInMemory(const Game &game, string &eco, string &opening, string &variation) const {
+    eco.clear();
+    opening.clear();
+    variation.clear();
+
+    bool retval = false;
+    Position pos = game.startPosition();
+    const ClassificationSlot *slot = 0, *prevSlot = 0;
+
+    // Move through the game until a move no longer appears in the opening tree,
+    // as classify() does using the database
+    for (const AnnotMove *move = game.mainline(); move; move = move->next()) {
+        prevSlot = slot;
+        UnmakeMoveInfo umi;
+
+        if (!pos.makeMove(move, umi)) {
+            LOGERR << "Failed to make move " << move->dump(false) << endl;
+            return false;
+        }
+
+        slot = findSlot(pos.hashKey());
+
+        if (slot == 0)
+            break;
+    }
+
+    if (prevSlot) {
+        if (prevSlot->classification != NO_CLASSIFICATION) {
+            const Classification &classification = m_classifications[prevSlot->classification];
+            eco = classification.eco;
+            opening = classification.opening;
+            variation = classification.variation;
+
+            retval = true;
+        }
+    } else {
+        LOGWRN << "Could not find opening classification for game";
+    }
+
+    return retval;
+}
+
+const OpeningTree::ClassificationSlot *OpeningTree::findSlot(uint64_t hashKey) const {
+    if (hashKey == 0)
+        return 0;
+
+    size_t index = (size_t)(hashKey ^ (hashKey >> 32)) & m_slotMask;
+
+    while (m_slots[index].hashKey) {
+        if (m_slots[index].hashKey == hashKey)
+            return &m_slots[index];
+
+        index = (index + 1) & m_slotMask;
+    }
+
+    return 0;
+}
+
 bool OpeningTree::classify(Game &game, bool setComment /*=true*/) {
     string eco, opening, variation;
 
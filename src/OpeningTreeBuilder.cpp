@@ -0,0 +1,472 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// OpeningTreeBuilder.cpp: OpeningTreeBuilder class implementation.
+//
+
+#include <ChessCore/OpeningTreeBuilder.h>
+#include <ChessCore/OpeningTreeFile.h>
+#include <ChessCore/Thread.h>
+#include <ChessCore/IoEvent.h>
+#include <ChessCore/IoEventWaiter.h>
+#include <ChessCore/Log.h>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+
+namespace ChessCore {
+const char *OpeningTreeBuilder::m_classname = "OpeningTreeBuilder";
+
+// Number of tuples read from a run at a time during the merge
+#define MERGE_BUFFER_SIZE   16384
+
+// Number of games a thread replays before updating the progress
+#define PROGRESS_GAMES      64
+
+// How often build() reports progress, in milliseconds
+#define PROGRESS_INTERVAL   250
+
+//
+// Replay every 'step' game, starting with game 'firstGameNum + index', and write the
+// sorted opening tree entries as runs.
+//
+class OpeningTreeBuilderThread : public Thread {
+protected:
+    OpeningTreeBuilder &m_builder;
+    string m_dburl;
+    unsigned m_firstGameNum;
+    unsigned m_lastGameNum;
+    unsigned m_depth;
+    unsigned m_index;
+    unsigned m_step;
+    size_t m_maxTuples;
+
+public:
+    IoEvent m_doneEvent;            // Set by the thread when it finishes
+    atomic<bool> m_quit;            // Set by build() to stop the thread early
+    atomic<bool> m_failed;
+
+    OpeningTreeBuilderThread(OpeningTreeBuilder &builder, const string &dburl, unsigned firstGameNum,
+                             unsigned lastGameNum, unsigned depth, unsigned index, unsigned step,
+                             size_t maxTuples) :
+        Thread(),
+        m_builder(builder),
+        m_dburl(dburl),
+        m_firstGameNum(firstGameNum),
+        m_lastGameNum(lastGameNum),
+        m_depth(depth),
+        m_index(index),
+        m_step(step),
+        m_maxTuples(maxTuples),
+        m_doneEvent(),
+        m_quit(false),
+        m_failed(false) {
+    }
+
+protected:
+    void entry() {
+        if (!replay())
+            m_failed = true;
+
+        m_doneEvent.set();
+    }
+
+    bool replay() {
+        shared_ptr<Database> db = Database::openDatabase(m_dburl, true);
+
+        if (!db || !db->isOpen()) {
+            m_builder.setErrorMsg(Util::format("Failed to open database '%s'", m_dburl.c_str()));
+            return false;
+        }
+
+        vector<OpeningTreeBuilder::Tuple> tuples;
+        vector<OpeningTreeEntry> entries;
+        OpeningTreeBuilder::Tuple tuple;
+        Game game;
+        string errorMsg;
+        unsigned gamesDone = 0;
+
+        // Only the mainline moves within the depth are replayed.  The move after the
+        // depth is read as well so replayGame() can tell if the last move is the last
+        // move of the game.
+        DatabaseReadOptions options;
+        options.mainlineOnly = true;
+        options.skipAnnotations = true;
+        options.maxPlies = m_depth + 1;
+
+        tuples.reserve(m_maxTuples);
+
+        for (unsigned i = m_firstGameNum + m_index; i <= m_lastGameNum && !m_quit; i += m_step) {
+            if (++gamesDone == PROGRESS_GAMES) {
+                MUTEX_LOCK(m_builder.m_mutex);
+                m_builder.m_gamesDone += gamesDone;
+                gamesDone = 0;
+            }
+
+            if (!db->gameExists(i))
+                continue;
+
+            if (!db->read(i, game, options)) {
+                m_builder.setErrorMsg(Util::format("Failed to read game %u: %s", i, db->errorMsg().c_str()));
+                return false;
+            }
+
+            if (!OpeningTreeBuilder::replayGame(game, i, m_depth, entries, errorMsg)) {
+                m_builder.setErrorMsg(errorMsg);
+                return false;
+            }
+
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                tuple.hashKey = it->hashKey();
+                tuple.prevHashKey = it->prevHashKey();
+                tuple.gameRef = OpeningTreeFile::gameRef(i, it->lastMove(), it->score());
+                tuple.move = it->move().intValue();
+                tuples.push_back(tuple);
+
+                if (tuples.size() >= m_maxTuples && !m_builder.writeRun(tuples))
+                    return false;
+            }
+        }
+
+        {
+            MUTEX_LOCK(m_builder.m_mutex);
+            m_builder.m_gamesDone += gamesDone;
+        }
+
+        return m_quit || tuples.empty() || m_builder.writeRun(tuples);
+    }
+};
+
+OpeningTreeBuilder::OpeningTreeBuilder() :
+    m_maxMemory(DEFAULT_MAX_MEMORY),
+    m_runPrefix(),
+    m_runFilenames(),
+    m_runSizes(),
+    m_runs(),
+    m_heap(),
+    m_numEntries(0),
+    m_gamesDone(0),
+    m_mutex(),
+    m_errorMsg() {
+}
+
+OpeningTreeBuilder::~OpeningTreeBuilder() {
+    clear();
+}
+
+bool OpeningTreeBuilder::replayGame(const Game &game, unsigned gameNum, unsigned depth,
+                                    vector<OpeningTreeEntry> &entries, string &errorMsg) {
+    entries.clear();
+
+    if (!game.startPosition().isStarting() || game.mainline() == 0)
+        return true;
+
+    Position pos = game.startPosition();
+    UnmakeMoveInfo umi;
+    OpeningTreeEntry entry;
+    const AnnotMove *move;
+    unsigned count;
+    int score;
+
+    switch (game.result()) {
+    case GameHeader::WHITE_WIN:
+        score = +1;
+        break;
+
+    case GameHeader::BLACK_WIN:
+        score = -1;
+        break;
+
+    default:
+        score = 0;
+        break;
+    }
+
+    for (move = game.mainline(), count = 0;
+         move && count < depth;
+         move = move->next(), count++) {
+        entry.setPrevHashKey(pos.hashKey());
+
+        if (!pos.makeMove(move, umi)) {
+            errorMsg = Util::format("Error making move '%s' in game %u", move->dump(false).c_str(), gameNum);
+            return false;
+        }
+
+        entry.setHashKey(pos.hashKey());
+        entry.setMove(move->move());
+        entry.setScore(score);
+        entry.setLastMove(move->next() == 0);
+        entry.setGameNum(gameNum);
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+bool OpeningTreeBuilder::build(const string &dburl, unsigned firstGameNum, unsigned lastGameNum, unsigned depth,
+                               unsigned numThreads, DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    unsigned i, startTime = Util::getTickCount();
+    bool retval = true;
+
+    clear();
+    m_errorMsg.clear();
+
+    if (firstGameNum > lastGameNum)
+        return startMerge();
+
+    if (numThreads == 0)
+        numThreads = Util::numProcessors();
+
+    m_runPrefix = Util::tempFilename("optree");
+
+    if (m_runPrefix.empty())
+        m_runPrefix = dburl + ".optree";
+
+    size_t maxTuples = m_maxMemory / numThreads / sizeof(Tuple);
+
+    if (maxTuples < MERGE_BUFFER_SIZE)
+        maxTuples = MERGE_BUFFER_SIZE;
+
+    vector<OpeningTreeBuilderThread *> threads;
+    IoEventList events;
+
+    for (i = 0; i < numThreads && retval; i++) {
+        OpeningTreeBuilderThread *thread = new OpeningTreeBuilderThread(*this, dburl, firstGameNum, lastGameNum,
+                                                                        depth, i, numThreads, maxTuples);
+
+        if (thread->start()) {
+            threads.push_back(thread);
+            events.push_back(&thread->m_doneEvent);
+        } else {
+            setErrorMsg("Failed to start opening tree thread");
+            delete thread;
+            retval = false;
+        }
+    }
+
+    if (!retval) {
+        for (i = 0; i < threads.size(); i++)
+            threads[i]->m_quit = true;
+    }
+
+    // Report progress until every thread has finished
+    IoEventWaiter waiter;
+    unsigned numGames = lastGameNum - firstGameNum + 1;
+
+    while (!events.empty()) {
+        if (!waiter.setEvents(events)) {
+            setErrorMsg("Failed to wait for opening tree threads");
+            retval = false;
+
+            for (i = 0; i < threads.size(); i++)
+                threads[i]->m_quit = true;
+
+            break;
+        }
+
+        int index = waiter.wait(PROGRESS_INTERVAL);
+
+        if (index >= 0 && index < (int)events.size()) {
+            events[index]->reset();
+            events.erase(events.begin() + index);
+        }
+
+        // Stop the other threads as soon as one fails
+        for (i = 0; i < threads.size() && retval; i++) {
+            if (threads[i]->m_failed) {
+                retval = false;
+
+                for (unsigned j = 0; j < threads.size(); j++)
+                    threads[j]->m_quit = true;
+            }
+        }
+
+        if (retval && callback) {
+            unsigned gamesDone;
+            {
+                MUTEX_LOCK(m_mutex);
+                gamesDone = m_gamesDone;
+            }
+
+            float complete = (float(gamesDone) * 100.0f) / float(numGames);
+
+            if (gamesDone > 0 && !callback(firstGameNum + gamesDone - 1, complete, contextInfo)) {
+                setErrorMsg("User cancelled operation");
+                retval = false;
+
+                for (i = 0; i < threads.size(); i++)
+                    threads[i]->m_quit = true;
+            }
+        }
+    }
+
+    for (i = 0; i < threads.size(); i++) {
+        while (threads[i]->isThreadRunning())
+            Util::sleep(1);
+
+        if (threads[i]->m_failed)
+            retval = false;
+
+        delete threads[i];
+    }
+
+    if (retval) {
+        LOGINF << "Sorted " << m_numEntries << " opening tree entries of games " << firstGameNum << " to " <<
+            lastGameNum << " into " << m_runFilenames.size() << " runs using " << numThreads << " threads in " <<
+            (Util::getTickCount() - startTime) << "ms";
+
+        retval = startMerge();
+    }
+
+    if (!retval) {
+        LOGERR << m_errorMsg;
+        clear();
+    }
+
+    return retval;
+}
+
+bool OpeningTreeBuilder::next(OpeningTreeEntry &entry, bool &done) {
+    done = m_heap.empty();
+
+    if (done)
+        return true;
+
+    RunOrder order(m_runs);
+    pop_heap(m_heap.begin(), m_heap.end(), order);
+
+    unsigned index = m_heap.back();
+    Run &run = *m_runs[index];
+    const Tuple &tuple = run.buffer[run.pos];
+
+    entry.setHashKey(tuple.hashKey);
+    entry.setPrevHashKey(tuple.prevHashKey);
+    entry.setMove(tuple.move);
+    entry.setScore(OpeningTreeFile::gameRefScore(tuple.gameRef));
+    entry.setLastMove(OpeningTreeFile::gameRefLastMove(tuple.gameRef));
+    entry.setGameNum(OpeningTreeFile::gameRefGameNum(tuple.gameRef));
+
+    if (++run.pos == run.buffer.size()) {
+        if (!fillBuffer(run))
+            return false;
+
+        if (run.buffer.empty()) {
+            m_heap.pop_back();
+            return true;
+        }
+    }
+
+    push_heap(m_heap.begin(), m_heap.end(), order);
+    return true;
+}
+
+void OpeningTreeBuilder::clear() {
+    for (auto it = m_runs.begin(); it != m_runs.end(); ++it)
+        delete *it;
+
+    for (auto it = m_runFilenames.begin(); it != m_runFilenames.end(); ++it)
+        Util::deleteFile(*it);
+
+    m_runs.clear();
+    m_heap.clear();
+    m_runFilenames.clear();
+    m_runSizes.clear();
+    m_numEntries = 0;
+    m_gamesDone = 0;
+}
+
+bool OpeningTreeBuilder::writeRun(vector<Tuple> &tuples) {
+    sort(tuples.begin(), tuples.end());
+
+    string filename;
+    size_t index;
+    {
+        MUTEX_LOCK(m_mutex);
+        index = m_runFilenames.size();
+        filename = m_runPrefix + Util::format(".%u.run", (unsigned)index);
+        m_runFilenames.push_back(filename);
+        m_runSizes.push_back(0);
+    }
+
+    ofstream file(filename.c_str(), ios::binary | ios::out | ios::trunc);
+
+    if (file.is_open())
+        file.write((const char *)tuples.data(), tuples.size() * sizeof(Tuple));
+
+    if (!file.is_open() || file.fail()) {
+        setErrorMsg(Util::format("Failed to write opening tree run '%s': %s", filename.c_str(), strerror(errno)));
+        return false;
+    }
+
+    file.close();
+
+    {
+        MUTEX_LOCK(m_mutex);
+        m_runSizes[index] = tuples.size();
+        m_numEntries += tuples.size();
+    }
+
+    tuples.clear();
+    return true;
+}
+
+bool OpeningTreeBuilder::startMerge() {
+    RunOrder order(m_runs);
+
+    for (unsigned i = 0; i < m_runFilenames.size(); i++) {
+        Run *run = new Run;
+        m_runs.push_back(run);
+
+        run->file.open(m_runFilenames[i].c_str(), ios::binary | ios::in);
+        run->pos = 0;
+        run->remaining = m_runSizes[i];
+
+        if (!run->file.is_open()) {
+            setErrorMsg(Util::format("Failed to open opening tree run '%s': %s", m_runFilenames[i].c_str(),
+                                     strerror(errno)));
+            return false;
+        }
+
+        if (!fillBuffer(*run))
+            return false;
+
+        if (!run->buffer.empty()) {
+            m_heap.push_back(i);
+            push_heap(m_heap.begin(), m_heap.end(), order);
+        }
+    }
+
+    return true;
+}
+
+bool OpeningTreeBuilder::fillBuffer(Run &run) {
+    size_t count = (size_t)min(run.remaining, (uint64_t)MERGE_BUFFER_SIZE);
+
+    run.buffer.resize(count);
+    run.pos = 0;
+
+    if (count == 0)
+        return true;
+
+    run.file.read((char *)run.buffer.data(), count * sizeof(Tuple));
+
+    if (run.file.fail()) {
+        setErrorMsg("Failed to read opening tree run");
+        return false;
+    }
+
+    run.remaining -= count;
+    return true;
+}
+
+void OpeningTreeBuilder::setErrorMsg(const string &errorMsg) {
+    MUTEX_LOCK(m_mutex);
+
+    // Keep the first error
+    if (m_errorMsg.empty())
+        m_errorMsg = errorMsg;
+}
+} // namespace ChessCore
@@ -0,0 +1,184 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// OpeningTreeCache.cpp: OpeningTreeCache class implementation.
+//
+
+#include <ChessCore/OpeningTreeCache.h>
+#include <ChessCore/Log.h>
+
+using namespace std;
+
+namespace ChessCore {
+const char *OpeningTreeCache::m_classname = "OpeningTreeCache";
+
+OpeningTreeCache::OpeningTreeCache(size_t maxEntries) :
+    m_items(),
+    m_index(),
+    m_maxEntries(maxEntries),
+    m_numEntries(0),
+    m_hits(0),
+    m_misses(0),
+    m_mutex() {
+}
+
+OpeningTreeCache::~OpeningTreeCache() {
+}
+
+void OpeningTreeCache::setMaxEntries(size_t maxEntries) {
+    MUTEX_LOCK(m_mutex);
+    m_maxEntries = maxEntries;
+    evict();
+}
+
+size_t OpeningTreeCache::maxEntries() const {
+    MUTEX_LOCK(m_mutex);
+    return m_maxEntries;
+}
+
+bool OpeningTreeCache::findEntries(uint64_t hashKey, bool lastMoveOnly, vector<OpeningTreeEntry> &entries) {
+    MUTEX_LOCK(m_mutex);
+    Item *item = findItem(hashKey);
+
+    if (item && (item->haveEntries || item->count == 0)) {
+        for (auto it = item->entries.begin(); it != item->entries.end(); ++it)
+            if (!lastMoveOnly || it->lastMove())
+                entries.push_back(*it);
+
+        m_hits++;
+        return true;
+    }
+
+    m_misses++;
+    return false;
+}
+
+bool OpeningTreeCache::findCount(uint64_t hashKey, unsigned &count) {
+    MUTEX_LOCK(m_mutex);
+    Item *item = findItem(hashKey);
+
+    if (item) {
+        count = item->count;
+        m_hits++;
+        return true;
+    }
+
+    m_misses++;
+    return false;
+}
+
+void OpeningTreeCache::addEntries(uint64_t hashKey, const vector<OpeningTreeEntry> &entries) {
+    MUTEX_LOCK(m_mutex);
+
+    if (m_maxEntries == 0)
+        return;
+
+    Item &item = addItem(hashKey);
+    item.count = (unsigned)entries.size();
+
+    if (!item.haveEntries && entries.size() < m_maxEntries / 2) {
+        item.entries = entries;
+        item.haveEntries = true;
+        m_numEntries += entries.size();
+    }
+
+    evict();
+}
+
+void OpeningTreeCache::addCount(uint64_t hashKey, unsigned count) {
+    MUTEX_LOCK(m_mutex);
+
+    if (m_maxEntries == 0)
+        return;
+
+    Item &item = addItem(hashKey);
+
+    if (!item.haveEntries)
+        item.count = count;
+
+    evict();
+}
+
+void OpeningTreeCache::clear() {
+    MUTEX_LOCK(m_mutex);
+    m_items.clear();
+    m_index.clear();
+    m_numEntries = 0;
+}
+
+bool OpeningTreeCache::isFull() const {
+    MUTEX_LOCK(m_mutex);
+    return m_numEntries >= m_maxEntries;
+}
+
+size_t OpeningTreeCache::numPositions() const {
+    MUTEX_LOCK(m_mutex);
+    return m_items.size();
+}
+
+size_t OpeningTreeCache::numEntries() const {
+    MUTEX_LOCK(m_mutex);
+    return m_numEntries;
+}
+
+uint64_t OpeningTreeCache::hits() const {
+    MUTEX_LOCK(m_mutex);
+    return m_hits;
+}
+
+uint64_t OpeningTreeCache::misses() const {
+    MUTEX_LOCK(m_mutex);
+    return m_misses;
+}
+
+double OpeningTreeCache::hitRate() const {
+    MUTEX_LOCK(m_mutex);
+    uint64_t lookups = m_hits + m_misses;
+    return lookups ? (double)m_hits / (double)lookups : 0.0;
+}
+
+void OpeningTreeCache::resetStats() {
+    MUTEX_LOCK(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+}
+
+// The mutex must be locked by the caller
+OpeningTreeCache::Item *OpeningTreeCache::findItem(uint64_t hashKey) {
+    auto found = m_index.find(hashKey);
+
+    if (found == m_index.end())
+        return 0;
+
+    // Make it the most recently used
+    m_items.splice(m_items.begin(), m_items, found->second);
+    return &m_items.front();
+}
+
+// The mutex must be locked by the caller
+OpeningTreeCache::Item &OpeningTreeCache::addItem(uint64_t hashKey) {
+    Item *item = findItem(hashKey);
+
+    if (item)
+        return *item;
+
+    m_items.push_front(Item());
+    m_items.front().hashKey = hashKey;
+    m_items.front().count = 0;
+    m_items.front().haveEntries = false;
+    m_index[hashKey] = m_items.begin();
+    m_numEntries++;
+
+    return m_items.front();
+}
+
+// The mutex must be locked by the caller
+void OpeningTreeCache::evict() {
+    while (m_numEntries > m_maxEntries && !m_items.empty()) {
+        Item &item = m_items.back();
+        m_numEntries -= 1 + item.entries.size();
+        m_index.erase(item.hashKey);
+        m_items.pop_back();
+    }
+}
+} // namespace ChessCore
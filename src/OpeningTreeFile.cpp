@@ -0,0 +1,665 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// OpeningTreeFile.cpp: OpeningTreeFile class implementation.
+//
+
+#include <ChessCore/OpeningTreeFile.h>
+#include <ChessCore/Log.h>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+
+namespace ChessCore {
+const char *OpeningTreeFile::m_classname = "OpeningTreeFile";
+
+#define OPENING_TREE_MAGIC          0x31544f50  // "POT1"
+#define OPENING_TREE_HEADER_SIZE    (4 * sizeof(uint32_t) + 4 * sizeof(uint64_t))
+#define OPENING_TREE_MAX_GAMENUM    0x1fffffff
+
+// The search interpolates this many times before reverting to a binary search
+#define OPENING_TREE_MAX_PROBES     4
+
+// Used to write the moves of a position in move order
+static bool moveLess(const OpeningTreeFileWriter::PositionMove &a, const OpeningTreeFileWriter::PositionMove &b) {
+    return a.record.move < b.record.move;
+}
+
+// Used to sort the position graph edges by the position the move is made from
+static bool fromLess(const OpeningTreeFileWriter::GraphEdge &a, const OpeningTreeFileWriter::GraphEdge &b) {
+    if (a.from != b.from)
+        return a.from < b.from;
+    if (a.move != b.move)
+        return a.move < b.move;
+    return a.to < b.to;
+}
+
+// Used to sort the moves into the current position
+static bool parentLess(const OpeningTreeFileWriter::GraphEdge &a, const OpeningTreeFileWriter::GraphEdge &b) {
+    if (a.move != b.move)
+        return a.move < b.move;
+    return a.from < b.from;
+}
+
+// Used to return the entries of a position in game order
+static bool gameNumLess(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    return a.gameNum() < b.gameNum();
+}
+
+//
+// Find the first of a sorted array of items whose hash key is not less than hashKey.
+//
+template<typename T> static uint64_t lowerBound(const T *items, uint64_t count, uint64_t hashKey) {
+    // Everything before lo is less than hashKey and everything from hi onwards is not
+    uint64_t lo = 0, hi = count;
+
+    for (unsigned probes = 0; probes < OPENING_TREE_MAX_PROBES && hi - lo > 32; probes++) {
+        uint64_t lowKey = le64(items[lo].hashKey);
+        uint64_t highKey = le64(items[hi - 1].hashKey);
+
+        if (hashKey <= lowKey) {
+            hi = lo;
+            break;
+        }
+
+        if (hashKey > highKey) {
+            lo = hi;
+            break;
+        }
+
+        double fraction = (double)(hashKey - lowKey) / (double)(highKey - lowKey);
+        uint64_t mid = lo + (uint64_t)(fraction * (double)(hi - 1 - lo));
+
+        if (mid >= hi)
+            mid = hi - 1;
+
+        if (le64(items[mid].hashKey) < hashKey)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+
+        if (le64(items[mid].hashKey) < hashKey)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+OpeningTreeFile::OpeningTreeFile() :
+    m_file(),
+    m_numGames(0),
+    m_generation(0),
+    m_numRecords(0),
+    m_numGameRefs(0),
+    m_numNodes(0),
+    m_numEdges(0),
+    m_records(0),
+    m_gameRefs(0),
+    m_nodes(0),
+    m_children(0),
+    m_parents(0) {
+}
+
+OpeningTreeFile::~OpeningTreeFile() {
+    close();
+}
+
+bool OpeningTreeFile::open(const string &filename, unsigned generation) {
+    close();
+
+    if (!m_file.open(filename))
+        return false;
+
+    const uint8_t *data = m_file.data();
+    uint64_t size = m_file.size();
+    const uint32_t *header = (const uint32_t *)data;
+
+    if (size < OPENING_TREE_HEADER_SIZE ||
+        le32(header[0]) != OPENING_TREE_MAGIC ||
+        le32(header[1]) != CURRENT_VERSION ||
+        le32(header[3]) != generation) {
+        LOGWRN << "Opening tree file '" << filename << "' is invalid or out-of-date";
+        close();
+        return false;
+    }
+
+    const uint64_t *counts = (const uint64_t *)(data + 4 * sizeof(uint32_t));
+    m_numGames = le32(header[2]);
+    m_generation = generation;
+    m_numRecords = le64(counts[0]);
+    m_numGameRefs = le64(counts[1]);
+    m_numNodes = le64(counts[2]);
+    m_numEdges = le64(counts[3]);
+
+    uint64_t gameRefsOffset = OPENING_TREE_HEADER_SIZE + m_numRecords * sizeof(Record);
+    uint64_t nodesOffset = (gameRefsOffset + m_numGameRefs * sizeof(uint32_t) + 7) & ~7ULL;
+    uint64_t childrenOffset = nodesOffset + m_numNodes * sizeof(Node);
+    uint64_t parentsOffset = childrenOffset + m_numEdges * sizeof(Edge);
+
+    if (size < parentsOffset + m_numEdges * sizeof(Edge)) {
+        LOGWRN << "Opening tree file '" << filename << "' is truncated";
+        close();
+        return false;
+    }
+
+    m_records = (const Record *)(data + OPENING_TREE_HEADER_SIZE);
+    m_gameRefs = (const uint32_t *)(data + gameRefsOffset);
+    m_nodes = (const Node *)(data + nodesOffset);
+    m_children = (const Edge *)(data + childrenOffset);
+    m_parents = (const Edge *)(data + parentsOffset);
+
+    LOGDBG << "Opened opening tree file '" << filename << "' with " << m_numRecords << " records and " <<
+        m_numNodes << " positions";
+
+    return true;
+}
+
+void OpeningTreeFile::close() {
+    m_file.close();
+    m_numGames = 0;
+    m_generation = 0;
+    m_numRecords = 0;
+    m_numGameRefs = 0;
+    m_numNodes = 0;
+    m_numEdges = 0;
+    m_records = 0;
+    m_gameRefs = 0;
+    m_nodes = 0;
+    m_children = 0;
+    m_parents = 0;
+}
+
+const OpeningTreeFile::Record *OpeningTreeFile::find(uint64_t hashKey, unsigned &numRecords) const {
+    numRecords = 0;
+
+    if (!isOpen())
+        return 0;
+
+    uint64_t first = lowerBound(m_records, m_numRecords, hashKey), end = first;
+
+    while (end < m_numRecords && le64(m_records[end].hashKey) == hashKey)
+        end++;
+
+    if (end == first)
+        return 0;
+
+    numRecords = (unsigned)(end - first);
+    return m_records + first;
+}
+
+const OpeningTreeFile::Node *OpeningTreeFile::findNode(uint64_t hashKey) const {
+    if (!isOpen())
+        return 0;
+
+    uint64_t index = lowerBound(m_nodes, m_numNodes, hashKey);
+
+    if (index == m_numNodes || le64(m_nodes[index].hashKey) != hashKey)
+        return 0;
+
+    return m_nodes + index;
+}
+
+void OpeningTreeFile::search(uint64_t hashKey, bool lastMoveOnly, vector<OpeningTreeEntry> &entries) const {
+    unsigned numRecords;
+    const Record *record = find(hashKey, numRecords);
+    size_t firstEntry = entries.size();
+    OpeningTreeEntry entry;
+
+    for (unsigned i = 0; i < numRecords; i++, record++) {
+        const uint32_t *refs = gameRefs(*record);
+        uint32_t move = le32(record->move);
+        uint32_t numGames = le32(record->numGames);
+
+        for (uint32_t j = 0; j < numGames; j++) {
+            uint32_t ref = le32(refs[j]);
+
+            if (lastMoveOnly && !gameRefLastMove(ref))
+                continue;
+
+            entry.setHashKey(hashKey);
+            entry.setMove(move);
+            entry.setScore(gameRefScore(ref));
+            entry.setLastMove(gameRefLastMove(ref));
+            entry.setGameNum(gameRefGameNum(ref));
+            entries.push_back(entry);
+        }
+    }
+
+    if (numRecords > 1)
+        stable_sort(entries.begin() + firstEntry, entries.end(), gameNumLess);
+}
+
+unsigned OpeningTreeFile::count(uint64_t hashKey) const {
+    unsigned numRecords, count = 0;
+    const Record *record = find(hashKey, numRecords);
+
+    for (unsigned i = 0; i < numRecords; i++, record++)
+        count += le32(record->numGames);
+
+    return count;
+}
+
+void OpeningTreeFile::stats(uint64_t hashKey, unsigned maxSampleGames, vector<OpeningTreeStats> &stats) const {
+    unsigned numRecords;
+    const Record *record = find(hashKey, numRecords);
+
+    for (unsigned i = 0; i < numRecords; i++, record++) {
+        stats.push_back(OpeningTreeStats());
+        OpeningTreeStats &moveStats = stats.back();
+        moveStats.setHashKey(hashKey);
+        moveStats.setMove(le32(record->move));
+        moveStats.setNumGames(le32(record->numGames));
+        moveStats.setWhiteWins(le32(record->whiteWins));
+        moveStats.setDraws(le32(record->draws));
+        moveStats.setBlackWins(le32(record->blackWins));
+
+        const uint32_t *refs = gameRefs(*record);
+        unsigned numSamples = std::min(maxSampleGames, moveStats.numGames());
+        moveStats.sampleGames().reserve(numSamples);
+
+        for (unsigned j = 0; j < numSamples; j++)
+            moveStats.sampleGames().push_back(gameRefGameNum(le32(refs[j])));
+    }
+}
+
+void OpeningTreeFile::children(uint64_t hashKey, vector<OpeningTreeEdge> &edges) const {
+    const Node *node = findNode(hashKey);
+
+    if (!node)
+        return;
+
+    const Edge *edge = m_children + le64(node->firstChild);
+    uint32_t numChildren = le32(node->numChildren);
+
+    for (uint32_t i = 0; i < numChildren; i++, edge++)
+        edges.push_back(OpeningTreeEdge(hashKey, le64(edge->hashKey), le32(edge->move), le32(edge->numGames)));
+}
+
+void OpeningTreeFile::parents(uint64_t hashKey, vector<OpeningTreeEdge> &edges) const {
+    const Node *node = findNode(hashKey);
+
+    if (!node)
+        return;
+
+    const Edge *edge = m_parents + le64(node->firstParent);
+    uint32_t numParents = le32(node->numParents);
+
+    for (uint32_t i = 0; i < numParents; i++, edge++)
+        edges.push_back(OpeningTreeEdge(le64(edge->hashKey), hashKey, le32(edge->move), le32(edge->numGames)));
+}
+
+//
+// OpeningTreeFileWriter
+//
+const char *OpeningTreeFileWriter::m_classname = "OpeningTreeFileWriter";
+
+OpeningTreeFileWriter::OpeningTreeFileWriter() :
+    m_filename(),
+    m_tempFilename(),
+    m_gamesFilename(),
+    m_file(),
+    m_gamesFile(),
+    m_moves(),
+    m_positionEdges(),
+    m_edges(),
+    m_hashKey(0ULL),
+    m_havePosition(false),
+    m_numGames(0),
+    m_generation(0),
+    m_numRecords(0),
+    m_numGameRefs(0),
+    m_numNodes(0),
+    m_numEdges(0),
+    m_errorMsg() {
+}
+
+OpeningTreeFileWriter::~OpeningTreeFileWriter() {
+    abort();
+}
+
+bool OpeningTreeFileWriter::create(const string &filename, unsigned numGames, unsigned generation) {
+    abort();
+
+    m_filename = filename;
+    m_tempFilename = filename + ".tmp";
+    m_gamesFilename = filename + ".games.tmp";
+    m_numGames = numGames;
+    m_generation = generation;
+    m_numRecords = 0;
+    m_numGameRefs = 0;
+    m_numNodes = 0;
+    m_numEdges = 0;
+    m_moves.clear();
+    m_positionEdges.clear();
+    m_edges.clear();
+    m_havePosition = false;
+    m_errorMsg.clear();
+
+    m_file.open(m_tempFilename.c_str(), ios::binary | ios::out | ios::trunc);
+
+    if (!m_file.is_open()) {
+        m_errorMsg = Util::format("Failed to create opening tree file '%s': %s", m_tempFilename.c_str(),
+                                  strerror(errno));
+        return false;
+    }
+
+    m_gamesFile.open(m_gamesFilename.c_str(), ios::binary | ios::out | ios::trunc);
+
+    if (!m_gamesFile.is_open()) {
+        m_errorMsg = Util::format("Failed to create opening tree file '%s': %s", m_gamesFilename.c_str(),
+                                  strerror(errno));
+        abort();
+        return false;
+    }
+
+    // The header is rewritten by finish() once the counts are known
+    if (!writeHeader()) {
+        abort();
+        return false;
+    }
+
+    return true;
+}
+
+bool OpeningTreeFileWriter::add(const OpeningTreeEntry &entry) {
+    if (!m_file.is_open()) {
+        m_errorMsg = "Opening tree file has not been created";
+        return false;
+    }
+
+    uint64_t hashKey = entry.hashKey();
+    uint32_t move = entry.move().intValue();
+
+    if (entry.gameNum() > OPENING_TREE_MAX_GAMENUM) {
+        m_errorMsg = Util::format("Game number %u is too large for an opening tree file", entry.gameNum());
+        return false;
+    }
+
+    if (!m_havePosition || hashKey != m_hashKey) {
+        if (m_havePosition) {
+            if (hashKey < m_hashKey) {
+                m_errorMsg = "Opening tree entries are not in order";
+                return false;
+            }
+
+            if (!writePosition())
+                return false;
+        }
+
+        m_hashKey = hashKey;
+        m_havePosition = true;
+    }
+
+    // There are only ever a few moves into a position
+    size_t i;
+
+    for (i = 0; i < m_moves.size() && m_moves[i].record.move != move; i++)
+        ;
+
+    if (i == m_moves.size()) {
+        m_moves.push_back(PositionMove());
+        memset(&m_moves[i].record, 0, sizeof(m_moves[i].record));
+        m_moves[i].record.hashKey = hashKey;
+        m_moves[i].record.move = move;
+    }
+
+    OpeningTreeFile::Record &record = m_moves[i].record;
+    m_moves[i].gameRefs.push_back(le32(OpeningTreeFile::gameRef(entry.gameNum(), entry.lastMove(),
+                                                                 entry.score())));
+    record.numGames++;
+
+    if (entry.score() > 0)
+        record.whiteWins++;
+    else if (entry.score() < 0)
+        record.blackWins++;
+    else
+        record.draws++;
+
+    if (entry.prevHashKey() == 0ULL)
+        return true;
+
+    for (i = 0; i < m_positionEdges.size(); i++) {
+        if (m_positionEdges[i].move == move && m_positionEdges[i].from == entry.prevHashKey()) {
+            m_positionEdges[i].numGames++;
+            return true;
+        }
+    }
+
+    GraphEdge edge;
+    edge.from = entry.prevHashKey();
+    edge.to = hashKey;
+    edge.move = move;
+    edge.numGames = 1;
+    m_positionEdges.push_back(edge);
+
+    return true;
+}
+
+bool OpeningTreeFileWriter::finish() {
+    if (!m_file.is_open()) {
+        m_errorMsg = "Opening tree file has not been created";
+        return false;
+    }
+
+    if (m_havePosition && !writePosition()) {
+        abort();
+        return false;
+    }
+
+    m_havePosition = false;
+    m_gamesFile.close();
+
+    bool retval = !m_gamesFile.fail();
+
+    if (retval) {
+        // Append the game list to the records
+        ifstream gamesFile(m_gamesFilename.c_str(), ios::binary | ios::in);
+        retval = gamesFile.is_open();
+
+        if (retval && m_numGameRefs > 0)
+            m_file << gamesFile.rdbuf();
+    }
+
+    if (retval)
+        retval = writeGraph();
+
+    if (retval) {
+        m_file.seekp(0);
+        retval = writeHeader();
+    }
+
+    if (retval) {
+        m_file.close();
+        retval = !m_file.fail();
+    }
+
+    if (!retval) {
+        if (m_errorMsg.empty())
+            m_errorMsg = Util::format("Failed to write opening tree file '%s': %s", m_tempFilename.c_str(),
+                                      strerror(errno));
+        abort();
+        return false;
+    }
+
+    Util::deleteFile(m_gamesFilename);
+
+    if (!Util::renameFile(m_tempFilename, m_filename)) {
+        m_errorMsg = Util::format("Failed to rename opening tree file '%s': %s", m_tempFilename.c_str(),
+                                  strerror(errno));
+        abort();
+        return false;
+    }
+
+    LOGDBG << "Wrote opening tree file '" << m_filename << "' with " << m_numRecords << " records, " <<
+        m_numGameRefs << " game references and " << m_numNodes << " positions";
+
+    m_tempFilename.clear();
+    m_gamesFilename.clear();
+
+    return true;
+}
+
+void OpeningTreeFileWriter::abort() {
+    if (m_file.is_open())
+        m_file.close();
+
+    if (m_gamesFile.is_open())
+        m_gamesFile.close();
+
+    if (!m_tempFilename.empty()) {
+        Util::deleteFile(m_tempFilename);
+        m_tempFilename.clear();
+    }
+
+    if (!m_gamesFilename.empty()) {
+        Util::deleteFile(m_gamesFilename);
+        m_gamesFilename.clear();
+    }
+
+    m_moves.clear();
+    m_positionEdges.clear();
+    m_edges.clear();
+    m_havePosition = false;
+}
+
+bool OpeningTreeFileWriter::writePosition() {
+    sort(m_moves.begin(), m_moves.end(), moveLess);
+
+    for (auto it = m_moves.begin(); it != m_moves.end(); ++it) {
+        OpeningTreeFile::Record record;
+        record.hashKey = le64(it->record.hashKey);
+        record.firstGame = le64(m_numGameRefs);
+        record.move = le32(it->record.move);
+        record.numGames = le32(it->record.numGames);
+        record.whiteWins = le32(it->record.whiteWins);
+        record.draws = le32(it->record.draws);
+        record.blackWins = le32(it->record.blackWins);
+        record.reserved = 0;
+
+        m_file.write((const char *)&record, sizeof(record));
+
+        if (m_file.fail() || m_file.bad()) {
+            m_errorMsg = Util::format("Failed to write opening tree file '%s': %s", m_tempFilename.c_str(),
+                                      strerror(errno));
+            return false;
+        }
+
+        m_gamesFile.write((const char *)it->gameRefs.data(), it->gameRefs.size() * sizeof(uint32_t));
+
+        if (m_gamesFile.fail() || m_gamesFile.bad()) {
+            m_errorMsg = Util::format("Failed to write opening tree file '%s': %s", m_gamesFilename.c_str(),
+                                      strerror(errno));
+            return false;
+        }
+
+        m_numRecords++;
+        m_numGameRefs += it->gameRefs.size();
+    }
+
+    m_moves.clear();
+
+    sort(m_positionEdges.begin(), m_positionEdges.end(), parentLess);
+    m_edges.insert(m_edges.end(), m_positionEdges.begin(), m_positionEdges.end());
+    m_positionEdges.clear();
+
+    return true;
+}
+
+bool OpeningTreeFileWriter::writeGraph() {
+    // Pad the game list so the nodes are aligned
+    static const char padding[8] = { 0 };
+
+    if (m_numGameRefs & 1)
+        m_file.write(padding, sizeof(uint32_t));
+
+    // m_edges is in the order of the parent lists; the child lists need another copy
+    vector<GraphEdge> children(m_edges);
+    sort(children.begin(), children.end(), fromLess);
+
+    size_t numEdges = m_edges.size(), child = 0, parent = 0;
+    vector<OpeningTreeFile::Edge> edges;
+    OpeningTreeFile::Node node;
+    OpeningTreeFile::Edge edge;
+
+    // Each position is the 'from' of a child list, the 'to' of a parent list, or both
+    while (child < numEdges || parent < numEdges) {
+        uint64_t hashKey;
+
+        if (child < numEdges && (parent == numEdges || children[child].from <= m_edges[parent].to))
+            hashKey = children[child].from;
+        else
+            hashKey = m_edges[parent].to;
+
+        uint64_t firstChild = child, firstParent = parent;
+
+        while (child < numEdges && children[child].from == hashKey)
+            child++;
+
+        while (parent < numEdges && m_edges[parent].to == hashKey)
+            parent++;
+
+        node.hashKey = le64(hashKey);
+        node.firstChild = le64(firstChild);
+        node.firstParent = le64(firstParent);
+        node.numChildren = le32((uint32_t)(child - firstChild));
+        node.numParents = le32((uint32_t)(parent - firstParent));
+        m_file.write((const char *)&node, sizeof(node));
+        m_numNodes++;
+    }
+
+    edges.reserve(numEdges);
+
+    for (size_t i = 0; i < numEdges; i++) {
+        edge.hashKey = le64(children[i].to);
+        edge.move = le32(children[i].move);
+        edge.numGames = le32(children[i].numGames);
+        edges.push_back(edge);
+    }
+
+    m_file.write((const char *)edges.data(), edges.size() * sizeof(edge));
+    edges.clear();
+
+    for (size_t i = 0; i < numEdges; i++) {
+        edge.hashKey = le64(m_edges[i].from);
+        edge.move = le32(m_edges[i].move);
+        edge.numGames = le32(m_edges[i].numGames);
+        edges.push_back(edge);
+    }
+
+    m_file.write((const char *)edges.data(), edges.size() * sizeof(edge));
+    m_numEdges = numEdges;
+
+    if (m_file.fail() || m_file.bad()) {
+        m_errorMsg = Util::format("Failed to write opening tree file '%s': %s", m_tempFilename.c_str(),
+                                  strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool OpeningTreeFileWriter::writeHeader() {
+    if (!StreamUtil<uint32_t>::write(m_file, le32(OPENING_TREE_MAGIC)) ||
+        !StreamUtil<uint32_t>::write(m_file, le32(OpeningTreeFile::CURRENT_VERSION)) ||
+        !StreamUtil<uint32_t>::write(m_file, le32(m_numGames)) ||
+        !StreamUtil<uint32_t>::write(m_file, le32(m_generation)) ||
+        !StreamUtil<uint64_t>::write(m_file, le64(m_numRecords)) ||
+        !StreamUtil<uint64_t>::write(m_file, le64(m_numGameRefs)) ||
+        !StreamUtil<uint64_t>::write(m_file, le64(m_numNodes)) ||
+        !StreamUtil<uint64_t>::write(m_file, le64(m_numEdges))) {
+        m_errorMsg = Util::format("Failed to write opening tree file header '%s': %s", m_tempFilename.c_str(),
+                                  strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+} // namespace ChessCore
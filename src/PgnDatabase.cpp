@@ -7,6 +7,8 @@
 #define VERBOSE_LOGGING 0
 
 #include <ChessCore/PgnDatabase.h>
+#include <ChessCore/PgnTokenizer.h>
+#include <ChessCore/PgnWriter.h>
 #include <ChessCore/Log.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,7 +19,10 @@
 using namespace std;
 
 namespace ChessCore {
-#define EMBEDDED_VARIATIONS 0
+// Header cache file layout (see buildHeaderCache())
+#define HEADER_CACHE_MAGIC          0x50484331  // "PHC1"
+#define HEADER_CACHE_TABLE_OFFSET   8
+#define HEADER_CACHE_BATCH          1000
 
 // Database Factory
 static shared_ptr<Database> databaseFactory(const string &dburl, bool readOnly) {
@@ -38,6 +43,7 @@ static bool registered = Database::registerFactory(databaseFactory);
 
 const char *PgnDatabase::m_classname = "PgnDatabase";
 bool PgnDatabase::m_relaxedParsing = false;
+bool PgnDatabase::m_headerCaching = false;
 IndexManager PgnDatabase::m_indexManager;
 
 Nag PgnDatabase::m_nagMap[NUM_PGN_NAGS] = {
@@ -330,6 +336,11 @@ PgnDatabase::PgnDatabase() :
     m_pgnFile(),
     m_indexFilename(),
     m_indexFile(),
+    m_headerCacheFilename(),
+    m_headerCacheFile(),
+    m_searchIndex(),
+    m_gameText(),
+    m_writeBuffer(),
     m_context(m_pgnFile),
     m_numGames(0) {
 
@@ -343,6 +354,11 @@ PgnDatabase::PgnDatabase(const string &filename, bool readOnly) :
     m_pgnFile(),
     m_indexFilename(),
     m_indexFile(),
+    m_headerCacheFilename(),
+    m_headerCacheFile(),
+    m_searchIndex(),
+    m_gameText(),
+    m_writeBuffer(),
     m_context(m_pgnFile),
     m_numGames(0) {
 
@@ -357,6 +373,8 @@ PgnDatabase::~PgnDatabase() {
 }
 
 bool PgnDatabase::open(const string &filename, bool readOnly) {
+    MutexLock lock(m_readersMutex);
+
     clearErrorMsg();
 
     if (m_isOpen)
@@ -402,10 +420,16 @@ bool PgnDatabase::open(const string &filename, bool readOnly) {
 }
 
 bool PgnDatabase::close() {
+    MutexLock lock(m_readersMutex);
+
+    closeReaders();
     m_pgnFilename.clear();
     m_pgnFile.close();
     m_indexFilename.clear();
     m_indexFile.close();
+    m_headerCacheFilename.clear();
+    m_headerCacheFile.close();
+    m_searchIndex.close();
     m_isOpen = false;
     m_access = ACCESS_NONE;
     return true;
@@ -432,10 +456,12 @@ bool PgnDatabase::hasValidIndex() {
     bool retval = false;
     m_numGames = 0;
 
-    // The index file might already be valid
+    // The index file might already be valid.  Index files are named after the inode
+    // of the PGN file, which can be reused by a new file, so an index file written in
+    // the same second as the PGN file was modified cannot be trusted
     if (Util::size(m_pgnFile) > 0 &&
         Util::size(m_indexFile) > 0 &&
-        Util::modifyTime(m_indexFilename) >= Util::modifyTime(m_pgnFilename)) {
+        Util::modifyTime(m_indexFilename) > Util::modifyTime(m_pgnFilename)) {
         // Determine number of games in database based on size of index file
         m_numGames = (unsigned)(Util::size(m_indexFile) / (uint64_t)(sizeof(uint64_t) + sizeof(uint32_t)));
         LOGINF << "PGN database '" << m_pgnFilename << "' already has a valid index file";
@@ -446,6 +472,8 @@ bool PgnDatabase::hasValidIndex() {
 }
 
 bool PgnDatabase::index(DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    MutexLock lock(m_readersMutex);
+
     clearErrorMsg();
 
     if (!m_isOpen) {
@@ -453,12 +481,26 @@ bool PgnDatabase::index(DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
         return false;
     }
 
+    closeReaders();
+
     // hasValidIndex() will set m_numGames and open index file if it succeeds
     if (hasValidIndex())
         return true;
 
     ASSERT(m_indexFile.is_open());
 
+    // The index file is opened in append mode, so any stale entries must be removed
+    // before re-indexing
+    if (Util::size(m_indexFile) > 0) {
+        m_indexFile.close();
+
+        if (!m_indexManager.deleteIndexFile(m_pgnFilename) ||
+            !m_indexManager.getIndexFile(m_pgnFilename, m_indexFile, m_indexFilename)) {
+            DBERROR << "Failed to recreate index file for database";
+            return false;
+        }
+    }
+
     bool retval = true;
     uint64_t totalSize = Util::size(m_pgnFile);
     m_pgnFile.seekg(0, ios::beg);
@@ -521,6 +563,204 @@ bool PgnDatabase::index(DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
     return retval;
 }
 
+bool PgnDatabase::buildHeaderCache(DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (!m_indexFile.is_open()) {
+        DBERROR << "Database must be indexed before building the header cache";
+        return false;
+    }
+
+    m_headerCacheFile.close();
+
+    if (m_headerCacheFilename.empty()) {
+        m_headerCacheFilename = m_indexManager.getSideFilename(m_pgnFilename, "hdrcache");
+
+        if (m_headerCacheFilename.empty()) {
+            DBERROR << "Failed to get a header cache file for database";
+            return false;
+        }
+    }
+
+    fstream cacheFile(m_headerCacheFilename, ios::binary | ios::out | ios::trunc);
+
+    if (!cacheFile.is_open()) {
+        DBERROR << "Failed to create header cache file '" << m_headerCacheFilename << "': " << strerror(errno);
+        return false;
+    }
+
+    // The file consists of the magic number and number of games, followed by a table
+    // of offsets to the tag section of each game (relative to the end of the table;
+    // the extra entry marks the end of the last tag section) and then the tag sections
+    // themselves.  The table is written once all the tag sections are known.
+    vector<uint64_t> table(m_numGames + 1, 0);
+    bool retval = StreamUtil<uint32_t>::write(cacheFile, le32(HEADER_CACHE_MAGIC)) &&
+                  StreamUtil<uint32_t>::write(cacheFile, le32(m_numGames));
+
+    if (retval) {
+        cacheFile.write((const char *)&table[0], table.size() * sizeof(uint64_t));
+        retval = !cacheFile.fail() && !cacheFile.bad();
+    }
+
+    if (!retval)
+        DBERROR << "Failed to write to header cache file: " << strerror(errno);
+
+    vector<uint64_t> offsets;
+    vector<uint32_t> linenums;
+    vector<string> tagSections;
+    uint64_t dataOffset = 0;
+
+    for (unsigned firstGameNum = 1; retval && firstGameNum <= m_numGames; firstGameNum += HEADER_CACHE_BATCH) {
+        unsigned lastGameNum = firstGameNum + HEADER_CACHE_BATCH - 1;
+
+        if (lastGameNum > m_numGames)
+            lastGameNum = m_numGames;
+
+        retval = readIndex(firstGameNum, lastGameNum, offsets, linenums) &&
+                 readTagSections(firstGameNum, offsets, tagSections);
+
+        for (unsigned i = 0; retval && i < tagSections.size(); i++) {
+            const string &tagSection = tagSections[i];
+            cacheFile.write(tagSection.data(), tagSection.size());
+            dataOffset += tagSection.size();
+            table[firstGameNum + i] = le64(dataOffset);
+        }
+
+        if (retval && (cacheFile.fail() || cacheFile.bad())) {
+            DBERROR << "Failed to write to header cache file: " << strerror(errno);
+            retval = false;
+        }
+
+        if (retval && callback) {
+            float complete = static_cast<float> ((lastGameNum * 100.0) / m_numGames);
+
+            if (!callback(lastGameNum, complete, contextInfo)) {
+                DBERROR << "User cancelled building header cache";
+                retval = false;
+            }
+        }
+    }
+
+    if (retval) {
+        cacheFile.seekp(HEADER_CACHE_TABLE_OFFSET, ios::beg);
+        cacheFile.write((const char *)&table[0], table.size() * sizeof(uint64_t));
+
+        if (cacheFile.fail() || cacheFile.bad()) {
+            DBERROR << "Failed to write to header cache file: " << strerror(errno);
+            retval = false;
+        }
+    }
+
+    cacheFile.close();
+
+    if (retval) {
+        LOGINF << "Built header cache for PGN database '" << m_pgnFilename << "' in file '" <<
+            m_headerCacheFilename << "'";
+
+        // The new file may have the same modification time as the PGN file, so it is
+        // opened here rather than checked by openHeaderCache()
+        m_headerCacheFile.open(m_headerCacheFilename, ios::binary | ios::in);
+    } else {
+        Util::deleteFile(m_headerCacheFilename);
+    }
+
+    return retval;
+}
+
+bool PgnDatabase::buildSearchIndex(DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (!m_indexFile.is_open()) {
+        DBERROR << "Database must be indexed before building the search index";
+        return false;
+    }
+
+    string filename = m_indexManager.getSideFilename(m_pgnFilename, "search");
+
+    if (filename.empty()) {
+        DBERROR << "Failed to get a search index file for database";
+        return false;
+    }
+
+    m_searchIndex.close();
+
+    string errorMsg;
+
+    if (!SearchIndex::build(filename, *this, callback, contextInfo, errorMsg)) {
+        DBERROR << errorMsg;
+        return false;
+    }
+
+    // The new file may have the same modification time as the PGN file, so it is
+    // opened here rather than checked by openSearchIndex()
+    if (!m_searchIndex.open(filename, m_numGames)) {
+        DBERROR << "Failed to open search index";
+        return false;
+    }
+
+    return true;
+}
+
+bool PgnDatabase::search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                         DATABASE_CALLBACK_FUNC callback, void *contextInfo, int offset /*=0*/, int limit /*=0*/) {
+    clearErrorMsg();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    if (callback == 0) {
+        DBERROR << "No callback function provided";
+        return false;
+    }
+
+    if (!m_indexFile.is_open()) {
+        DBERROR << "Database must be indexed before it can be searched";
+        return false;
+    }
+
+    if (!openSearchIndex() && !buildSearchIndex(0, 0))
+        return false;
+
+    DatabaseGameList gameList;
+    string errorMsg;
+
+    if (!m_searchIndex.search(searchCriteria, sortCriteria, gameList, errorMsg)) {
+        DBERROR << errorMsg;
+        return false;
+    }
+
+    LOGDBG << gameList.size() << " games matched";
+
+    size_t first = offset > 0 ? (size_t)(offset - 1) : 0;
+    size_t last = gameList.size();
+
+    if (limit > 0 && first + limit < last)
+        last = first + limit;
+
+    for (size_t i = first; i < last; i++)
+        if (!callback(gameList[i], 0.0f, contextInfo))
+            break;
+
+    return true;
+}
+
 bool PgnDatabase::readHeader(unsigned gameNum, GameHeader &gameHeader) {
     bool retval = true;
     string str;
@@ -594,9 +834,270 @@ bool PgnDatabase::readHeader(unsigned gameNum, GameHeader &gameHeader) {
     return retval;
 }
 
+//
+// PgnByteReader is a buffered, forward-only reader used when scanning the PGN file
+// for game headers.  It avoids the flex scanner altogether, which is both slower
+// (it reads a character at a time) and does far more work than is needed to find
+// the tag section of each game.
+//
+class PgnByteReader {
+protected:
+    istream &m_stream;
+    vector<char> m_buffer;
+    uint64_t m_bufferOffset;    // File offset of m_buffer[0]
+    size_t m_pos;
+    size_t m_len;
+
+public:
+    enum {
+        BUFFER_SIZE = 64 * 1024
+    };
+
+    PgnByteReader(istream &stream) :
+        m_stream(stream),
+        m_buffer(BUFFER_SIZE),
+        m_bufferOffset(0),
+        m_pos(0),
+        m_len(0) {
+    }
+
+    uint64_t offset() const {
+        return m_bufferOffset + m_pos;
+    }
+
+    bool seek(uint64_t offset) {
+        if (m_len > 0 && offset >= m_bufferOffset && offset <= m_bufferOffset + m_len) {
+            // Already buffered
+            m_pos = (size_t)(offset - m_bufferOffset);
+            return true;
+        }
+
+        m_stream.clear();
+        m_stream.seekg(offset, ios::beg);
+
+        if (m_stream.fail() || m_stream.bad())
+            return false;
+
+        m_bufferOffset = offset;
+        m_pos = m_len = 0;
+        return true;
+    }
+
+    inline int peek() {
+        if (m_pos == m_len && !fill())
+            return EOF;
+
+        return (uint8_t)m_buffer[m_pos];
+    }
+
+    inline int get() {
+        int c = peek();
+
+        if (c != EOF)
+            m_pos++;
+
+        return c;
+    }
+
+    // Skip past the next occurrence of the specified character
+    bool skipPast(char c) {
+        return scanPast(c, 0);
+    }
+
+    // Append everything up to and including the next newline to str
+    bool readLine(string &str) {
+        return scanPast('\n', &str);
+    }
+
+protected:
+    bool fill() {
+        m_bufferOffset += m_len;
+        m_pos = m_len = 0;
+        m_stream.read(&m_buffer[0], m_buffer.size());
+        m_len = (size_t)m_stream.gcount();
+        return m_len > 0;
+    }
+
+    bool scanPast(char c, string *str) {
+        while (m_pos < m_len || fill()) {
+            const char *start = &m_buffer[m_pos];
+            const char *found = (const char *)memchr(start, c, m_len - m_pos);
+            size_t len = found ? (size_t)(found - start) + 1 : m_len - m_pos;
+
+            if (str)
+                str->append(start, len);
+
+            m_pos += len;
+
+            if (found)
+                return true;
+        }
+
+        return false;
+    }
+};
+
+//
+// Read the tag section of a game, leaving the reader at the start of the movetext.
+//
+static void readRawTagSection(PgnByteReader &reader, string &tagSection) {
+    int c;
+
+    tagSection.clear();
+
+    while ((c = reader.peek()) != EOF) {
+        if (c == '[') {
+            reader.readLine(tagSection);
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            tagSection += (char)reader.get();
+        } else {
+            break;
+        }
+    }
+}
+
+//
+// Skip the movetext of a game, leaving the reader at the start of the next game's tag
+// section (or at end-of-file).  Comments ({...}, ';' to end-of-line and '%' escape lines)
+// and variations are tracked so that a '[' within them is not mistaken for the start
+// of the next game.
+//
+static void skipMovetext(PgnByteReader &reader) {
+    unsigned varDepth = 0;
+    bool lineStart = true;
+    int c;
+
+    while ((c = reader.peek()) != EOF) {
+        if (lineStart) {
+            if (c == '[' && varDepth == 0)
+                return;             // Next game
+
+            if (c == '%') {
+                reader.skipPast('\n');
+                continue;
+            }
+        }
+
+        reader.get();
+        lineStart = false;
+
+        switch (c) {
+        case '{':
+            reader.skipPast('}');
+            break;
+
+        case ';':
+            reader.skipPast('\n');
+            lineStart = true;
+            break;
+
+        case '(':
+            varDepth++;
+            break;
+
+        case ')':
+            if (varDepth > 0)
+                varDepth--;
+            break;
+
+        case '\n':
+            lineStart = true;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+bool PgnDatabase::readHeaders(unsigned firstGameNum, unsigned lastGameNum, vector<GameHeader> &gameHeaders) {
+    clearErrorMsg();
+
+    gameHeaders.clear();
+
+    if (!m_isOpen) {
+        DBERROR << "Database is not open";
+        return false;
+    }
+
+    if (m_access == ACCESS_NONE) {
+        DBERROR << "Cannot read from this database";
+        return false;
+    }
+
+    if (!m_indexFile.is_open()) {
+        DBERROR << "Database must be indexed in order to read a range of game headers";
+        return false;
+    }
+
+    if (firstGameNum < 1 || firstGameNum > lastGameNum) {
+        DBERROR << "Game range " << firstGameNum << " to " << lastGameNum << " is invalid";
+        return false;
+    } else if (lastGameNum > m_numGames) {
+        DBERROR << "Cannot read game header " << lastGameNum << " as there are only " <<
+            m_numGames << " games in the database";
+        return false;
+    }
+
+    vector<uint64_t> offsets;
+    vector<uint32_t> linenums;
+
+    if (!readIndex(firstGameNum, lastGameNum, offsets, linenums))
+        return false;
+
+    vector<string> tagSections;
+    bool cached = false;
+
+    if (m_headerCaching) {
+        if (!openHeaderCache() && buildHeaderCache(0, 0))
+            openHeaderCache();
+
+        if (m_headerCacheFile.is_open())
+            cached = readHeaderCache(firstGameNum, lastGameNum, tagSections);
+
+        if (!cached)
+            LOGWRN << "Failed to use header cache for PGN database '" << m_pgnFilename << "': " << m_errorMsg;
+
+        clearErrorMsg();
+    }
+
+    if (!cached && !readTagSections(firstGameNum, offsets, tagSections))
+        return false;
+
+    gameHeaders.resize(tagSections.size());
+
+    for (unsigned i = 0; i < tagSections.size(); i++) {
+        GameHeader &gameHeader = gameHeaders[i];
+
+        if (!readTagSection(tagSections[i], linenums[i], gameHeader, m_errorMsg)) {
+            if (m_errorMsg.empty())
+                DBERROR << "Game " << (firstGameNum + i) << " has no header";
+
+            gameHeader.setReadFail(true);
+            return false;
+        }
+
+        gameHeader.setReadFail(false);
+    }
+
+    return true;
+}
+
 bool PgnDatabase::read(unsigned gameNum, Game &game) {
+    return read(gameNum, game, DatabaseReadOptions());
+}
+
+bool PgnDatabase::read(unsigned gameNum, Game &game, const DatabaseReadOptions &options) {
+    return readGame(gameNum, game, options);
+}
+
+bool PgnDatabase::read(unsigned gameNum, CompactGame &game, const DatabaseReadOptions &options) {
+    return readGame(gameNum, game, options);
+}
+
+template <class GameType>
+bool PgnDatabase::readGame(unsigned gameNum, GameType &game, const DatabaseReadOptions &options) {
     bool retval = true;
-    string str;
 
     //LOGDBG << "gameNum=" << gameNum << ", m_numGames=" << m_numGames;
 
@@ -626,16 +1127,18 @@ bool PgnDatabase::read(unsigned gameNum, Game &game) {
                 return false;
             }
 
+            // Read the text of the game in one go and scan it in-place
             uint32_t linenum;
 
-            if (!seekGameNum(gameNum, linenum))
+            if (!readGameText(gameNum, linenum))
                 return false;
 
-            m_context.flush();
-            m_context.setLineNumber(linenum);
+            PgnScannerContext context(&m_gameText[0], m_gameText.size());
+            context.setLineNumber(linenum);
+            retval = read(context, game, m_errorMsg, options);
+        } else {
+            retval = read(m_context, game, m_errorMsg, options);
         }
-
-        retval = read(m_context, game, m_errorMsg);
     } catch(ChessCoreException &e) {
         logerr("ChessCoreException while reading game: %s", e.what());
         DBERROR << e.what();
@@ -648,6 +1151,8 @@ bool PgnDatabase::read(unsigned gameNum, Game &game) {
 }
 
 bool PgnDatabase::write(unsigned gameNum, const Game &game) {
+    MutexLock lock(m_readersMutex);
+
     uint64_t offset = m_pgnFile.tellg();
 
     //LOGDBG << "gameNum=" << gameNum << ", m_numGames=" << m_numGames;
@@ -669,6 +1174,9 @@ bool PgnDatabase::write(unsigned gameNum, const Game &game) {
         return false;
     }
 
+    // The readers would not know about the game
+    closeReaders();
+
     if (m_indexFile.is_open()) {
         // Random access
         if (gameNum != m_numGames + 1) {
@@ -735,20 +1243,28 @@ bool PgnDatabase::write(unsigned gameNum, const Game &game) {
         }
     }
 
+    m_writeBuffer.clear();
+
     if (gameNum > 1) {
         // Add a blank line to separate this game from the previous one
-        m_pgnFile << endl;
+        m_writeBuffer += '\n';
     }
 
-    if (!write(m_pgnFile, game, m_errorMsg)) {
+    if (!PgnWriter::format(game, m_writeBuffer, m_errorMsg)) {
         DBERROR << "Error writing game: " << m_errorMsg;
         return false;
     }
 
+    m_pgnFile.write(m_writeBuffer.data(), m_writeBuffer.length());
     m_pgnFile.flush();
 
-    // Write the offset of this game to the index file
-    if (m_indexFile.is_open())
+    if (m_pgnFile.fail()) {
+        DBERROR << "Failed to write to database: " << strerror(errno);
+        return false;
+    }
+
+    // Write the offset of this game to the index file
+    if (m_indexFile.is_open())
         if (!writeIndex(gameNum, offset, m_context.lineNumber()))
             return false;
 
@@ -757,8 +1273,7 @@ bool PgnDatabase::write(unsigned gameNum, const Game &game) {
 }
 
 bool PgnDatabase::readFromString(const string &input, Game &game) {
-    istringstream iss(input);
-    PgnScannerContext context(iss);
+    PgnScannerContext context(input);
     string errorMsg;
     bool retval = read(context, game, errorMsg);
 
@@ -771,8 +1286,7 @@ bool PgnDatabase::readFromString(const string &input, Game &game) {
 unsigned PgnDatabase::readMultiFromString(const string &input,
                                           vector<shared_ptr<Game> > &games,
                                           DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
-    istringstream iss(input);
-    PgnScannerContext context(iss);
+    PgnScannerContext context(input);
 
     string errorMsg;
     size_t totalSize = input.size();
@@ -790,7 +1304,7 @@ unsigned PgnDatabase::readMultiFromString(const string &input,
             games.push_back(game);
             game = 0;
             numGames++;
-            unsigned offset = (unsigned)iss.tellg();
+            size_t offset = context.bufferOffset();
 
             if (callback) {
                 float complete = static_cast<float>((offset * 100) / totalSize);
@@ -809,12 +1323,11 @@ unsigned PgnDatabase::readMultiFromString(const string &input,
 }
 
 bool PgnDatabase::writeToString(const Game &game, string &output) {
-    stringstream outss;
-    string errorMsg;
-    bool retval = write(outss, game, errorMsg);
+    string text, errorMsg;
+    bool retval = PgnWriter::format(game, text, errorMsg);
 
     if (retval) {
-        output = outss.str();
+        output.swap(text);
     } else {
         LOGERR << "Failed to write game to string: " << errorMsg;
     }
@@ -822,11 +1335,14 @@ bool PgnDatabase::writeToString(const Game &game, string &output) {
     return retval;
 }
 
-bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg) {
+bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg,
+                       const DatabaseReadOptions &options /*=DatabaseReadOptions()*/) {
     bool retval = true;
     int token, tokenCount = 0;
     AnnotMove *lastMove = 0;
     string annotation, str;
+    unsigned depth = 0, skipDepth = 0;
+    bool endSkippedVariation = false, afterSkippedVariation = false, movesDone = false;
 
     try {
         game.init();
@@ -836,6 +1352,31 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
 
             tokenCount++;
 
+            // The tokens of variations and moves that are not wanted are skipped
+            // without making any moves
+            if (skipDepth > 0) {
+                if (token == A_VARSTART) {
+                    skipDepth++;
+                } else if (token == A_VAREND && --skipDepth == 0) {
+                    if (endSkippedVariation) {
+                        if (!game.endVariation()) {
+                            errorMsg = Util::format("line %u: failed to end variation", context.lineNumber());
+                            retval = false;
+                        }
+
+                        depth--;
+                    }
+
+                    // Annotations that follow belong to the last move of the variation
+                    lastMove = 0;
+                    afterSkippedVariation = true;
+                }
+
+                continue;
+            } else if (movesDone && !IS_PGN_RESULT(token)) {
+                continue;
+            }
+
             if (token == A_PGN_FEN) {
                 // This is in the class IS_PGN_HEADER, however the value must be stored
                 // in a Game object, not a GameHeader object (which is all readRoster()
@@ -867,10 +1408,22 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
                     retval = false;
                 }
             } else if (IS_PGN_MOVE(token)) {
-                // It is necessary to ask the for the 'game over' condition when making the
-                // move in order to get the returned move to have the right flags (e.g mate).
-                Game::GameOver gameOver = Game::GAMEOVER_NOT;
-                lastMove = game.makeMove(context.text(), 0, 0, false, &gameOver, 0);
+                if (options.maxPlies > 0 && game.nextPly() - game.startPosition().ply() > options.maxPlies) {
+                    // The rest of the line is beyond the ply limit
+                    if (depth == 0) {
+                        movesDone = true;
+                    } else {
+                        skipDepth = 1;
+                        endSkippedVariation = true;
+                    }
+
+                    continue;
+                }
+
+                afterSkippedVariation = false;
+
+                // The game-over flags (e.g. mate) are set at the end of each line
+                lastMove = game.makeMove(context.text());
 
                 if (lastMove == 0) {
                     errorMsg = Util::format("line %u: failed to make move '%s'",
@@ -903,6 +1456,9 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
                 }
 
                 break; // End of game
+            } else if ((token == A_COMMENT || token == A_ROL_COMMENT || IS_PGN_EVAL(token)) &&
+                       (options.skipAnnotations || afterSkippedVariation)) {
+                // Annotation not wanted
             } else if (token == A_COMMENT || token == A_ROL_COMMENT) {
                 const char *comment = context.text();
 
@@ -983,8 +1539,13 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
                     if (nag != NAG_NONE)
                         lastMove->addNag(nag);
                 }
+            } else if (token == A_VARSTART && options.mainlineOnly) {
+                skipDepth = 1;
+                endSkippedVariation = false;
             } else if (token == A_VARSTART) {
-                if (!game.startVariation()) {
+                if (game.startVariation()) {
+                    depth++;
+                } else {
                     str = Util::format("line %u: failed to start variation after move %s",
                                        context.lineNumber(), (lastMove ? lastMove->dump().c_str() : "none"));
 
@@ -1010,7 +1571,11 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
 
                 lastMove = 0;
             } else if (token == A_VAREND) {
-                if (!game.endVariation()) {
+                game.checkGameOver();
+
+                if (game.endVariation()) {
+                    depth--;
+                } else {
                     errorMsg = Util::format("line %u: failed to end variation after move '%s'",
                                             context.lineNumber(), (lastMove != 0 ? lastMove->dump().c_str() : "none"));
                     retval = false;
@@ -1037,6 +1602,8 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
 
         if (tokenCount == 0)
             retval = false;
+        else if (retval && !movesDone)
+            game.checkGameOver();
 
     } catch(ChessCoreException &e) {
         logerr("ChessCoreException while reading game: %s", e.what());
@@ -1047,7 +1614,224 @@ bool PgnDatabase::read(PgnScannerContext &context, Game &game, string &errorMsg)
     return retval;
 }
 
+bool PgnDatabase::read(PgnScannerContext &context, CompactGame &game, string &errorMsg,
+                       const DatabaseReadOptions &options) {
+    bool retval = true;
+    int token, tokenCount = 0;
+    string str;
+    unsigned skipDepth = 0;
+    bool endSkippedVariation = false, movesDone = false;
+    Move move;
+
+    try {
+        game.init();
+
+        // lines[0] is the mainline and the others are the variations being read
+        vector<CompactGameLine> lines(1);
+        lines[0].pos = game.startPosition();
+
+        while ((token = context.lex()) > 0 && retval) {
+            LOGVERBOSE << "linenum=" << context.lineNumber() << ", token=" << token;
+
+            tokenCount++;
+
+            // The tokens of variations and moves that are not wanted are skipped
+            if (skipDepth > 0) {
+                if (token == A_VARSTART) {
+                    skipDepth++;
+                } else if (token == A_VAREND && --skipDepth == 0 && endSkippedVariation) {
+                    lines.pop_back();
+                }
+
+                continue;
+            } else if (movesDone && !IS_PGN_RESULT(token)) {
+                continue;
+            }
+
+            CompactGameLine &line = lines.back();
+
+            if (token == A_PGN_FEN) {
+                string data = getTagString(context, errorMsg);
+                Position pos;
+
+                if (data.empty()) {
+                    errorMsg = Util::format("line %u: invalid FEN header", context.lineNumber());
+                    retval = false;
+                } else if (pos.setFromFen(data.c_str()) != Position::LEGAL) {
+                    errorMsg = Util::format("line %u: invalid FEN in header: '%s'",
+                                            context.lineNumber(), data.c_str());
+                    retval = false;
+                } else {
+                    game.setStartPosition(pos);
+                    line.pos = pos;
+                }
+            } else if (IS_PGN_HEADER(token)) {
+                retval = readRoster(context, token, game, errorMsg);
+            } else if (IS_PGN_MOVENUM(token)) {
+                unsigned moveNum = (unsigned)atoi(context.text());
+                moveNum = toHalfMove(moveNum, token == A_WHITE_MOVENUM ? WHITE : BLACK);
+                unsigned nextPly = line.pos.ply() + 1;
+
+                if (moveNum != nextPly) {
+                    errorMsg = Util::format("line %u: invalid move number '%s'; expected %u%s",
+                                            context.lineNumber(), context.text(), toMove(nextPly),
+                                            (toColour(nextPly) == WHITE ? "." : "..."));
+                    retval = false;
+                }
+            } else if (IS_PGN_MOVE(token)) {
+                unsigned plies = (unsigned)line.pos.ply() + 1 - game.startPosition().ply();
+
+                if (options.maxPlies > 0 && plies > options.maxPlies) {
+                    // The rest of the line is beyond the ply limit
+                    if (lines.size() == 1) {
+                        movesDone = true;
+                    } else {
+                        skipDepth = 1;
+                        endSkippedVariation = true;
+                    }
+
+                    continue;
+                }
+
+                if (!move.parse(line.pos, context.text()) || !line.pos.makeMove(move, line.umi)) {
+                    errorMsg = Util::format("line %u: failed to make move '%s'",
+                                            context.lineNumber(), context.text());
+                    retval = false;
+                    continue;
+                }
+
+                uint32_t index;
+
+                // Use the position's last move as that has the flags updated (FL_CHECK etc.)
+                if (lines.size() == 1)
+                    index = game.addMainlineMove(line.pos.lastMove(), line.pos.hashKey());
+                else
+                    index = game.addVariationMove(line.pos.lastMove(), line.pos.hashKey(), line.parent);
+
+                line.prevParent = line.parent;
+                line.parent = index;
+                line.hasMove = true;
+            } else if (IS_PGN_RESULT(token)) {
+                Game::Result rslt = Game::UNFINISHED;
+
+                if (strcmp(context.text(), "1-0") == 0) {
+                    rslt = Game::WHITE_WIN;
+                } else if (strcmp(context.text(), "0-1") == 0) {
+                    rslt = Game::BLACK_WIN;
+                } else if (strcmp(context.text(), "1/2-1/2") == 0) {
+                    rslt = Game::DRAW;
+                } else if (strcmp(context.text(), "*") == 0) {
+                    rslt = Game::UNFINISHED;
+                } else {
+                    errorMsg = Util::format("line %u: invalid result", context.lineNumber());
+                    retval = false;
+                }
+
+                if (retval && rslt != game.result()) {
+                    errorMsg = Util::format("line %u: result does not match result in header",
+                                            context.lineNumber());
+                    retval = false;
+                }
+
+                break; // End of game
+            } else if (token == A_COMMENT || token == A_ROL_COMMENT || IS_PGN_EVAL(token)) {
+                // Annotations are not held
+            } else if (token == A_VARSTART && options.mainlineOnly) {
+                skipDepth = 1;
+                endSkippedVariation = false;
+            } else if (token == A_VARSTART) {
+                // The variation is made from the position before the last move
+                CompactGameLine variation = line;
+
+                if (variation.hasMove && variation.pos.unmakeMove(variation.umi)) {
+                    variation.parent = variation.prevParent;
+                    variation.hasMove = false;
+                    lines.push_back(variation);
+                } else {
+                    str = Util::format("line %u: failed to start variation", context.lineNumber());
+
+                    if (m_relaxedParsing) {
+                        // Consume the invalid variation and carry on
+                        LOGWRN << str;
+                        skipDepth = 1;
+                        endSkippedVariation = false;
+                    } else {
+                        errorMsg = str;
+                        retval = false;
+                    }
+                }
+            } else if (token == A_VAREND) {
+                if (lines.size() > 1) {
+                    lines.pop_back();
+                } else {
+                    errorMsg = Util::format("line %u: failed to end variation", context.lineNumber());
+                    retval = false;
+                }
+            } else {
+                if (token == '{' || token == '}') {
+                    str = Util::format("line %u:: broken comment (unmatched braces?)", context.lineNumber());
+                } else {
+                    if (isprint(token))
+                        str = Util::format("line %u: spurious character '%c'", context.lineNumber(), (char)token);
+                    else
+                        str = Util::format("line %u: spurious character 0x%02x", context.lineNumber(), (unsigned)token);
+                }
+
+                if (m_relaxedParsing) {
+                    // Keep calm and carry on
+                    LOGWRN << str;
+                } else {
+                    errorMsg = str;
+                    return false;
+                }
+            }
+        }
+
+        game.endMoves();
+
+        if (tokenCount == 0)
+            retval = false;
+
+    } catch(ChessCoreException &e) {
+        logerr("ChessCoreException while reading game: %s", e.what());
+        errorMsg = e.what();
+        retval = false;
+    }
+
+    return retval;
+}
+
+shared_ptr<Database> PgnDatabase::openReader() {
+    // Games can only be read independently of each other using the index
+    if (!m_isOpen || !m_indexFile.is_open())
+        return shared_ptr<Database>();
+
+    shared_ptr<PgnDatabase> reader(new PgnDatabase());
+
+    if (!reader->open(m_pgnFilename, true)) {
+        LOGWRN << "Failed to open reader for '" << m_pgnFilename << "': " << reader->errorMsg();
+        return shared_ptr<Database>();
+    }
+
+    // Use the index that this instance has validated or built
+    reader->m_indexFilename = m_indexFilename;
+    reader->m_indexFile.open(m_indexFilename.c_str(), ios::binary | ios::in);
+
+    if (!reader->m_indexFile.is_open()) {
+        LOGWRN << "Failed to open index file '" << m_indexFilename << "' for reader: " << strerror(errno);
+        return shared_ptr<Database>();
+    }
+
+    reader->m_numGames = m_numGames;
+    return reader;
+}
+
 bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &gameHeader, string &errorMsg) {
+    return readRoster(context.text(), context.lineNumber(), token, gameHeader, errorMsg);
+}
+
+bool PgnDatabase::readRoster(const char *text, unsigned lineNumber, int token, GameHeader &gameHeader,
+                             string &errorMsg) {
     unsigned d, m, y;
     unsigned major, minor;
     unsigned elo;
@@ -1057,7 +1841,7 @@ bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &
     try {
         string data;
 
-        data = getTagString(context, errorMsg);
+        data = getTagString(text, lineNumber, errorMsg);
 
         if (data.empty())
             return errorMsg.empty(); // Empty string could be an error
@@ -1138,7 +1922,7 @@ bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &
                 gameHeader.setResult(Game::UNFINISHED);
             } else {
                 errorMsg = Util::format("line %u: invalid result in header: '%s'",
-                                        context.lineNumber(), data.c_str());
+                                        lineNumber, data.c_str());
                 return false;
             }
 
@@ -1157,7 +1941,7 @@ bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &
 
             if (sscanf(data.c_str(), "%u", &elo) != 1) {
                 errorMsg = Util::format("line %u: invalid white elo in header: '%s'",
-                                        context.lineNumber(), data.c_str());
+                                        lineNumber, data.c_str());
                 return false;
             }
 
@@ -1169,7 +1953,7 @@ bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &
 
             if (sscanf(data.c_str(), "%u", &elo) != 1) {
                 errorMsg = Util::format("line %u: invalid black elo in header: '%s'",
-                                        context.lineNumber(), data.c_str());
+                                        lineNumber, data.c_str());
                 return false;
             }
 
@@ -1190,7 +1974,7 @@ bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &
             // Ignore any errors with time control
             gameHeader.timeControl().set(data, TimeControlPeriod::FORMAT_PGN);
             if (!gameHeader.timeControl().isValid()) {
-                LOGWRN << "Line: " << context.lineNumber() << ": Failed to parse time control '" << data << "'";
+                LOGWRN << "Line: " << lineNumber << ": Failed to parse time control '" << data << "'";
             }
             break;
 
@@ -1205,234 +1989,62 @@ bool PgnDatabase::readRoster(PgnScannerContext &context, int token, GameHeader &
     return true;
 }
 
-bool PgnDatabase::write(ostream &output, const Game &game, string &errorMsg) {
-    bool retval = true;
-    string date, result;
-
-    if (game.year() > 0) {
-        if (game.month() > 0) {
-            if (game.day() > 0)
-                date = Util::format("%04u.%02u.%02u", game.year(), game.month(), game.day());
-            else
-                date = Util::format("%04u.%02u.??", game.year(), game.month());
-        } else {
-            date = Util::format("%04u.??.??", game.year());
-        }
-    } else {
-        date = "????.??.??";
-    }
+bool PgnDatabase::readTagSection(const string &tagSection, unsigned lineNumber, GameHeader &gameHeader,
+                                 string &errorMsg) {
+    unsigned tagCount = 0;
+    size_t pos = 0;
 
-    switch (game.result()) {
-    case Game::WHITE_WIN:
-        result = "1-0";
-        break;
-
-    case Game::BLACK_WIN:
-        result = "0-1";
-        break;
+    gameHeader.initHeader();
+    errorMsg.clear();
 
-    case Game::DRAW:
-        result = "1/2-1/2";
-        break;
+    while (pos < tagSection.length()) {
+        size_t end = tagSection.find('\n', pos);
 
-    default:
-        result = "*";
-        break;
-    }
+        if (end == string::npos)
+            end = tagSection.length();
 
-    output << Util::format("[Event \"%s\"]", formatTagString(game.event()).c_str()) << '\n';
-    output << Util::format("[Site \"%s\"]", formatTagString(game.site()).c_str()) << '\n';
-    output << Util::format("[Date \"%s\"]", date.c_str()) << '\n';
+        string line = tagSection.substr(pos, end - pos);
+        Util::trim(line);
 
-    if (game.roundMajor() && game.roundMinor())
-        output << Util::format("[Round \"%u.%u\"]", game.roundMajor(), game.roundMinor()) << '\n';
-    else if (game.roundMajor() && game.roundMinor() == 0)
-        output << Util::format("[Round \"%u\"]", game.roundMajor()) << '\n';
-    else if (game.roundMajor() == 0 && game.roundMinor())
-        output << Util::format("[Round \"?.%u\"]", game.roundMinor()) << '\n';
-    else
-        output << "[Round \"?\"]" << '\n';
+        if (!line.empty() && line[0] == '[') {
+            tagCount++;
 
-    output << Util::format("[White \"%s\"]",
-                           formatTagString(game.white().formattedName()).c_str()) << '\n';
-    output << Util::format("[Black \"%s\"]",
-                           formatTagString(game.black().formattedName()).c_str()) << '\n';
+            if (!readRoster(line.c_str(), lineNumber, tagToken(line.c_str()), gameHeader, errorMsg))
+                return false;
+        }
 
-    if (!game.startPosition().isStarting()) {
-        output << "[SetUp \"1\"]" << endl;
-        output << Util::format("[FEN \"%s\"]", game.startPositionFen().c_str()) << '\n';
+        pos = end + 1;
+        lineNumber++;
     }
 
-    output << Util::format("[Result \"%s\"]", result.c_str()) << '\n';
-
-    if (!game.annotator().empty())
-        output << Util::format("[Annotator \"%s\"]", game.annotator().c_str()) << '\n';
-
-    if (!game.eco().empty())
-        output << Util::format("[ECO \"%s\"]", game.eco().c_str()) << '\n';
+    return tagCount > 0;
+}
 
-    if (game.white().elo())
-        output << Util::format("[WhiteElo \"%u\"]", game.white().elo()) << '\n';
+int PgnDatabase::tagToken(const char *text) {
+    return PgnTokenizer::tagToken(text, strlen(text));
+}
 
-    if (game.black().elo())
-        output << Util::format("[BlackElo \"%u\"]", game.black().elo()) << '\n';
+bool PgnDatabase::write(ostream &output, const Game &game, string &errorMsg) {
+    string text;
+    bool retval = PgnWriter::format(game, text, errorMsg);
 
-    if (game.timeControl().isValid()) {
-        output << "[TimeControl \"" << game.timeControl().notation(TimeControlPeriod::FORMAT_PGN) << "\"\n";
-    }
-    output << endl;
+    output.write(text.data(), text.length());
 
     if (output.bad() || output.fail()) {
-        LOGERR << "Failed to write PGN header to stream: " << strerror(errno);
+        LOGERR << "Failed to write game to stream: " << strerror(errno);
         return false;
     }
 
-    unsigned width = 0;
-
-    if (game.mainline())
-        retval = writeMoves(output, game.mainline(), width, errorMsg);
-
-    writeText(output, result, width);
-    output << endl;
-    return retval;
-}
-
-bool PgnDatabase::writeMoves(ostream &output, const AnnotMove *amove, unsigned &width, string &errorMsg) {
-    Position pos;
-    UnmakeMoveInfo umi;
-
-    vector<string> parts;
-    const AnnotMove *m;
-    string str;
-    bool retval = true, moveNum = true, forceMoveNum = false, firstWord = true;
-    unsigned i, numParts;
-
-    ASSERT(amove);
-
-    // There must be a priorPosition available for this line
-    m = amove;
-
-    while (m->mainline())
-        m = m->mainline();
-
-    ASSERT(m->priorPosition());
-    pos.set(m->priorPosition());
-
-    // We can write a 'pre-move annotation' at the start of each line
-    if (amove) {
-        const string &preAnnot = amove->preAnnot();
-
-        if (!preAnnot.empty()) {
-            writeText(output, "{", width, false);
-            numParts = Util::splitLine(preAnnot, parts);
-
-            for (i = 0; i < numParts; i++)
-                writeText(output, parts[i], width, i > 0);
-
-            writeText(output, "}", width, false);
-            forceMoveNum = true;
-            firstWord = false;
-        }
-    }
-
-    while (amove && retval) {
-        if (output.bad() || output.fail()) {
-            LOGERR << "Failed to write moves to stream: " << strerror(errno);
-            retval = false;
-            break;
-        }
-
-        moveNum = toColour(pos.ply() + 1) == WHITE || amove->mainline();
-
-        if (moveNum || forceMoveNum) {
-            str = pos.moveNumber();
-            writeText(output, str, width, !firstWord);
-            firstWord = false;
-        }
-
-        str = amove->san(pos);
-        writeText(output, str, width, !firstWord);
-        firstWord = false;
-        forceMoveNum = false;
-
-        if (amove->nagCount() > 0) {
-            Nag nags[STORED_NAGS];
-            unsigned numNags = amove->nags(nags);
-            ASSERT(numNags == amove->nagCount());
-
-            for (i = 0; i < numNags; i++) {
-                unsigned nagValue = toPgnNag(nags[i]);
-
-                if (nagValue) {
-                    str = Util::format("$%u", nagValue);
-                    writeText(output, str, width);
-                    forceMoveNum = true;
-                }
-            }
-        }
-
-        const string &postAnnot = amove->postAnnot();
-
-        if (!postAnnot.empty()) {
-            writeText(output, "{", width, true);
-            numParts = Util::splitLine(postAnnot, parts);
-
-            for (i = 0; i < numParts; i++)
-                writeText(output, parts[i], width, i > 0);
-
-            writeText(output, "}", width, false);
-            forceMoveNum = true;
-        }
-
-        if (!pos.makeMove(amove->move(), umi)) {
-            errorMsg = Util::format("Failed to make move '%s'", amove->dump(false).c_str());
-            return false;
-        }
-
-        if (amove->variation()) {
-            if (EMBEDDED_VARIATIONS) {
-                writeText(output, "(", width, true);
-                retval = writeMoves(output, amove->variation(), width, errorMsg);
-                writeText(output, ")", width, false);
-                forceMoveNum = true;
-            } else if (amove->mainline() == 0) {
-                // Top of variation tree
-                for (m = amove->variation(); m; m = m->variation()) {
-                    writeText(output, "(", width, true);
-                    retval = writeMoves(output, m, width, errorMsg);
-                    writeText(output, ")", width, false);
-                }
-
-                forceMoveNum = true;
-            }
-        }
-
-        amove = amove->next();
-    }
-
     return retval;
 }
 
-void PgnDatabase::writeText(ostream &output, const string &text, unsigned &width, bool insertSpace /*=true*/) {
-    if (insertSpace && width > 0) {
-        output << ' ';
-        width++;
-    }
-
-    unsigned len = (unsigned)text.length();
-
-    if (width + len > 79) {
-        output << endl;
-        width = 0;
-    }
-
-    output << text;
-    width += len;
+string PgnDatabase::getTagString(PgnScannerContext &context, string &errorMsg) {
+    return getTagString(context.text(), context.lineNumber(), errorMsg);
 }
 
-string PgnDatabase::getTagString(PgnScannerContext &context, string &errorMsg) {
+string PgnDatabase::getTagString(const char *text, unsigned lineNumber, string &errorMsg) {
     stringstream ss;
-    char *s = context.text();
+    const char *s = text;
 
     // Find leading quote
     while (*s != '\0' && *s != '"')
@@ -1467,10 +2079,10 @@ string PgnDatabase::getTagString(PgnScannerContext &context, string &errorMsg) {
 
         if (it != string::npos) {
             tag = tag.substr(0, it);
-            logwrn("line %u: unmatched quotes in header (recovered)", context.lineNumber());
+            logwrn("line %u: unmatched quotes in header (recovered)", lineNumber);
         } else {
             // Cannot recover from this error
-            errorMsg = Util::format("line %u: unmatched quotes in header", context.lineNumber());
+            errorMsg = Util::format("line %u: unmatched quotes in header", lineNumber);
             return "";
         }
     }
@@ -1478,24 +2090,6 @@ string PgnDatabase::getTagString(PgnScannerContext &context, string &errorMsg) {
     return Util::trim(const_cast<const string &> (tag));
 }
 
-string PgnDatabase::formatTagString(const string &str) {
-    if (str.empty())
-        return "?";
-
-    stringstream ss;
-
-    for (string::const_iterator it = str.begin(); it != str.end(); ++it) {
-        uint8_t c = *it;
-
-        if (c == '"' || c == '\\')
-            ss << '\\';
-
-        ss << c;
-    }
-
-    return Util::trim(ss.str());
-}
-
 void PgnDatabase::setOpening(Player &player, const string &data) {
     if (!player.firstNames().empty() ||
         !player.lastName().empty()) {
@@ -1542,6 +2136,197 @@ bool PgnDatabase::seekGameNum(unsigned gameNum, uint32_t &linenum) {
     return true;
 }
 
+bool PgnDatabase::readGameText(unsigned gameNum, uint32_t &linenum) {
+    ASSERT(gameNum > 0 && gameNum <= m_numGames);
+    vector<uint64_t> offsets;
+    vector<uint32_t> linenums;
+
+    // The game ends where the next one starts, or at the end of the file
+    unsigned lastGameNum = gameNum < m_numGames ? gameNum + 1 : gameNum;
+
+    if (!readIndex(gameNum, lastGameNum, offsets, linenums))
+        return false;
+
+    uint64_t startOffset = offsets[0], endOffset;
+    linenum = linenums[0];
+
+    if (offsets.size() > 1) {
+        endOffset = offsets[1];
+    } else {
+        m_pgnFile.seekg(0, ios::end);
+        endOffset = m_pgnFile.tellg();
+    }
+
+    if (endOffset < startOffset) {
+        DBERROR << "Invalid offsets for game " << gameNum << " in PGN index file";
+        return false;
+    }
+
+    // The scanner requires the buffer to be terminated with two NUL characters
+    size_t length = (size_t)(endOffset - startOffset);
+    m_gameText.resize(length + 2);
+    m_gameText[length] = m_gameText[length + 1] = '\0';
+
+    m_pgnFile.seekg(startOffset, ios::beg);
+    if (length > 0)
+        m_pgnFile.read(&m_gameText[0], length);
+
+    if (m_pgnFile.fail() || m_pgnFile.bad()) {
+        DBERROR << "Failed to read game " << gameNum << " at offset 0x" << hex << startOffset <<
+            " from PGN database file: " << strerror(errno);
+        m_pgnFile.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool PgnDatabase::readTagSections(unsigned firstGameNum, const vector<uint64_t> &offsets,
+                                  vector<string> &tagSections) {
+    PgnByteReader reader(m_pgnFile);
+    bool retval = true;
+
+    tagSections.resize(offsets.size());
+
+    for (unsigned i = 0; i < offsets.size(); i++) {
+        if (reader.offset() != offsets[i] || i == 0) {
+            // The index is the authority on where each game starts, so if skipping
+            // the movetext of the previous game ended up elsewhere then re-sync
+            if (i > 0) {
+                LOGDBG << "Game " << (firstGameNum + i) << " does not start where the movetext of " <<
+                    "the previous game ended; seeking to offset 0x" << hex << offsets[i];
+            }
+
+            if (!reader.seek(offsets[i])) {
+                DBERROR << "Failed to seek to offset 0x" << hex << offsets[i] << " in PGN database file: " <<
+                    strerror(errno);
+                retval = false;
+                break;
+            }
+        }
+
+        readRawTagSection(reader, tagSections[i]);
+
+        if (i + 1 < offsets.size())
+            skipMovetext(reader);
+    }
+
+    m_pgnFile.clear();
+
+    return retval;
+}
+
+bool PgnDatabase::openHeaderCache() {
+    clearErrorMsg();
+
+    if (m_headerCacheFilename.empty()) {
+        m_headerCacheFilename = m_indexManager.getSideFilename(m_pgnFilename, "hdrcache");
+
+        if (m_headerCacheFilename.empty()) {
+            DBERROR << "Failed to get a header cache file for database";
+            return false;
+        }
+    }
+
+    if (!m_headerCacheFile.is_open()) {
+        // Like the index file, the header cache must be newer than the PGN file
+        if (!Util::fileExists(m_headerCacheFilename) ||
+            Util::modifyTime(m_headerCacheFilename) <= Util::modifyTime(m_pgnFilename)) {
+            DBERROR << "Header cache file '" << m_headerCacheFilename << "' is missing or out-of-date";
+            return false;
+        }
+
+        m_headerCacheFile.open(m_headerCacheFilename, ios::binary | ios::in);
+
+        if (!m_headerCacheFile.is_open()) {
+            DBERROR << "Failed to open header cache file '" << m_headerCacheFilename << "': " << strerror(errno);
+            return false;
+        }
+    }
+
+    // Games may have been added since the header cache was built
+    uint32_t magic, numGames;
+    m_headerCacheFile.clear();
+    m_headerCacheFile.seekg(0, ios::beg);
+
+    if (!StreamUtil<uint32_t>::read(m_headerCacheFile, magic) ||
+        !StreamUtil<uint32_t>::read(m_headerCacheFile, numGames) ||
+        le32(magic) != HEADER_CACHE_MAGIC ||
+        le32(numGames) != m_numGames) {
+        DBERROR << "Header cache file '" << m_headerCacheFilename << "' is invalid or out-of-date";
+        m_headerCacheFile.close();
+        return false;
+    }
+
+    return true;
+}
+
+bool PgnDatabase::openSearchIndex() {
+    // Games may have been added since the search index was opened
+    if (m_searchIndex.isOpen() && m_searchIndex.numGames() == m_numGames)
+        return true;
+
+    m_searchIndex.close();
+
+    string filename = m_indexManager.getSideFilename(m_pgnFilename, "search");
+
+    // Like the index file, the search index must be newer than the PGN file
+    if (filename.empty() ||
+        !Util::fileExists(filename) ||
+        Util::modifyTime(filename) <= Util::modifyTime(m_pgnFilename))
+        return false;
+
+    return m_searchIndex.open(filename, m_numGames);
+}
+
+bool PgnDatabase::readHeaderCache(unsigned firstGameNum, unsigned lastGameNum, vector<string> &tagSections) {
+    clearErrorMsg();
+
+    ASSERT(m_headerCacheFile.is_open());
+    ASSERT(firstGameNum > 0 && firstGameNum <= lastGameNum && lastGameNum <= m_numGames);
+
+    unsigned count = lastGameNum - firstGameNum + 1;
+    vector<uint64_t> table(count + 1);
+
+    m_headerCacheFile.clear();
+    m_headerCacheFile.seekg(HEADER_CACHE_TABLE_OFFSET + (uint64_t)(firstGameNum - 1) * sizeof(uint64_t), ios::beg);
+    m_headerCacheFile.read((char *)&table[0], table.size() * sizeof(uint64_t));
+
+    if (m_headerCacheFile.fail() || m_headerCacheFile.bad()) {
+        DBERROR << "Failed to read header cache table: " << strerror(errno);
+        return false;
+    }
+
+    for (unsigned i = 0; i <= count; i++) {
+        table[i] = le64(table[i]);
+
+        if (i > 0 && table[i] < table[i - 1]) {
+            DBERROR << "Header cache table is corrupt";
+            return false;
+        }
+    }
+
+    uint64_t dataOffset = HEADER_CACHE_TABLE_OFFSET + (uint64_t)(m_numGames + 1) * sizeof(uint64_t);
+    string data((size_t)(table[count] - table[0]), '\0');
+
+    m_headerCacheFile.seekg(dataOffset + table[0], ios::beg);
+
+    if (!data.empty())
+        m_headerCacheFile.read(&data[0], data.size());
+
+    if (m_headerCacheFile.fail() || m_headerCacheFile.bad()) {
+        DBERROR << "Failed to read from header cache file: " << strerror(errno);
+        return false;
+    }
+
+    tagSections.resize(count);
+
+    for (unsigned i = 0; i < count; i++)
+        tagSections[i].assign(data, (size_t)(table[i] - table[0]), (size_t)(table[i + 1] - table[i]));
+
+    return true;
+}
+
 bool PgnDatabase::readIndex(unsigned gameNum, uint64_t &offset, uint32_t &linenum) {
     clearErrorMsg();
 
@@ -1576,6 +2361,57 @@ bool PgnDatabase::readIndex(unsigned gameNum, uint64_t &offset, uint32_t &linenu
     return true;
 }
 
+bool PgnDatabase::readIndex(unsigned firstGameNum, unsigned lastGameNum, vector<uint64_t> &offsets,
+                            vector<uint32_t> &linenums) {
+    clearErrorMsg();
+
+    ASSERT(firstGameNum > 0 && firstGameNum <= lastGameNum);
+
+    const size_t entrySize = sizeof(uint64_t) + sizeof(uint32_t);
+    unsigned count = lastGameNum - firstGameNum + 1;
+    uint64_t indexOffset = (uint64_t)(firstGameNum - 1) * entrySize;
+    m_indexFile.seekg(indexOffset, ios::beg);
+
+    if (m_indexFile.fail() || m_indexFile.bad()) {
+        DBERROR << "Failed to seek to offset 0x" << hex << indexOffset <<
+            " in PGN index file: " << strerror(errno);
+        return false;
+    }
+
+    // Read all entries in one go
+    vector<char> buffer(count * entrySize);
+    m_indexFile.read(&buffer[0], buffer.size());
+
+    if (m_indexFile.fail() || m_indexFile.bad()) {
+        DBERROR << "Failed to read index for games " << firstGameNum << " to " << lastGameNum <<
+            " from PGN index file: " << strerror(errno);
+        m_indexFile.clear();
+        return false;
+    }
+
+    offsets.resize(count);
+    linenums.resize(count);
+
+    const char *p = &buffer[0];
+
+    for (unsigned i = 0; i < count; i++, p += entrySize) {
+        uint64_t tempOffset;
+        uint32_t tempLinenum;
+
+        memcpy(&tempOffset, p, sizeof(tempOffset));
+        memcpy(&tempLinenum, p + sizeof(tempOffset), sizeof(tempLinenum));
+        offsets[i] = le64(tempOffset);
+        linenums[i] = le32(tempLinenum);
+
+        if (linenums[i] == 0) {
+            DBERROR << "Got line number of 0 from index file for game " << (firstGameNum + i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool PgnDatabase::writeIndex(unsigned gameNum, uint64_t offset, uint32_t linenum) {
     clearErrorMsg();
 
@@ -8623,6 +8623,7 @@ static yyconst struct yy_trans_info *yy_start_state_list[3] =
 //
 
 #include <ChessCore/PgnScanner.h>
+#include <ChessCore/PgnTokenizer.h>
 #include <ChessCore/Log.h>
 
 using namespace std;
@@ -10242,15 +10243,49 @@ void pgnfree (void * ptr , yyscan_t yyscanner)
 //
 
 const char *PgnScannerContext::m_classname = "PgnScannerContext";
+PgnScannerContext::Lexer PgnScannerContext::m_defaultLexer = PgnScannerContext::LEXER_FLEX;
 
 PgnScannerContext::PgnScannerContext(istream &stream) :
+    m_lexer(m_defaultLexer),
     m_scanner(0),
-    m_stream(stream),
+    m_tokenizer(0),
+    m_stream(&stream),
+    m_buffer(0),
+    m_bufferCopy(),
     m_lineNumber(1) {
 
     initScanner();
 }
 
+PgnScannerContext::PgnScannerContext(char *buffer, size_t size) :
+    m_lexer(m_defaultLexer),
+    m_scanner(0),
+    m_tokenizer(0),
+    m_stream(0),
+    m_buffer(0),
+    m_bufferCopy(),
+    m_lineNumber(1) {
+
+    initScanner();
+    initBuffer(buffer, size);
+}
+
+PgnScannerContext::PgnScannerContext(const string &input) :
+    m_lexer(m_defaultLexer),
+    m_scanner(0),
+    m_tokenizer(0),
+    m_stream(0),
+    m_buffer(0),
+    m_bufferCopy(input.size() + 2, '\0'),
+    m_lineNumber(1) {
+
+    if (!input.empty())
+        memcpy(&m_bufferCopy[0], input.data(), input.size());
+
+    initScanner();
+    initBuffer(&m_bufferCopy[0], m_bufferCopy.size());
+}
+
 PgnScannerContext::~PgnScannerContext() {
     destroyScanner();
 }
@@ -10260,10 +10295,13 @@ void *PgnScannerContext::scanner() {
 }
 
 int PgnScannerContext::read(void *buffer, unsigned len) {
+    if (m_stream == 0)
+        return 0;       // Scanning a buffer; nothing more to read
+
     int read = 0;
     for (unsigned i = 0; i < len; i++) {
-        m_stream.get(((char *)buffer)[i]);
-        if (m_stream.good())
+        m_stream->get(((char *)buffer)[i]);
+        if (m_stream->good())
             read++;
         else
             break;
@@ -10272,18 +10310,28 @@ int PgnScannerContext::read(void *buffer, unsigned len) {
 }
 
 int PgnScannerContext::lex() {
+    if (m_tokenizer)
+        return m_tokenizer->lex();
     return pgnlex(m_scanner);
 }
 
 void PgnScannerContext::restart() {
-    pgnrestart(0, m_scanner);
+    if (m_tokenizer)
+        m_tokenizer->flush();
+    else if (m_buffer == 0)     // Restarting would discard the buffer being scanned
+        pgnrestart(0, m_scanner);
 }
 
 void PgnScannerContext::flush() {
-    flushBuffer(m_scanner);
+    if (m_tokenizer)
+        m_tokenizer->flush();
+    else if (m_buffer == 0)     // Flushing would overwrite the start of the buffer being scanned
+        flushBuffer(m_scanner);
 }
 
 char *PgnScannerContext::text() const {
+    if (m_tokenizer)
+        return m_tokenizer->text();
     return pgnget_text(m_scanner);
 }
 
@@ -10299,7 +10347,23 @@ void PgnScannerContext::incLineNumber(unsigned amount /*=1*/) {
     m_lineNumber += amount;
 }
 
+size_t PgnScannerContext::bufferOffset() const {
+    if (m_tokenizer)
+        return m_tokenizer->bufferOffset();
+    if (m_buffer == 0 || m_scanner == 0)
+        return 0;
+    struct yyguts_t *yyg = (struct yyguts_t *)m_scanner;
+    return yyg->yy_c_buf_p - m_buffer;
+}
+
 void PgnScannerContext::initScanner() {
+    if (m_lexer == LEXER_TOKENIZER) {
+        // A buffer-based tokenizer is created by initBuffer()
+        if (m_stream)
+            m_tokenizer = new PgnTokenizer(*this, *m_stream);
+        return;
+    }
+
     ASSERT(m_scanner == 0);
     int status = pgnlex_init_extra(this, &m_scanner);
     if (status) {
@@ -10307,7 +10371,27 @@ void PgnScannerContext::initScanner() {
     }
 }
 
+void PgnScannerContext::initBuffer(char *buffer, size_t size) {
+    if (m_lexer == LEXER_TOKENIZER) {
+        m_tokenizer = new PgnTokenizer(*this, buffer, size);
+        m_buffer = buffer;
+        return;
+    }
+
+    if (m_scanner == 0)
+        return;
+    // The buffer state is released by pgnlex_destroy(), but the buffer itself is not
+    if (pgn_scan_buffer(buffer, size, m_scanner) == 0) {
+        LOGERR << "PGN scanner buffer must end with two NUL characters";
+        return;
+    }
+    m_buffer = buffer;
+}
+
 void PgnScannerContext::destroyScanner() {
+    delete m_tokenizer;
+    m_tokenizer = 0;
+
     if (m_scanner) {
         pgnlex_destroy(m_scanner);
         m_scanner = 0;
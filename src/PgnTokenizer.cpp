@@ -0,0 +1,629 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// PgnTokenizer.cpp: Hand-written PGN tokenizer.
+//
+
+#include <ChessCore/PgnTokenizer.h>
+#include <ChessCore/PgnScanner.h>
+#include <ChessCore/Log.h>
+#include <string.h>
+
+using namespace std;
+
+namespace ChessCore {
+const char *PgnTokenizer::m_classname = "PgnTokenizer";
+
+// Amount of data read from the stream at a time
+#define READ_SIZE 65536
+
+// Data that must be available before matching a fixed-length token ("1/2-1/2").
+// Variable-length tokens ask for more data when they reach the end of the buffer.
+#define LOOKAHEAD 16
+
+static inline bool isFile(char c) {
+    return c >= 'a' && c <= 'h';
+}
+
+static inline bool isRank(char c) {
+    return c >= '1' && c <= '8';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isCapture(char c) {
+    return c == 'x' || c == 'X';
+}
+
+static inline bool isPromotionPiece(char c) {
+    return c == 'Q' || c == 'B' || c == 'N' || c == 'R';
+}
+
+// Length of the optional promotion ("="?[QBNR]) at 's'
+static inline size_t promotionLength(const char *s) {
+    if (s[0] == '=' && isPromotionPiece(s[1]))
+        return 2;
+    return isPromotionPiece(s[0]) ? 1 : 0;
+}
+
+//
+// Match the move rules that start with a file, returning the length of the longest
+// match, or 0 if nothing matched.  Where rules match the same length, the first rule
+// in PgnScanner.l wins, as it does with flex.
+//
+static size_t matchFileMove(const char *s, int &token) {
+    size_t length = 0, len;
+    const char *t;
+
+    if (isRank(s[1])) {
+        // {file}{rank}{prom}?
+        length = 2 + promotionLength(s + 2);
+        token = A_PAWN_MOVE;
+    }
+
+    // {file}{x}?{file}{rank}{prom}? and {file}{x}?{file}{prom}?
+    t = s + 1;
+    if (isCapture(*t))
+        t++;
+    if (isFile(*t)) {
+        t++;
+        if (isRank(*t))
+            len = (t + 1 - s) + promotionLength(t + 1);
+        else
+            len = (t - s) + promotionLength(t);
+        if (len > length) {
+            length = len;
+            token = A_PAWN_CAPTURE;
+        }
+    }
+
+    // {file}{rank}"-"?{file}{rank}
+    if (isRank(s[1])) {
+        t = s + 2;
+        if (*t == '-')
+            t++;
+        if (isFile(t[0]) && isRank(t[1])) {
+            len = t + 2 - s;
+            if (len > length) {
+                length = len;
+                token = A_PIECE_MOVE;
+            }
+        }
+    }
+
+    if (s[0] == 'd' && strncmp(s, "draw", 4) == 0 && length < 4) {
+        length = 4;
+        token = A_DRAW;
+    }
+
+    return length;
+}
+
+//
+// Match the move rules that start with a piece.
+//
+static size_t matchPieceMove(const char *s, int &token) {
+    size_t length = 0;
+
+    // Characters are only examined while the previous ones match, so the NUL
+    // terminators are never read past
+    if (isFile(s[1])) {
+        if (isRank(s[2])) {
+            // {piece}{file}{rank}
+            length = 3;
+            token = A_PIECE_MOVE;
+
+            // {piece}{file}{rank}"-"?{file}{rank}
+            const char *t = s + 3;
+            if (*t == '-')
+                t++;
+            if (isFile(t[0]) && isRank(t[1])) {
+                length = t + 2 - s;
+            } else if (isCapture(s[3]) && isFile(s[4]) && isRank(s[5])) {
+                // {piece}{file}{rank}{x}{file}{rank}
+                length = 6;
+                token = A_PIECE_CAPTURE;
+            }
+        } else if (isFile(s[2]) && isRank(s[3])) {
+            // {piece}{file}{file}{rank}
+            length = 4;
+            token = A_PIECE_MOVE;
+        } else if (isCapture(s[2]) && isFile(s[3]) && isRank(s[4])) {
+            // {piece}{file}{x}{file}{rank}
+            length = 5;
+            token = A_PIECE_CAPTURE;
+        }
+    } else if (isRank(s[1])) {
+        if (isFile(s[2]) && isRank(s[3])) {
+            // {piece}{rank}{file}{rank}
+            length = 4;
+            token = A_PIECE_MOVE;
+        } else if (isCapture(s[2]) && isFile(s[3]) && isRank(s[4])) {
+            // {piece}{rank}{x}{file}{rank}
+            length = 5;
+            token = A_PIECE_CAPTURE;
+        }
+    } else if (isCapture(s[1]) && isFile(s[2]) && isRank(s[3])) {
+        // {piece}{x}{file}{rank}
+        length = 4;
+        token = A_PIECE_CAPTURE;
+    }
+
+    return length;
+}
+
+//
+// Match the rules that start with a digit (move numbers, results and castling with
+// zeros).  'end' is the end of the available data; unless 'eof' is set, 'incomplete'
+// is set if the match might continue beyond it.
+//
+static size_t matchDigits(const char *s, const char *end, bool eof, int &token, bool &incomplete) {
+    const char *t = s;
+    while (t < end && isDigit(*t))
+        t++;
+
+    if (!eof && end - t < 3) {
+        incomplete = true;
+        return 0;
+    }
+
+    // {value}"."? and {value}"..."
+    size_t length = t - s;
+    token = A_WHITE_MOVENUM;
+    if (*t == '.') {
+        if (t[1] == '.' && t[2] == '.') {
+            length += 3;
+            token = A_BLACK_MOVENUM;
+        } else {
+            length++;
+        }
+    }
+
+    size_t len = 0;
+    int tok = 0;
+
+    if (s[0] == '0') {
+        if (strncmp(s, "0-0-0", 5) == 0) {
+            len = 5;
+            tok = A_LONG_CASTLE;
+        } else if (strncmp(s, "0-0", 3) == 0) {
+            len = 3;
+            tok = A_SHORT_CASTLE;
+        } else if (strncmp(s, "0-1", 3) == 0 || strncmp(s, "0:1", 3) == 0) {
+            len = 3;
+            tok = A_BLACK_WINS;
+        }
+    } else if (s[0] == '1') {
+        if (strncmp(s, "1/2-1/2", 7) == 0 || strncmp(s, "1/2:1/2", 7) == 0) {
+            len = 7;
+            tok = A_DRAW;
+        } else if (strncmp(s, "1-0", 3) == 0 || strncmp(s, "1:0", 3) == 0) {
+            len = 3;
+            tok = A_WHITE_WINS;
+        } else if (strncmp(s, "1/2", 3) == 0) {
+            len = 3;
+            tok = A_DRAW;
+        }
+    }
+
+    if (len > length) {
+        length = len;
+        token = tok;
+    }
+
+    return length;
+}
+
+//
+// Count the number of newlines within a comment (the same as countNewlines() in
+// PgnScanner.l, including the removal of newlines and braces).
+//
+static unsigned countNewlines(char *s) {
+    unsigned count = 0;
+    while(*s != '\0') {
+        if ((*s == '\n' && *(s+1) == '\r') ||
+            (*s == '\r' && *(s+1) == '\n')) {
+            count++;
+            *s++ = ' ';
+            *s = ' ';
+        }
+        else if (*s == '\n') {
+            count++;
+            *s = ' ';
+        }
+        else if (*s == '{' || *s == '}') {
+            *s = ' ';
+        }
+        s++;
+    }
+    return count;
+}
+
+PgnTokenizer::PgnTokenizer(PgnScannerContext &context, istream &stream) :
+    m_context(context),
+    m_stream(&stream),
+    m_data(READ_SIZE + 2, '\0'),
+    m_buffer(&m_data[0]),
+    m_length(0),
+    m_pos(0),
+    m_text(m_buffer),
+    m_holdPos(0),
+    m_holdChar('\0'),
+    m_atBol(true),
+    m_eof(false) {
+}
+
+PgnTokenizer::PgnTokenizer(PgnScannerContext &context, char *buffer, size_t size) :
+    m_context(context),
+    m_stream(0),
+    m_data(),
+    m_buffer(buffer),
+    m_length(size >= 2 ? size - 2 : 0),
+    m_pos(0),
+    m_text(buffer),
+    m_holdPos(0),
+    m_holdChar('\0'),
+    m_atBol(true),
+    m_eof(true) {
+
+    if (size < 2 || buffer[size - 2] != '\0' || buffer[size - 1] != '\0') {
+        LOGERR << "PGN tokenizer buffer must end with two NUL characters";
+        m_data.resize(2, '\0');
+        m_buffer = m_text = &m_data[0];
+        m_length = 0;
+    }
+}
+
+int PgnTokenizer::lex() {
+    restoreHoldChar();
+
+    for (;;) {
+        if (!m_eof && m_length - m_pos < LOOKAHEAD) {
+            fill();
+            continue;
+        }
+
+        if (m_pos >= m_length)
+            return 0;
+
+        char *s = m_buffer + m_pos;
+        const char *end = m_buffer + m_length;
+        const char *t;
+        size_t length = 1;
+        int token = *s;
+        bool incomplete = false, ignore = false, bolOverride = false;
+
+        switch (*s) {
+        case ' ':
+        case '\t':
+            // [ \t]+
+            while (s[length] == ' ' || s[length] == '\t')
+                length++;
+            ignore = true;
+            break;
+
+        case '\n':
+        case '\r':
+            // (\n\r|\r\n|\n|\r)
+            if ((s[1] == '\n' || s[1] == '\r') && s[1] != s[0])
+                length = 2;
+            m_context.incLineNumber();
+            ignore = true;
+            break;
+
+        case '[': {
+            // "["[^\n\r]*"]", ending with the last ']' on the line
+            const char *close = 0;
+            for (t = s + 1; t < end && *t != '\n' && *t != '\r'; t++)
+                if (*t == ']')
+                    close = t;
+            if (t == end && !m_eof)
+                incomplete = true;
+            else if (close) {
+                length = close + 1 - s;
+                token = tagToken(s, length);
+            }
+            break;
+        }
+
+        case '{':
+            // "{"[^}]*"}"
+            t = (const char *)memchr(s + 1, '}', end - (s + 1));
+            if (t) {
+                length = t + 1 - s;
+                token = A_COMMENT;
+            } else if (!m_eof) {
+                incomplete = true;
+            }
+            break;
+
+        case ';':
+            // ";".*$
+            t = (const char *)memchr(s + 1, '\n', end - (s + 1));
+            if (t) {
+                length = t - s;
+                token = A_ROL_COMMENT;
+            } else if (!m_eof) {
+                incomplete = true;
+            }
+            break;
+
+        case '%':
+            // ^"%", then eat the rest of the line
+            if (m_atBol) {
+                // eatLine() also stops at a NUL character, which it consumes
+                for (t = s + 1; t < end && *t != '\n' && *t != '\r' && *t != '\0'; t++)
+                    ;
+                if (end - t < 2 && !m_eof) {
+                    incomplete = true;
+                } else if (t == end) {
+                    length = t - s;
+                } else if (*t == '\0') {
+                    length = t + 1 - s;
+                } else {
+                    // As with eatLine(), a following newline character is also eaten,
+                    // whichever it is, and the line is counted once.  Otherwise the
+                    // character is put back, which leaves flex not at the beginning of
+                    // a line
+                    if (t[1] == '\n' || t[1] == '\r') {
+                        length = t + 2 - s;
+                    } else {
+                        length = t + 1 - s;
+                        bolOverride = true;
+                    }
+                    m_context.incLineNumber();
+                }
+                ignore = true;
+            }
+            break;
+
+        case '(':
+            token = A_VARSTART;
+            break;
+
+        case ')':
+            token = A_VAREND;
+            break;
+
+        case '+':
+            token = A_CHECK;
+            break;
+
+        case '#':
+            token = A_MATE;
+            break;
+
+        case '*':
+            token = A_UNFINISHED;
+            break;
+
+        case '!':
+            if (s[1] == '!') {
+                length = 2;
+                token = A_BRILLIANT_MOVE;
+            } else if (s[1] == '?') {
+                length = 2;
+                token = A_INTERESTING_MOVE;
+            } else {
+                token = A_GOOD_MOVE;
+            }
+            break;
+
+        case '?':
+            if (s[1] == '?') {
+                length = 2;
+                token = A_BLUNDER_MOVE;
+            } else if (s[1] == '!') {
+                length = 2;
+                token = A_DUBIOUS_MOVE;
+            } else {
+                token = A_BAD_MOVE;
+            }
+            break;
+
+        case '$':
+            if (isDigit(s[1])) {
+                // "$"[0-9]+
+                for (t = s + 1; t < end && isDigit(*t); t++)
+                    ;
+                if (t == end && !m_eof)
+                    incomplete = true;
+                length = t - s;
+                token = A_NAG;
+            } else if (s[1] == '#') {
+                length = 2;
+                token = A_NAG_MATE;
+            } else if (s[1] == 'N') {
+                length = 2;
+                token = A_NAG_NOVELTY;
+            }
+            break;
+
+        case '.':
+            if (s[1] == '.' && s[2] == '.') {
+                length = 3;
+                ignore = true;
+            }
+            break;
+
+        case '<':
+        case '>':
+            ignore = true;
+            break;
+
+        case '-':
+            if (s[1] == '-') {
+                length = 2;
+                token = A_NULL_MOVE;
+            }
+            break;
+
+        case 'Z':
+            if (s[1] == '0') {
+                length = 2;
+                token = A_NULL_MOVE;
+            }
+            break;
+
+        case 'O':
+        case 'o':
+            // Castling, with the same letter throughout
+            if (s[1] == '-' && s[2] == s[0]) {
+                if (s[3] == '-' && s[4] == s[0]) {
+                    length = 5;
+                    token = A_LONG_CASTLE;
+                } else {
+                    length = 3;
+                    token = A_SHORT_CASTLE;
+                }
+            }
+            break;
+
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9': {
+            size_t len = matchDigits(s, end, m_eof, token, incomplete);
+            if (len > 0)
+                length = len;
+            break;
+        }
+
+        case 'a': case 'b': case 'c': case 'd':
+        case 'e': case 'f': case 'g': case 'h': {
+            size_t len = matchFileMove(s, token);
+            if (len > 0)
+                length = len;
+            else
+                token = *s;
+            break;
+        }
+
+        case 'K': case 'Q': case 'B': case 'N': case 'R': case 'P': {
+            size_t len = matchPieceMove(s, token);
+            if (len > 0)
+                length = len;
+            else
+                token = *s;
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        if (incomplete) {
+            fill();
+            continue;
+        }
+
+        m_pos += length;
+        m_atBol = s[length - 1] == '\n' && !bolOverride;
+
+        if (ignore)
+            continue;
+
+        // NUL-terminate the token text, as flex does
+        m_text = s;
+        m_holdPos = s + length;
+        m_holdChar = *m_holdPos;
+        *m_holdPos = '\0';
+
+        if (token == A_COMMENT)
+            m_context.incLineNumber(countNewlines(m_text));
+
+        return token;
+    }
+}
+
+char *PgnTokenizer::text() const {
+    return m_text;
+}
+
+void PgnTokenizer::flush() {
+    if (m_stream == 0)
+        return;
+
+    restoreHoldChar();
+    m_length = m_pos = 0;
+    m_buffer[0] = m_buffer[1] = '\0';
+    m_text = m_buffer;
+    m_atBol = true;
+    m_eof = false;
+}
+
+size_t PgnTokenizer::bufferOffset() const {
+    return m_stream ? 0 : m_pos;
+}
+
+int PgnTokenizer::tagToken(const char *text, size_t length) {
+    // These must match the header rules in PgnScanner.l
+    static const struct {
+        const char *prefix;
+        size_t length;
+        int token;
+    } tags[] = {
+        { "[Event ", 7, A_PGN_EVENT },
+        { "[Site ", 6, A_PGN_SITE },
+        { "[Date ", 6, A_PGN_DATE },
+        { "[Round ", 7, A_PGN_ROUND },
+        { "[White ", 7, A_PGN_WHITE },
+        { "[Black ", 7, A_PGN_BLACK },
+        { "[Result ", 8, A_PGN_RESULT },
+        { "[SetUp ", 7, A_PGN_SETUP },
+        { "[FEN ", 5, A_PGN_FEN },
+        { "[Annotator ", 11, A_PGN_ANNOTATOR },
+        { "[ECO ", 5, A_PGN_ECO },
+        { "[WhiteElo ", 10, A_PGN_WHITEELO },
+        { "[BlackElo ", 10, A_PGN_BLACKELO },
+        { "[Opening ", 9, A_PGN_OPENING },
+        { "[Variation ", 11, A_PGN_VARIATION },
+        { "[TimeControl ", 13, A_PGN_TIMECONTROL }
+    };
+
+    for (unsigned i = 0; i < sizeof(tags) / sizeof(tags[0]); i++)
+        if (length > tags[i].length && memcmp(text, tags[i].prefix, tags[i].length) == 0)
+            return tags[i].token;
+
+    return A_PGN_XXX;
+}
+
+bool PgnTokenizer::fill() {
+    if (m_eof)
+        return false;
+
+    restoreHoldChar();
+
+    // Move the unconsumed data to the start of the buffer, growing it if a single
+    // token is larger than the buffer
+    size_t remaining = m_length - m_pos;
+    if (m_pos > 0 && remaining > 0)
+        memmove(&m_data[0], &m_data[m_pos], remaining);
+    m_pos = 0;
+    m_length = remaining;
+
+    if (m_data.size() - 2 - m_length < READ_SIZE / 2)
+        m_data.resize(m_data.size() * 2);
+    m_buffer = m_text = &m_data[0];
+
+    m_stream->read(m_buffer + m_length, m_data.size() - 2 - m_length);
+    size_t count = (size_t)m_stream->gcount();
+    m_length += count;
+    m_buffer[m_length] = m_buffer[m_length + 1] = '\0';
+
+    if (!m_stream->good()) {
+        // Leave the stream usable for seeking
+        m_stream->clear();
+        m_eof = true;
+    }
+
+    return count > 0;
+}
+
+void PgnTokenizer::restoreHoldChar() {
+    if (m_holdPos) {
+        *m_holdPos = m_holdChar;
+        m_holdPos = 0;
+    }
+}
+} // namespace ChessCore
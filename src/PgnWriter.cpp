@@ -0,0 +1,731 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// PgnWriter.cpp: PgnWriter class implementation.
+//
+
+#include <ChessCore/PgnWriter.h>
+#include <ChessCore/PgnDatabase.h>
+#include <ChessCore/Thread.h>
+#include <ChessCore/IoEvent.h>
+#include <ChessCore/IoEventWaiter.h>
+#include <ChessCore/Util.h>
+#include <ChessCore/Log.h>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef WINDOWS
+#include <io.h>
+#else // !WINDOWS
+#include <unistd.h>
+#endif // WINDOWS
+
+using namespace std;
+
+// Set to 1 to write variations after the move they replace, rather than after the first
+// move of the line
+#define EMBEDDED_VARIATIONS 0
+
+namespace ChessCore {
+const char *PgnWriter::m_classname = "PgnWriter";
+
+// Number of games read from the database before they are formatted by the threads
+#define WRITE_BATCH_SIZE 1000
+
+//
+// Wait for an event to be signalled and then reset it.
+//
+static bool waitForEvent(IoEvent &event) {
+    IoEventWaiter waiter;
+    IoEventList events(1);
+    events[0] = &event;
+
+    if (!waiter.setEvents(events) || waiter.wait() != 0)
+        return false;
+
+    event.reset();
+    return true;
+}
+
+//
+// Format every 'step' game of a batch, starting with game 'index', into its own
+// output string.
+//
+class PgnFormatThread : public Thread {
+protected:
+    unsigned m_index;
+    unsigned m_step;
+
+public:
+    IoEvent m_startEvent;           // Set by writeDatabase() when a batch is ready
+    IoEvent m_doneEvent;            // Set by the thread once the batch is formatted
+    const vector<shared_ptr<Game> > *m_games;
+    vector<string> *m_output;
+    vector<string> *m_errorMsgs;
+    atomic<bool> m_quit;            // Set by writeDatabase() before m_startEvent
+
+    PgnFormatThread(unsigned index, unsigned step) :
+        Thread(),
+        m_index(index),
+        m_step(step),
+        m_startEvent(),
+        m_doneEvent(),
+        m_games(0),
+        m_output(0),
+        m_errorMsgs(0),
+        m_quit(false) {
+    }
+
+protected:
+    void entry() {
+        while (waitForEvent(m_startEvent) && !m_quit) {
+            const vector<shared_ptr<Game> > &games = *m_games;
+
+            for (size_t i = m_index; i < games.size(); i += m_step) {
+                (*m_output)[i].clear();
+                (*m_errorMsgs)[i].clear();
+
+                if (games[i])
+                    PgnWriter::format(*games[i], (*m_output)[i], (*m_errorMsgs)[i]);
+            }
+
+            m_doneEvent.set();
+        }
+
+        m_doneEvent.set();
+    }
+};
+
+PgnWriter::PgnWriter() :
+    m_filename(),
+    m_fd(-1),
+    m_buffer(),
+    m_fileSize(0),
+    m_errorMsg() {
+}
+
+PgnWriter::~PgnWriter() {
+    close();
+}
+
+bool PgnWriter::open(const string &filename, bool append) {
+    close();
+
+#ifdef WINDOWS
+    int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC);
+    m_fd = ::_open(filename.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else // !WINDOWS
+    int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+    m_fd = ::open(filename.c_str(), flags, 0644);
+#endif // WINDOWS
+
+    if (m_fd < 0) {
+        m_errorMsg = Util::format("Failed to open file '%s': %s", filename.c_str(), strerror(errno));
+        LOGERR << m_errorMsg;
+        return false;
+    }
+
+#ifdef WINDOWS
+    int64_t size = ::_lseeki64(m_fd, 0, SEEK_END);
+#else // !WINDOWS
+    off_t size = ::lseek(m_fd, 0, SEEK_END);
+#endif // WINDOWS
+
+    m_filename = filename;
+    m_fileSize = size > 0 ? (uint64_t)size : 0;
+    m_buffer.reserve(BUFFER_SIZE + BUFFER_SIZE / 4);
+    m_errorMsg.clear();
+    return true;
+}
+
+bool PgnWriter::close() {
+    bool retval = true;
+
+    if (m_fd >= 0) {
+        retval = flush();
+
+#ifdef WINDOWS
+        ::_close(m_fd);
+#else // !WINDOWS
+        ::close(m_fd);
+#endif // WINDOWS
+
+        m_fd = -1;
+    }
+
+    m_buffer.clear();
+    m_fileSize = 0;
+    return retval;
+}
+
+bool PgnWriter::write(const Game &game) {
+    if (m_fd < 0) {
+        m_errorMsg = "File is not open";
+        LOGERR << m_errorMsg;
+        return false;
+    }
+
+    size_t length = m_buffer.length();
+    appendSeparator();
+
+    if (!format(game, m_buffer, m_errorMsg)) {
+        LOGERR << "Failed to format game: " << m_errorMsg;
+        m_buffer.resize(length);
+        return false;
+    }
+
+    if (m_buffer.length() >= BUFFER_SIZE)
+        return flush();
+
+    return true;
+}
+
+bool PgnWriter::flush() {
+    if (m_buffer.empty())
+        return true;
+
+    if (!writeBuffer(m_buffer.data(), m_buffer.length()))
+        return false;
+
+    m_fileSize += m_buffer.length();
+    m_buffer.clear();
+    return true;
+}
+
+bool PgnWriter::writeDatabase(Database &database, unsigned firstGameNum, unsigned lastGameNum,
+                              unsigned numThreads, DATABASE_CALLBACK_FUNC callback, void *contextInfo) {
+    unsigned gameNum, i, batch = 0, numGames = lastGameNum - firstGameNum + 1;
+    bool retval = true;
+
+    if (m_fd < 0) {
+        m_errorMsg = "File is not open";
+        LOGERR << m_errorMsg;
+        return false;
+    }
+
+    if (firstGameNum > lastGameNum)
+        return true;
+
+    if (numThreads == 0)
+        numThreads = Util::numProcessors();
+
+    // While the threads format one batch, the next batch is read into the other
+    vector<shared_ptr<Game> > games[2];
+    vector<string> output(WRITE_BATCH_SIZE), errorMsgs(WRITE_BATCH_SIZE);
+    vector<PgnFormatThread *> threads;
+
+    for (i = 0; i < numThreads && retval; i++) {
+        PgnFormatThread *thread = new PgnFormatThread(i, numThreads);
+
+        if (thread->start()) {
+            threads.push_back(thread);
+        } else {
+            m_errorMsg = "Failed to start formatting thread";
+            delete thread;
+            retval = false;
+        }
+    }
+
+    gameNum = firstGameNum;
+
+    while (retval && (gameNum <= lastGameNum || !games[batch].empty())) {
+        vector<shared_ptr<Game> > &current = games[batch];
+        vector<shared_ptr<Game> > &next = games[batch ^ 1];
+
+        // Start formatting the current batch
+        for (i = 0; i < threads.size(); i++) {
+            threads[i]->m_games = &current;
+            threads[i]->m_output = &output;
+            threads[i]->m_errorMsgs = &errorMsgs;
+            threads[i]->m_startEvent.set();
+        }
+
+        // Read the next batch
+        next.clear();
+
+        while (retval && gameNum <= lastGameNum && next.size() < WRITE_BATCH_SIZE) {
+            shared_ptr<Game> game;
+
+            if (database.gameExists(gameNum)) {
+                game.reset(new Game);
+
+                if (!database.read(gameNum, *game)) {
+                    m_errorMsg = Util::format("Failed to read game %u: %s", gameNum,
+                                              database.errorMsg().c_str());
+                    retval = false;
+                }
+            }
+
+            next.push_back(game);
+            gameNum++;
+        }
+
+        for (i = 0; i < threads.size(); i++)
+            waitForEvent(threads[i]->m_doneEvent);
+
+        // Write the current batch in order
+        for (i = 0; i < current.size() && retval; i++) {
+            if (!current[i])
+                continue;
+
+            if (!errorMsgs[i].empty()) {
+                m_errorMsg = errorMsgs[i];
+                retval = false;
+                break;
+            }
+
+            appendSeparator();
+            m_buffer += output[i];
+
+            if (m_buffer.length() >= BUFFER_SIZE)
+                retval = flush();
+        }
+
+        if (retval && callback && !current.empty()) {
+            unsigned done = gameNum - firstGameNum - (unsigned)next.size();
+            float complete = (float(done) * 100.0f) / float(numGames);
+
+            if (!callback(firstGameNum + done - 1, complete, contextInfo)) {
+                m_errorMsg = "User cancelled writing";
+                retval = false;
+            }
+        }
+
+        current.clear();
+        batch ^= 1;
+    }
+
+    // Stop the threads and wait for them to exit before deleting them
+    for (i = 0; i < threads.size(); i++) {
+        threads[i]->m_quit = true;
+        threads[i]->m_startEvent.set();
+    }
+
+    for (i = 0; i < threads.size(); i++) {
+        waitForEvent(threads[i]->m_doneEvent);
+
+        while (threads[i]->isThreadRunning())
+            Util::sleep(1);
+
+        delete threads[i];
+    }
+
+    if (retval)
+        retval = flush();
+    else
+        LOGERR << m_errorMsg;
+
+    return retval;
+}
+
+bool PgnWriter::format(const Game &game, string &output, string &errorMsg) {
+    const char *result;
+    bool retval = true;
+
+    switch (game.result()) {
+    case Game::WHITE_WIN:
+        result = "1-0";
+        break;
+
+    case Game::BLACK_WIN:
+        result = "0-1";
+        break;
+
+    case Game::DRAW:
+        result = "1/2-1/2";
+        break;
+
+    default:
+        result = "*";
+        break;
+    }
+
+    formatHeader(game, result, output);
+
+    unsigned width = 0;
+    const AnnotMove *mainline = game.mainline();
+
+    if (mainline) {
+        if (hasAnnotations(mainline))
+            retval = formatMoves(mainline, output, width, errorMsg);
+        else
+            retval = formatMainline(mainline, output, width, errorMsg);
+    }
+
+    formatText(result, strlen(result), output, width);
+    output += '\n';
+    return retval;
+}
+
+bool PgnWriter::writeBuffer(const char *data, size_t length) {
+    while (length > 0) {
+#ifdef WINDOWS
+        int written = ::_write(m_fd, data, length > 0x40000000 ? 0x40000000 : (unsigned)length);
+#else // !WINDOWS
+        ssize_t written = ::write(m_fd, data, length);
+#endif // WINDOWS
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            m_errorMsg = Util::format("Failed to write to file '%s': %s", m_filename.c_str(), strerror(errno));
+            LOGERR << m_errorMsg;
+            return false;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+void PgnWriter::appendSeparator() {
+    // Add a blank line to separate this game from the previous one
+    if (offset() > 0)
+        m_buffer += '\n';
+}
+
+//
+// Append an unsigned value, zero-padded to 'minDigits'.
+//
+static void formatUnsigned(unsigned value, unsigned minDigits, string &output) {
+    char buffer[16], *s = buffer + sizeof(buffer);
+
+    do {
+        *--s = char('0' + value % 10);
+        value /= 10;
+    } while (value > 0 || buffer + sizeof(buffer) - s < (ptrdiff_t)minDigits);
+
+    output.append(s, buffer + sizeof(buffer) - s);
+}
+
+void PgnWriter::formatHeader(const Game &game, const char *result, string &output) {
+    output += "[Event \"";
+    formatTagString(game.event(), output);
+    output += "\"]\n[Site \"";
+    formatTagString(game.site(), output);
+    output += "\"]\n[Date \"";
+
+    if (game.year() > 0) {
+        formatUnsigned(game.year(), 4, output);
+        output += '.';
+
+        if (game.month() > 0) {
+            formatUnsigned(game.month(), 2, output);
+            output += '.';
+
+            if (game.day() > 0)
+                formatUnsigned(game.day(), 2, output);
+            else
+                output += "??";
+        } else {
+            output += "??.??";
+        }
+    } else {
+        output += "????.??.??";
+    }
+
+    output += "\"]\n[Round \"";
+
+    if (game.roundMajor())
+        formatUnsigned(game.roundMajor(), 1, output);
+    else
+        output += '?';
+
+    if (game.roundMinor()) {
+        output += '.';
+        formatUnsigned(game.roundMinor(), 1, output);
+    }
+
+    output += "\"]\n[White \"";
+    formatTagString(game.white().formattedName(), output);
+    output += "\"]\n[Black \"";
+    formatTagString(game.black().formattedName(), output);
+    output += "\"]\n";
+
+    if (!game.startPosition().isStarting()) {
+        output += "[SetUp \"1\"]\n";
+        formatTag("FEN", game.startPositionFen(), output);
+    }
+
+    output += "[Result \"";
+    output += result;
+    output += "\"]\n";
+
+    if (!game.annotator().empty())
+        formatTag("Annotator", game.annotator(), output);
+
+    if (!game.eco().empty())
+        formatTag("ECO", game.eco(), output);
+
+    if (game.white().elo()) {
+        output += "[WhiteElo \"";
+        formatUnsigned(game.white().elo(), 1, output);
+        output += "\"]\n";
+    }
+
+    if (game.black().elo()) {
+        output += "[BlackElo \"";
+        formatUnsigned(game.black().elo(), 1, output);
+        output += "\"]\n";
+    }
+
+    if (game.timeControl().isValid())
+        formatTag("TimeControl", game.timeControl().notation(TimeControlPeriod::FORMAT_PGN), output);
+
+    output += '\n';
+}
+
+void PgnWriter::formatTag(const char *name, const string &value, string &output) {
+    output += '[';
+    output += name;
+    output += " \"";
+    output += value;
+    output += "\"]\n";
+}
+
+void PgnWriter::formatTagString(const string &str, string &output) {
+    if (str.empty()) {
+        output += '?';
+        return;
+    }
+
+    // Leading and trailing spaces are removed
+    size_t first = str.find_first_not_of(' ');
+
+    if (first == string::npos)
+        return;
+
+    size_t last = str.find_last_not_of(' ');
+
+    for (size_t i = first; i <= last; i++) {
+        char c = str[i];
+
+        if (c == '"' || c == '\\')
+            output += '\\';
+
+        output += c;
+    }
+}
+
+bool PgnWriter::hasAnnotations(const AnnotMove *amove) {
+    for (; amove; amove = amove->next())
+        if (amove->variation() || amove->nagCount() > 0 || !amove->preAnnot().empty() ||
+            !amove->postAnnot().empty())
+            return true;
+
+    return false;
+}
+
+bool PgnWriter::formatMainline(const AnnotMove *amove, string &output, unsigned &width, string &errorMsg) {
+    Position pos;
+    UnmakeMoveInfo umi;
+    char buffer[32];
+    size_t length;
+    bool firstWord = true;
+
+    ASSERT(amove && amove->priorPosition());
+    pos.set(amove->priorPosition());
+
+    for (; amove; amove = amove->next()) {
+        if (toColour(pos.ply() + 1) == WHITE) {
+            length = formatMoveNumber(pos, buffer);
+            formatText(buffer, length, output, width, !firstWord);
+            firstWord = false;
+        }
+
+        length = amove->move().san(pos, buffer);
+        formatText(buffer, length, output, width, !firstWord);
+        firstWord = false;
+
+        if (!pos.makeMove(amove->move(), umi)) {
+            errorMsg = Util::format("Failed to make move '%s'", amove->dump(false).c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool PgnWriter::formatMoves(const AnnotMove *amove, string &output, unsigned &width, string &errorMsg) {
+    Position pos;
+    UnmakeMoveInfo umi;
+    const AnnotMove *m;
+    char buffer[32];
+    size_t length;
+    bool retval = true, moveNum = true, forceMoveNum = false, firstWord = true;
+    unsigned i;
+
+    ASSERT(amove);
+
+    // There must be a priorPosition available for this line
+    m = amove;
+
+    while (m->mainline())
+        m = m->mainline();
+
+    ASSERT(m->priorPosition());
+    pos.set(m->priorPosition());
+
+    // We can write a 'pre-move annotation' at the start of each line
+    if (!amove->preAnnot().empty()) {
+        formatAnnotation(amove->preAnnot(), output, width, false);
+        forceMoveNum = true;
+        firstWord = false;
+    }
+
+    while (amove && retval) {
+        moveNum = toColour(pos.ply() + 1) == WHITE || amove->mainline();
+
+        if (moveNum || forceMoveNum) {
+            length = formatMoveNumber(pos, buffer);
+            formatText(buffer, length, output, width, !firstWord);
+            firstWord = false;
+        }
+
+        length = amove->move().san(pos, buffer);
+        formatText(buffer, length, output, width, !firstWord);
+        firstWord = false;
+        forceMoveNum = false;
+
+        if (amove->nagCount() > 0) {
+            Nag nags[STORED_NAGS];
+            unsigned numNags = amove->nags(nags);
+            ASSERT(numNags == amove->nagCount());
+
+            for (i = 0; i < numNags; i++) {
+                unsigned nagValue = PgnDatabase::toPgnNag(nags[i]);
+
+                if (nagValue) {
+                    buffer[0] = '$';
+                    length = 1;
+
+                    do {
+                        buffer[length++] = char('0' + nagValue % 10);
+                        nagValue /= 10;
+                    } while (nagValue > 0);
+
+                    std::reverse(buffer + 1, buffer + length);
+                    formatText(buffer, length, output, width);
+                    forceMoveNum = true;
+                }
+            }
+        }
+
+        if (!amove->postAnnot().empty()) {
+            formatAnnotation(amove->postAnnot(), output, width, true);
+            forceMoveNum = true;
+        }
+
+        if (!pos.makeMove(amove->move(), umi)) {
+            errorMsg = Util::format("Failed to make move '%s'", amove->dump(false).c_str());
+            return false;
+        }
+
+        if (amove->variation()) {
+            if (EMBEDDED_VARIATIONS) {
+                formatText("(", 1, output, width, true);
+                retval = formatMoves(amove->variation(), output, width, errorMsg);
+                formatText(")", 1, output, width, false);
+                forceMoveNum = true;
+            } else if (amove->mainline() == 0) {
+                // Top of variation tree
+                for (m = amove->variation(); m; m = m->variation()) {
+                    formatText("(", 1, output, width, true);
+                    retval = formatMoves(m, output, width, errorMsg);
+                    formatText(")", 1, output, width, false);
+                }
+
+                forceMoveNum = true;
+            }
+        }
+
+        amove = amove->next();
+    }
+
+    return retval;
+}
+
+void PgnWriter::formatAnnotation(const string &annotation, string &output, unsigned &width, bool insertSpace) {
+    formatText("{", 1, output, width, insertSpace);
+
+    // Split into words as Util::splitLine() does, where quotes group words together
+    const char *start, *end;
+    char inQuotes;
+    bool firstWord = true;
+
+    start = end = annotation.c_str();
+
+    while (*end != '\0') {
+        if (*start == '\0')
+            break;
+
+        inQuotes = '\0';
+
+        if (*start == '\'' || *start == '"')
+            inQuotes = *start++;
+
+        end = start;
+
+        if (inQuotes != '\0') {
+            while (*end != '\0' && *end != inQuotes)
+                end++;
+        } else {
+            while (*end != '\0' && *end != ' ')
+                end++;
+        }
+
+        if (end > start) {
+            formatText(start, end - start, output, width, !firstWord);
+            firstWord = false;
+        }
+
+        start = end + 1;
+    }
+
+    formatText("}", 1, output, width, false);
+}
+
+void PgnWriter::formatText(const char *text, size_t length, string &output, unsigned &width,
+                           bool insertSpace /*=true*/) {
+    if (insertSpace && width > 0) {
+        output += ' ';
+        width++;
+    }
+
+    if (width + length > MAX_LINE_WIDTH) {
+        output += '\n';
+        width = 0;
+    }
+
+    output.append(text, length);
+    width += (unsigned)length;
+}
+
+size_t PgnWriter::formatMoveNumber(const Position &pos, char *buffer) {
+    char *s = buffer;
+    unsigned moveNum = toMove(pos.ply() + 1);
+
+    do {
+        *s++ = char('0' + moveNum % 10);
+        moveNum /= 10;
+    } while (moveNum > 0);
+
+    std::reverse(buffer, s);
+    *s++ = '.';
+
+    if (toColour(pos.ply() + 1) != WHITE) {
+        *s++ = '.';
+        *s++ = '.';
+    }
+
+    *s = '\0';
+    return s - buffer;
+}
+} // namespace ChessCore
@@ -7,6 +7,7 @@
 #include <ChessCore/Player.h>
 #include <ChessCore/Util.h>
 #include <sstream>
+#include <utility>
 
 using namespace std;
 
@@ -38,9 +39,35 @@ Player::Player(const Player &other) :
 {
 }
 
+Player::Player(Player &&other) :
+    m_lastName(std::move(other.m_lastName)),
+    m_firstNames(std::move(other.m_firstNames)),
+    m_countryCode(std::move(other.m_countryCode)),
+    m_elo(other.m_elo)
+{
+    other.clear();
+}
+
 Player::~Player() {
 }
 
+Player &Player::operator=(const Player &other) {
+    set(other);
+    return *this;
+}
+
+Player &Player::operator=(Player &&other) {
+    if (this == &other)
+        return *this;
+
+    m_lastName = std::move(other.m_lastName);
+    m_firstNames = std::move(other.m_firstNames);
+    m_countryCode = std::move(other.m_countryCode);
+    m_elo = other.m_elo;
+    other.clear();
+    return *this;
+}
+
 void Player::set(const Player &other) {
     m_lastName = other.m_lastName;
     m_firstNames = other.m_firstNames;
@@ -908,6 +908,111 @@ bool Position::attacks(unsigned sq, bool stm, uint64_t removePiece /*= 0ULL*/) c
     return false;
 }
 
+uint64_t Position::moveTargets(Square from) const {
+    Colour moveSide = wtm() ? WHITE : BLACK;
+    Colour oppSide = flipColour(moveSide);
+    uint64_t occupy = m_pieces[WHITE][ALLPIECES] | m_pieces[BLACK][ALLPIECES];
+    uint64_t targets = 0ULL;
+
+    if (m_board[from] == EMPTY || pieceColour(m_board[from]) != moveSide)
+        return 0ULL;
+
+    switch (pieceOnly(m_board[from])) {
+    case PAWN: {
+        int pawnMoveDir = (moveSide == WHITE) ? +8 : -8;
+        uint64_t capturable = m_pieces[oppSide][ALLPIECES];
+
+        if (m_flags & FL_EP_MOVE)
+            capturable |= offsetBit(fileRankOffset(m_ep, moveSide == WHITE ? 5 : 2));
+
+        targets = pawnAttacks[moveSide][from] & capturable;
+
+        if ((occupy & offsetBit(from + pawnMoveDir)) == 0ULL) {
+            targets |= offsetBit(from + pawnMoveDir);
+
+            if (offsetRank(from) == (moveSide == WHITE ? 1 : 6) &&
+                (occupy & offsetBit(from + pawnMoveDir * 2)) == 0ULL)
+                targets |= offsetBit(from + pawnMoveDir * 2);
+        }
+        break;
+    }
+
+    case KNIGHT:
+        targets = knightAttacks[from];
+        break;
+
+    case BISHOP:
+        targets = Util::magicBishopAttacks(from, occupy);
+        break;
+
+    case ROOK:
+        targets = Util::magicRookAttacks(from, occupy);
+        break;
+
+    case QUEEN:
+        targets = Util::magicQueenAttacks(from, occupy);
+        break;
+
+    case KING:
+        targets = kingAttacks[from];
+
+        if (moveSide == WHITE && from == E1) {
+            if (m_flags & FL_WCASTLE_KS)
+                targets |= offsetBit(G1);
+            if (m_flags & FL_WCASTLE_QS)
+                targets |= offsetBit(C1);
+        } else if (moveSide == BLACK && from == E8) {
+            if (m_flags & FL_BCASTLE_KS)
+                targets |= offsetBit(G8);
+            if (m_flags & FL_BCASTLE_QS)
+                targets |= offsetBit(C8);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return targets & ~m_pieces[moveSide][ALLPIECES];
+}
+
+bool Position::buildMove(Square from, Square to, Piece prom, Move &move) const {
+    if ((moveTargets(from) & offsetBit(to)) == 0ULL)
+        return false;
+
+    Piece pce = pieceOnly(m_board[from]);
+    unsigned flags = Move::FL_NONE;
+
+    if (m_board[to] != EMPTY)
+        flags |= Move::FL_CAPTURE;
+
+    if (pce == PAWN) {
+        if (offsetFile(from) != offsetFile(to) && m_board[to] == EMPTY)
+            flags |= Move::FL_CAPTURE | Move::FL_EP_CAP;
+        else if (abs(to - from) == 16)
+            flags |= Move::FL_EP_MOVE;
+
+        if (offsetBit(to) & rankMask1and8) {
+            if (prom != QUEEN && prom != ROOK && prom != KNIGHT && prom != BISHOP)
+                return false;
+
+            flags |= Move::FL_PROMOTION;
+        } else {
+            prom = EMPTY;
+        }
+    } else {
+        prom = EMPTY;
+
+        if (pce == KING && to == from + 2)
+            flags |= Move::FL_CASTLE_KS;
+        else if (pce == KING && to == from - 2)
+            flags |= Move::FL_CASTLE_QS;
+    }
+
+    move.set(flags, prom, pce, from, to);
+    return true;
+}
+
 string Position::completeMove(Move &move, bool includeMoveNum) {
     Position posTemp(this);
     UnmakeMoveInfo umi;
@@ -1390,6 +1495,11 @@ bool Position::blob(Blob &blob) const {
         return false;
     }
 
+    if (!stream.flush()) {
+        LOGERR << "Failed to flush position to blob";
+        return false;
+    }
+
     return true;
 }
 
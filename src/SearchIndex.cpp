@@ -0,0 +1,725 @@
+//
+// ChessCore (c)2008-2013 Andy Duplain <andy@trojanfoe.com>
+//
+// SearchIndex.cpp: SearchIndex class implementation.
+//
+
+#include <ChessCore/SearchIndex.h>
+#include <ChessCore/Log.h>
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+
+namespace ChessCore {
+const char *SearchIndex::m_classname = "SearchIndex";
+
+#define SEARCH_INDEX_MAGIC          0x50534932  // "PSI2"
+#define SEARCH_INDEX_HEADER_SIZE    (6 * sizeof(uint32_t))
+#define SEARCH_INDEX_BATCH          1000
+
+// Orders string IDs by their strings while the dictionary is sorted
+struct StringOrder {
+    const vector<const string *> &m_strings;
+
+    StringOrder(const vector<const string *> &strings) :
+        m_strings(strings) {
+    }
+
+    bool operator()(uint32_t a, uint32_t b) const {
+        return *m_strings[a] < *m_strings[b];
+    }
+};
+
+static inline uint32_t trigram(const char *str) {
+    return ((uint32_t)(uint8_t)str[0] << 16) | ((uint32_t)(uint8_t)str[1] << 8) | (uint32_t)(uint8_t)str[2];
+}
+
+// Sort columns and descending flag; NUM_COLUMNS is the game number
+typedef vector<pair<SearchIndex::Column, bool> > SortColumns;
+
+//
+// Orders game numbers using the sort columns during SearchIndex::search()
+//
+struct GameOrder {
+    const uint32_t * const *m_columns;
+    const SortColumns &m_sortColumns;
+
+    GameOrder(const uint32_t * const *columns, const SortColumns &sortColumns) :
+        m_columns(columns),
+        m_sortColumns(sortColumns) {
+    }
+
+    bool operator()(unsigned a, unsigned b) const {
+        for (auto it = m_sortColumns.begin(); it != m_sortColumns.end(); ++it) {
+            uint32_t valueA, valueB;
+
+            if (it->first == SearchIndex::NUM_COLUMNS) {
+                valueA = a;
+                valueB = b;
+            } else {
+                valueA = le32(m_columns[it->first][a - 1]);
+                valueB = le32(m_columns[it->first][b - 1]);
+            }
+
+            if (valueA != valueB)
+                return it->second ? valueA > valueB : valueA < valueB;
+        }
+
+        return false;
+    }
+};
+
+static bool writeValues(ostream &stream, const vector<uint32_t> &values) {
+    for (auto it = values.begin(); it != values.end(); ++it)
+        if (!StreamUtil<uint32_t>::write(stream, le32(*it)))
+            return false;
+
+    return true;
+}
+
+SearchIndex::SearchIndex() :
+    m_file(),
+    m_numGames(0),
+    m_numStrings(0),
+    m_generation(0),
+    m_numTrigrams(0),
+    m_stringOffsets(0),
+    m_trigrams(0),
+    m_postingOffsets(0),
+    m_postings(0),
+    m_stringData(0),
+    m_foldedData(0) {
+    for (unsigned i = 0; i < NUM_COLUMNS; i++)
+        m_columns[i] = 0;
+}
+
+SearchIndex::~SearchIndex() {
+    close();
+}
+
+bool SearchIndex::build(const string &filename, Database &database, DATABASE_CALLBACK_FUNC callback,
+                        void *contextInfo, string &errorMsg) {
+    unsigned numGames = database.numGames();
+    unsigned startTime = Util::getTickCount();
+    SearchIndexBuilder builder;
+    vector<GameHeader> gameHeaders;
+
+    errorMsg.clear();
+    builder.reserve(numGames);
+
+    for (unsigned firstGameNum = 1; firstGameNum <= numGames; firstGameNum += SEARCH_INDEX_BATCH) {
+        unsigned lastGameNum = firstGameNum + SEARCH_INDEX_BATCH - 1;
+
+        if (lastGameNum > numGames)
+            lastGameNum = numGames;
+
+        if (!database.readHeaders(firstGameNum, lastGameNum, gameHeaders)) {
+            // Fall back to reading the headers one at a time, so that a single bad game
+            // doesn't prevent the rest from being indexed
+            gameHeaders.resize(lastGameNum - firstGameNum + 1);
+
+            for (unsigned gameNum = firstGameNum; gameNum <= lastGameNum; gameNum++) {
+                GameHeader &gameHeader = gameHeaders[gameNum - firstGameNum];
+
+                if (!database.readHeader(gameNum, gameHeader)) {
+                    LOGWRN << "Failed to read header of game " << gameNum << ": " << database.errorMsg();
+                    gameHeader.initHeader();
+                }
+            }
+        }
+
+        for (unsigned i = 0; i < gameHeaders.size(); i++)
+            builder.add(firstGameNum + i, gameHeaders[i]);
+
+        if (callback) {
+            float complete = static_cast<float> ((lastGameNum * 100.0) / numGames);
+
+            if (!callback(lastGameNum, complete, contextInfo)) {
+                errorMsg = "User cancelled building search index";
+                return false;
+            }
+        }
+    }
+
+    if (!builder.write(filename, 0, errorMsg))
+        return false;
+
+    LOGINF << "Built search index '" << filename << "' of " << numGames << " games in " <<
+        (Util::getTickCount() - startTime) << "ms";
+
+    return true;
+}
+
+bool SearchIndex::open(const string &filename, unsigned numGames, unsigned generation) {
+    close();
+
+    if (!m_file.open(filename))
+        return false;
+
+    const uint32_t *header = (const uint32_t *)m_file.data();
+    uint64_t size = m_file.size();
+
+    if (size < SEARCH_INDEX_HEADER_SIZE ||
+        le32(header[0]) != SEARCH_INDEX_MAGIC ||
+        le32(header[1]) != numGames ||
+        le32(header[3]) != generation) {
+        LOGWRN << "Search index file '" << filename << "' is invalid or out-of-date";
+        close();
+        return false;
+    }
+
+    m_numGames = numGames;
+    m_numStrings = le32(header[2]);
+    m_generation = generation;
+    m_numTrigrams = le32(header[4]);
+
+    uint64_t stringTableOffset = SEARCH_INDEX_HEADER_SIZE + (uint64_t)NUM_COLUMNS * m_numGames * sizeof(uint32_t);
+    uint64_t trigramsOffset = stringTableOffset + ((uint64_t)m_numStrings + 1) * sizeof(uint32_t);
+    uint64_t postingOffsetsOffset = trigramsOffset + (uint64_t)m_numTrigrams * sizeof(uint32_t);
+    uint64_t postingsOffset = postingOffsetsOffset + ((uint64_t)m_numTrigrams + 1) * sizeof(uint32_t);
+
+    if (size < postingsOffset) {
+        LOGWRN << "Search index file '" << filename << "' is truncated";
+        close();
+        return false;
+    }
+
+    for (unsigned i = 0; i < NUM_COLUMNS; i++)
+        m_columns[i] = (const uint32_t *)(m_file.data() + SEARCH_INDEX_HEADER_SIZE) + (size_t)i * m_numGames;
+
+    m_stringOffsets = (const uint32_t *)(m_file.data() + stringTableOffset);
+    m_trigrams = (const uint32_t *)(m_file.data() + trigramsOffset);
+    m_postingOffsets = (const uint32_t *)(m_file.data() + postingOffsetsOffset);
+    m_postings = (const uint32_t *)(m_file.data() + postingsOffset);
+
+    uint64_t stringDataOffset = postingsOffset + (uint64_t)le32(m_postingOffsets[m_numTrigrams]) * sizeof(uint32_t);
+    uint64_t stringDataSize = size < stringDataOffset ? 0 : le32(m_stringOffsets[m_numStrings]);
+
+    if (size < stringDataOffset + 2 * stringDataSize) {
+        LOGWRN << "Search index file '" << filename << "' is truncated";
+        close();
+        return false;
+    }
+
+    m_stringData = (const char *)(m_file.data() + stringDataOffset);
+    m_foldedData = m_stringData + stringDataSize;
+
+    return true;
+}
+
+void SearchIndex::close() {
+    m_file.close();
+    m_numGames = 0;
+    m_numStrings = 0;
+    m_generation = 0;
+    m_numTrigrams = 0;
+    m_stringOffsets = 0;
+    m_trigrams = 0;
+    m_postingOffsets = 0;
+    m_postings = 0;
+    m_stringData = 0;
+    m_foldedData = 0;
+
+    for (unsigned i = 0; i < NUM_COLUMNS; i++)
+        m_columns[i] = 0;
+}
+
+string SearchIndex::stringValue(uint32_t stringId) const {
+    ASSERT(stringId < m_numStrings);
+    uint32_t offset = le32(m_stringOffsets[stringId]);
+    return string(m_stringData + offset, le32(m_stringOffsets[stringId + 1]) - offset);
+}
+
+void SearchIndex::matchStrings(DatabaseComparison comparison, const string &value, vector<uint8_t> &matches) const {
+    bool caseInsensitive = databaseComparisonCaseInsensitive(comparison);
+    DatabaseComparison compare = databaseComparisonNoFlags(comparison);
+    string folded = Util::toupper(value);
+    const string &target = caseInsensitive ? folded : value;
+    const char *data = caseInsensitive ? m_foldedData : m_stringData;
+    const uint32_t *first, *last;
+
+    matches.assign(m_numStrings, 0);
+
+    if (!caseInsensitive && (compare == DATABASE_COMPARE_EQUALS || compare == DATABASE_COMPARE_STARTSWITH)) {
+        // The matching strings are together in the sorted dictionary
+        for (uint32_t id = lowerBound(target); id < m_numStrings && stringMatches(data, id, compare, target); id++)
+            matches[id] = 1;
+    } else if (trigramCandidates(folded, first, last)) {
+        // Only the strings that contain every trigram of the value can match
+        for (; first < last; first++) {
+            uint32_t id = le32(*first);
+
+            if (stringMatches(data, id, compare, target))
+                matches[id] = 1;
+        }
+    } else {
+        for (uint32_t id = 0; id < m_numStrings; id++)
+            if (stringMatches(data, id, compare, target))
+                matches[id] = 1;
+    }
+}
+
+bool SearchIndex::stringMatches(const char *data, uint32_t stringId, DatabaseComparison compare,
+                                const string &target) const {
+    uint32_t offset = le32(m_stringOffsets[stringId]);
+    uint32_t length = le32(m_stringOffsets[stringId + 1]) - offset;
+    const char *str = data + offset;
+
+    switch (compare) {
+    case DATABASE_COMPARE_EQUALS:
+        return length == target.length() && memcmp(str, target.data(), length) == 0;
+
+    case DATABASE_COMPARE_STARTSWITH:
+        return length >= target.length() && memcmp(str, target.data(), target.length()) == 0;
+
+    case DATABASE_COMPARE_CONTAINS:
+        return std::search(str, str + length, target.begin(), target.end()) != str + length || target.empty();
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
+//
+// Find the first string in the dictionary that is not less than target.
+//
+uint32_t SearchIndex::lowerBound(const string &target) const {
+    uint32_t lo = 0, hi = m_numStrings;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t offset = le32(m_stringOffsets[mid]);
+        uint32_t length = le32(m_stringOffsets[mid + 1]) - offset;
+        int cmp = memcmp(m_stringData + offset, target.data(), min((size_t)length, target.length()));
+
+        if (cmp < 0 || (cmp == 0 && length < target.length()))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+//
+// Find the shortest posting list of the trigrams of an upper case value.
+//
+// @return false if the value is too short to have trigrams.  Otherwise [first, last)
+// holds the candidate string IDs, which is empty if a trigram does not occur at all.
+//
+bool SearchIndex::trigramCandidates(const string &folded, const uint32_t *&first, const uint32_t *&last) const {
+    if (folded.length() < 3)
+        return false;
+
+    first = last = m_postings;
+    bool found = false;
+
+    for (size_t i = 0; i + 3 <= folded.length(); i++) {
+        uint32_t key = trigram(folded.data() + i);
+        uint32_t lo = 0, hi = m_numTrigrams;
+
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            if (le32(m_trigrams[mid]) < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == m_numTrigrams || le32(m_trigrams[lo]) != key) {
+            first = last = m_postings;
+            return true;
+        }
+
+        const uint32_t *postingsFirst = m_postings + le32(m_postingOffsets[lo]);
+        const uint32_t *postingsLast = m_postings + le32(m_postingOffsets[lo + 1]);
+
+        if (!found || postingsLast - postingsFirst < last - first) {
+            first = postingsFirst;
+            last = postingsLast;
+            found = true;
+        }
+    }
+
+    return true;
+}
+
+bool SearchIndex::search(const DatabaseSearchCriteria &searchCriteria, const DatabaseSortCriteria &sortCriteria,
+                         DatabaseGameList &gameList, string &errorMsg) const {
+    // Each search descriptor becomes a filter on one or two columns; either a set
+    // of matching string IDs or a range of values
+    struct Filter {
+        Column column1, column2;
+        vector<uint8_t> matches;
+        uint32_t low, high;
+    };
+
+    vector<Filter> filters;
+
+    errorMsg.clear();
+    gameList.clear();
+
+    if (!isOpen()) {
+        errorMsg = "Search index is not open";
+        return false;
+    }
+
+    for (auto it = searchCriteria.begin(); it != searchCriteria.end(); ++it) {
+        const DatabaseSearchDescriptor &descriptor = *it;
+        Filter filter;
+        filter.column2 = NUM_COLUMNS;
+        filter.low = filter.high = 0;
+
+        switch (descriptor.field) {
+        case DATABASE_FIELD_WHITEPLAYER:
+            filter.column1 = COLUMN_WHITE;
+            break;
+
+        case DATABASE_FIELD_BLACKPLAYER:
+            filter.column1 = COLUMN_BLACK;
+            break;
+
+        case DATABASE_FIELD_PLAYER:
+            filter.column1 = COLUMN_WHITE;
+            filter.column2 = COLUMN_BLACK;
+            break;
+
+        case DATABASE_FIELD_EVENT:
+            filter.column1 = COLUMN_EVENT;
+            break;
+
+        case DATABASE_FIELD_SITE:
+            filter.column1 = COLUMN_SITE;
+            break;
+
+        case DATABASE_FIELD_ECO:
+            filter.column1 = COLUMN_ECO;
+            break;
+
+        case DATABASE_FIELD_DATE:
+            filter.column1 = COLUMN_DATE;
+
+            if (databaseComparisonNoFlags(descriptor.comparison) == DATABASE_COMPARE_EQUALS) {
+                int year = 0, month = 0, day = 0;
+
+                if (sscanf(descriptor.value.c_str(), "%04d%02d%02d", &year, &month, &day) == 3) {
+                    // Exact year/month/day
+                    filter.low = filter.high = year * 10000 + month * 100 + day;
+                } else if (sscanf(descriptor.value.c_str(), "%04d%02d", &year, &month) == 2) {
+                    // This month and end of month
+                    filter.low = year * 10000 + month * 100;
+                    filter.high = filter.low + 31;
+                } else if (sscanf(descriptor.value.c_str(), "%04d", &year) == 1) {
+                    // This year and end of year
+                    filter.low = year * 10000;
+                    filter.high = filter.low + 1231;
+                } else {
+                    errorMsg = Util::format("Cannot search for date using invalid value '%s'",
+                                            descriptor.value.c_str());
+                    return false;
+                }
+            } else {
+                LOGWRN << "Ignoring to request to search for date as comparison is not \"equals\"";
+                continue;
+            }
+
+            break;
+
+        default:
+            errorMsg = Util::format("Field %d cannot be used for searching", descriptor.field);
+            return false;
+        }
+
+        if (filter.column1 != COLUMN_DATE)
+            matchStrings(descriptor.comparison, descriptor.value, filter.matches);
+
+        filters.push_back(filter);
+    }
+
+    for (unsigned i = 0; i < m_numGames; i++) {
+        bool match = le32(m_columns[COLUMN_RESULT][i]) != NO_GAME;
+
+        for (auto it = filters.begin(); match && it != filters.end(); ++it) {
+            const Filter &filter = *it;
+            uint32_t value = le32(m_columns[filter.column1][i]);
+
+            if (filter.matches.empty()) {
+                match = value >= filter.low && value <= filter.high;
+            } else {
+                match = filter.matches[value] != 0;
+
+                if (!match && filter.column2 != NUM_COLUMNS)
+                    match = filter.matches[le32(m_columns[filter.column2][i])] != 0;
+            }
+        }
+
+        if (match)
+            gameList.push_back(i + 1);
+    }
+
+    // The list is already in game number order, so only sort if something else
+    // is required
+    SortColumns sortColumns;
+
+    for (auto it = sortCriteria.begin(); it != sortCriteria.end(); ++it) {
+        const DatabaseSortDescriptor &descriptor = *it;
+        Column column;
+
+        switch (descriptor.field) {
+        case DATABASE_FIELD_GAME_NUM:
+            column = NUM_COLUMNS;
+            break;
+
+        case DATABASE_FIELD_WHITEPLAYER:
+            column = COLUMN_WHITE;
+            break;
+
+        case DATABASE_FIELD_BLACKPLAYER:
+            column = COLUMN_BLACK;
+            break;
+
+        case DATABASE_FIELD_EVENT:
+            column = COLUMN_EVENT;
+            break;
+
+        case DATABASE_FIELD_SITE:
+            column = COLUMN_SITE;
+            break;
+
+        case DATABASE_FIELD_ROUND:
+            column = COLUMN_ROUND;
+            break;
+
+        case DATABASE_FIELD_DATE:
+            column = COLUMN_DATE;
+            break;
+
+        case DATABASE_FIELD_ECO:
+            column = COLUMN_ECO;
+            break;
+
+        case DATABASE_FIELD_RESULT:
+            column = COLUMN_RESULT;
+            break;
+
+        default:
+            errorMsg = Util::format("Field %d cannot be used for sorting", descriptor.field);
+            gameList.clear();
+            return false;
+        }
+
+        sortColumns.push_back(make_pair(column, descriptor.order == DATABASE_ORDER_DESCENDING));
+    }
+
+    if (!sortColumns.empty() &&
+        !(sortColumns.size() == 1 && sortColumns[0].first == NUM_COLUMNS && !sortColumns[0].second))
+        stable_sort(gameList.begin(), gameList.end(), GameOrder(m_columns, sortColumns));
+
+    return true;
+}
+
+//
+// SearchIndexBuilder
+//
+const char *SearchIndexBuilder::m_classname = "SearchIndexBuilder";
+
+SearchIndexBuilder::SearchIndexBuilder() :
+    m_ids(),
+    m_strings() {
+}
+
+SearchIndexBuilder::~SearchIndexBuilder() {
+}
+
+void SearchIndexBuilder::reserve(unsigned numGames) {
+    for (unsigned i = 0; i < SearchIndex::NUM_COLUMNS; i++)
+        m_columns[i].reserve(numGames);
+}
+
+void SearchIndexBuilder::add(unsigned gameNum, const GameHeader &gameHeader) {
+    add(gameNum, gameHeader.white().lastName(), gameHeader.black().lastName(), gameHeader.event(),
+        gameHeader.site(), gameHeader.eco(),
+        (uint32_t)(gameHeader.year() * 10000 + gameHeader.month() * 100 + gameHeader.day()),
+        gameHeader.roundMajor(), gameHeader.roundMinor(), (uint32_t)gameHeader.result());
+}
+
+void SearchIndexBuilder::add(unsigned gameNum, const string &white, const string &black, const string &event,
+                             const string &site, const string &eco, uint32_t date, unsigned roundMajor,
+                             unsigned roundMinor, uint32_t result) {
+    ASSERT(gameNum > numGames());
+
+    if (gameNum > numGames() + 1) {
+        uint32_t empty = addString("");
+
+        while (gameNum > numGames() + 1)
+            addRow(empty, empty, empty, empty, empty, 0, 0, SearchIndex::NO_GAME);
+    }
+
+    addRow(addString(white), addString(black), addString(event), addString(site), addString(eco), date,
+           (roundMajor << 16) | (roundMinor & 0xffff), result);
+}
+
+uint32_t SearchIndexBuilder::addString(const string &str) {
+    auto it = m_ids.find(str);
+
+    if (it != m_ids.end())
+        return it->second;
+
+    uint32_t id = (uint32_t)m_strings.size();
+    auto inserted = m_ids.insert(make_pair(str, id));
+    m_strings.push_back(&inserted.first->first);
+    return id;
+}
+
+void SearchIndexBuilder::addRow(uint32_t white, uint32_t black, uint32_t event, uint32_t site, uint32_t eco,
+                                uint32_t date, uint32_t round, uint32_t result) {
+    m_columns[SearchIndex::COLUMN_WHITE].push_back(white);
+    m_columns[SearchIndex::COLUMN_BLACK].push_back(black);
+    m_columns[SearchIndex::COLUMN_EVENT].push_back(event);
+    m_columns[SearchIndex::COLUMN_SITE].push_back(site);
+    m_columns[SearchIndex::COLUMN_ECO].push_back(eco);
+    m_columns[SearchIndex::COLUMN_DATE].push_back(date);
+    m_columns[SearchIndex::COLUMN_ROUND].push_back(round);
+    m_columns[SearchIndex::COLUMN_RESULT].push_back(result);
+}
+
+bool SearchIndexBuilder::write(const string &filename, unsigned generation, string &errorMsg) {
+    unsigned numGames = this->numGames();
+
+    errorMsg.clear();
+
+    // Sort the dictionary and renumber the string columns so that the IDs are in
+    // string order
+    vector<uint32_t> order(m_strings.size()), remap(m_strings.size());
+    vector<const string *> sorted(m_strings.size());
+
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), StringOrder(m_strings));
+
+    for (uint32_t i = 0; i < order.size(); i++) {
+        remap[order[i]] = i;
+        sorted[i] = m_strings[order[i]];
+        m_ids[*sorted[i]] = i;
+    }
+
+    m_strings.swap(sorted);
+
+    static const SearchIndex::Column stringColumns[] = {
+        SearchIndex::COLUMN_WHITE, SearchIndex::COLUMN_BLACK, SearchIndex::COLUMN_EVENT,
+        SearchIndex::COLUMN_SITE, SearchIndex::COLUMN_ECO
+    };
+
+    for (unsigned i = 0; i < sizeof(stringColumns) / sizeof(stringColumns[0]); i++) {
+        vector<uint32_t> &column = m_columns[stringColumns[i]];
+
+        for (auto it = column.begin(); it != column.end(); ++it)
+            *it = remap[*it];
+    }
+
+    const vector<const string *> &strings = m_strings;
+
+    // The string table and the upper case strings, with their trigrams as
+    // (trigram << 32) | string ID
+    vector<uint32_t> stringOffsets;
+    vector<string> folded(strings.size());
+    vector<uint64_t> trigrams;
+    uint32_t stringOffset = 0;
+
+    stringOffsets.reserve(strings.size() + 1);
+    stringOffsets.push_back(0);
+
+    for (uint32_t id = 0; id < strings.size(); id++) {
+        stringOffset += (uint32_t)strings[id]->size();
+        stringOffsets.push_back(stringOffset);
+        folded[id] = Util::toupper(*strings[id]);
+
+        for (size_t i = 0; i + 3 <= folded[id].length(); i++)
+            trigrams.push_back(((uint64_t)trigram(folded[id].data() + i) << 32) | id);
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    vector<uint32_t> trigramKeys, postingOffsets, postings;
+    postings.reserve(trigrams.size());
+
+    for (auto it = trigrams.begin(); it != trigrams.end(); ++it) {
+        uint32_t key = (uint32_t)(*it >> 32);
+
+        if (trigramKeys.empty() || trigramKeys.back() != key) {
+            trigramKeys.push_back(key);
+            postingOffsets.push_back((uint32_t)postings.size());
+        }
+
+        postings.push_back((uint32_t)*it);
+    }
+
+    postingOffsets.push_back((uint32_t)postings.size());
+
+    string tempFilename = filename + ".tmp";
+    ofstream file(tempFilename.c_str(), ios::binary | ios::out | ios::trunc);
+
+    if (!file.is_open()) {
+        errorMsg = Util::format("Failed to create search index file '%s': %s", tempFilename.c_str(),
+                                strerror(errno));
+        return false;
+    }
+
+    bool retval = StreamUtil<uint32_t>::write(file, le32(SEARCH_INDEX_MAGIC)) &&
+                  StreamUtil<uint32_t>::write(file, le32(numGames)) &&
+                  StreamUtil<uint32_t>::write(file, le32((uint32_t)strings.size())) &&
+                  StreamUtil<uint32_t>::write(file, le32(generation)) &&
+                  StreamUtil<uint32_t>::write(file, le32((uint32_t)trigramKeys.size())) &&
+                  StreamUtil<uint32_t>::write(file, 0);
+
+    for (unsigned i = 0; retval && i < SearchIndex::NUM_COLUMNS; i++)
+        retval = writeValues(file, m_columns[i]);
+
+    if (retval)
+        retval = writeValues(file, stringOffsets) &&
+                 writeValues(file, trigramKeys) &&
+                 writeValues(file, postingOffsets) &&
+                 writeValues(file, postings);
+
+    for (auto it = strings.begin(); retval && it != strings.end(); ++it) {
+        file.write((*it)->data(), (*it)->size());
+        retval = !file.fail() && !file.bad();
+    }
+
+    for (auto it = folded.begin(); retval && it != folded.end(); ++it) {
+        file.write(it->data(), it->size());
+        retval = !file.fail() && !file.bad();
+    }
+
+    file.close();
+
+    if (retval) {
+        if (!Util::renameFile(tempFilename, filename)) {
+            errorMsg = Util::format("Failed to rename search index file '%s': %s", tempFilename.c_str(),
+                                    strerror(errno));
+            retval = false;
+        }
+    } else {
+        errorMsg = Util::format("Failed to write search index file '%s': %s", tempFilename.c_str(),
+                                strerror(errno));
+    }
+
+    if (retval) {
+        LOGDBG << "Wrote search index '" << filename << "' of " << numGames << " games, " << strings.size() <<
+            " strings and " << trigramKeys.size() << " trigrams";
+    } else {
+        Util::deleteFile(tempFilename);
+    }
+
+    return retval;
+}
+}   // namespace ChessCore
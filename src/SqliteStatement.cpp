@@ -211,7 +211,7 @@ unsigned SqliteStatement::columnCount() {
 }
 
 bool SqliteStatement::columnBlob(unsigned index, Blob &blob) {
-    blob.free();
+    // Blob::set() reuses the memory of the blob if it can
     return blob.set((const uint8_t *)sqlite3_column_blob(m_stmt, (int)index),
                     (unsigned)sqlite3_column_bytes(m_stmt, (int)index));
 }
@@ -10,6 +10,7 @@
 #include <ChessCore/Util.h>
 #include <sstream>
 #include <algorithm>
+#include <utility>
 
 using namespace std;
 
@@ -316,6 +317,12 @@ TimeControl::TimeControl(const TimeControl &other) :
 
 }
 
+TimeControl::TimeControl(TimeControl &&other) :
+    m_periods(std::move(other.m_periods))
+{
+    other.m_periods.clear();
+}
+
 TimeControl::TimeControl(const vector<TimeControlPeriod> &periods) :
     m_periods(periods)
 {
@@ -333,6 +340,15 @@ TimeControl &TimeControl::operator=(const TimeControl &other) {
     return *this;
 }
 
+TimeControl &TimeControl::operator=(TimeControl &&other) {
+    if (this == &other)
+        return *this;
+
+    m_periods = std::move(other.m_periods);
+    other.m_periods.clear();
+    return *this;
+}
+
 bool TimeControl::operator==(const TimeControl &other) const {
     if (m_periods.size() != other.m_periods.size())
         return false;
@@ -488,6 +504,11 @@ bool TimeControl::blob(Blob &blob) const {
         }
     }
 
+    if (!stream.flush()) {
+        LOGERR << "Failed to flush time control to blob";
+        return false;
+    }
+
     return true;
 }
 
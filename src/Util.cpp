@@ -349,6 +349,17 @@ unsigned Util::getTickCount() {
 #endif // WINDOWS
 }
 
+unsigned Util::numProcessors() {
+#ifdef WINDOWS
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (unsigned)si.dwNumberOfProcessors : 1;
+#else // !WINDOWS
+    long count = ::sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+#endif // WINDOWS
+}
+
 uint64_t Util::currentTime() {
 #ifdef WINDOWS
     SYSTEMTIME st;
@@ -720,7 +731,7 @@ bool Util::deleteFile(const string &filename) {
 
 bool Util::renameFile(const string &oldFilename, const string &newFilename) {
 #ifdef WINDOWS
-	return ::MoveFile(oldFilename.c_str(), newFilename.c_str()) == TRUE;
+	return ::MoveFileEx(oldFilename.c_str(), newFilename.c_str(), MOVEFILE_REPLACE_EXISTING) == TRUE;
 #else // !WINDOWS
     return ::rename(oldFilename.c_str(), newFilename.c_str()) == 0;
 #endif // WINDOWS
@@ -731,10 +742,10 @@ bool Util::copyFile(const std::string &srcFilename, const std::string &dstFilena
     bool retval = true;
     struct stat statbuf;
 
-    FILE *src = ::fopen(srcFilename.c_str(), "r");
+    FILE *src = ::fopen(srcFilename.c_str(), "rb");
     if (src) {
         if (::fstat(::fileno(src), &statbuf) == 0) {
-            FILE *dst = ::fopen(dstFilename.c_str(), "w+");
+            FILE *dst = ::fopen(dstFilename.c_str(), "wb+");
             if (dst) {
                 uint8_t buffer[4096];
                 int numRead;
@@ -761,7 +772,7 @@ bool Util::copyFile(const std::string &srcFilename, const std::string &dstFilena
                         retval = false;
                     }
                     totalRead += (off_t)numRead;
-                } while (retval && numRead < sizeof(buffer));
+                } while (retval && numRead == (int)sizeof(buffer));
 
                 ::fclose(dst);
 
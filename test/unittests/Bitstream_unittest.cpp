@@ -59,3 +59,50 @@ static testing::AssertionResult testBitstream() {
 TEST(BitstreamTest, test) {
     EXPECT_TRUE(testBitstream());
 }
+
+TEST(BitstreamTest, format) {
+    static const struct {
+        uint32_t value;
+        unsigned numBits;
+    } values[] = {
+        { 0x2, 2 }, { 0x1ab, 9 }, { 0xffffffff, 32 }, { 0x0, 3 }, { 0x1, 1 }, { 0x5, 4 }
+    };
+    static const uint8_t expected[] = { 0xb5, 0x7f, 0xff, 0xff, 0xff, 0xe2, 0xa0 };
+    const unsigned numValues = sizeof(values) / sizeof(values[0]);
+    Blob blob;
+    unsigned i;
+
+    // The most significant bit is written first
+    {
+        Bitstream bitstream(blob);
+
+        for (i = 0; i < numValues; i++)
+            ASSERT_TRUE(bitstream.write(values[i].value, values[i].numBits));
+
+        EXPECT_EQ(sizeof(expected), bitstream.length());
+        EXPECT_EQ(6u, bitstream.writeOffset());
+        EXPECT_EQ(4u, bitstream.writeBit());
+        ASSERT_TRUE(bitstream.flush());
+    }
+
+    ASSERT_EQ(sizeof(expected), blob.length());
+
+    for (i = 0; i < sizeof(expected); i++)
+        EXPECT_EQ(expected[i], blob.data()[i]) << "byte " << i;
+
+    // Reading stops at the end of the blob
+    const Blob &constBlob = blob;
+    Bitstream bitstream(constBlob);
+    uint32_t value;
+
+    for (i = 0; i < numValues; i++) {
+        ASSERT_TRUE(bitstream.read(value, values[i].numBits));
+        EXPECT_EQ(values[i].value & (uint32_t)((1ULL << values[i].numBits) - 1), value) << "value " << i;
+    }
+
+    EXPECT_EQ(6u, bitstream.readOffset());
+    EXPECT_EQ(4u, bitstream.readBit());
+    EXPECT_TRUE(bitstream.read(value, 5));
+    EXPECT_FALSE(bitstream.read(value, 1));
+    EXPECT_FALSE(bitstream.write(0, 1));
+}
@@ -0,0 +1,102 @@
+#include <ChessCore/Blob.h>
+#include <gtest/gtest.h>
+#include <utility>
+
+using namespace std;
+using namespace ChessCore;
+
+static void fill(uint8_t *data, unsigned length, uint8_t first) {
+    for (unsigned i = 0; i < length; i++)
+        data[i] = (uint8_t)(first + i);
+}
+
+TEST(BlobTest, smallBlobsAreInline) {
+    uint8_t data[Blob::INLINE_LENGTH + 1];
+    fill(data, sizeof(data), 1);
+
+    Blob blob;
+    EXPECT_TRUE(blob.isEmpty());
+    ASSERT_TRUE(blob.add(data, 38));
+    EXPECT_TRUE(blob.isInline());
+    EXPECT_TRUE(blob.ownsMemory());
+    EXPECT_EQ(38u, blob.length());
+    EXPECT_EQ((unsigned)Blob::INLINE_LENGTH, blob.allocatedLength());
+
+    // Growing beyond the inline buffer keeps the data
+    ASSERT_TRUE(blob.add(data + 38, sizeof(data) - 38));
+    EXPECT_FALSE(blob.isInline());
+    ASSERT_EQ(sizeof(data), blob.length());
+    EXPECT_EQ(0, memcmp(data, blob.data(), sizeof(data)));
+}
+
+TEST(BlobTest, addGrowsGeometrically) {
+    uint8_t data[3] = { 1, 2, 3 };
+    Blob blob;
+    unsigned numAllocations = 0, allocatedLength = 0;
+
+    for (unsigned i = 0; i < 10000; i++) {
+        ASSERT_TRUE(blob.add(data, sizeof(data)));
+
+        if (blob.allocatedLength() != allocatedLength) {
+            allocatedLength = blob.allocatedLength();
+            numAllocations++;
+        }
+    }
+
+    EXPECT_EQ(30000u, blob.length());
+    EXPECT_GE(blob.allocatedLength(), blob.length());
+    EXPECT_LT(numAllocations, 12u);
+    EXPECT_EQ(3, blob.data()[29999]);
+
+    // Reserving less than is allocated does nothing
+    ASSERT_TRUE(blob.reserve(10));
+    EXPECT_EQ(allocatedLength, blob.allocatedLength());
+}
+
+TEST(BlobTest, clearKeepsMemory) {
+    uint8_t data[1000];
+    fill(data, sizeof(data), 0);
+
+    Blob blob;
+    ASSERT_TRUE(blob.set(data, sizeof(data)));
+    const uint8_t *memory = blob.data();
+
+    blob.clear();
+    EXPECT_TRUE(blob.isEmpty());
+    EXPECT_EQ(sizeof(data), blob.allocatedLength());
+
+    ASSERT_TRUE(blob.set(data + 500, 500));
+    EXPECT_EQ(memory, blob.data());
+    EXPECT_EQ(500u, blob.length());
+    EXPECT_EQ(0, memcmp(data + 500, blob.data(), 500));
+
+    // External memory cannot be reused
+    Blob external(data, sizeof(data));
+    EXPECT_FALSE(external.ownsMemory());
+    external.clear();
+    EXPECT_TRUE(external.data() == 0);
+}
+
+TEST(BlobTest, moveConstructAndAssign) {
+    uint8_t data[500];
+    fill(data, sizeof(data), 7);
+
+    // Inline data is copied
+    Blob small;
+    ASSERT_TRUE(small.set(data, 20));
+    Blob movedSmall(std::move(small));
+    EXPECT_TRUE(small.isEmpty());
+    EXPECT_TRUE(movedSmall.isInline());
+    ASSERT_EQ(20u, movedSmall.length());
+    EXPECT_EQ(0, memcmp(data, movedSmall.data(), 20));
+
+    // Heap memory is taken over
+    Blob large;
+    ASSERT_TRUE(large.set(data, sizeof(data)));
+    const uint8_t *memory = large.data();
+    movedSmall = std::move(large);
+    EXPECT_TRUE(large.isEmpty());
+    EXPECT_FALSE(large.ownsMemory());
+    EXPECT_EQ(memory, movedSmall.data());
+    EXPECT_EQ(sizeof(data), movedSmall.length());
+}
@@ -0,0 +1,590 @@
+#include <ChessCore/CfdbDatabase.h>
+#include <ChessCore/PgnDatabase.h>
+#include <ChessCore/OpeningTree.h>
+#include <ChessCore/OpeningTreeBuilder.h>
+#include <ChessCore/Util.h>
+#include <gtest/gtest.h>
+#include "DatabaseTestUtil.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace ChessCore;
+
+#define ECO_FILE "../cfdb/eco.cfdb"
+#define KRAMNIK_FILE "../cfdb/Kramnik.cfdb"
+#define DEPTH 10
+
+static bool entryLess(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    if (a.gameNum() != b.gameNum())
+        return a.gameNum() < b.gameNum();
+    if (a.hashKey() != b.hashKey())
+        return a.hashKey() < b.hashKey();
+    return a.move().intValue() < b.move().intValue();
+}
+
+static bool entryEqual(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    return a.hashKey() == b.hashKey() && a.move().intValue() == b.move().intValue() &&
+           a.score() == b.score() && a.lastMove() == b.lastMove() && a.gameNum() == b.gameNum();
+}
+
+static bool readSortedOpeningTree(CfdbDatabase &db, vector<OpeningTreeEntry> &entries) {
+    if (!db.readOpeningTree(entries))
+        return false;
+
+    sort(entries.begin(), entries.end(), entryLess);
+    return true;
+}
+
+// Add the positions a game passes through in the opening tree to the set
+static void addGamePositions(const Game &game, set<uint64_t> &positions) {
+    vector<OpeningTreeEntry> entries;
+    string errorMsg;
+
+    ASSERT_TRUE(OpeningTreeBuilder::replayGame(game, 1, DEPTH, entries, errorMsg)) << errorMsg;
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        positions.insert(it->hashKey());
+        positions.insert(it->prevHashKey());
+    }
+}
+
+// Describe everything the opening tree holds about each of the positions
+static void describeOpeningTree(CfdbDatabase &db, const set<uint64_t> &positions,
+                                map<uint64_t, string> &descriptions) {
+    for (auto pos = positions.begin(); pos != positions.end(); ++pos) {
+        vector<OpeningTreeEntry> entries;
+        vector<OpeningTreeStats> stats;
+        vector<OpeningTreeEdge> children, parents;
+        unsigned count;
+        ostringstream oss;
+
+        ASSERT_TRUE(db.searchOpeningTree(*pos, false, entries)) << db.errorMsg();
+        ASSERT_TRUE(db.countInOpeningTree(*pos, count)) << db.errorMsg();
+        ASSERT_TRUE(db.searchOpeningTreeStats(*pos, 2, stats)) << db.errorMsg();
+        ASSERT_TRUE(db.searchOpeningTreeChildren(*pos, children)) << db.errorMsg();
+        ASSERT_TRUE(db.searchOpeningTreeParents(*pos, parents)) << db.errorMsg();
+
+        oss << count << ";";
+
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            oss << " " << it->dump();
+
+        for (auto it = stats.begin(); it != stats.end(); ++it) {
+            oss << "; " << it->dump();
+
+            for (auto game = it->sampleGames().begin(); game != it->sampleGames().end(); ++game)
+                oss << " " << *game;
+        }
+
+        for (auto it = children.begin(); it != children.end(); ++it)
+            oss << "; " << it->toHashKey() << " " << it->move().intValue() << " " << it->numGames();
+
+        for (auto it = parents.begin(); it != parents.end(); ++it)
+            oss << "; " << it->fromHashKey() << " " << it->move().intValue() << " " << it->numGames();
+
+        descriptions[*pos] = oss.str();
+    }
+}
+
+TEST(CfdbDatabaseTest, writeMaintainsOpeningTree) {
+    string filename = g_tempDir + PATHSEP + "cfdb_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    {
+        CfdbDatabase db(filename, false);
+        ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+        ASSERT_TRUE(db.upgradeSchema(0, 0)) << db.errorMsg();
+        EXPECT_EQ(0u, db.openingTreeDepth());
+        ASSERT_TRUE(db.buildOpeningTree(0, DEPTH, 0, 0)) << db.errorMsg();
+        ASSERT_TRUE(db.setOpeningTreeDepth(DEPTH)) << db.errorMsg();
+    }
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    EXPECT_EQ((unsigned)DEPTH, db.openingTreeDepth());
+
+    // Change the result of one game, the moves of another and add a new game
+    set<uint64_t> positions;
+    Game game;
+    ASSERT_TRUE(db.read(3, game)) << db.errorMsg();
+    game.setResult(GameHeader::BLACK_WIN);
+    ASSERT_TRUE(db.write(3, game)) << db.errorMsg();
+    addGamePositions(game, positions);
+
+    Game edited;
+    ASSERT_TRUE(db.read(4, edited)) << db.errorMsg();
+    addGamePositions(edited, positions);
+    ASSERT_TRUE(PgnDatabase::readFromString("1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 *", edited));
+    edited.setResult(GameHeader::WHITE_WIN);
+    ASSERT_TRUE(db.write(4, edited)) << db.errorMsg();
+    addGamePositions(edited, positions);
+
+    Game added;
+    ASSERT_TRUE(PgnDatabase::readFromString("1. d4 d5 2. c4 e6 3. Nc3 Nf6 *", added));
+    ASSERT_TRUE(db.write(0, added)) << db.errorMsg();
+    addGamePositions(added, positions);
+
+    // The opening tree file is still used, along with the changes made since it was built
+    vector<OpeningTreeEntry> maintained, rebuilt;
+    map<uint64_t, string> maintainedPositions, rebuiltPositions;
+    ASSERT_TRUE(readSortedOpeningTree(db, maintained)) << db.errorMsg();
+    describeOpeningTree(db, positions, maintainedPositions);
+
+    // Including by another connection
+    {
+        CfdbDatabase other(filename, true);
+        ASSERT_TRUE(other.isOpen()) << other.errorMsg();
+        map<uint64_t, string> otherPositions;
+        describeOpeningTree(other, positions, otherPositions);
+        EXPECT_TRUE(otherPositions == maintainedPositions);
+    }
+
+    ASSERT_TRUE(db.buildOpeningTree(0, DEPTH, 0, 0)) << db.errorMsg();
+    ASSERT_TRUE(readSortedOpeningTree(db, rebuilt)) << db.errorMsg();
+    describeOpeningTree(db, positions, rebuiltPositions);
+
+    ASSERT_EQ(rebuilt.size(), maintained.size());
+    EXPECT_TRUE(equal(rebuilt.begin(), rebuilt.end(), maintained.begin(), entryEqual));
+
+    for (auto it = rebuiltPositions.begin(); it != rebuiltPositions.end(); ++it)
+        EXPECT_EQ(it->second, maintainedPositions[it->first]);
+
+    unsigned count;
+    ASSERT_TRUE(db.countInOpeningTree(rebuilt.back().hashKey(), count));
+    EXPECT_LT(0u, count);
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".optree");
+}
+
+// Before schema version 3 the opening tree file is deleted when the tree changes
+TEST(CfdbDatabaseTest, writeOldSchemaOpeningTree) {
+    string filename = g_tempDir + PATHSEP + "cfdb_oldtree_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    ASSERT_EQ(1u, db.schemaVersion());
+    ASSERT_TRUE(db.buildOpeningTree(0, DEPTH, 0, 0)) << db.errorMsg();
+    ASSERT_TRUE(db.setOpeningTreeDepth(DEPTH)) << db.errorMsg();
+    EXPECT_TRUE(Util::fileExists(filename + ".optree"));
+
+    Game game;
+    ASSERT_TRUE(db.read(3, game)) << db.errorMsg();
+    game.setResult(GameHeader::BLACK_WIN);
+    ASSERT_TRUE(db.write(3, game)) << db.errorMsg();
+    EXPECT_FALSE(Util::fileExists(filename + ".optree"));
+
+    vector<OpeningTreeEntry> maintained, rebuilt;
+    ASSERT_TRUE(readSortedOpeningTree(db, maintained)) << db.errorMsg();
+    ASSERT_TRUE(db.buildOpeningTree(0, DEPTH, 0, 0)) << db.errorMsg();
+    ASSERT_TRUE(readSortedOpeningTree(db, rebuilt)) << db.errorMsg();
+    ASSERT_EQ(rebuilt.size(), maintained.size());
+    EXPECT_TRUE(equal(rebuilt.begin(), rebuilt.end(), maintained.begin(), entryEqual));
+    EXPECT_EQ(1u, db.schemaVersion());
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".optree");
+}
+
+static bool searchCallback(unsigned gameNum, float percentComplete, void *contextInfo) {
+    static_cast<DatabaseGameList *>(contextInfo)->push_back(gameNum);
+    return true;
+}
+
+static bool searchBoth(CfdbDatabase &db, const DatabaseSearchCriteria &searchCriteria,
+                       const DatabaseSortCriteria &sortCriteria, DatabaseGameList &indexList,
+                       DatabaseGameList &tableList) {
+    indexList.clear();
+    tableList.clear();
+    db.setUseSearchIndex(true);
+
+    if (!db.search(searchCriteria, sortCriteria, searchCallback, &indexList))
+        return false;
+
+    db.setUseSearchIndex(false);
+    bool retval = db.search(searchCriteria, sortCriteria, searchCallback, &tableList);
+    db.setUseSearchIndex(true);
+    return retval;
+}
+
+TEST(CfdbDatabaseTest, searchUsingSearchIndex) {
+    string filename = g_tempDir + PATHSEP + "cfdb_search_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    EXPECT_TRUE(db.useSearchIndex());
+
+    DatabaseComparison insensitive = DATABASE_COMPARE_CASE_INSENSITIVE;
+    static const DatabaseSearchDescriptor searches[] = {
+        { DATABASE_FIELD_WHITEPLAYER, databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive), "gambit" },
+        { DATABASE_FIELD_WHITEPLAYER, databaseComparison(DATABASE_COMPARE_STARTSWITH, insensitive), "sicilian" },
+        { DATABASE_FIELD_BLACKPLAYER, DATABASE_COMPARE_EQUALS, "Tuebingen Variation" },
+        { DATABASE_FIELD_ECO, databaseComparison(DATABASE_COMPARE_STARTSWITH, insensitive), "b2" },
+        { DATABASE_FIELD_BLACKPLAYER, databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive), "ar" },
+        { DATABASE_FIELD_WHITEPLAYER, DATABASE_COMPARE_CONTAINS, "Gambit" },
+        { DATABASE_FIELD_PLAYER, DATABASE_COMPARE_STARTSWITH, "Sicilian" },
+        { DATABASE_FIELD_WHITEPLAYER, databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive), "xqz" },
+        { DATABASE_FIELD_WHITEPLAYER, DATABASE_COMPARE_CONTAINS, "GAMBIT" }
+    };
+
+    DatabaseSearchCriteria searchCriteria;
+    DatabaseSortCriteria sortCriteria;
+    DatabaseGameList indexList, tableList;
+
+    // The search index gives the same games as querying the tables, whether or not case
+    // is ignored
+    for (unsigned i = 0; i < sizeof(searches) / sizeof(searches[0]); i++) {
+        searchCriteria.assign(1, searches[i]);
+        ASSERT_TRUE(searchBoth(db, searchCriteria, sortCriteria, indexList, tableList)) << db.errorMsg();
+        EXPECT_EQ(tableList, indexList) << "search " << i;
+        EXPECT_EQ(i >= 7, indexList.empty()) << "search " << i;
+    }
+
+    EXPECT_TRUE(Util::fileExists(filename + ".search"));
+
+    // Two criteria, sorted by ECO and then game number, from the third match
+    searchCriteria.assign(searches + 3, searches + 5);
+    DatabaseSortDescriptor sort = { DATABASE_FIELD_ECO, DATABASE_ORDER_DESCENDING };
+    sortCriteria.push_back(sort);
+    sort.field = DATABASE_FIELD_GAME_NUM;
+    sort.order = DATABASE_ORDER_ASCENDING;
+    sortCriteria.push_back(sort);
+    ASSERT_TRUE(searchBoth(db, searchCriteria, sortCriteria, indexList, tableList)) << db.errorMsg();
+    EXPECT_EQ(tableList, indexList);
+    ASSERT_LT(3u, indexList.size());
+
+    DatabaseGameList pageList;
+    ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &pageList, 3, 2)) << db.errorMsg();
+    ASSERT_EQ(2u, pageList.size());
+    EXPECT_EQ(indexList[2], pageList[0]);
+    EXPECT_EQ(indexList[3], pageList[1]);
+
+    // Case-sensitive matching is exact
+    GameHeader gameHeader;
+    DatabaseGameList expected;
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= db.lastGameNum(); gameNum++) {
+        ASSERT_TRUE(db.readHeader(gameNum, gameHeader)) << db.errorMsg();
+
+        if (gameHeader.white().lastName().find("Gambit") != string::npos)
+            expected.push_back(gameNum);
+    }
+
+    DatabaseSearchDescriptor search = { DATABASE_FIELD_WHITEPLAYER, DATABASE_COMPARE_CONTAINS, "Gambit" };
+    searchCriteria.assign(1, search);
+    sortCriteria.clear();
+    indexList.clear();
+    ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &indexList)) << db.errorMsg();
+    EXPECT_EQ(expected, indexList);
+
+    // The search index is rebuilt after a write, even within the same second
+    Game game;
+    ASSERT_TRUE(db.read(5, game)) << db.errorMsg();
+    game.white().setLastName("Zyzzyva Attack");
+    ASSERT_TRUE(db.write(5, game)) << db.errorMsg();
+
+    search.comparison = databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive);
+    search.value = "zyzzyva";
+    searchCriteria.assign(1, search);
+    indexList.clear();
+    ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &indexList)) << db.errorMsg();
+    ASSERT_EQ(1u, indexList.size());
+    EXPECT_EQ(5u, indexList[0]);
+
+    // Unused game numbers are never found
+    unsigned numGames = db.numGames();
+    ASSERT_TRUE(db.write(numGames + 100, game)) << db.errorMsg();
+    searchCriteria.clear();
+    indexList.clear();
+    ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &indexList)) << db.errorMsg();
+    ASSERT_EQ(numGames + 1, indexList.size());
+    EXPECT_EQ(numGames + 100, indexList.back());
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".search");
+}
+
+TEST(CfdbDatabaseTest, searchUsingNameIndexes) {
+    string filename = g_tempDir + PATHSEP + "cfdb_names_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    EXPECT_FALSE(db.hasNameIndexes());
+    EXPECT_TRUE(db.useSearchIndex());
+
+    DatabaseComparison insensitive = DATABASE_COMPARE_CASE_INSENSITIVE;
+    static const DatabaseSearchDescriptor searches[] = {
+        { DATABASE_FIELD_WHITEPLAYER, databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive), "gambit" },
+        { DATABASE_FIELD_BLACKPLAYER, databaseComparison(DATABASE_COMPARE_STARTSWITH, insensitive), "tueb" },
+        { DATABASE_FIELD_BLACKPLAYER, DATABASE_COMPARE_CONTAINS, "ar" },
+        { DATABASE_FIELD_WHITEPLAYER, DATABASE_COMPARE_EQUALS, "Sicilian" }
+    };
+    const unsigned numSearches = sizeof(searches) / sizeof(searches[0]);
+
+    DatabaseSearchCriteria searchCriteria;
+    DatabaseSortCriteria sortCriteria;
+    DatabaseGameList tableLists[numSearches], indexList;
+
+    for (unsigned i = 0; i < numSearches; i++) {
+        searchCriteria.assign(1, searches[i]);
+        ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &tableLists[i])) << db.errorMsg();
+        EXPECT_FALSE(tableLists[i].empty()) << "search " << i;
+    }
+
+    // The name indexes give the same games, without the search index
+    ASSERT_TRUE(db.buildNameIndexes()) << db.errorMsg();
+    EXPECT_TRUE(db.hasNameIndexes());
+
+    for (unsigned i = 0; i < numSearches; i++) {
+        searchCriteria.assign(1, searches[i]);
+        indexList.clear();
+        ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &indexList)) << db.errorMsg();
+        EXPECT_EQ(tableLists[i], indexList) << "search " << i;
+    }
+
+    // New names are added to the name indexes, which search() uses instead of the
+    // search index
+    Util::deleteFile(filename + ".search");
+    Game game;
+    ASSERT_TRUE(db.read(5, game)) << db.errorMsg();
+    game.white().setLastName("Zyzzyva Attack");
+    game.setEvent("Hastings Congress");
+    ASSERT_TRUE(db.write(5, game)) << db.errorMsg();
+
+    DatabaseSearchDescriptor search = {
+        DATABASE_FIELD_PLAYER, databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive), "zzyv"
+    };
+    searchCriteria.assign(1, search);
+    search.field = DATABASE_FIELD_EVENT;
+    search.comparison = DATABASE_COMPARE_STARTSWITH;
+    search.value = "Hast";
+    searchCriteria.push_back(search);
+    indexList.clear();
+    ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &indexList)) << db.errorMsg();
+    ASSERT_EQ(1u, indexList.size());
+    EXPECT_EQ(5u, indexList[0]);
+    EXPECT_FALSE(Util::fileExists(filename + ".search"));
+
+    // The name indexes are found when the database is opened
+    db.close();
+    ASSERT_TRUE(db.open(filename, false)) << db.errorMsg();
+    EXPECT_TRUE(db.hasNameIndexes());
+
+    // A name changed without updating the indexes, as a version of sqlite without them
+    // would, leaves them out-of-date; they are ignored when reading and rebuilt when
+    // writing
+    db.close();
+    sqlite3 *sqlite;
+    ASSERT_EQ(SQLITE_OK, sqlite3_open(filename.c_str(), &sqlite));
+    EXPECT_EQ(SQLITE_OK, sqlite3_exec(sqlite,
+                                      "UPDATE player SET last_name = 'Quuxbar Gambit' WHERE player_id = "
+                                      "(SELECT white_player_id FROM game WHERE game_id = 7);"
+                                      "UPDATE metadata SET val = val + 1 WHERE name = 'header_generation'",
+                                      0, 0, 0));
+    sqlite3_close(sqlite);
+
+    search.field = DATABASE_FIELD_WHITEPLAYER;
+    search.comparison = databaseComparison(DATABASE_COMPARE_CONTAINS, insensitive);
+    search.value = "quuxbar";
+    searchCriteria.assign(1, search);
+
+    ASSERT_TRUE(db.open(filename, true)) << db.errorMsg();
+    EXPECT_FALSE(db.hasNameIndexes());
+    db.close();
+
+    ASSERT_TRUE(db.open(filename, false)) << db.errorMsg();
+    EXPECT_TRUE(db.hasNameIndexes());
+    indexList.clear();
+    ASSERT_TRUE(db.search(searchCriteria, sortCriteria, searchCallback, &indexList)) << db.errorMsg();
+    ASSERT_FALSE(indexList.empty());
+    EXPECT_EQ(7u, indexList[0]);
+
+    ASSERT_TRUE(db.dropNameIndexes()) << db.errorMsg();
+    EXPECT_FALSE(db.hasNameIndexes());
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".search");
+}
+
+TEST(CfdbDatabaseTest, writeAndReadMoves) {
+    string filename = g_tempDir + PATHSEP + "cfdb_moves_unittest.cfdb";
+    Util::deleteFile(filename);
+
+    // En-passant, castling, under-promotion, variations, annotations and mate
+    static const char *pgns[] = {
+        "1. e4 Nf6 2. e5 d5 3. exd6 $1 {en passant} cxd6 4. Nf3 g6 5. Bc4 Bg7 6. O-O O-O 7. d4 Nc6 "
+        "8. Nc3 Bg4 9. Be3 Qd7 10. Qd2 Rac8 (10... Bxf3 11. gxf3 Qh3 (11... Qh3 $2)) 11. Rfe1 *",
+        "[FEN \"r3k3/1P6/8/8/8/8/6p1/R3K2R w KQq - 0 1\"]\n\n"
+        "1. O-O-O gxh1=Q 2. Rxh1 Kf7 3. bxa8=N (3. b8=Q Rxb8) 3... Ke6 *",
+        "1. f3 e5 2. g4 Qh4# *"
+    };
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    EXPECT_EQ(CfdbDatabase::currentSchemaVersion(), db.schemaVersion());
+
+    for (unsigned i = 0; i < sizeof(pgns) / sizeof(pgns[0]); i++) {
+        Game game, readGame;
+        string expected, actual;
+        ASSERT_TRUE(PgnDatabase::readFromString(pgns[i], game)) << "game " << i;
+        ASSERT_TRUE(PgnDatabase::writeToString(game, expected));
+        ASSERT_TRUE(db.write(0, game)) << db.errorMsg();
+        ASSERT_TRUE(db.read(db.lastGameNum(), readGame)) << db.errorMsg();
+        ASSERT_TRUE(PgnDatabase::writeToString(readGame, actual));
+        EXPECT_EQ(expected, actual) << "game " << i;
+    }
+
+    db.close();
+    Util::deleteFile(filename);
+}
+
+TEST(CfdbDatabaseTest, readPartialGames) {
+    string filename = g_tempDir + PATHSEP + "cfdb_partial_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(KRAMNIK_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    ASSERT_EQ(1u, db.schemaVersion());
+    expectPartialReadsMatch(db);
+
+    // Schema version 2 needs the position to skip a promotion in a variation
+    Game game;
+    ASSERT_TRUE(PgnDatabase::readFromString(PROMOTION_GAME, game));
+    ASSERT_TRUE(db.upgradeSchema(0, 0)) << db.errorMsg();
+    ASSERT_TRUE(db.write(0, game)) << db.errorMsg();
+    expectPartialReadsMatch(db);
+
+    db.close();
+    Util::deleteFile(filename);
+}
+
+TEST(CfdbDatabaseTest, readCompactGames) {
+    string filename = g_tempDir + PATHSEP + "cfdb_compact_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(KRAMNIK_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    ASSERT_EQ(1u, db.schemaVersion());
+    expectCompactReadsMatch(db);
+
+    Game game;
+    ASSERT_TRUE(PgnDatabase::readFromString(PROMOTION_GAME, game));
+    ASSERT_TRUE(db.upgradeSchema(0, 0)) << db.errorMsg();
+    ASSERT_TRUE(db.write(0, game)) << db.errorMsg();
+    expectCompactReadsMatch(db);
+
+    db.close();
+    Util::deleteFile(filename);
+}
+
+TEST(CfdbDatabaseTest, readSharedFromThreads) {
+    string filename = g_tempDir + PATHSEP + "cfdb_shared_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(KRAMNIK_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    expectSharedReadsMatch(db);
+
+    db.close();
+    Util::deleteFile(filename);
+}
+
+// Finish reading after a while, unlocking the database for writing
+static void finishReading(sqlite3_stmt *stmt) {
+    this_thread::sleep_for(chrono::milliseconds(200));
+    sqlite3_finalize(stmt);
+}
+
+TEST(CfdbDatabaseTest, writeWhileReading) {
+    string filename = g_tempDir + PATHSEP + "cfdb_busy_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(KRAMNIK_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    unsigned numGames = db.numGames();
+    Game game;
+    ASSERT_TRUE(db.read(db.firstGameNum(), game)) << db.errorMsg();
+
+    // Another connection part-way through reading the games
+    sqlite3 *sqlite;
+    sqlite3_stmt *stmt;
+    ASSERT_EQ(SQLITE_OK, sqlite3_open(filename.c_str(), &sqlite));
+    ASSERT_EQ(SQLITE_OK, sqlite3_prepare_v2(sqlite, "SELECT game_id FROM game", -1, &stmt, 0));
+    ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+    thread reading(finishReading, stmt);
+
+    EXPECT_TRUE(db.write(0, game)) << db.errorMsg();
+    reading.join();
+    sqlite3_close(sqlite);
+
+    CfdbDatabase other(filename, true);
+    ASSERT_TRUE(other.isOpen()) << other.errorMsg();
+    EXPECT_EQ(numGames + 1, other.numGames());
+    other.close();
+
+    db.close();
+    Util::deleteFile(filename);
+}
+
+static string fileContents(const string &filename) {
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+    ostringstream oss;
+    oss << file.rdbuf();
+    return oss.str();
+}
+
+TEST(CfdbDatabaseTest, upgradeSchema) {
+    string filename = g_tempDir + PATHSEP + "cfdb_upgrade_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    // Opening the database for writing leaves it unchanged until it is upgraded
+    string original = fileContents(filename);
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    ASSERT_EQ(1u, db.schemaVersion());
+    db.close();
+    EXPECT_TRUE(fileContents(filename) == original);
+
+    ASSERT_TRUE(db.open(filename, false)) << db.errorMsg();
+
+    vector<string> expected;
+    unsigned lastGameNum = db.lastGameNum();
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= lastGameNum; gameNum++) {
+        Game game;
+        string pgn;
+        ASSERT_TRUE(db.read(gameNum, game)) << db.errorMsg();
+        ASSERT_TRUE(PgnDatabase::writeToString(game, pgn));
+        expected.push_back(pgn);
+    }
+
+    ASSERT_TRUE(db.upgradeSchema(0, 0)) << db.errorMsg();
+    EXPECT_EQ(CfdbDatabase::currentSchemaVersion(), db.schemaVersion());
+
+    db.close();
+    ASSERT_TRUE(db.open(filename, true)) << db.errorMsg();
+    EXPECT_EQ(CfdbDatabase::currentSchemaVersion(), db.schemaVersion());
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= lastGameNum; gameNum++) {
+        Game game;
+        string pgn;
+        ASSERT_TRUE(db.read(gameNum, game)) << db.errorMsg();
+        ASSERT_TRUE(PgnDatabase::writeToString(game, pgn));
+        EXPECT_EQ(expected[gameNum - db.firstGameNum()], pgn) << "game " << gameNum;
+    }
+
+    db.close();
+    Util::deleteFile(filename);
+}
@@ -0,0 +1,131 @@
+//
+// Checks shared by the tests of the Database implementations.
+//
+
+#pragma once
+
+#include <ChessCore/CompactGame.h>
+#include <ChessCore/Database.h>
+#include <ChessCore/PgnDatabase.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Castling, promotion and under-promotion, in the mainline and in variations
+#define PROMOTION_GAME \
+    "[FEN \"r3k3/1P6/8/8/8/8/6p1/R3K2R w KQq - 0 1\"]\n\n" \
+    "1. O-O-O {castles} gxh1=Q (1... g1=N {knight} 2. b8=Q+ $1 (2. Rhxg1 Kf7) 2... Ke7) 2. Rxh1 Kf7 " \
+    "3. bxa8=N (3. b8=Q Rxb8 4. Rh7+) 3... Ke6 *"
+
+// Compare reading parts of each game with reading the whole game and removing the
+// parts that are not wanted, which is what Database::read() does
+inline void expectPartialReadsMatch(ChessCore::Database &db) {
+    static const unsigned maxPlies[] = { 0, 1, 6, 21 };
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= db.lastGameNum(); gameNum++) {
+        for (unsigned flags = 0; flags < 4; flags++) {
+            for (unsigned i = 0; i < sizeof(maxPlies) / sizeof(maxPlies[0]); i++) {
+                ChessCore::DatabaseReadOptions options;
+                options.mainlineOnly = (flags & 1) != 0;
+                options.skipAnnotations = (flags & 2) != 0;
+                options.maxPlies = maxPlies[i];
+
+                ChessCore::Game expectedGame, actualGame;
+                std::string expected, actual;
+                ASSERT_TRUE(db.Database::read(gameNum, expectedGame, options)) << db.errorMsg();
+                ASSERT_TRUE(db.read(gameNum, actualGame, options)) << db.errorMsg();
+                ASSERT_TRUE(ChessCore::PgnDatabase::writeToString(expectedGame, expected));
+                ASSERT_TRUE(ChessCore::PgnDatabase::writeToString(actualGame, actual));
+                EXPECT_EQ(expected, actual) << "game " << gameNum << ", flags " << flags <<
+                    ", maxPlies " << maxPlies[i];
+            }
+        }
+    }
+}
+
+// Compare reading each game directly into a CompactGame with reading it into a Game
+// and converting it, which is what Database::read() does
+inline void expectCompactReadsMatch(ChessCore::Database &db) {
+    static const unsigned maxPlies[] = { 0, 1, 6, 21 };
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= db.lastGameNum(); gameNum++) {
+        for (unsigned mainlineOnly = 0; mainlineOnly < 2; mainlineOnly++) {
+            for (unsigned i = 0; i < sizeof(maxPlies) / sizeof(maxPlies[0]); i++) {
+                ChessCore::DatabaseReadOptions options;
+                options.mainlineOnly = mainlineOnly != 0;
+                options.skipAnnotations = true;
+                options.maxPlies = maxPlies[i];
+
+                ChessCore::CompactGame expected, actual;
+                ASSERT_TRUE(db.Database::read(gameNum, expected, options)) << db.errorMsg();
+                ASSERT_TRUE(db.read(gameNum, actual, options)) << db.errorMsg();
+                ASSERT_EQ(expected.numMoves(), actual.numMoves()) << "game " << gameNum;
+                EXPECT_EQ(expected.mainlineLength(), actual.mainlineLength()) << "game " << gameNum;
+
+                for (unsigned index = 0; index < actual.numMoves(); index++) {
+                    EXPECT_EQ(expected.moves()[index].intValue(), actual.moves()[index].intValue());
+                    EXPECT_EQ(expected.posHashes()[index], actual.posHashes()[index]);
+                    EXPECT_EQ(expected.parent(index), actual.parent(index));
+                }
+
+                // Converting back to a Game gives the game without its annotations
+                ChessCore::Game expectedGame, actualGame;
+                std::string expectedPgn, actualPgn;
+                ASSERT_TRUE(db.Database::read(gameNum, expectedGame, options)) << db.errorMsg();
+                ASSERT_TRUE(actual.toGame(actualGame));
+                ASSERT_TRUE(ChessCore::PgnDatabase::writeToString(expectedGame, expectedPgn));
+                ASSERT_TRUE(ChessCore::PgnDatabase::writeToString(actualGame, actualPgn));
+                EXPECT_EQ(expectedPgn, actualPgn) << "game " << gameNum << ", mainlineOnly " <<
+                    mainlineOnly << ", maxPlies " << maxPlies[i];
+            }
+        }
+    }
+}
+
+// Read every game with readShared(), starting at a different game in each thread
+inline void readGamesShared(ChessCore::Database *db, unsigned firstGameNum, unsigned start,
+                            std::vector<std::string> *pgns) {
+    unsigned numGames = (unsigned)pgns->size();
+
+    for (unsigned i = 0; i < numGames; i++) {
+        unsigned index = (start + i) % numGames;
+        ChessCore::Game game;
+        std::string errorMsg;
+
+        if (db->readShared(firstGameNum + index, game, ChessCore::DatabaseReadOptions(), errorMsg))
+            ChessCore::PgnDatabase::writeToString(game, (*pgns)[index]);
+        else
+            (*pgns)[index] = errorMsg;
+    }
+}
+
+// Compare reading the games with readShared() from several threads at once with
+// reading them with read()
+inline void expectSharedReadsMatch(ChessCore::Database &db) {
+    static const unsigned NUM_THREADS = 4;
+    unsigned firstGameNum = db.firstGameNum();
+    unsigned numGames = db.numGames();
+    ASSERT_LT(0u, numGames);
+
+    std::vector<std::string> expected(numGames);
+
+    for (unsigned i = 0; i < numGames; i++) {
+        ChessCore::Game game;
+        ASSERT_TRUE(db.read(firstGameNum + i, game)) << db.errorMsg();
+        ASSERT_TRUE(ChessCore::PgnDatabase::writeToString(game, expected[i]));
+    }
+
+    std::vector<std::vector<std::string> > actual(NUM_THREADS, std::vector<std::string>(numGames));
+    std::vector<std::thread> threads;
+
+    for (unsigned t = 0; t < NUM_THREADS; t++)
+        threads.push_back(std::thread(readGamesShared, &db, firstGameNum, t * numGames / NUM_THREADS, &actual[t]));
+
+    for (unsigned t = 0; t < NUM_THREADS; t++)
+        threads[t].join();
+
+    for (unsigned t = 0; t < NUM_THREADS; t++)
+        for (unsigned i = 0; i < numGames; i++)
+            EXPECT_EQ(expected[i], actual[t][i]) << "thread " << t << ", game " << (firstGameNum + i);
+}
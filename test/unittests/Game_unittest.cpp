@@ -45,3 +45,122 @@ TEST(GameTest, parseGame) {
               movesStr);
 }
 
+
+TEST(GameTest, threefoldRepetition) {
+    // The third occurrence of the position after 1.Nf3 is in a variation
+    static const char *moves[] = {
+        "Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8", "e4",
+        "(", "Nf3", ")", 0
+    };
+    Game game;
+    Game::GameOver gameOver = Game::GAMEOVER_NOT;
+
+    for (unsigned i = 0; moves[i]; i++) {
+        string movetext = moves[i];
+
+        if (movetext == "(") {
+            EXPECT_TRUE(game.startVariation());
+        } else if (movetext == ")") {
+            EXPECT_TRUE(game.endVariation());
+        } else {
+            ASSERT_TRUE(game.makeMove(movetext, 0, 0, false, &gameOver, 0) != 0) << movetext;
+
+            if (moves[i + 1] && strcmp(moves[i + 1], ")") == 0) {
+                EXPECT_EQ(Game::GAMEOVER_3FOLDREP, gameOver);
+
+                // Only the plies within the halfmove clock are searched
+                const AnnotMove *amove = game.currentMove();
+                EXPECT_EQ(9u, game.position().hmclock());
+                EXPECT_EQ(3u, AnnotMove::countRepeatedPositions(amove, game.position().hmclock()));
+                EXPECT_EQ(2u, AnnotMove::countRepeatedPositions(amove, 7));
+            } else {
+                EXPECT_EQ(Game::GAMEOVER_NOT, gameOver) << movetext;
+            }
+        }
+    }
+}
+
+TEST(GameTest, movesAreAllocatedFromPool) {
+    static const char *moves[] = { "e4", "e5", "Nf3", "Nc6", "Bb5", "a6", 0 };
+    Game game;
+    const AnnotMove *firstMove = 0;
+
+    for (unsigned pass = 0; pass < 2; pass++) {
+        game.init();
+
+        for (unsigned i = 0; moves[i]; i++)
+            ASSERT_TRUE(game.makeMove(moves[i]) != 0) << moves[i];
+
+        // The memory of the moves deleted by init() is reused
+        if (pass == 0)
+            firstMove = game.mainline();
+        else
+            EXPECT_EQ(firstMove, game.mainline());
+    }
+
+    // Moves unlinked from a game can outlive it
+    Game *copy = new Game(game);
+    AnnotMove *unlinked = copy->mainline()->next()->next();
+    copy->removeMove(unlinked, true);
+    delete copy;
+    EXPECT_EQ(F3, unlinked->to());
+    AnnotMove::deepDelete(unlinked);
+
+    // Blocks of nodes are allocated as needed and kept
+    AnnotMovePool *pool = new AnnotMovePool;
+    vector<AnnotMove *> amoves;
+
+    for (unsigned i = 0; i < AnnotMovePool::NODES_PER_BLOCK + 1; i++)
+        amoves.push_back(new (pool) AnnotMove(Move()));
+
+    EXPECT_EQ((unsigned)AnnotMovePool::NODES_PER_BLOCK + 1, pool->numAllocated());
+    EXPECT_EQ((unsigned)AnnotMovePool::NODES_PER_BLOCK * 2, pool->capacity());
+
+    for (auto it = amoves.begin(); it != amoves.end(); ++it)
+        delete *it;
+
+    EXPECT_EQ(0u, pool->numAllocated());
+    EXPECT_EQ((unsigned)AnnotMovePool::NODES_PER_BLOCK * 2, pool->capacity());
+    pool->release();
+}
+
+TEST(GameTest, moveTransfersMoves) {
+    static const char *moves[] = { "e4", "e5", "Nf3", "Nc6", "Bb5", "a6", 0 };
+    Game game;
+    game.white().setLastName("White");
+
+    for (unsigned i = 0; moves[i]; i++)
+        ASSERT_TRUE(game.makeMove(moves[i]) != 0) << moves[i];
+
+    string expected;
+    game.get(expected);
+    const AnnotMove *mainline = game.mainline();
+
+    // The moves are taken, not copied, and the other game is left empty
+    Game moved(std::move(game));
+    EXPECT_EQ(mainline, moved.mainline());
+    EXPECT_EQ("White", moved.white().lastName());
+    EXPECT_EQ(nullptr, game.mainline());
+    EXPECT_EQ("", game.white().lastName());
+    ASSERT_TRUE(game.makeMove("d4") != 0);
+
+    string actual;
+    moved.get(actual);
+    EXPECT_EQ(expected, actual);
+
+    Game assigned;
+    assigned = std::move(moved);
+    EXPECT_EQ(mainline, assigned.mainline());
+    EXPECT_EQ(nullptr, moved.mainline());
+
+    // Assigning over a game with moves deletes them
+    assigned = std::move(game);
+    EXPECT_EQ(D4, assigned.mainline()->to());
+    EXPECT_EQ(nullptr, game.mainline());
+
+    // Copying still copies the moves
+    Game copy;
+    copy = assigned;
+    EXPECT_NE(assigned.mainline(), copy.mainline());
+    EXPECT_EQ(D4, copy.mainline()->to());
+}
@@ -0,0 +1,117 @@
+#include <ChessCore/OpeningTreeBuilder.h>
+#include <ChessCore/CfdbDatabase.h>
+#include <ChessCore/Util.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+
+using namespace std;
+using namespace ChessCore;
+
+#define ECO_FILE "../cfdb/eco.cfdb"
+#define DEPTH 8
+
+static bool entryLess(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    if (a.hashKey() != b.hashKey())
+        return a.hashKey() < b.hashKey();
+    if (a.gameNum() != b.gameNum())
+        return a.gameNum() < b.gameNum();
+    return a.move().intValue() < b.move().intValue();
+}
+
+static bool entryEqual(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    return a.hashKey() == b.hashKey() && a.move().intValue() == b.move().intValue() &&
+           a.score() == b.score() && a.lastMove() == b.lastMove() && a.gameNum() == b.gameNum();
+}
+
+static bool readAll(OpeningTreeBuilder &builder, vector<OpeningTreeEntry> &entries) {
+    OpeningTreeEntry entry;
+    bool done = false;
+
+    while (builder.next(entry, done) && !done)
+        entries.push_back(entry);
+
+    return done;
+}
+
+TEST(OpeningTreeBuilderTest, mergesRunsInOrder) {
+    CfdbDatabase db(ECO_FILE, true);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+
+    // Small runs from several threads
+    OpeningTreeBuilder builder;
+    vector<OpeningTreeEntry> entries;
+    builder.setMaxMemory(3 * 16384 * sizeof(OpeningTreeBuilder::Tuple));
+    ASSERT_TRUE(builder.build(ECO_FILE, db.firstGameNum(), db.lastGameNum(), 30, 3, 0, 0)) << builder.errorMsg();
+    ASSERT_TRUE(readAll(builder, entries)) << builder.errorMsg();
+    EXPECT_EQ(builder.numEntries(), entries.size());
+    EXPECT_TRUE(is_sorted(entries.begin(), entries.end(), entryLess));
+
+    // A single run from one thread
+    OpeningTreeBuilder builder1;
+    vector<OpeningTreeEntry> entries1;
+    ASSERT_TRUE(builder1.build(ECO_FILE, db.firstGameNum(), db.lastGameNum(), 30, 1, 0, 0)) << builder1.errorMsg();
+    ASSERT_TRUE(readAll(builder1, entries1)) << builder1.errorMsg();
+    ASSERT_EQ(entries1.size(), entries.size());
+    EXPECT_TRUE(equal(entries.begin(), entries.end(), entries1.begin(), entryEqual));
+}
+
+TEST(OpeningTreeBuilderTest, wholeTreeMatchesPerGameTree) {
+    string filename = g_tempDir + PATHSEP + "optree_builder_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+
+    vector<OpeningTreeEntry> wholeEntries, gameEntries;
+    ASSERT_TRUE(db.buildOpeningTree(0, DEPTH, 0, 0)) << db.errorMsg();
+    ASSERT_TRUE(db.readOpeningTree(wholeEntries)) << db.errorMsg();
+    ASSERT_FALSE(wholeEntries.empty());
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= db.lastGameNum(); gameNum++)
+        ASSERT_TRUE(db.buildOpeningTree(gameNum, DEPTH, 0, 0)) << db.errorMsg();
+
+    ASSERT_TRUE(db.readOpeningTree(gameEntries)) << db.errorMsg();
+    ASSERT_EQ(gameEntries.size(), wholeEntries.size());
+
+    // The whole tree is loaded in position order and the per-game tree in game order
+    sort(wholeEntries.begin(), wholeEntries.end(), entryLess);
+    sort(gameEntries.begin(), gameEntries.end(), entryLess);
+    EXPECT_TRUE(equal(wholeEntries.begin(), wholeEntries.end(), gameEntries.begin(), entryEqual));
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".optree");
+}
+
+static bool cancelCallback(unsigned gameNum, float percentComplete, void *contextInfo) {
+    return false;
+}
+
+TEST(OpeningTreeBuilderTest, cancelledBuildKeepsTree) {
+    string filename = g_tempDir + PATHSEP + "optree_cancel_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+
+    vector<OpeningTreeEntry> entries, cancelledEntries;
+    ASSERT_TRUE(db.buildOpeningTree(0, DEPTH, 0, 0)) << db.errorMsg();
+    ASSERT_TRUE(db.readOpeningTree(entries)) << db.errorMsg();
+    ASSERT_FALSE(entries.empty());
+
+    EXPECT_FALSE(db.buildOpeningTree(0, DEPTH + 2, cancelCallback, 0));
+    ASSERT_TRUE(db.readOpeningTree(cancelledEntries)) << db.errorMsg();
+    ASSERT_EQ(entries.size(), cancelledEntries.size());
+    EXPECT_TRUE(equal(entries.begin(), entries.end(), cancelledEntries.begin(), entryEqual));
+
+    // The opening tree file is still used
+    Position pos;
+    vector<OpeningTreeEdge> edges;
+    pos.setStarting();
+    EXPECT_TRUE(db.searchOpeningTreeChildren(pos.hashKey(), edges)) << db.errorMsg();
+    EXPECT_FALSE(edges.empty());
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".optree");
+}
@@ -0,0 +1,177 @@
+#include <ChessCore/OpeningTreeCache.h>
+#include <ChessCore/CfdbDatabase.h>
+#include <ChessCore/OpeningTreeBuilder.h>
+#include <ChessCore/Util.h>
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace ChessCore;
+
+#define ECO_FILE "../cfdb/eco.cfdb"
+
+static void makeEntries(uint64_t hashKey, unsigned count, vector<OpeningTreeEntry> &entries) {
+    entries.clear();
+
+    for (unsigned i = 0; i < count; i++)
+        entries.push_back(OpeningTreeEntry(hashKey, 0ULL, Move(), 0, (i & 1) != 0, i + 1));
+}
+
+TEST(OpeningTreeCacheTest, evictsLeastRecentlyUsed) {
+    OpeningTreeCache cache(20);
+    vector<OpeningTreeEntry> entries, found;
+    unsigned count;
+
+    // Each position costs one plus its entries
+    makeEntries(1, 4, entries);
+    cache.addEntries(1, entries);
+    makeEntries(2, 4, entries);
+    cache.addEntries(2, entries);
+    cache.addCount(3, 7);
+    EXPECT_EQ(3u, cache.numPositions());
+    EXPECT_EQ(11u, cache.numEntries());
+
+    ASSERT_TRUE(cache.findEntries(1, true, found));
+    EXPECT_EQ(2u, found.size());
+    EXPECT_TRUE(cache.findCount(2, count));
+    EXPECT_EQ(4u, count);
+    EXPECT_TRUE(cache.findCount(3, count));
+    EXPECT_EQ(7u, count);
+    EXPECT_FALSE(cache.findEntries(3, false, found));
+
+    // Position 1 was used least recently
+    cache.findCount(2, count);
+    makeEntries(4, 9, entries);
+    cache.addEntries(4, entries);
+    EXPECT_FALSE(cache.findCount(1, count));
+    EXPECT_TRUE(cache.findCount(2, count));
+    EXPECT_TRUE(cache.findCount(4, count));
+    EXPECT_LE(cache.numEntries(), 20u);
+
+    // Too many entries to hold, so only the count is cached
+    makeEntries(5, 15, entries);
+    cache.addEntries(5, entries);
+    EXPECT_TRUE(cache.findCount(5, count));
+    EXPECT_EQ(15u, count);
+    EXPECT_FALSE(cache.findEntries(5, false, found));
+
+    EXPECT_EQ(7u, cache.hits());
+    EXPECT_EQ(3u, cache.misses());
+    EXPECT_DOUBLE_EQ(0.7, cache.hitRate());
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.numPositions());
+    EXPECT_EQ(0u, cache.numEntries());
+    EXPECT_FALSE(cache.findCount(2, count));
+
+    cache.resetStats();
+    EXPECT_EQ(0.0, cache.hitRate());
+}
+
+TEST(OpeningTreeCacheTest, databaseCachesAndInvalidates) {
+    string filename = g_tempDir + PATHSEP + "optree_cache_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    {
+        CfdbDatabase db(filename, false);
+        ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+        ASSERT_TRUE(db.buildOpeningTree(0, 10, 0, 0)) << db.errorMsg();
+        ASSERT_TRUE(db.setOpeningTreeDepth(10)) << db.errorMsg();
+    }
+
+    // Load the first four half-moves when the database is opened
+    CfdbDatabase db;
+    EXPECT_TRUE(db.openingTreeCache().get() == 0);
+    shared_ptr<OpeningTreeCache> cache(new OpeningTreeCache());
+    db.setOpeningTreeCache(cache);
+    CfdbDatabase::setOpeningTreePrewarmPlies(4);
+    ASSERT_TRUE(db.open(filename, false)) << db.errorMsg();
+    CfdbDatabase::setOpeningTreePrewarmPlies(0);
+
+    EXPECT_LT(0u, cache->numPositions());
+    EXPECT_EQ(0u, cache->hits() + cache->misses());
+
+    // Use a game longer than the prewarmed half-moves
+    Game game;
+    vector<OpeningTreeEntry> entries;
+    string errorMsg;
+    unsigned gameNum;
+
+    for (gameNum = db.firstGameNum(); gameNum <= db.lastGameNum(); gameNum++) {
+        ASSERT_TRUE(db.read(gameNum, game)) << db.errorMsg();
+        ASSERT_TRUE(OpeningTreeBuilder::replayGame(game, gameNum, 10, entries, errorMsg)) << errorMsg;
+
+        if (entries.size() > 4)
+            break;
+    }
+
+    ASSERT_LT(4u, entries.size());
+
+    // The position after the second half-move was cached by open(); compare it with
+    // the uncached result
+    uint64_t hashKey = entries[1].hashKey();
+    vector<OpeningTreeEntry> cached, uncached;
+    unsigned cachedCount, uncachedCount;
+    ASSERT_TRUE(db.searchOpeningTree(hashKey, true, cached)) << db.errorMsg();
+    ASSERT_TRUE(db.countInOpeningTree(hashKey, cachedCount)) << db.errorMsg();
+    EXPECT_EQ(2u, cache->hits());
+
+    db.setOpeningTreeCache(shared_ptr<OpeningTreeCache>());
+    ASSERT_TRUE(db.searchOpeningTree(hashKey, true, uncached)) << db.errorMsg();
+    ASSERT_TRUE(db.countInOpeningTree(hashKey, uncachedCount)) << db.errorMsg();
+    db.setOpeningTreeCache(cache);
+
+    EXPECT_EQ(uncachedCount, cachedCount);
+    ASSERT_EQ(uncached.size(), cached.size());
+
+    for (unsigned i = 0; i < cached.size(); i++) {
+        EXPECT_EQ(uncached[i].gameNum(), cached[i].gameNum());
+        EXPECT_EQ(uncached[i].move().intValue(), cached[i].move().intValue());
+        EXPECT_TRUE(cached[i].lastMove());
+    }
+
+    // A deeper position is added on the first lookup
+    hashKey = entries.back().hashKey();
+    unsigned count;
+    cache->resetStats();
+    ASSERT_TRUE(db.countInOpeningTree(hashKey, count)) << db.errorMsg();
+    ASSERT_TRUE(db.countInOpeningTree(hashKey, count)) << db.errorMsg();
+    EXPECT_EQ(1u, cache->hits());
+    EXPECT_EQ(1u, cache->misses());
+    EXPECT_DOUBLE_EQ(0.5, cache->hitRate());
+
+    // Writing a game changes its opening tree entries, which must not come from the cache
+    entries.clear();
+    ASSERT_TRUE(db.searchOpeningTree(hashKey, false, entries)) << db.errorMsg();
+    ASSERT_EQ(count, entries.size());
+    unsigned i;
+    int score;
+
+    for (i = 0; i < entries.size() && entries[i].gameNum() != gameNum; i++)
+        ;
+
+    ASSERT_LT(i, entries.size());
+    score = entries[i].score();
+    game.setResult(score > 0 ? GameHeader::BLACK_WIN : GameHeader::WHITE_WIN);
+    ASSERT_TRUE(db.write(gameNum, game)) << db.errorMsg();
+    EXPECT_EQ(0u, cache->numPositions());
+
+    entries.clear();
+    ASSERT_TRUE(db.searchOpeningTree(hashKey, false, entries)) << db.errorMsg();
+
+    for (i = 0; i < entries.size() && entries[i].gameNum() != gameNum; i++)
+        ;
+
+    ASSERT_LT(i, entries.size());
+    EXPECT_EQ(score > 0 ? -1 : 1, entries[i].score());
+
+    // As does rebuilding the opening tree
+    ASSERT_TRUE(db.countInOpeningTree(hashKey, count)) << db.errorMsg();
+    ASSERT_TRUE(db.buildOpeningTree(0, 2, 0, 0)) << db.errorMsg();
+    EXPECT_EQ(0u, cache->numPositions());
+    ASSERT_TRUE(db.countInOpeningTree(hashKey, count)) << db.errorMsg();
+    EXPECT_EQ(0u, count);
+
+    db.close();
+    Util::deleteFile(filename);
+    Util::deleteFile(filename + ".optree");
+}
@@ -0,0 +1,236 @@
+#include <ChessCore/OpeningTreeFile.h>
+#include <ChessCore/OpeningTreeBuilder.h>
+#include <ChessCore/CfdbDatabase.h>
+#include <ChessCore/OpeningTree.h>
+#include <ChessCore/Util.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+
+using namespace std;
+using namespace ChessCore;
+
+#define ECO_FILE "../cfdb/eco.cfdb"
+
+static bool entryLess(const OpeningTreeEntry &a, const OpeningTreeEntry &b) {
+    if (a.gameNum() != b.gameNum())
+        return a.gameNum() < b.gameNum();
+    return a.move().intValue() < b.move().intValue();
+}
+
+TEST(OpeningTreeFileTest, writerRejectsUnsortedEntries) {
+    string filename = g_tempDir + PATHSEP + "optree_unittest.optree";
+    OpeningTreeFileWriter writer;
+    OpeningTreeEntry entry;
+
+    ASSERT_TRUE(writer.create(filename, 3, 1)) << writer.errorMsg();
+
+    entry.setHashKey(0xfedcba9876543210ULL);
+    entry.setMove(1234);
+    entry.setScore(1);
+    entry.setGameNum(2);
+    ASSERT_TRUE(writer.add(entry)) << writer.errorMsg();
+
+    entry.setScore(-1);
+    entry.setLastMove(true);
+    entry.setGameNum(3);
+    ASSERT_TRUE(writer.add(entry)) << writer.errorMsg();
+
+    entry.setHashKey(0x0123456789abcdefULL);
+    EXPECT_FALSE(writer.add(entry));
+    writer.abort();
+    EXPECT_FALSE(Util::fileExists(filename));
+
+    ASSERT_TRUE(writer.create(filename, 3, 1)) << writer.errorMsg();
+    ASSERT_TRUE(writer.add(entry)) << writer.errorMsg();
+    ASSERT_TRUE(writer.finish()) << writer.errorMsg();
+
+    OpeningTreeFile file;
+    EXPECT_FALSE(file.open(filename, 2));
+    ASSERT_TRUE(file.open(filename, 1));
+    EXPECT_EQ(3u, file.numGames());
+    EXPECT_EQ(1u, file.numRecords());
+    EXPECT_EQ(1u, file.count(0x0123456789abcdefULL));
+    EXPECT_EQ(0u, file.count(0xfedcba9876543210ULL));
+
+    vector<OpeningTreeEntry> entries;
+    file.search(0x0123456789abcdefULL, true, entries);
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ(1234u, entries[0].move().intValue());
+    EXPECT_EQ(-1, entries[0].score());
+    EXPECT_TRUE(entries[0].lastMove());
+    EXPECT_EQ(3u, entries[0].gameNum());
+
+    file.close();
+    Util::deleteFile(filename);
+}
+
+TEST(OpeningTreeFileTest, fileMatchesDatabase) {
+    string filename = g_tempDir + PATHSEP + "optree_unittest.cfdb";
+    string optreeFilename = filename + ".optree";
+
+    Util::deleteFile(optreeFilename);
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    // Collect the positions to compare
+    vector<OpeningTreeEntry> allEntries;
+    vector<uint64_t> hashKeys;
+    {
+        CfdbDatabase db(filename, false);
+        ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+        ASSERT_TRUE(db.buildOpeningTree(0, 12, 0, 0)) << db.errorMsg();
+        ASSERT_TRUE(Util::fileExists(optreeFilename));
+        ASSERT_TRUE(db.readOpeningTree(allEntries)) << db.errorMsg();
+        ASSERT_FALSE(allEntries.empty());
+
+        for (unsigned i = 0; i < allEntries.size(); i += 97)
+            hashKeys.push_back(allEntries[i].hashKey());
+
+        hashKeys.push_back(0x0123456789abcdefULL);      // Not in the tree
+    }
+
+    vector<vector<OpeningTreeEntry> > fileEntries(hashKeys.size());
+    vector<unsigned> fileCounts(hashKeys.size());
+    vector<vector<OpeningTreeStats> > fileStats(hashKeys.size());
+    {
+        CfdbDatabase db(filename, true);
+        ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+
+        for (unsigned i = 0; i < hashKeys.size(); i++) {
+            ASSERT_TRUE(db.searchOpeningTree(hashKeys[i], false, fileEntries[i]));
+            ASSERT_TRUE(db.countInOpeningTree(hashKeys[i], fileCounts[i]));
+            ASSERT_TRUE(db.searchOpeningTreeStats(hashKeys[i], 3, fileStats[i]));
+        }
+    }
+
+    // Without the file the database falls back to the optree table
+    ASSERT_TRUE(Util::deleteFile(optreeFilename));
+    {
+        CfdbDatabase db(filename, true);
+        ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+
+        for (unsigned i = 0; i < hashKeys.size(); i++) {
+            vector<OpeningTreeEntry> entries;
+            unsigned count;
+            ASSERT_TRUE(db.searchOpeningTree(hashKeys[i], false, entries));
+            ASSERT_TRUE(db.countInOpeningTree(hashKeys[i], count));
+
+            EXPECT_EQ(count, fileCounts[i]);
+            ASSERT_EQ(entries.size(), fileEntries[i].size());
+
+            sort(entries.begin(), entries.end(), entryLess);
+            sort(fileEntries[i].begin(), fileEntries[i].end(), entryLess);
+
+            for (unsigned j = 0; j < entries.size(); j++) {
+                EXPECT_EQ(entries[j].hashKey(), fileEntries[i][j].hashKey());
+                EXPECT_EQ(entries[j].move().intValue(), fileEntries[i][j].move().intValue());
+                EXPECT_EQ(entries[j].score(), fileEntries[i][j].score());
+                EXPECT_EQ(entries[j].lastMove(), fileEntries[i][j].lastMove());
+                EXPECT_EQ(entries[j].gameNum(), fileEntries[i][j].gameNum());
+            }
+
+            vector<OpeningTreeStats> stats;
+            unsigned numGames = 0;
+            ASSERT_TRUE(db.searchOpeningTreeStats(hashKeys[i], 3, stats));
+            ASSERT_EQ(stats.size(), fileStats[i].size());
+
+            for (unsigned j = 0; j < stats.size(); j++) {
+                const OpeningTreeStats &fs = fileStats[i][j];
+                EXPECT_EQ(stats[j].move().intValue(), fs.move().intValue());
+                EXPECT_EQ(stats[j].numGames(), fs.numGames());
+                EXPECT_EQ(stats[j].whiteWins(), fs.whiteWins());
+                EXPECT_EQ(stats[j].draws(), fs.draws());
+                EXPECT_EQ(stats[j].blackWins(), fs.blackWins());
+                EXPECT_EQ(stats[j].numGames(), fs.whiteWins() + fs.draws() + fs.blackWins());
+                EXPECT_TRUE(stats[j].sampleGames() == fs.sampleGames());
+                EXPECT_EQ(min(3u, fs.numGames()), fs.sampleGames().size());
+                numGames += fs.numGames();
+            }
+
+            EXPECT_EQ(count, numGames);
+        }
+    }
+
+    Util::deleteFile(filename);
+}
+
+TEST(OpeningTreeFileTest, graphMatchesGames) {
+    string filename = g_tempDir + PATHSEP + "optree_graph_unittest.cfdb";
+    ASSERT_TRUE(Util::copyFile(ECO_FILE, filename));
+
+    CfdbDatabase db(filename, false);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+    ASSERT_TRUE(db.buildOpeningTree(0, 12, 0, 0)) << db.errorMsg();
+
+    // Count the games that played each move between two positions
+    typedef map<pair<uint64_t, uint32_t>, unsigned> MoveCounts;
+    map<uint64_t, MoveCounts> children, parents;
+    vector<OpeningTreeEntry> entries;
+    Game game;
+    string errorMsg;
+
+    for (unsigned gameNum = db.firstGameNum(); gameNum <= db.lastGameNum(); gameNum++) {
+        ASSERT_TRUE(db.read(gameNum, game)) << db.errorMsg();
+        ASSERT_TRUE(OpeningTreeBuilder::replayGame(game, gameNum, 12, entries, errorMsg)) << errorMsg;
+
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            uint32_t move = it->move().intValue();
+            children[it->prevHashKey()][make_pair(it->hashKey(), move)]++;
+            parents[it->hashKey()][make_pair(it->prevHashKey(), move)]++;
+        }
+    }
+
+    ASSERT_FALSE(children.empty());
+    Position startPos;
+    startPos.setStarting();
+    EXPECT_EQ(1u, children.count(startPos.hashKey()));
+
+    unsigned transpositions = 0;
+
+    for (auto it = children.begin(); it != children.end(); ++it) {
+        vector<OpeningTreeEdge> edges;
+        ASSERT_TRUE(db.searchOpeningTreeChildren(it->first, edges)) << db.errorMsg();
+        ASSERT_EQ(it->second.size(), edges.size());
+
+        for (unsigned i = 0; i < edges.size(); i++) {
+            EXPECT_EQ(it->first, edges[i].fromHashKey());
+            EXPECT_EQ(it->second[make_pair(edges[i].toHashKey(), edges[i].move().intValue())], edges[i].numGames());
+
+            if (i > 0) {
+                EXPECT_LT(edges[i - 1].move().intValue(), edges[i].move().intValue());
+            }
+        }
+    }
+
+    for (auto it = parents.begin(); it != parents.end(); ++it) {
+        vector<OpeningTreeEdge> edges;
+        ASSERT_TRUE(db.searchOpeningTreeParents(it->first, edges)) << db.errorMsg();
+        ASSERT_EQ(it->second.size(), edges.size());
+
+        for (unsigned i = 0; i < edges.size(); i++) {
+            EXPECT_EQ(it->first, edges[i].toHashKey());
+            EXPECT_EQ(it->second[make_pair(edges[i].fromHashKey(), edges[i].move().intValue())], edges[i].numGames());
+        }
+
+        if (edges.size() > 1)
+            transpositions++;
+    }
+
+    // The ECO lines reach many positions by more than one move order
+    EXPECT_LT(0u, transpositions);
+
+    vector<OpeningTreeEdge> edges;
+    ASSERT_TRUE(db.searchOpeningTreeParents(startPos.hashKey(), edges)) << db.errorMsg();
+    EXPECT_TRUE(edges.empty());
+    ASSERT_TRUE(db.searchOpeningTreeChildren(0x0123456789abcdefULL, edges)) << db.errorMsg();
+    EXPECT_TRUE(edges.empty());
+
+    // The optree table cannot answer graph queries
+    db.close();
+    ASSERT_TRUE(Util::deleteFile(filename + ".optree"));
+    ASSERT_TRUE(db.open(filename, true)) << db.errorMsg();
+    EXPECT_FALSE(db.searchOpeningTreeChildren(startPos.hashKey(), edges));
+
+    db.close();
+    Util::deleteFile(filename);
+}
@@ -0,0 +1,47 @@
+#include <ChessCore/OpeningTree.h>
+#include <ChessCore/PgnDatabase.h>
+#include <ChessCore/Game.h>
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace ChessCore;
+
+#define ECO_FILE "../cfdb/eco.cfdb"
+
+static const char *games[] = {
+    "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O *",
+    "1. d4 Nf6 2. c4 e6 3. Nc3 Bb4 4. Qc2 O-O 5. a3 Bxc3+ 6. Qxc3 *",
+    "1. c4 e5 2. Nc3 Nf6 3. Nf3 Nc6 4. g3 d5 5. cxd5 Nxd5 *",
+    "1. e4 c5 2. Nf3 d6 3. d4 cxd4 4. Nxd4 Nf6 5. Nc3 a6 6. Bg5 e6 7. f4 *"
+};
+
+TEST(OpeningTreeTest, inMemoryMatchesDatabase) {
+    OpeningTree optree(ECO_FILE);
+    ASSERT_TRUE(optree.isOpen());
+
+    const unsigned numGames = sizeof(games) / sizeof(games[0]);
+    string eco[numGames], opening[numGames], variation[numGames];
+
+    for (unsigned i = 0; i < numGames; i++) {
+        Game game;
+        ASSERT_TRUE(PgnDatabase::readFromString(games[i], game));
+        ASSERT_TRUE(optree.classify(game, eco[i], opening[i], variation[i]));
+        EXPECT_FALSE(eco[i].empty());
+    }
+
+    ASSERT_TRUE(optree.load());
+    ASSERT_TRUE(optree.isLoaded());
+
+    for (unsigned i = 0; i < numGames; i++) {
+        Game game;
+        string e, o, v;
+        ASSERT_TRUE(PgnDatabase::readFromString(games[i], game));
+        ASSERT_TRUE(optree.classify(game, e, o, v));
+        EXPECT_EQ(eco[i], e);
+        EXPECT_EQ(opening[i], o);
+        EXPECT_EQ(variation[i], v);
+    }
+
+    EXPECT_EQ("C", eco[0].substr(0, 1));
+    EXPECT_EQ("E", eco[1].substr(0, 1));
+}
@@ -1,6 +1,9 @@
 #include <ChessCore/PgnDatabase.h>
 #include <ChessCore/Game.h>
+#include <ChessCore/Util.h>
 #include <gtest/gtest.h>
+#include "DatabaseTestUtil.h"
+#include <fstream>
 
 using namespace std;
 using namespace ChessCore;
@@ -38,3 +41,253 @@ TEST(PgnDatabaseTest, nullMoveOutputsAsTwoDashes) {
     EXPECT_EQ(HEADER "1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5 4. Nc3 -- (4... Nh6 5. d3 d6) *\n", movesStr);
 }
 
+// The game-over flags are set at the end of each line when the game is read
+TEST(PgnDatabaseTest, mateAtEndOfLines) {
+    static const char *expected = HEADER "1. f3 e5 2. g4 Qh4# (2... Qg5 3. a3 Qh4#) *\n";
+    Game game;
+    string movesStr;
+    ASSERT_TRUE(PgnDatabase::readFromString("1. f3 e5 2. g4 Qh4 (2... Qg5 3. a3 Qh4) *", game));
+    game.get(movesStr);
+    EXPECT_EQ(expected, movesStr);
+
+    Game copy;
+    ASSERT_TRUE(CompactGame(game).toGame(copy));
+    copy.get(movesStr);
+    EXPECT_EQ(expected, movesStr);
+}
+
+
+//
+// Batched header reading tests
+//
+
+#define HEADER_GAMES \
+    "[Event \"First\"]\n[Site \"Here\"]\n[Date \"2013.01.02\"]\n[Round \"1\"]\n" \
+    "[White \"Adams, Michael\"]\n[Black \"Short, Nigel\"]\n[Result \"1-0\"]\n[ECO \"C60\"]\n\n" \
+    "1. e4 e5 {A comment\nspanning [two] lines} 2. Nf3 (2. f4 exf4\n) Nc6 3. Bb5 1-0\n\n" \
+    "[Event \"Second\"]\n[Site \"There\"]\n[Date \"2013.??.??\"]\n[Round \"2\"]\n" \
+    "[White \"Short, Nigel\"]\n[Black \"Adams, Michael\"]\n[Result \"0-1\"]\n\n" \
+    "1. d4 ; [comment to end-of-line\nd5 0-1\n\n" \
+    "[Event \"Third\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"3\"]\n" \
+    "[White \"Adams, Michael\"]\n[Black \"Short, Nigel\"]\n[Result \"1/2-1/2\"]\n\n" \
+    "1. c4 c5 1/2-1/2\n"
+
+static bool createPgnFile(const string &filename, const string &contents) {
+    ofstream file(filename.c_str(), ios::out | ios::trunc | ios::binary);
+    file << contents;
+    return !file.fail();
+}
+
+static void expectSameHeader(const GameHeader &expected, const GameHeader &actual) {
+    EXPECT_EQ(expected.event(), actual.event());
+    EXPECT_EQ(expected.site(), actual.site());
+    EXPECT_EQ(expected.year(), actual.year());
+    EXPECT_EQ(expected.roundMajor(), actual.roundMajor());
+    EXPECT_EQ(expected.white().formattedName(), actual.white().formattedName());
+    EXPECT_EQ(expected.black().formattedName(), actual.black().formattedName());
+    EXPECT_EQ(expected.result(), actual.result());
+    EXPECT_EQ(expected.eco(), actual.eco());
+    EXPECT_FALSE(actual.readFail());
+}
+
+TEST(PgnDatabaseTest, readHeadersMatchesReadHeader) {
+    string filename = g_tempDir + PATHSEP + "readheaders_unittest.pgn";
+    ASSERT_TRUE(createPgnFile(filename, HEADER_GAMES));
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    ASSERT_EQ(3u, pgnDb.numGames());
+
+    vector<GameHeader> gameHeaders;
+    ASSERT_TRUE(pgnDb.readHeaders(1, 3, gameHeaders)) << pgnDb.errorMsg();
+    ASSERT_EQ(3u, gameHeaders.size());
+
+    for (unsigned gameNum = 1; gameNum <= 3; gameNum++) {
+        GameHeader gameHeader;
+        ASSERT_TRUE(pgnDb.readHeader(gameNum, gameHeader));
+        expectSameHeader(gameHeader, gameHeaders[gameNum - 1]);
+    }
+
+    EXPECT_EQ("Second", gameHeaders[1].event());
+    EXPECT_EQ(Game::DRAW, gameHeaders[2].result());
+
+    ASSERT_TRUE(pgnDb.readHeaders(2, 3, gameHeaders));
+    ASSERT_EQ(2u, gameHeaders.size());
+    EXPECT_EQ("Second", gameHeaders[0].event());
+
+    EXPECT_FALSE(pgnDb.readHeaders(2, 4, gameHeaders));
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
+
+TEST(PgnDatabaseTest, readHeadersUsingHeaderCache) {
+    string filename = g_tempDir + PATHSEP + "readheaders_cache_unittest.pgn";
+    ASSERT_TRUE(createPgnFile(filename, HEADER_GAMES));
+
+    PgnDatabase::setHeaderCaching(true);
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    ASSERT_TRUE(pgnDb.buildHeaderCache(0, 0));
+
+    vector<GameHeader> gameHeaders;
+    EXPECT_TRUE(pgnDb.readHeaders(1, 3, gameHeaders));
+    ASSERT_EQ(3u, gameHeaders.size());
+
+    for (unsigned gameNum = 1; gameNum <= 3; gameNum++) {
+        GameHeader gameHeader;
+        ASSERT_TRUE(pgnDb.readHeader(gameNum, gameHeader));
+        expectSameHeader(gameHeader, gameHeaders[gameNum - 1]);
+    }
+
+    PgnDatabase::setHeaderCaching(false);
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
+
+//
+// Search tests
+//
+
+static bool searchCallback(unsigned gameNum, float percentComplete, void *contextInfo) {
+    static_cast<DatabaseGameList *>(contextInfo)->push_back(gameNum);
+    return true;
+}
+
+TEST(PgnDatabaseTest, searchUsingSearchIndex) {
+    string filename = g_tempDir + PATHSEP + "search_unittest.pgn";
+    ASSERT_TRUE(createPgnFile(filename, HEADER_GAMES));
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.supportsSearching());
+    ASSERT_TRUE(pgnDb.index(0, 0));
+
+    DatabaseSearchCriteria searchCriteria;
+    DatabaseSortCriteria sortCriteria;
+    DatabaseGameList gameList;
+
+    DatabaseSearchDescriptor search = { DATABASE_FIELD_WHITEPLAYER, DATABASE_COMPARE_EQUALS, "Adams" };
+    searchCriteria.push_back(search);
+    ASSERT_TRUE(pgnDb.search(searchCriteria, sortCriteria, searchCallback, &gameList)) << pgnDb.errorMsg();
+    ASSERT_EQ(2u, gameList.size());
+    EXPECT_EQ(1u, gameList[0]);
+    EXPECT_EQ(3u, gameList[1]);
+
+    // Case-insensitive substring match on either player, most recent game first
+    searchCriteria.clear();
+    gameList.clear();
+    search.field = DATABASE_FIELD_PLAYER;
+    search.comparison = databaseComparison(DATABASE_COMPARE_CONTAINS, DATABASE_COMPARE_CASE_INSENSITIVE);
+    search.value = "hor";
+    searchCriteria.push_back(search);
+    DatabaseSortDescriptor sort = { DATABASE_FIELD_GAME_NUM, DATABASE_ORDER_DESCENDING };
+    sortCriteria.push_back(sort);
+    ASSERT_TRUE(pgnDb.search(searchCriteria, sortCriteria, searchCallback, &gameList));
+    ASSERT_EQ(3u, gameList.size());
+    EXPECT_EQ(3u, gameList[0]);
+    EXPECT_EQ(1u, gameList[2]);
+
+    // Date, sorted by event, with offset and limit
+    searchCriteria.clear();
+    sortCriteria.clear();
+    gameList.clear();
+    search.field = DATABASE_FIELD_DATE;
+    search.comparison = DATABASE_COMPARE_EQUALS;
+    search.value = "2013";
+    searchCriteria.push_back(search);
+    sort.field = DATABASE_FIELD_EVENT;
+    sort.order = DATABASE_ORDER_ASCENDING;
+    sortCriteria.push_back(sort);
+    ASSERT_TRUE(pgnDb.search(searchCriteria, sortCriteria, searchCallback, &gameList, 2, 1));
+    ASSERT_EQ(1u, gameList.size());
+    EXPECT_EQ(2u, gameList[0]);     // "First", "Second"
+
+    // Result cannot be searched
+    searchCriteria.clear();
+    search.field = DATABASE_FIELD_RESULT;
+    searchCriteria.push_back(search);
+    EXPECT_FALSE(pgnDb.search(searchCriteria, sortCriteria, searchCallback, &gameList));
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
+
+//
+// Buffer scanning tests
+//
+
+TEST(PgnDatabaseTest, scanBufferInPlace) {
+    char buffer[] = "[Event \"Buffer\"]\n\n1. e4 *\0";    // Plus the implicit NUL
+    PgnScannerContext context(buffer, sizeof(buffer));
+
+    EXPECT_EQ(A_PGN_EVENT, context.lex());
+    EXPECT_EQ(A_WHITE_MOVENUM, context.lex());
+    EXPECT_EQ(A_PAWN_MOVE, context.lex());
+    EXPECT_EQ(A_UNFINISHED, context.lex());
+    EXPECT_EQ(0, context.lex());
+    EXPECT_EQ(3u, context.lineNumber());
+}
+
+TEST(PgnDatabaseTest, readMultiFromStringMatchesRead) {
+    string filename = g_tempDir + PATHSEP + "readmulti_unittest.pgn";
+    ASSERT_TRUE(createPgnFile(filename, HEADER_GAMES));
+
+    vector<shared_ptr<Game> > games;
+    ASSERT_EQ(3u, PgnDatabase::readMultiFromString(HEADER_GAMES, games, 0, 0));
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    ASSERT_EQ(3u, pgnDb.numGames());
+
+    for (unsigned gameNum = 1; gameNum <= 3; gameNum++) {
+        Game game;
+        ASSERT_TRUE(pgnDb.read(gameNum, game)) << pgnDb.errorMsg();
+        expectSameHeader(*games[gameNum - 1], game);
+        EXPECT_EQ(games[gameNum - 1]->position().fen(), game.position().fen());
+    }
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
+
+TEST(PgnDatabaseTest, readPartialGames) {
+    string filename = g_tempDir + PATHSEP + "partial_unittest.pgn";
+    ASSERT_TRUE(Util::copyFile("../pgn/Kramnik.pgn", filename));
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    ASSERT_LT(0u, pgnDb.numGames());
+
+    expectPartialReadsMatch(pgnDb);
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
+
+TEST(PgnDatabaseTest, readCompactGames) {
+    string filename = g_tempDir + PATHSEP + "compact_unittest.pgn";
+    ASSERT_TRUE(Util::copyFile("../pgn/Kramnik.pgn", filename));
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    ASSERT_LT(0u, pgnDb.numGames());
+
+    expectCompactReadsMatch(pgnDb);
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
+
+TEST(PgnDatabaseTest, readSharedFromThreads) {
+    string filename = g_tempDir + PATHSEP + "shared_unittest.pgn";
+    ASSERT_TRUE(Util::copyFile("../pgn/Kramnik.pgn", filename));
+
+    PgnDatabase pgnDb(filename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    expectSharedReadsMatch(pgnDb);
+
+    pgnDb.close();
+    Util::deleteFile(filename);
+}
@@ -0,0 +1,107 @@
+#include <ChessCore/PgnScanner.h>
+#include <ChessCore/PgnDatabase.h>
+#include <ChessCore/Game.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sstream>
+
+using namespace std;
+using namespace ChessCore;
+
+#define NORMAL_GAME \
+    "[Event \"Normal\"]\n[Site \"Here [there]\"]\r\n[Date \"2013.??.??\"]\n[Round \"1\"]\n" \
+    "[White \"Adams, Michael\"]\n[Black \"Short, Nigel\"]\n[Result \"1/2-1/2\"]\n[WhiteElo \"2700\"]\n\n" \
+    "1. e4 e5 2.Nf3 Nc6 3. Bb5!? a6?! 4. Ba4!! Nf6?? 5. O-O Be7! 6. Re1? b5 $1\n" \
+    "7. Bb3 d6 {multi-line\r\ncomment\n} 8. c3 (8. d4 exd4) O-O 9. h3 ; to end of line\n" \
+    "Nb8 10. d4 Nbd7 11. c4 c6 12. cxb5 axb5 13. Nc3 Bb7 14. Bg5 b4 15. Nb1 h6\n" \
+    "16. Bh4 c5 17. dxe5 Nxe4 18. Bxe7 Qxe7 19. exd6 Qf6 20. Nbd2 Nxd6 21. Nc4 Nxc4\n" \
+    "22. Bxc4 Nb6 23. Ne5 Rae8 24. Bxf7+ Rxf7 25. Nxf7 Rxe1+ 26. Qxe1 Kxf7 27. Qe3 Qg5\n" \
+    "28. Qxg5 hxg5 29. b3 Ke6 30. a3 Kd6 31. axb4 cxb4 32. Ra5 Nd5 33. f3 Bc8 34. Kf2 Bf5\n" \
+    "35. Ra7 g6 36. Ra6+ Kc5 37. Ke1 Nf4 38. g3 Nxh3 39. Kd2 Kb5 40. Rd6 Kc5 41. Ra6 Nf2\n" \
+    "42. g4 Bd3 43. Re6 1/2-1/2\n\n"
+
+#define AWKWARD_PGN \
+    NORMAL_GAME \
+    "[Event]\n[Unknown \"x\"]\n[ no close\n\n% escaped line\n%second escaped line\n" \
+    "1. d2d4 d7-d5 2. Ng1f3 Nb8-c6 3... e8=Q exd8N ed e8Q 0-0-0 o-o -- Z0 $# $N {nested {brace}\n" \
+    "draw 1:0 0:1 1/2:1/2 1/2 * < > .. ... 12345 $12 Ke2xe4 N1c3 Nbxd2 Xx\n"
+
+//
+// Return a description of the tokens produced by the given lexer.
+//
+static string tokenize(PgnScannerContext::Lexer lexer, const string &input, bool useStream) {
+    PgnScannerContext::Lexer savedLexer = PgnScannerContext::defaultLexer();
+    PgnScannerContext::setDefaultLexer(lexer);
+
+    istringstream iss(input);
+    PgnScannerContext *context;
+    if (useStream)
+        context = new PgnScannerContext(iss);
+    else
+        context = new PgnScannerContext(input);
+
+    PgnScannerContext::setDefaultLexer(savedLexer);
+
+    ostringstream oss;
+    int token;
+    while ((token = context->lex()) > 0)
+        oss << token << ":" << context->lineNumber() << ":" << context->text() << "\n";
+
+    delete context;
+    return oss.str();
+}
+
+TEST(PgnTokenizerTest, matchesFlexScanner) {
+    string expected = tokenize(PgnScannerContext::LEXER_FLEX, AWKWARD_PGN, false);
+    EXPECT_EQ(expected, tokenize(PgnScannerContext::LEXER_TOKENIZER, AWKWARD_PGN, false));
+    EXPECT_EQ(expected, tokenize(PgnScannerContext::LEXER_FLEX, AWKWARD_PGN, true));
+    EXPECT_EQ(expected, tokenize(PgnScannerContext::LEXER_TOKENIZER, AWKWARD_PGN, true));
+}
+
+TEST(PgnTokenizerTest, matchesFlexScannerAcrossReads) {
+    // Large enough for the stream to be read in several blocks, with tokens spanning them
+    string input;
+    while (input.size() < 300000)
+        input += AWKWARD_PGN "{" + string(input.size() % 1000, 'x') + "}\n";
+
+    string expected = tokenize(PgnScannerContext::LEXER_FLEX, input, false);
+    EXPECT_TRUE(expected == tokenize(PgnScannerContext::LEXER_TOKENIZER, input, true));
+}
+
+TEST(PgnTokenizerTest, tokenTextIsTerminated) {
+    char buffer[] = "[Event \"Tokenizer\"]\n1. e4 {A\ncomment} *\0";
+    PgnScannerContext::setDefaultLexer(PgnScannerContext::LEXER_TOKENIZER);
+    PgnScannerContext context(buffer, sizeof(buffer));
+    PgnScannerContext::setDefaultLexer(PgnScannerContext::LEXER_FLEX);
+
+    ASSERT_EQ(PgnScannerContext::LEXER_TOKENIZER, context.lexer());
+    EXPECT_EQ(A_PGN_EVENT, context.lex());
+    EXPECT_STREQ("[Event \"Tokenizer\"]", context.text());
+    EXPECT_EQ(A_WHITE_MOVENUM, context.lex());
+    EXPECT_STREQ("1.", context.text());
+    EXPECT_EQ(A_PAWN_MOVE, context.lex());
+    EXPECT_STREQ("e4", context.text());
+    EXPECT_EQ(A_COMMENT, context.lex());
+    EXPECT_STREQ(" A comment ", context.text());
+    EXPECT_EQ(3u, context.lineNumber());
+    EXPECT_EQ(A_UNFINISHED, context.lex());
+    EXPECT_EQ(0, context.lex());
+
+    // The buffer is restored, apart from the comment
+    EXPECT_EQ(0, strncmp(buffer, "[Event \"Tokenizer\"]\n1. e4 ", 26));
+}
+
+TEST(PgnTokenizerTest, readGame) {
+    PgnScannerContext::setDefaultLexer(PgnScannerContext::LEXER_TOKENIZER);
+    Game game;
+    bool result = PgnDatabase::readFromString(NORMAL_GAME, game);
+    PgnScannerContext::setDefaultLexer(PgnScannerContext::LEXER_FLEX);
+
+    ASSERT_TRUE(result);
+    EXPECT_EQ("Normal", game.event());
+    EXPECT_EQ(Game::DRAW, game.result());
+
+    Game expected;
+    ASSERT_TRUE(PgnDatabase::readFromString(NORMAL_GAME, expected));
+    EXPECT_EQ(expected.position().fen(), game.position().fen());
+}
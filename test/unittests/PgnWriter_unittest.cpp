@@ -0,0 +1,105 @@
+#include <ChessCore/PgnWriter.h>
+#include <ChessCore/PgnDatabase.h>
+#include <ChessCore/Game.h>
+#include <ChessCore/Util.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace ChessCore;
+
+#define PLAIN_GAME \
+    "[Event \"Plain\"]\n[Site \"Here\"]\n[Date \"2013.06.??\"]\n[Round \"3.1\"]\n" \
+    "[White \"Adams, Michael\"]\n[Black \"Short, Nigel\"]\n[Result \"1-0\"]\n" \
+    "[WhiteElo \"2700\"]\n[TimeControl \"40/7200:3600\"]\n\n" \
+    "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 \n" \
+    "O-O 9. h3 Nb8 10. d4 Nbd7 1-0\n"
+
+#define ANNOTATED_GAME \
+    "[Event \"Annotated\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"?\"]\n" \
+    "[White \"?\"]\n[Black \"?\"]\n[Result \"*\"]\n\n" \
+    "{Opening 'with' \"quoted words\"} 1. e4 $1 e5 {A comment} 2. Nf3 (2. f4 exf4 (2... d5))\n" \
+    "Nc6 3. Bb5 a6 *\n"
+
+#define ANNOTATED_PGN \
+    "[Event \"Annotated\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"?\"]\n" \
+    "[White \"?\"]\n[Black \"?\"]\n[Result \"*\"]\n\n" \
+    "{Opening with quoted words} 1. e4 $1 1... e5 {A comment} 2. Nf3 (2. f4 exf4 (\n" \
+    "2... d5)) 2... Nc6 3. Bb5 a6 *\n"
+
+static bool readFile(const string &filename, string &contents) {
+    ifstream file(filename.c_str(), ios::in | ios::binary);
+    if (!file.is_open())
+        return false;
+
+    stringstream ss;
+    ss << file.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+TEST(PgnWriterTest, formatPlainGame) {
+    Game game;
+    ASSERT_TRUE(PgnDatabase::readFromString(PLAIN_GAME, game));
+
+    string output, errorMsg;
+    ASSERT_TRUE(PgnWriter::format(game, output, errorMsg)) << errorMsg;
+    EXPECT_EQ(PLAIN_GAME, output);
+}
+
+TEST(PgnWriterTest, formatAnnotatedGame) {
+    Game game;
+    ASSERT_TRUE(PgnDatabase::readFromString(ANNOTATED_GAME, game));
+
+    // Output is appended
+    string output = "x", errorMsg;
+    ASSERT_TRUE(PgnWriter::format(game, output, errorMsg)) << errorMsg;
+    EXPECT_EQ("x" ANNOTATED_PGN, output);
+
+    string expected;
+    ASSERT_TRUE(PgnDatabase::writeToString(game, expected));
+    EXPECT_EQ(expected, output.substr(1));
+}
+
+TEST(PgnWriterTest, writeDatabaseMatchesWrite) {
+    string inFilename = g_tempDir + PATHSEP + "pgnwriter_in_unittest.pgn";
+    string outFilename = g_tempDir + PATHSEP + "pgnwriter_out_unittest.pgn";
+
+    // Enough games for several batches
+    string input;
+    for (unsigned i = 0; i < 1200; i++) {
+        if (i > 0)
+            input += "\n";
+        input += (i % 3) ? PLAIN_GAME : ANNOTATED_PGN;
+    }
+
+    PgnWriter writer;
+    vector<shared_ptr<Game> > games;
+    ASSERT_EQ(1200u, PgnDatabase::readMultiFromString(input, games, 0, 0));
+    ASSERT_TRUE(writer.open(inFilename, false));
+
+    for (unsigned i = 0; i < games.size(); i++)
+        ASSERT_TRUE(writer.write(*games[i])) << writer.errorMsg();
+
+    ASSERT_TRUE(writer.close());
+
+    string contents;
+    ASSERT_TRUE(readFile(inFilename, contents));
+    EXPECT_TRUE(input == contents);
+
+    PgnDatabase pgnDb(inFilename, true);
+    ASSERT_TRUE(pgnDb.index(0, 0));
+    ASSERT_EQ(1200u, pgnDb.numGames());
+
+    ASSERT_TRUE(writer.open(outFilename, false));
+    ASSERT_TRUE(writer.writeDatabase(pgnDb, 1, 1200, 3, 0, 0)) << writer.errorMsg();
+    ASSERT_TRUE(writer.close());
+
+    ASSERT_TRUE(readFile(outFilename, contents));
+    EXPECT_TRUE(input == contents);
+
+    pgnDb.close();
+    Util::deleteFile(inFilename);
+    Util::deleteFile(outFilename);
+}
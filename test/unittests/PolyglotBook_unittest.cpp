@@ -0,0 +1,238 @@
+#include <ChessCore/PolyglotBook.h>
+#include <ChessCore/CfdbDatabase.h>
+#include <ChessCore/PgnDatabase.h>
+#include <ChessCore/Util.h>
+#include <gtest/gtest.h>
+#include <fstream>
+
+using namespace std;
+using namespace ChessCore;
+
+#define ECO_FILE "../cfdb/eco.cfdb"
+
+static bool makeSanMoves(Position &pos, const char *pgn) {
+    Game game;
+
+    if (!PgnDatabase::readFromString(pgn, game))
+        return false;
+
+    UnmakeMoveInfo umi;
+
+    for (const AnnotMove *move = game.mainline(); move; move = move->next())
+        if (!pos.makeMove(move, umi))
+            return false;
+
+    return true;
+}
+
+TEST(PolyglotBookTest, referenceKeys) {
+    // The keys given in the Polyglot book format specification
+    static const struct {
+        const char *pgn;
+        uint64_t keys[8];       // After each half-move, or 0 if not given
+    } games[] = {
+        { "1. e4 d5 2. e5 f5 3. Ke2 Kf7 *", {
+              0x463b96181691fc9cULL, 0x823c9b50fd114196ULL, 0x0756b94461c50fb0ULL, 0x662fafb965db29d4ULL,
+              0x22a48b5a8e47ff78ULL, 0x652a607ca3f242c1ULL, 0x00fdd303c946bdd9ULL, 0
+          } },
+        { "1. a4 b5 2. h4 b4 3. c4 bxc3 4. Ra3 *", {
+              0x463b96181691fc9cULL, 0, 0, 0, 0, 0x3c8123ea7b067637ULL, 0, 0x5c3f9b829b279560ULL
+          } }
+    };
+
+    for (unsigned i = 0; i < sizeof(games) / sizeof(games[0]); i++) {
+        Game game;
+        ASSERT_TRUE(PgnDatabase::readFromString(games[i].pgn, game));
+
+        Position pos;
+        UnmakeMoveInfo umi;
+        unsigned ply = 0;
+        pos.setStarting();
+        EXPECT_EQ(games[i].keys[ply], PolyglotBook::hashKey(pos));
+
+        for (const AnnotMove *move = game.mainline(); move; move = move->next()) {
+            ASSERT_TRUE(pos.makeMove(move, umi));
+            ply++;
+
+            if (games[i].keys[ply] != 0) {
+                EXPECT_EQ(games[i].keys[ply], PolyglotBook::hashKey(pos)) << games[i].pgn << " ply " << ply;
+            }
+        }
+    }
+}
+
+TEST(PolyglotBookTest, rejectsIncorrectRandoms) {
+    vector<uint64_t> randoms(PolyglotBook::NUM_RANDOMS - 1, 1ULL);
+    string errorMsg;
+
+    EXPECT_FALSE(PolyglotBook::setRandoms(randoms, errorMsg));
+    randoms.push_back(1ULL);
+    EXPECT_FALSE(PolyglotBook::setRandoms(randoms, errorMsg));
+    EXPECT_NE(string::npos, errorMsg.find("incorrect"));
+
+    string filename = g_tempDir + PATHSEP + "polyglot_randoms.txt";
+    {
+        ofstream file(filename.c_str());
+        file << "static const uint64_t Random64[] = { 0x9D39247E33776D41, 0x2AF7398005AAA5C7 };" << endl;
+    }
+
+    EXPECT_FALSE(PolyglotBook::loadRandoms(filename, errorMsg));
+    EXPECT_NE(string::npos, errorMsg.find("contains 2 numbers"));
+    Util::deleteFile(filename);
+}
+
+TEST(PolyglotBookTest, encodeDecodeMove) {
+    Position pos;
+    Move moves[256], move;
+    unsigned numMoves, i;
+
+    // e2e4
+    pos.setStarting();
+    numMoves = pos.genMoves(moves);
+
+    for (i = 0; i < numMoves && !(moves[i].from() == E2 && moves[i].to() == E4); i++)
+        ;
+
+    ASSERT_LT(i, numMoves);
+    EXPECT_EQ(0x031c, PolyglotBook::encodeMove(moves[i]));
+    ASSERT_TRUE(PolyglotBook::decodeMove(pos, 0x031c, move));
+    EXPECT_EQ(moves[i].intValue(), move.intValue());
+
+    // Castling is the king taking its own rook
+    ASSERT_EQ(Position::LEGAL, pos.setFromFen("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1"));
+    ASSERT_TRUE(PolyglotBook::decodeMove(pos, 0x0107, move));
+    EXPECT_TRUE(move.isCastleKS());
+    ASSERT_TRUE(PolyglotBook::decodeMove(pos, 0x0100, move));
+    EXPECT_TRUE(move.isCastleQS());
+    EXPECT_EQ(0x0100, PolyglotBook::encodeMove(move));
+
+    // Promotion to a queen
+    ASSERT_EQ(Position::LEGAL, pos.setFromFen("8/P6k/8/8/8/8/8/K7 w - - 0 1"));
+    ASSERT_TRUE(PolyglotBook::decodeMove(pos, 0x4c38, move));
+    EXPECT_EQ(A7, move.from());
+    EXPECT_EQ(A8, move.to());
+    EXPECT_EQ(QUEEN, move.prom() & PIECE_MASK);
+
+    // Not a move of the position
+    EXPECT_FALSE(PolyglotBook::decodeMove(pos, 0x031c, move));
+}
+
+TEST(PolyglotBookTest, enPassantKey) {
+    // No black pawn can take en-passant, so the key ignores the en-passant file
+    Position pos, fenPos;
+    pos.setStarting();
+    ASSERT_TRUE(makeSanMoves(pos, "1. e4 *"));
+    ASSERT_EQ(Position::LEGAL, fenPos.setFromFen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1"));
+    EXPECT_EQ(PolyglotBook::hashKey(fenPos), PolyglotBook::hashKey(pos));
+
+    // The pawn on e5 can take en-passant
+    pos.setStarting();
+    ASSERT_TRUE(makeSanMoves(pos, "1. e4 d5 2. e5 f5 *"));
+    ASSERT_EQ(Position::LEGAL, fenPos.setFromFen("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq - 0 3"));
+    EXPECT_NE(PolyglotBook::hashKey(fenPos), PolyglotBook::hashKey(pos));
+}
+
+TEST(PolyglotBookTest, buildAndProbe) {
+    static const struct {
+        const char *pgn;
+        GameHeader::Result result;
+    } games[] = {
+        { "1. e4 e5 2. Nf3 *", GameHeader::WHITE_WIN },
+        { "1. e4 c5 *", GameHeader::BLACK_WIN },
+        { "1. d4 d5 *", GameHeader::DRAW },
+        { "1. e4 c5 2. Nf3 *", GameHeader::DRAW }
+    };
+
+    PolyglotBookBuilder builder;
+
+    for (unsigned i = 0; i < sizeof(games) / sizeof(games[0]); i++) {
+        Game game;
+        ASSERT_TRUE(PgnDatabase::readFromString(games[i].pgn, game));
+        game.setResult(games[i].result);
+        ASSERT_TRUE(builder.addGame(game, 10)) << builder.errorMsg();
+    }
+
+    EXPECT_EQ(4u, builder.numGames());
+
+    string filename = g_tempDir + PATHSEP + "polyglot_unittest.bin";
+    ASSERT_TRUE(builder.write(filename)) << builder.errorMsg();
+
+    PolyglotBook book;
+    ASSERT_TRUE(book.open(filename));
+
+    // e4 scored 2 + 0 + 1 and d4 scored 1
+    Position pos;
+    vector<PolyglotBookEntry> entries;
+    pos.setStarting();
+    ASSERT_TRUE(book.probe(pos, entries));
+    ASSERT_EQ(2u, entries.size());
+    EXPECT_EQ(E4, entries[0].move().to());
+    EXPECT_EQ(3u, entries[0].weight());
+    EXPECT_EQ(D4, entries[1].move().to());
+    EXPECT_EQ(1u, entries[1].weight());
+
+    // e5 lost and is left out
+    ASSERT_TRUE(makeSanMoves(pos, "1. e4 *"));
+    entries.clear();
+    ASSERT_TRUE(book.probe(pos, entries));
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ(C5, entries[0].move().to());
+    EXPECT_EQ(3u, entries[0].weight());
+
+    // Only moves played in at least two games
+    book.close();
+    ASSERT_TRUE(builder.write(filename, 2)) << builder.errorMsg();
+    ASSERT_TRUE(book.open(filename));
+    pos.setStarting();
+    entries.clear();
+    ASSERT_TRUE(book.probe(pos, entries));
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ(E4, entries[0].move().to());
+
+    book.close();
+    Util::deleteFile(filename);
+}
+
+TEST(PolyglotBookTest, buildFromDatabase) {
+    CfdbDatabase db(ECO_FILE, true);
+    ASSERT_TRUE(db.isOpen()) << db.errorMsg();
+
+    PolyglotBookBuilder builder;
+    ASSERT_TRUE(builder.addGames(db, db.firstGameNum(), db.lastGameNum(), 6, 0, 0)) << builder.errorMsg();
+    EXPECT_LT(0u, builder.numGames());
+
+    string filename = g_tempDir + PATHSEP + "polyglot_db_unittest.bin";
+    ASSERT_TRUE(builder.write(filename)) << builder.errorMsg();
+
+    PolyglotBook book;
+    ASSERT_TRUE(book.open(filename));
+    EXPECT_LT(0u, book.numEntries());
+
+    // The moves of a position are in descending weight order
+    Position pos;
+    vector<PolyglotBookEntry> entries;
+    unsigned numEntries, prevWeight = 0;
+    pos.setStarting();
+    ASSERT_TRUE(book.probe(pos, entries));
+    ASSERT_LT(0u, entries.size());
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it != entries.begin()) {
+            EXPECT_LE(it->weight(), prevWeight);
+        }
+
+        prevWeight = it->weight();
+        EXPECT_LT(0u, it->weight());
+    }
+
+    EXPECT_TRUE(book.find(PolyglotBook::hashKey(pos), numEntries) != 0);
+    EXPECT_EQ(entries.size(), numEntries);
+
+    // A position that is not in the book
+    ASSERT_EQ(Position::LEGAL, pos.setFromFen("8/P6k/8/8/8/8/8/K7 w - - 0 1"));
+    EXPECT_TRUE(book.find(PolyglotBook::hashKey(pos), numEntries) == 0);
+    EXPECT_EQ(0u, numEntries);
+
+    book.close();
+    Util::deleteFile(filename);
+}